@@ -0,0 +1,5 @@
+include(../benchmarks.pri)
+
+TARGET = bench_aes
+
+SOURCES += bench_aes.cpp
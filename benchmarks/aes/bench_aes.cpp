@@ -0,0 +1,272 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QtTest>
+#include <QThread>
+
+#include "benchmain.hpp"
+#include "fixtures.hpp"
+
+#include "../../qtupnp/aesencryption.h"
+
+Q_DECLARE_METATYPE(CAESEncryption::MODE)
+Q_DECLARE_METATYPE(CAESEncryption::BACKEND)
+
+/*
+ * Throughput of CAESEncryption with AES-256: encode and decode with the default backend, the
+ * streaming init/update/finalize by 64 KiB chunks like a download, the comparison of the
+ * backends on one thread, and the scaling of the parallel modes from 1 thread to
+ * QThread::idealThreadCount on 64 KiB to 1 GiB. The JSON output gives mb_per_s.
+ *
+ * encode and decode keep the 32 bytes blocks of Qt-AES in ECB, CBC and CFB: only the first 16 bytes
+ * of each block are ciphered, so mb_per_s counts these bytes, half of the input. CTR and the
+ * streaming functions use 16 bytes blocks and count the whole input.
+ */
+class AesBenchmark : public QObject
+{
+	Q_OBJECT
+private slots:
+	void encode_data();
+	void encode();
+	void decode_data();
+	void decode();
+	void stream_data();
+	void stream();
+	void backends_data();
+	void backends();
+	void scaling_data();
+	void scaling();
+
+private:
+	// The input of the last scaling row, reused by the next rows of the same size and mode.
+	QByteArray scaling_input;
+	int scaling_size = 0;
+	CAESEncryption::MODE scaling_mode = CAESEncryption::ECB;
+};
+
+static const int text_size = 4 * 1024 * 1024;
+static const int chunk_size = 64 * 1024;
+// The reference backend works byte by byte through QByteArray, a smaller text keeps its rows short.
+static const int backend_text_size = 1024 * 1024;
+
+// encode and decode use the 32 bytes iv of Qt-AES, except CTR which uses 16 bytes.
+static QByteArray blockIv(CAESEncryption::MODE mode) {
+	return Fixtures::randomBytes(mode == CAESEncryption::CTR ? 16 : 32, 3);
+}
+
+// The bytes ciphered by encode and decode, the half of the 32 bytes blocks except in CTR.
+static qint64 cipheredBytes(CAESEncryption::MODE mode, qint64 size) {
+	return mode == CAESEncryption::CTR ? size : size / 2;
+}
+
+static void addModes() {
+	QTest::addColumn<CAESEncryption::MODE>("mode");
+	QTest::newRow("ECB") << CAESEncryption::ECB;
+	QTest::newRow("CBC") << CAESEncryption::CBC;
+	QTest::newRow("CFB") << CAESEncryption::CFB;
+	QTest::newRow("CTR") << CAESEncryption::CTR;
+}
+
+void AesBenchmark::encode_data() {
+	addModes();
+}
+
+void AesBenchmark::encode() {
+	QFETCH(CAESEncryption::MODE, mode);
+	QByteArray text = Fixtures::randomBytes(text_size, 1);
+	QByteArray key = Fixtures::randomBytes(32, 2);
+	QByteArray iv = blockIv(mode);
+	CAESEncryption aes(CAESEncryption::AES_256, mode);
+	setBenchmarkBytes(cipheredBytes(mode, text.size()));
+
+	QBENCHMARK {
+		QByteArray cipher = aes.encode(text, key, iv);
+		QVERIFY(cipher.size() >= text.size());
+	}
+}
+
+void AesBenchmark::decode_data() {
+	addModes();
+}
+
+void AesBenchmark::decode() {
+	QFETCH(CAESEncryption::MODE, mode);
+	QByteArray text = Fixtures::randomBytes(text_size, 1);
+	QByteArray key = Fixtures::randomBytes(32, 2);
+	QByteArray iv = blockIv(mode);
+	CAESEncryption aes(CAESEncryption::AES_256, mode);
+	QByteArray cipher = aes.encode(text, key, iv);
+	setBenchmarkBytes(cipheredBytes(mode, cipher.size()));
+
+	QBENCHMARK {
+		QByteArray plain = aes.decode(cipher, key, iv);
+		QCOMPARE(plain.left(text.size()), text);
+	}
+}
+
+void AesBenchmark::stream_data() {
+	QTest::addColumn<CAESEncryption::MODE>("mode");
+	QTest::addColumn<bool>("encryption");
+	QTest::newRow("CBC encrypt") << CAESEncryption::CBC << true;
+	QTest::newRow("CBC decrypt") << CAESEncryption::CBC << false;
+	QTest::newRow("CTR") << CAESEncryption::CTR << true;
+}
+
+void AesBenchmark::stream() {
+	QFETCH(CAESEncryption::MODE, mode);
+	QFETCH(bool, encryption);
+	QByteArray key = Fixtures::randomBytes(32, 2);
+	QByteArray iv = Fixtures::randomBytes(16, 3);
+	CAESEncryption aes(CAESEncryption::AES_256, mode);
+
+	// Decryption needs a valid padding, so it runs on an encrypted text.
+	QByteArray text = Fixtures::randomBytes(text_size, 1);
+	if ( !encryption ) {
+		QVERIFY(aes.init(key, iv, true));
+		text = aes.update(text) + aes.finalize();
+	}
+	QList<QByteArray> chunks = Fixtures::fragments(text, chunk_size);
+	setBenchmarkBytes(text.size());
+
+	QBENCHMARK {
+		bool ok = false;
+		qint64 size = 0;
+		QVERIFY(aes.init(key, iv, encryption));
+		for ( QByteArray const & chunk : chunks ) {
+			size += aes.update(chunk).size();
+		}
+		size += aes.finalize(&ok).size();
+		QVERIFY(ok && size > 0);
+	}
+}
+
+void AesBenchmark::backends_data() {
+	QTest::addColumn<CAESEncryption::BACKEND>("backend");
+	QTest::addColumn<CAESEncryption::MODE>("mode");
+	QTest::addColumn<bool>("encryption");
+
+	QList<QPair<QString, CAESEncryption::BACKEND>> backends;
+	backends << qMakePair(QString("REFERENCE"), CAESEncryption::REFERENCE)
+			 << qMakePair(QString("TTABLE"), CAESEncryption::TTABLE)
+			 << qMakePair(QString("AESNI"), CAESEncryption::AESNI);
+	for ( QPair<QString, CAESEncryption::BACKEND> const & backend : backends ) {
+		QByteArray name = backend.first.toLatin1();
+		QTest::newRow(name + " ECB encrypt") << backend.second << CAESEncryption::ECB << true;
+		QTest::newRow(name + " CBC encrypt") << backend.second << CAESEncryption::CBC << true;
+		QTest::newRow(name + " CBC decrypt") << backend.second << CAESEncryption::CBC << false;
+		QTest::newRow(name + " CTR") << backend.second << CAESEncryption::CTR << true;
+	}
+}
+
+void AesBenchmark::backends() {
+	QFETCH(CAESEncryption::BACKEND, backend);
+	QFETCH(CAESEncryption::MODE, mode);
+	QFETCH(bool, encryption);
+	if ( backend == CAESEncryption::AESNI && !CAESBackend::hasAESNI() ) {
+		QSKIP("The processor has no AES-NI instructions.");
+	}
+
+	QByteArray text = Fixtures::randomBytes(backend_text_size, 1);
+	QByteArray key = Fixtures::randomBytes(32, 2);
+	QByteArray iv = blockIv(mode);
+	CAESEncryption aes(CAESEncryption::AES_256, mode);
+	aes.setThreadCount(1);
+
+	// The reference backend gives the expected result of the others.
+	aes.setBackend(CAESEncryption::REFERENCE);
+	QByteArray expected = aes.encode(text, key, iv);
+	aes.setBackend(backend);
+	QByteArray input = encryption ? text : expected;
+	if ( encryption ) {
+		QCOMPARE(aes.encode(text, key, iv), expected);
+	} else {
+		QCOMPARE(aes.decode(expected, key, iv).left(text.size()), text);
+	}
+	setBenchmarkBytes(cipheredBytes(mode, input.size()));
+
+	QBENCHMARK {
+		QByteArray output = encryption ? aes.encode(input, key, iv) : aes.decode(input, key, iv);
+		QVERIFY(output.size() >= text.size());
+	}
+}
+
+void AesBenchmark::scaling_data() {
+	QTest::addColumn<int>("size");
+	QTest::addColumn<CAESEncryption::MODE>("mode");
+	QTest::addColumn<int>("threads");
+
+	// 1, 2, 4... and the ideal count of the machine.
+	QList<int> counts;
+	int ideal = QThread::idealThreadCount();
+	for ( int threads = 1; threads < ideal; threads *= 2 ) {
+		counts.append(threads);
+	}
+	counts.append(qMax(1, ideal));
+
+	QList<QPair<QString, int>> sizes;
+	sizes << qMakePair(QString("64 KiB"), 64 * 1024)
+		  << qMakePair(QString("1 MiB"), 1024 * 1024)
+		  << qMakePair(QString("16 MiB"), 16 * 1024 * 1024)
+		  << qMakePair(QString("256 MiB"), 256 * 1024 * 1024)
+		  << qMakePair(QString("1 GiB"), 1024 * 1024 * 1024);
+	for ( QPair<QString, int> const & size : sizes ) {
+		for ( int m = 0; m < 2; m++ ) {
+			CAESEncryption::MODE mode = m == 0 ? CAESEncryption::CBC : CAESEncryption::CTR;
+			for ( int threads : counts ) {
+				QString name = QString("%1 %2 %3 threads").arg(size.first, m == 0 ? "CBC decrypt" : "CTR").arg(threads);
+				QTest::newRow(name.toLatin1()) << size.second << mode << threads;
+			}
+		}
+	}
+}
+
+void AesBenchmark::scaling() {
+	QFETCH(int, size);
+	QFETCH(CAESEncryption::MODE, mode);
+	QFETCH(int, threads);
+	QByteArray key = Fixtures::randomBytes(32, 2);
+	QByteArray iv = blockIv(mode);
+	CAESEncryption aes(CAESEncryption::AES_256, mode);
+
+	// The large texts repeat a random MiB, the cipher does not depend on it.
+	if ( size != this->scaling_size || mode != this->scaling_mode ) {
+		this->scaling_input.clear();
+		QByteArray block = Fixtures::randomBytes(qMin(size, 1024 * 1024), 1);
+		QByteArray text;
+		text.reserve(size);
+		while ( text.size() < size ) {
+			text += block;
+		}
+		this->scaling_input = mode == CAESEncryption::CTR ? text : aes.encode(text, key, iv);
+		this->scaling_size = size;
+		this->scaling_mode = mode;
+	}
+
+	// CTR decryption is the encryption, CBC decryption is the parallel one.
+	auto run = [&]() {
+		return mode == CAESEncryption::CTR ? aes.encode(this->scaling_input, key, iv) : aes.decode(this->scaling_input, key, iv);
+	};
+
+	// The parallel output is the serial one. Checked on the small sizes only to keep the memory low.
+	if ( threads > 1 && size <= 16 * 1024 * 1024 ) {
+		aes.setThreadCount(1);
+		QByteArray serial = run();
+		aes.setThreadCount(threads);
+		QCOMPARE(run(), serial);
+	}
+	aes.setThreadCount(threads);
+	setBenchmarkBytes(cipheredBytes(mode, this->scaling_input.size()));
+
+	QBENCHMARK {
+		QByteArray output = run();
+		QVERIFY(output.size() >= size);
+	}
+}
+
+BENCHMARK_MAIN(AesBenchmark)
+
+#include "bench_aes.moc"
@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# Common settings of the benchmarks
+#
+#-------------------------------------------------
+
+QT += core network xml testlib
+QT -= gui
+
+TEMPLATE = app
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/common
+
+SOURCES += $$PWD/common/benchmain.cpp \
+		   $$PWD/common/fixtures.cpp
+
+HEADERS += $$PWD/common/benchmain.hpp \
+		   $$PWD/common/fixtures.hpp
+
+unix {
+	LIBS += -L$$OUT_PWD/../../qtupnp/ -lqtupnp
+	PRE_TARGETDEPS += $$OUT_PWD/../../qtupnp/libqtupnp.a
+}
+
+win32 {
+	CONFIG(release, debug|release) {
+		LIBS += -L$$OUT_PWD/../../qtupnp/release/ -lqtupnp
+	}
+	CONFIG(debug, debug|release) {
+		LIBS += -L$$OUT_PWD/../../qtupnp/debug/ -lqtupnp
+	}
+}
@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# QTest benchmarks of qtupnp. Each directory is one executable,
+# run it with -o <file>,json to write the results as JSON.
+# downloads runs fetchsim and fetchtv end to end.
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += xml \
+		   httpparser \
+		   ssdp \
+		   browsereply \
+		   aes \
+		   controlpoint \
+		   devicemap \
+		   downloads
@@ -0,0 +1,101 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QtTest>
+
+#include "benchmain.hpp"
+#include "fixtures.hpp"
+
+#include "../../qtupnp/browsereply.hpp"
+#include "../../qtupnp/searchindex.hpp"
+
+static const int item_count = 10000;
+
+/*
+ * CBrowseReply::sort and search over the 10 000 recordings of a large library. The one-shot
+ * search scans the titles, the member search reuses the index built by its first call.
+ */
+class BrowseReplyBenchmark : public QObject
+{
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void sort_data();
+	void sort();
+	void search_data();
+	void search();
+	void searchIndexed_data();
+	void searchIndexed();
+	void buildIndex();
+
+private:
+	QtUPnP::CBrowseReply reply;
+};
+
+void BrowseReplyBenchmark::initTestCase() {
+	this->reply.setItems(Fixtures::didlItems(item_count));
+	QCOMPARE(this->reply.items().size(), item_count);
+}
+
+void BrowseReplyBenchmark::sort_data() {
+	QTest::addColumn<QString>("criteria");
+	QTest::newRow("title") << "dc:title";
+	QTest::newRow("date") << "dc:date";
+	QTest::newRow("size") << "res@size";
+	QTest::newRow("date descending then title") << "-dc:date,+dc:title";
+}
+
+void BrowseReplyBenchmark::sort() {
+	QFETCH(QString, criteria);
+
+	QBENCHMARK {
+		QtUPnP::CBrowseReply sorted = this->reply;
+		sorted.sort(criteria);
+		QCOMPARE(sorted.items().size(), item_count);
+	}
+}
+
+void BrowseReplyBenchmark::search_data() {
+	QTest::addColumn<QString>("text");
+	QTest::newRow("word") << "Simpsons";
+	QTest::newRow("words") << "grand designs";
+	QTest::newRow("typo") << "midsommer murder";
+}
+
+void BrowseReplyBenchmark::search() {
+	QFETCH(QString, text);
+
+	QBENCHMARK {
+		QList<QtUPnP::CDidlItem> found = QtUPnP::CBrowseReply::search(this->reply.items(), text, 20);
+		QCOMPARE(found.size(), 20);
+	}
+}
+
+void BrowseReplyBenchmark::searchIndexed_data() {
+	search_data();
+}
+
+void BrowseReplyBenchmark::searchIndexed() {
+	QFETCH(QString, text);
+	this->reply.search(text, 20); // Builds the index.
+
+	QBENCHMARK {
+		QList<QtUPnP::CDidlItem> found = this->reply.search(text, 20);
+		QCOMPARE(found.size(), 20);
+	}
+}
+
+void BrowseReplyBenchmark::buildIndex() {
+	QBENCHMARK {
+		QtUPnP::CSearchIndex index(this->reply.items());
+		QCOMPARE(index.size(), item_count);
+	}
+}
+
+BENCHMARK_MAIN(BrowseReplyBenchmark)
+
+#include "bench_browsereply.moc"
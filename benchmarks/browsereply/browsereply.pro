@@ -0,0 +1,5 @@
+include(../benchmarks.pri)
+
+TARGET = bench_browsereply
+
+SOURCES += bench_browsereply.cpp
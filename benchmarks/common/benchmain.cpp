@@ -0,0 +1,114 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QHash>
+#include <iostream>
+
+#include "benchmain.hpp"
+
+// Bytes by iteration, by "function/tag".
+static QHash<QString, qint64> benchmark_bytes;
+
+void setBenchmarkBytes(qint64 bytes) {
+	benchmark_bytes.insert(QString(QTest::currentTestFunction()) + "/" + QTest::currentDataTag(), bytes);
+}
+
+// Converts the BenchmarkResult elements of a QTest xml output.
+static QJsonArray readResults(QString const & filename) {
+	QJsonArray results;
+	QFile file(filename);
+	if ( !file.open(QIODevice::ReadOnly) ) {
+		return results;
+	}
+
+	QString function;
+	QXmlStreamReader xml(&file);
+	while ( !xml.atEnd() ) {
+		if ( xml.readNext() != QXmlStreamReader::StartElement ) {
+			continue;
+		}
+
+		QXmlStreamAttributes attributes = xml.attributes();
+		if ( xml.name() == "TestFunction" ) {
+			function = attributes.value("name").toString();
+		} else if ( xml.name() == "BenchmarkResult" ) {
+			QJsonObject result;
+			QString tag = attributes.value("tag").toString();
+			QString metric = attributes.value("metric").toString();
+			double value = attributes.value("value").toDouble();
+			result["function"] = function;
+			result["tag"] = tag;
+			result["metric"] = metric;
+			result["value"] = value;
+			result["iterations"] = attributes.value("iterations").toInt();
+
+			qint64 bytes = benchmark_bytes.value(function + "/" + tag, 0);
+			if ( bytes > 0 ) {
+				result["bytes"] = bytes;
+				if ( metric == "WalltimeMilliseconds" && value > 0 ) {
+					result["mb_per_s"] = bytes / (value * 1000.0);
+				}
+			}
+			results.append(result);
+		}
+	}
+	return results;
+}
+
+int runBenchmark(QObject * object, QStringList const & arguments) {
+	QTemporaryDir directory;
+	QStringList args;
+	QStringList json_files;
+	QStringList xml_files;
+	bool other_output = false;
+
+	for ( int i = 0; i < arguments.size(); i++ ) {
+		QString const & argument = arguments.at(i);
+		if ( argument == "-o" && i + 1 < arguments.size() ) {
+			QString output = arguments.at(++i);
+			if ( output.endsWith(",json") ) {
+				QString xml_file = directory.filePath(QString("results%1.xml").arg(xml_files.size()));
+				json_files.append(output.left(output.size() - 5));
+				xml_files.append(xml_file);
+				output = xml_file + ",xml";
+			} else {
+				other_output = true;
+			}
+			args << argument << output;
+		} else {
+			args << argument;
+		}
+	}
+
+	// The console keeps the usual text output.
+	if ( !json_files.isEmpty() && !other_output ) {
+		args << "-o" << "-,txt";
+	}
+
+	int status = QTest::qExec(object, args);
+
+	for ( int i = 0; i < json_files.size(); i++ ) {
+		QJsonObject root;
+		root["benchmark"] = object->metaObject()->className();
+		root["results"] = readResults(xml_files.at(i));
+
+		QFile file(json_files.at(i));
+		if ( file.open(QIODevice::WriteOnly | QIODevice::Truncate) ) {
+			file.write(QJsonDocument(root).toJson());
+		} else {
+			std::cerr << "Can not write " << json_files.at(i).toStdString() << std::endl;
+			status = 1;
+		}
+	}
+	return status;
+}
@@ -0,0 +1,35 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#ifndef BENCHMAIN_HPP
+#define BENCHMAIN_HPP
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QObject>
+
+/*
+ * Runs a QTest benchmark object. The QTest options are accepted, plus the output format json:
+ *   bench_xml -o results.json,json
+ * QTest runs with an xml output in a temporary file, which is converted to one JSON object:
+ *   {"benchmark": class, "results": [{"function", "tag", "metric", "value", "iterations", "bytes", "mb_per_s"}]}
+ * value is by iteration, like the xml output. bytes and mb_per_s are only written for the
+ * functions which called setBenchmarkBytes.
+ */
+int runBenchmark(QObject * object, QStringList const & arguments);
+
+// Sets the bytes processed by one iteration of the current function and data tag.
+void setBenchmarkBytes(qint64 bytes);
+
+#define BENCHMARK_MAIN(TestObject) \
+int main(int argc, char *argv[]) { \
+	QCoreApplication app(argc, argv); \
+	TestObject test; \
+	return runBenchmark(&test, app.arguments()); \
+}
+
+#endif // BENCHMAIN_HPP
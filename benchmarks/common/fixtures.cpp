@@ -0,0 +1,201 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QDateTime>
+#include <random>
+
+#include "fixtures.hpp"
+
+#include "../../qtupnp/xmlhdidllite.hpp"
+
+static const char * const title_words[] = {
+	"News", "Sport", "Doctor", "Who", "Grand", "Designs", "Gardening", "Australia", "Four", "Corners",
+	"Landline", "Kitchen", "Cabinet", "Hard", "Quiz", "Midsomer", "Murders", "Vera", "Rake", "Utopia",
+	"Simpsons", "Futurama", "Planet", "Earth", "Frozen", "Wild", "Outback", "Coast", "Police", "Rescue",
+	"Border", "Security", "Travel", "Guides", "Masterchef", "Block", "Voice", "Late", "Night", "Live"
+};
+static const int title_word_count = sizeof(title_words) / sizeof(title_words[0]);
+
+static QString seriesTitle(std::mt19937 & random) {
+	QString title = title_words[random() % title_word_count];
+	int words = 1 + random() % 3;
+	for ( int w = 1; w < words; w++ ) {
+		title += " ";
+		title += title_words[random() % title_word_count];
+	}
+	return title;
+}
+
+QString Fixtures::didl(int items, quint32 seed) {
+	std::mt19937 random(seed);
+	QDateTime first_date(QDate(2019, 1, 1), QTime(20, 30));
+	QString didl = "<DIDL-Lite xmlns=\"urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/\" "
+				   "xmlns:dc=\"http://purl.org/dc/elements/1.1/\" "
+				   "xmlns:upnp=\"urn:schemas-upnp-org:metadata-1-0/upnp/\">";
+
+	for ( int i = 0; i < items; i++ ) {
+		QString series = seriesTitle(random);
+		int episode = 1 + random() % 30;
+		int minutes = 30 * (1 + random() % 4);
+		qint64 size = qint64(minutes) * 60 * 1000000 + random() % 1000000;
+		QDateTime date = first_date.addSecs(qint64(random() % (365 * 24)) * 3600);
+
+		didl += QString("<item id=\"%1\" parentID=\"%2\" restricted=\"1\">").arg(1000 + i).arg(10 + i % 50);
+		didl += QString("<dc:title>%1 Episode %2</dc:title>").arg(series).arg(episode);
+		didl += "<upnp:class>object.item.videoItem.movie</upnp:class>";
+		didl += QString("<dc:date>%1</dc:date>").arg(date.toString(Qt::ISODate));
+		didl += QString("<dc:description>%1, episode %2 of the season.</dc:description>").arg(series).arg(episode);
+		didl += QString("<res protocolInfo=\"http-get:*:video/mpeg:*\" size=\"%1\" duration=\"%2:%3:00\">"
+						"http://192.168.1.10:49152/web/%4.ts</res>")
+					.arg(size).arg(minutes / 60).arg(minutes % 60, 2, 10, QChar('0')).arg(1000 + i);
+		didl += "</item>";
+	}
+	didl += "</DIDL-Lite>";
+	return didl;
+}
+
+QList<QtUPnP::CDidlItem> Fixtures::didlItems(int items, quint32 seed) {
+	QtUPnP::CXmlHDidlLite h;
+	h.parse(didl(items, seed));
+	return h.items();
+}
+
+QByteArray Fixtures::deviceDescription(int services) {
+	QByteArray xml = "<?xml version=\"1.0\"?>"
+					 "<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+					 "<specVersion><major>1</major><minor>0</minor></specVersion>"
+					 "<device>"
+					 "<deviceType>urn:schemas-upnp-org:device:MediaServer:1</deviceType>"
+					 "<friendlyName>Fetch Benchmark</friendlyName>"
+					 "<manufacturer>Fetch TV</manufacturer>"
+					 "<manufacturerURL>http://www.fetch.com.au</manufacturerURL>"
+					 "<modelDescription>Fetch TV set top box</modelDescription>"
+					 "<modelName>Fetch Mighty</modelName>"
+					 "<modelNumber>H7160</modelNumber>"
+					 "<serialNumber>0123456789</serialNumber>"
+					 "<UDN>uuid:01234567-89ab-cdef-0123-456789abcdef</UDN>"
+					 "<iconList>";
+	for ( int size = 32; size <= 256; size *= 2 ) {
+		xml += "<icon><mimetype>image/png</mimetype><width>" + QByteArray::number(size) + "</width><height>"
+			   + QByteArray::number(size) + "</height><depth>24</depth><url>/icon" + QByteArray::number(size)
+			   + ".png</url></icon>";
+	}
+	xml += "</iconList><serviceList>";
+	for ( int s = 0; s < services; s++ ) {
+		QByteArray name = "Service" + QByteArray::number(s);
+		xml += "<service><serviceType>urn:schemas-upnp-org:service:" + name + ":1</serviceType>"
+			   "<serviceId>urn:upnp-org:serviceId:" + name + "</serviceId>"
+			   "<SCPDURL>/" + name + ".xml</SCPDURL>"
+			   "<controlURL>/control/" + name + "</controlURL>"
+			   "<eventSubURL>/event/" + name + "</eventSubURL></service>";
+	}
+	xml += "</serviceList></device></root>";
+	return xml;
+}
+
+QByteArray Fixtures::serviceDescription(int actions) {
+	QByteArray xml = "<?xml version=\"1.0\"?>"
+					 "<scpd xmlns=\"urn:schemas-upnp-org:service-1-0\">"
+					 "<specVersion><major>1</major><minor>0</minor></specVersion>"
+					 "<actionList>";
+	for ( int a = 0; a < actions; a++ ) {
+		QByteArray action = QByteArray::number(a);
+		xml += "<action><name>Action" + action + "</name><argumentList>";
+		for ( int g = 0; g < 6; g++ ) {
+			QByteArray argument = QByteArray::number(g);
+			xml += "<argument><name>Arg" + argument + "</name><direction>" + (g < 3 ? "in" : "out") + "</direction>"
+				   "<relatedStateVariable>A_ARG_TYPE_" + action + "_" + QByteArray::number(g % 2) + "</relatedStateVariable></argument>";
+		}
+		xml += "</argumentList></action>";
+	}
+	xml += "</actionList><serviceStateTable>";
+	for ( int a = 0; a < actions; a++ ) {
+		QByteArray action = QByteArray::number(a);
+		xml += "<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_" + action + "_0</name><dataType>string</dataType>"
+			   "<allowedValueList><allowedValue>First</allowedValue><allowedValue>Second</allowedValue>"
+			   "<allowedValue>Third</allowedValue></allowedValueList></stateVariable>";
+		xml += "<stateVariable sendEvents=\"" + QByteArray(a % 4 ? "no" : "yes") + "\"><name>A_ARG_TYPE_" + action
+			   + "_1</name><dataType>ui4</dataType><allowedValueRange><minimum>0</minimum>"
+			   "<maximum>100</maximum><step>1</step></allowedValueRange></stateVariable>";
+	}
+	xml += "</serviceStateTable></scpd>";
+	return xml;
+}
+
+QByteArray Fixtures::ssdpBurst(int messages, int devices, quint32 seed) {
+	static const char * const types[] = {
+		"upnp:rootdevice", "urn:schemas-upnp-org:device:MediaServer:1", "urn:schemas-upnp-org:service:ContentDirectory:1"
+	};
+
+	std::mt19937 random(seed);
+	QByteArray burst;
+	for ( int m = 0; m < messages; m++ ) {
+		int device = random() % devices;
+		const char * type = types[random() % 3];
+		QByteArray uuid = "uuid:" + QByteArray::number(0x10000000 + device, 16) + "-89ab-cdef-0123-456789abcdef";
+		QByteArray location = "http://192.168." + QByteArray::number(1 + device / 250) + "." + QByteArray::number(1 + device % 250)
+							  + ":49152/description.xml";
+		QByteArray usn = uuid + "::" + type;
+		int kind = random() % 10;
+		if ( kind < 7 ) {
+			burst += "NOTIFY * HTTP/1.1\r\nHOST: 239.255.255.250:1900\r\nCACHE-CONTROL: max-age=1800\r\n"
+					 "LOCATION: " + location + "\r\nNT: " + type + "\r\nNTS: ssdp:alive\r\n"
+					 "SERVER: Linux/3.3 UPnP/1.0 Fetch/1.0\r\nUSN: " + usn + "\r\nBOOTID.UPNP.ORG: 1\r\n\r\n";
+		} else if ( kind < 9 ) {
+			burst += "HTTP/1.1 200 OK\r\nCACHE-CONTROL: max-age=1800\r\nEXT:\r\nLOCATION: " + location + "\r\n"
+					 "SERVER: Linux/3.3 UPnP/1.0 Fetch/1.0\r\nST: " + type + "\r\nUSN: " + usn + "\r\n\r\n";
+		} else {
+			burst += "NOTIFY * HTTP/1.1\r\nHOST: 239.255.255.250:1900\r\nNT: " + QByteArray(type) + "\r\n"
+					 "NTS: ssdp:byebye\r\nUSN: " + usn + "\r\nBOOTID.UPNP.ORG: 1\r\n\r\n";
+		}
+	}
+	return burst;
+}
+
+QByteArray Fixtures::httpMessage(int body_size, int chunk_size) {
+	QByteArray body = "<?xml version=\"1.0\"?><e:propertyset xmlns:e=\"urn:schemas-upnp-org:event-1-0\">";
+	for ( int p = 0; body.size() < body_size; p++ ) {
+		body += "<e:property><Variable" + QByteArray::number(p) + ">" + QByteArray::number(p * 7919) + "</Variable"
+				+ QByteArray::number(p) + "></e:property>";
+	}
+	body.truncate(body_size);
+
+	QByteArray message = "NOTIFY / HTTP/1.1\r\nHOST: 192.168.1.2:49200\r\nCONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+						 "NT: upnp:event\r\nNTS: upnp:propchange\r\nSID: uuid:01234567-89ab-cdef-0123-456789abcdef\r\nSEQ: 0\r\n";
+	if ( chunk_size <= 0 ) {
+		message += "CONTENT-LENGTH: " + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+	} else {
+		message += "TRANSFER-ENCODING: chunked\r\n\r\n";
+		for ( int offset = 0; offset < body.size(); offset += chunk_size ) {
+			QByteArray chunk = body.mid(offset, chunk_size);
+			message += QByteArray::number(chunk.size(), 16) + "\r\n" + chunk + "\r\n";
+		}
+		message += "0\r\n\r\n";
+	}
+	return message;
+}
+
+QList<QByteArray> Fixtures::fragments(QByteArray const & data, int size) {
+	QList<QByteArray> parts;
+	if ( size <= 0 ) {
+		parts.append(data);
+		return parts;
+	}
+	for ( int offset = 0; offset < data.size(); offset += size ) {
+		parts.append(data.mid(offset, size));
+	}
+	return parts;
+}
+
+QByteArray Fixtures::randomBytes(int size, quint32 seed) {
+	std::mt19937 random(seed);
+	QByteArray bytes(size, 0);
+	for ( int i = 0; i < size; i++ ) {
+		bytes[i] = char(random() & 0xff);
+	}
+	return bytes;
+}
@@ -0,0 +1,44 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#ifndef FIXTURES_HPP
+#define FIXTURES_HPP
+
+#include <QByteArray>
+#include <QString>
+#include <QList>
+
+#include "../../qtupnp/didlitem.hpp"
+
+/*
+ * Inputs of the benchmarks, generated in memory. The random parts come from std::mt19937 with
+ * a fixed seed, so every run and every machine measures the same data.
+ */
+class Fixtures {
+public:
+	// DIDL-Lite of video items like the Fetch box returns: series titles, dates, descriptions, res.
+	static QString didl(int items, quint32 seed = 1);
+	static QList<QtUPnP::CDidlItem> didlItems(int items, quint32 seed = 1);
+
+	// A device description with services and icons, and a service description (SCPD).
+	static QByteArray deviceDescription(int services);
+	static QByteArray serviceDescription(int actions);
+
+	// SSDP datagrams of devices: ssdp:alive NOTIFY (3 by device), M-SEARCH responses and ssdp:byebye.
+	static QByteArray ssdpBurst(int messages, int devices, quint32 seed = 1);
+
+	// A NOTIFY event request with a body of body_size bytes. chunk_size 0 uses CONTENT-LENGTH.
+	static QByteArray httpMessage(int body_size, int chunk_size = 0);
+
+	// Splits data in parts of size bytes. 0 keeps data in one part.
+	static QList<QByteArray> fragments(QByteArray const & data, int size);
+
+	// Bytes of a fixed seed.
+	static QByteArray randomBytes(int size, quint32 seed = 1);
+};
+
+#endif // FIXTURES_HPP
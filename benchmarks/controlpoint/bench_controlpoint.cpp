@@ -0,0 +1,164 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "benchmain.hpp"
+#include "fixtures.hpp"
+
+#include "../../qtupnp/controlpoint.hpp"
+#include "../../qtupnp/actioninfo.hpp"
+#include "../../qtupnp/contentdirectory.hpp"
+#include "../../qtupnp/mediaserver.hpp"
+
+/*
+ * CControlPoint::invokeAction and invokeActions against a CMediaServer on the loopback. It
+ * measures the SOAP round trip (message building, HTTP, response parsing) without a network.
+ * nonAsciiText checks that a title and a friendly name outside ASCII come back unchanged.
+ */
+class ControlPointBenchmark : public QObject
+{
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void invokeAction();
+	void browse_data();
+	void browse();
+	void invokeActions_data();
+	void invokeActions();
+	void nonAsciiText();
+
+private:
+	QList<QtUPnP::CControlPoint::TArgValue> browseArguments(int first, int count) const;
+
+	QTemporaryDir folder;
+	QtUPnP::CMediaServer * server = nullptr;
+	QtUPnP::CControlPoint * control_point = nullptr;
+	QString container;
+	QString non_ascii_item;
+};
+
+// Escaped once and encoded once in the DIDL and the device description.
+static const char non_ascii_title[] = "Émission spéciale – 東京 & <Live>";
+static const char non_ascii_name[] = "Fetch Bénchmark";
+
+static const int item_count = 1000;
+
+void ControlPointBenchmark::initTestCase() {
+	QVERIFY(this->folder.isValid());
+	this->server = new QtUPnP::CMediaServer(this);
+	this->server->setFriendlyName(QString::fromUtf8(non_ascii_name));
+	this->container = this->server->addContainer("Recordings");
+
+	QDateTime first_date(QDate(2019, 1, 1), QTime(20, 30));
+	for ( int i = 0; i < item_count; i++ ) {
+		this->server->addItem(this->container, QString("Recording %1").arg(i), QString("%1.ts").arg(i),
+							  first_date.addDays(i), QString("Recording %1 of the benchmark").arg(i));
+	}
+	// After the benchmarked items, the pages hold only ASCII titles.
+	this->non_ascii_item = this->server->addItem(this->container, QString::fromUtf8(non_ascii_title), "unicode.ts",
+												 first_date, QString::fromUtf8(non_ascii_title));
+	QVERIFY(this->server->start(this->folder.path()));
+
+	this->control_point = new QtUPnP::CControlPoint(this);
+	QUrl url(QString("http://127.0.0.1:%1/description.xml").arg(this->server->httpServer()->serverPort()));
+	QList<QPair<QString, QUrl>> pairs;
+	pairs.append(QPair<QString, QUrl>(this->server->uuid(), url));
+	this->control_point->extractDevices(pairs);
+	QVERIFY(this->control_point->contains(this->server->uuid()));
+}
+
+void ControlPointBenchmark::cleanupTestCase() {
+	delete this->control_point;
+	this->control_point = nullptr;
+	delete this->server;
+	this->server = nullptr;
+}
+
+QList<QtUPnP::CControlPoint::TArgValue> ControlPointBenchmark::browseArguments(int first, int count) const {
+	typedef QtUPnP::CControlPoint::TArgValue TArgValue;
+	QList<TArgValue> args;
+	args << TArgValue("ObjectID", this->container)
+		 << TArgValue("BrowseFlag", "BrowseDirectChildren")
+		 << TArgValue("Filter", "*")
+		 << TArgValue("StartingIndex", QString::number(first))
+		 << TArgValue("RequestedCount", QString::number(count))
+		 << TArgValue("SortCriteria", QString())
+		 << TArgValue("Result", QString())
+		 << TArgValue("NumberReturned", QString())
+		 << TArgValue("TotalMatches", QString())
+		 << TArgValue("UpdateID", QString());
+	return args;
+}
+
+void ControlPointBenchmark::invokeAction() {
+	QString uuid = this->server->uuid();
+
+	QBENCHMARK {
+		QList<QtUPnP::CControlPoint::TArgValue> args;
+		args << QtUPnP::CControlPoint::TArgValue("Id", QString());
+		QtUPnP::CActionInfo info = this->control_point->invokeAction(uuid, "GetSystemUpdateID", args);
+		QVERIFY(info.succeeded());
+	}
+}
+
+void ControlPointBenchmark::browse_data() {
+	QTest::addColumn<int>("page_size");
+	QTest::newRow("10 items") << 10;
+	QTest::newRow("100 items") << 100;
+	QTest::newRow("1000 items") << 1000;
+}
+
+void ControlPointBenchmark::browse() {
+	QFETCH(int, page_size);
+	QtUPnP::CContentDirectory cd(this->control_point);
+
+	QBENCHMARK {
+		QtUPnP::CBrowseReply reply = cd.browse(this->server->uuid(), this->container,
+											   QtUPnP::CContentDirectory::BrowseDirectChildren, "*", 0, page_size);
+		QCOMPARE(reply.items().size(), page_size);
+	}
+}
+
+void ControlPointBenchmark::invokeActions_data() {
+	QTest::addColumn<int>("window");
+	QTest::newRow("1 page of 100") << 1;
+	QTest::newRow("4 pages of 100") << 4;
+	QTest::newRow("8 pages of 100") << 8;
+}
+
+void ControlPointBenchmark::invokeActions() {
+	QFETCH(int, window);
+
+	QBENCHMARK {
+		QList<QList<QtUPnP::CControlPoint::TArgValue>> args_list;
+		for ( int page = 0; page < window; page++ ) {
+			args_list.append(browseArguments(page * 100, 100));
+		}
+		QList<QtUPnP::CActionInfo> infos = this->control_point->invokeActions(this->server->uuid(), "Browse", args_list);
+		QCOMPARE(infos.size(), window);
+		for ( int page = 0; page < window; page++ ) {
+			QVERIFY(infos[page].succeeded());
+			QCOMPARE(args_list[page][7].second.toInt(), 100);
+		}
+	}
+}
+
+void ControlPointBenchmark::nonAsciiText() {
+	QCOMPARE(this->control_point->device(this->server->uuid()).friendlyName(), QString::fromUtf8(non_ascii_name));
+
+	QtUPnP::CContentDirectory cd(this->control_point);
+	QtUPnP::CBrowseReply reply = cd.browse(this->server->uuid(), this->non_ascii_item, QtUPnP::CContentDirectory::BrowseMetaData);
+	QCOMPARE(reply.items().size(), 1);
+	QCOMPARE(reply.items().first().title(), QString::fromUtf8(non_ascii_title));
+}
+
+BENCHMARK_MAIN(ControlPointBenchmark)
+
+#include "bench_controlpoint.moc"
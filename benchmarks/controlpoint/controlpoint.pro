@@ -0,0 +1,5 @@
+include(../benchmarks.pri)
+
+TARGET = bench_controlpoint
+
+SOURCES += bench_controlpoint.cpp
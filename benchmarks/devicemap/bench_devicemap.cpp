@@ -0,0 +1,147 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QtTest>
+
+#include "benchmain.hpp"
+
+#include "../../qtupnp/devicemap.hpp"
+
+// Gives access to the insertion of the devices and the subscriptions without a network.
+class BenchDeviceMap : public QtUPnP::CDeviceMap
+{
+public:
+	void addDevice(QtUPnP::CDevice & device) { insertDevice(device); }
+	void addSubscription(QString const & sid, QString const & uuid, QString const & service_id) { indexSID(sid, uuid, service_id); }
+};
+
+/*
+ * CDeviceMap::uuid(host) and eventSender(sid) on a network of 500 devices with 3 subscribed
+ * services each, for known and unknown keys. The misses are the chatter of the devices not in
+ * the map and the events of expired subscriptions. The scan rows repeat the search over the
+ * devices that the indexes replaced, as the reference.
+ */
+class DeviceMapBenchmark : public QObject
+{
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void uuid_data();
+	void uuid();
+	void eventSender_data();
+	void eventSender();
+
+private:
+	BenchDeviceMap devices;
+	QStringList hosts;
+	QStringList unknown_hosts;
+	QStringList sids;
+	QStringList stale_sids;
+};
+
+static const int device_count = 500;
+static const int service_count = 3;
+
+void DeviceMapBenchmark::initTestCase() {
+	for ( int d = 0; d < device_count; d++ ) {
+		QString uuid = QString("uuid:%1-89ab-cdef-0123-456789abcdef").arg(0x10000000 + d, 0, 16);
+		QString host = QString("192.168.%1.%2").arg(1 + d / 250).arg(1 + d % 250);
+		QtUPnP::CDevice device;
+		device.setUUID(uuid);
+		device.setURL(QUrl(QString("http://%1:49152/description.xml").arg(host)));
+
+		QtUPnP::TMServices services;
+		for ( int s = 0; s < service_count; s++ ) {
+			QString service_id = QString("urn:upnp-org:serviceId:Service%1").arg(s);
+			QString sid = QString("uuid:%1-%2-0000-0000-000000000000").arg(d, 8, 16, QChar('0')).arg(s, 4, 16, QChar('0'));
+			QtUPnP::CService service;
+			service.setSubscribeSID(sid);
+			services.insert(service_id, service);
+			this->sids.append(sid);
+			this->stale_sids.append(sid + "-stale");
+		}
+		device.setServices(services);
+		this->devices.addDevice(device);
+		for ( int s = 0; s < service_count; s++ ) {
+			QString sid = this->sids.at(d * service_count + s);
+			this->devices.addSubscription(sid, uuid, QString("urn:upnp-org:serviceId:Service%1").arg(s));
+		}
+
+		this->hosts.append(host);
+		this->unknown_hosts.append(QString("10.0.%1.%2").arg(d / 250).arg(1 + d % 250));
+	}
+	QCOMPARE(this->devices.size(), device_count);
+}
+
+void DeviceMapBenchmark::uuid_data() {
+	QTest::addColumn<bool>("known");
+	QTest::addColumn<bool>("scan");
+	QTest::newRow("hit") << true << false;
+	QTest::newRow("miss") << false << false;
+	QTest::newRow("hit scan") << true << true;
+	QTest::newRow("miss scan") << false << true;
+}
+
+void DeviceMapBenchmark::uuid() {
+	QFETCH(bool, known);
+	QFETCH(bool, scan);
+	QStringList const & keys = known ? this->hosts : this->unknown_hosts;
+
+	QBENCHMARK {
+		int found = 0;
+		for ( QString const & host : keys ) {
+			QString uuid;
+			if ( scan ) {
+				for ( QtUPnP::CDevice const & device : this->devices ) {
+					if ( device.url().host() == host ) {
+						uuid = device.uuid();
+						break;
+					}
+				}
+			} else {
+				uuid = this->devices.uuid(host);
+			}
+			found += uuid.isEmpty() ? 0 : 1;
+		}
+		QCOMPARE(found, known ? device_count : 0);
+	}
+}
+
+void DeviceMapBenchmark::eventSender_data() {
+	uuid_data();
+}
+
+void DeviceMapBenchmark::eventSender() {
+	QFETCH(bool, known);
+	QFETCH(bool, scan);
+	QStringList const & keys = known ? this->sids : this->stale_sids;
+
+	QBENCHMARK {
+		int found = 0;
+		for ( QString const & sid : keys ) {
+			QPair<QString, QString> sender;
+			if ( scan ) {
+				for ( QtUPnP::CDevice const & device : this->devices ) {
+					QtUPnP::TMServices const & services = device.services();
+					for ( QtUPnP::TMServices::const_iterator it = services.cbegin(); it != services.cend(); ++it ) {
+						if ( it.value().subscribeSID() == sid ) {
+							sender = QPair<QString, QString>(device.uuid(), it.key());
+						}
+					}
+				}
+			} else {
+				sender = this->devices.eventSender(sid);
+			}
+			found += sender.first.isEmpty() ? 0 : 1;
+		}
+		QCOMPARE(found, known ? device_count * service_count : 0);
+	}
+}
+
+BENCHMARK_MAIN(DeviceMapBenchmark)
+
+#include "bench_devicemap.moc"
@@ -0,0 +1,5 @@
+include(../benchmarks.pri)
+
+TARGET = bench_devicemap
+
+SOURCES += bench_devicemap.cpp
@@ -0,0 +1,277 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QRegExp>
+#include <iostream>
+
+/*
+ * End-to-end download benchmark. For each recording size and delivery pattern, fetchsim is
+ * started, then for each disk and concurrency, that many fetchtv download the first episodes at
+ * the same time with --stats-json. The stats lines of the downloads are aggregated by run into a
+ * table on the standard output and a JSON summary.
+ */
+
+// The fetchsim options of the delivery patterns.
+static QList<QPair<QString, QStringList>> deliveryPatterns() {
+	QList<QPair<QString, QStringList>> patterns;
+	patterns << qMakePair(QString("bulk"), QStringList({ "--block", "256" }))
+			 << qMakePair(QString("small-writes"), QStringList({ "--block", "4" }))
+			 << qMakePair(QString("capped"), QStringList({ "--block", "64", "--bandwidth", "20000" }))
+			 << qMakePair(QString("latency"), QStringList({ "--latency", "200" }));
+	return patterns;
+}
+
+static QStringList splitList(QString const & value) {
+	return value.split(',', QString::SkipEmptyParts);
+}
+
+// Starts fetchsim and returns the host of its description, or an empty string.
+static QString startSimulator(QProcess & simulator, QString const & program, QStringList const & arguments) {
+	simulator.setProcessChannelMode(QProcess::MergedChannels);
+	simulator.start(program, arguments);
+	if ( !simulator.waitForStarted() ) {
+		std::cout << "Can not start " << program.toStdString() << ": " << simulator.errorString().toStdString() << std::endl;
+		return QString();
+	}
+
+	QRegExp description(" at http://([^:/]+):");
+	QElapsedTimer timer;
+	timer.start();
+	while ( timer.elapsed() < 30000 && simulator.waitForReadyRead(1000) ) {
+		while ( simulator.canReadLine() ) {
+			QString line = QString::fromUtf8(simulator.readLine());
+			if ( description.indexIn(line) != -1 ) {
+				return description.cap(1);
+			}
+		}
+	}
+	std::cout << "fetchsim did not start: " << simulator.readAll().toStdString() << std::endl;
+	return QString();
+}
+
+static void stopProcess(QProcess & process) {
+	if ( process.state() != QProcess::NotRunning ) {
+		process.kill();
+		process.waitForFinished();
+	}
+}
+
+// Runs the downloads of one run and returns their stats lines.
+static QJsonArray runDownloads(QString const & program, QString const & host, QString const & directory, int concurrency, int timeout, qint64 & wall_ms) {
+	QList<QProcess *> downloads;
+	QElapsedTimer timer;
+	timer.start();
+	for ( int d = 0; d < concurrency; d++ ) {
+		// The episodes of the first series are the IDs 3 and following.
+		QProcess * process = new QProcess();
+		process->setProcessChannelMode(QProcess::MergedChannels);
+		process->setStandardOutputFile(QDir(directory).filePath(QString("fetchtv-%1.log").arg(d)));
+		process->start(program, { "--ip", host, "-d", directory, "--stats-json", QDir(directory).filePath(QString("stats-%1.json").arg(d)),
+								  "--progress", "none", "download", QString::number(3 + d) });
+		downloads.append(process);
+	}
+
+	for ( QProcess * process : downloads ) {
+		qint64 remaining = qMax<qint64>(1, timeout * 1000LL - timer.elapsed());
+		if ( !process->waitForFinished(int(remaining)) ) {
+			std::cout << "A download did not end after " << timeout << " s." << std::endl;
+			stopProcess(*process);
+		}
+	}
+	wall_ms = timer.elapsed();
+	qDeleteAll(downloads);
+
+	QJsonArray stats;
+	for ( int d = 0; d < concurrency; d++ ) {
+		QFile file(QDir(directory).filePath(QString("stats-%1.json").arg(d)));
+		if ( !file.open(QIODevice::ReadOnly) ) {
+			continue;
+		}
+		while ( !file.atEnd() ) {
+			QJsonDocument line = QJsonDocument::fromJson(file.readLine());
+			if ( line.isObject() ) {
+				stats.append(line.object());
+			}
+		}
+	}
+	return stats;
+}
+
+// The aggregate of the downloads of one run.
+static QJsonObject summarize(QJsonArray const & stats, int concurrency, qint64 wall_ms) {
+	QJsonObject summary;
+	qint64 bytes = 0;
+	int complete = 0;
+	double mb_per_s = 0.0, ttfb_ms = 0.0, cpu_percent = 0.0, cpu_ms_per_mb = 0.0;
+	qint64 peak_rss_kb = 0;
+	for ( QJsonValue const & value : stats ) {
+		QJsonObject download = value.toObject();
+		bytes += qint64(download["bytes"].toDouble());
+		complete += download["complete"].toBool() ? 1 : 0;
+		mb_per_s += download["mb_per_s"].toDouble();
+		ttfb_ms += download["ttfb_ms"].toDouble();
+		cpu_percent += download["cpu_percent"].toDouble();
+		cpu_ms_per_mb += download["cpu_ms_per_mb"].toDouble();
+		peak_rss_kb = qMax(peak_rss_kb, qint64(download["peak_rss_kb"].toDouble()));
+	}
+
+	int count = stats.size();
+	summary["downloads"] = concurrency;
+	summary["complete"] = complete;
+	summary["failed"] = concurrency - complete;
+	summary["bytes"] = bytes;
+	summary["wall_ms"] = wall_ms;
+	// All the downloads together, and the mean of each one, both in MB (10^6 bytes) like the task stats.
+	summary["total_mb_per_s"] = wall_ms > 0 ? bytes / 1000000.0 / (wall_ms / 1000.0) : 0.0;
+	summary["mb_per_s"] = count > 0 ? mb_per_s / count : 0.0;
+	summary["ttfb_ms"] = count > 0 ? ttfb_ms / count : 0.0;
+	summary["cpu_percent"] = count > 0 ? cpu_percent / count : 0.0;
+	summary["cpu_ms_per_mb"] = count > 0 ? cpu_ms_per_mb / count : 0.0;
+	summary["peak_rss_kb"] = peak_rss_kb;
+	return summary;
+}
+
+static QString cell(QString const & text, int width) {
+	return text.leftJustified(width, ' ', true) + " ";
+}
+
+static QString number(double value, int width, int precision = 1) {
+	return QString::number(value, 'f', precision).rightJustified(width) + " ";
+}
+
+static void printHeader() {
+	std::cout << (cell("size", 8) + cell("pattern", 13) + cell("n", 3) + cell("disk", 20) + QString("ok").rightJustified(5) + " "
+				  + QString("MB/s").rightJustified(9) + " " + QString("each").rightJustified(9) + " " + QString("ttfb ms").rightJustified(9) + " "
+				  + QString("cpu%").rightJustified(7) + " " + QString("cpu ms/MB").rightJustified(10) + " " + QString("rss KiB").rightJustified(10)).toStdString()
+			  << std::endl;
+}
+
+static void printRun(QJsonObject const & run) {
+	QString ok = QString("%1/%2").arg(run["complete"].toInt()).arg(run["downloads"].toInt());
+	std::cout << (cell(QString("%1 MiB").arg(run["size_mib"].toInt()), 8) + cell(run["pattern"].toString(), 13)
+				  + cell(QString::number(run["concurrency"].toInt()), 3) + cell(run["disk"].toString(), 20) + ok.rightJustified(5) + " "
+				  + number(run["total_mb_per_s"].toDouble(), 9) + number(run["mb_per_s"].toDouble(), 9) + number(run["ttfb_ms"].toDouble(), 9)
+				  + number(run["cpu_percent"].toDouble(), 7) + number(run["cpu_ms_per_mb"].toDouble(), 10, 2)
+				  + number(run["peak_rss_kb"].toDouble(), 10, 0)).toStdString()
+			  << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication a(argc, argv);
+	QCoreApplication::setApplicationName("bench_downloads");
+
+	QString build = QCoreApplication::applicationDirPath() + "/../../";
+	QString patterns_help;
+	for ( QPair<QString, QStringList> const & pattern : deliveryPatterns() ) {
+		patterns_help += (patterns_help.isEmpty() ? "" : ", ") + pattern.first + " (" + pattern.second.join(' ') + ")";
+	}
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Downloads from fetchsim with fetchtv over a matrix of recording size, delivery pattern, concurrency and disk.");
+	parser.addHelpOption();
+	parser.addOptions({
+		{"fetchtv", "fetchtv executable. Default the one of the build.", "file", build + "fetchtv/fetchtv"},
+		{"fetchsim", "fetchsim executable. Default the one of the build.", "file", build + "fetchsim/fetchsim"},
+		{"sizes", "Average recording sizes in MiB, separated by commas. Default 64,256,1024.", "MiB", "64,256,1024"},
+		{"patterns", "Delivery patterns, separated by commas: " + patterns_help + ". Default all.", "patterns"},
+		{"concurrency", "Numbers of simultaneous downloads, separated by commas. Default 1,2,4.", "counts", "1,2,4"},
+		{"disks", "Directories downloaded into, separated by commas. Default the temporary directory.", "directories", QDir::tempPath()},
+		{"port", "Port of fetchsim. Default 49152.", "port", "49152"},
+		{"timeout", "Time limit of a run in seconds. Default 600.", "s", "600"},
+		{"output", "JSON summary file. Default downloads.json.", "file", "downloads.json"},
+	});
+	parser.process(a);
+
+	QList<QPair<QString, QStringList>> patterns;
+	QStringList pattern_names = splitList(parser.value("patterns"));
+	for ( QPair<QString, QStringList> const & pattern : deliveryPatterns() ) {
+		if ( pattern_names.isEmpty() || pattern_names.contains(pattern.first) ) {
+			patterns.append(pattern);
+		}
+	}
+	QList<int> concurrencies;
+	int max_concurrency = 1;
+	for ( QString const & count : splitList(parser.value("concurrency")) ) {
+		concurrencies.append(qMax(1, count.toInt()));
+		max_concurrency = qMax(max_concurrency, concurrencies.last());
+	}
+	QStringList disks = splitList(parser.value("disks"));
+	int timeout = qMax(1, parser.value("timeout").toInt());
+	if ( patterns.isEmpty() || concurrencies.isEmpty() || disks.isEmpty() ) {
+		std::cout << "Nothing to run." << std::endl;
+		return 1;
+	}
+
+	QJsonArray runs;
+	QJsonArray downloads;
+	printHeader();
+	for ( QString const & size : splitList(parser.value("sizes")) ) {
+		for ( QPair<QString, QStringList> const & pattern : patterns ) {
+			// One series holding enough episodes for the largest concurrency.
+			QProcess simulator;
+			QStringList arguments { "--port", parser.value("port"), "--series", "1", "--episodes", QString::number(max_concurrency), "--size", size };
+			QString host = startSimulator(simulator, parser.value("fetchsim"), arguments + pattern.second);
+			if ( host.isEmpty() ) {
+				stopProcess(simulator);
+				return 1;
+			}
+
+			for ( QString const & disk : disks ) {
+				for ( int concurrency : concurrencies ) {
+					QDir directory(QDir(disk).filePath(QString("bench_downloads-%1").arg(QCoreApplication::applicationPid())));
+					if ( !directory.mkpath(".") ) {
+						std::cout << "Can not create " << directory.path().toStdString() << std::endl;
+						continue;
+					}
+
+					qint64 wall_ms = 0;
+					QJsonArray stats = runDownloads(parser.value("fetchtv"), host, directory.path(), concurrency, timeout, wall_ms);
+					QJsonObject run = summarize(stats, concurrency, wall_ms);
+					run["size_mib"] = size.toInt();
+					run["pattern"] = pattern.first;
+					run["concurrency"] = concurrency;
+					run["disk"] = disk;
+					runs.append(run);
+					printRun(run);
+
+					for ( QJsonValue const & value : stats ) {
+						QJsonObject download = value.toObject();
+						download["size_mib"] = size.toInt();
+						download["pattern"] = pattern.first;
+						download["concurrency"] = concurrency;
+						download["disk"] = disk;
+						downloads.append(download);
+					}
+					directory.removeRecursively();
+				}
+			}
+			stopProcess(simulator);
+		}
+	}
+
+	QJsonObject summary;
+	summary["fetchtv"] = parser.value("fetchtv");
+	summary["fetchsim"] = parser.value("fetchsim");
+	summary["runs"] = runs;
+	summary["downloads"] = downloads;
+	QFile output(parser.value("output"));
+	if ( !output.open(QIODevice::WriteOnly | QIODevice::Truncate) ) {
+		std::cout << "Summary file " << parser.value("output").toStdString() << " can not be open." << std::endl;
+		return 1;
+	}
+	output.write(QJsonDocument(summary).toJson());
+	return 0;
+}
@@ -0,0 +1,15 @@
+#-------------------------------------------------
+#
+# End-to-end download benchmark, drives fetchsim and fetchtv
+#
+#-------------------------------------------------
+
+QT += core
+QT -= gui
+
+TARGET = bench_downloads
+TEMPLATE = app
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+SOURCES += bench_downloads.cpp
@@ -0,0 +1,234 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QtTest>
+
+#include <random>
+
+#include "benchmain.hpp"
+#include "fixtures.hpp"
+
+#include "../../qtupnp/httpparser.hpp"
+
+/*
+ * CHTTPParser on the event requests, received whole or in TCP sized fragments, with a
+ * CONTENT-LENGTH or a chunked body. The fragments never match the chunk boundaries. pipelined
+ * sends several requests on the same connection, fuzz feeds malformed requests built from the
+ * valid ones with a fixed seed and checks that the parser stays consistent.
+ */
+class HttpParserBenchmark : public QObject
+{
+	Q_OBJECT
+private slots:
+	void fragmented_data();
+	void fragmented();
+	void chunked_data();
+	void chunked();
+	void pipelined_data();
+	void pipelined();
+	void fuzz_data();
+	void fuzz();
+
+private:
+	void parse(QByteArray const & message, int fragment_size, int body_size);
+};
+
+static const int fuzz_count = 1000;
+
+// Splits the data in fragments of 1 to 2048 bytes.
+static QList<QByteArray> randomFragments(QByteArray const & data, std::mt19937 & random) {
+	QList<QByteArray> parts;
+	for ( int offset = 0; offset < data.size(); ) {
+		int size = 1 + int(random() % 2048);
+		parts.append(data.mid(offset, size));
+		offset += size;
+	}
+	return parts;
+}
+
+// Damages the message 1 to 4 times: random bytes, insertions, removals, truncation, repeated
+// ranges, and lengths replaced by random, negative or huge values.
+static QByteArray mutate(QByteArray message, std::mt19937 & random) {
+	static const QByteArray lengths[] = { "0", "-1", "-2147483648", "2147483647", "7fffffff", "ffffffff", "zz", "" };
+	int count = 1 + int(random() % 4);
+	for ( int m = 0; m < count && !message.isEmpty(); m++ ) {
+		int at = int(random() % quint32(message.size()));
+		int size = 1 + int(random() % 64);
+		switch ( random() % 6 ) {
+			case 0:
+				message[at] = char(random() & 0xff);
+				break;
+			case 1:
+				message.insert(at, Fixtures::randomBytes(size, random()));
+				break;
+			case 2:
+				message.remove(at, size);
+				break;
+			case 3:
+				message.truncate(at);
+				break;
+			case 4:
+				message.insert(at, message.mid(at, size));
+				break;
+			default: {
+				// The CONTENT-LENGTH value or the first chunk size.
+				int start = message.indexOf("CONTENT-LENGTH: ");
+				start = start == -1 ? message.indexOf("\r\n\r\n") : start + 12;
+				if ( start != -1 ) {
+					start += 4;
+					int end = message.indexOf("\r\n", start);
+					if ( end != -1 ) {
+						message.replace(start, end - start, lengths[random() % (sizeof(lengths) / sizeof(lengths[0]))]);
+					}
+				}
+				break;
+			}
+		}
+	}
+	return message;
+}
+
+// The state is one of the enum and a complete message has a body taken from the message.
+static bool consistent(QtUPnP::CHTTPParser const & parser) {
+	if ( parser.state() < QtUPnP::CHTTPParser::Header || parser.state() > QtUPnP::CHTTPParser::Error ) {
+		return false;
+	}
+	if ( parser.isComplete() ) {
+		if ( parser.body().size() > parser.message().size() ) {
+			return false;
+		}
+		if ( parser.contentLength() >= 0 && parser.body().size() != parser.contentLength() ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void HttpParserBenchmark::parse(QByteArray const & message, int fragment_size, int body_size) {
+	QList<QByteArray> fragments = Fixtures::fragments(message, fragment_size);
+	setBenchmarkBytes(message.size());
+
+	QBENCHMARK {
+		QtUPnP::CHTTPParser parser;
+		for ( QByteArray const & fragment : fragments ) {
+			parser.addData(fragment);
+		}
+		QVERIFY(parser.isComplete());
+		QCOMPARE(parser.body().size(), body_size);
+	}
+}
+
+void HttpParserBenchmark::fragmented_data() {
+	QTest::addColumn<int>("body_size");
+	QTest::addColumn<int>("fragment_size");
+	QTest::newRow("4 KiB whole") << 4096 << 0;
+	QTest::newRow("64 KiB whole") << 65536 << 0;
+	QTest::newRow("64 KiB by 1460") << 65536 << 1460;
+	QTest::newRow("64 KiB by 64") << 65536 << 64;
+	QTest::newRow("4 KiB by 1") << 4096 << 1;
+}
+
+void HttpParserBenchmark::fragmented() {
+	QFETCH(int, body_size);
+	QFETCH(int, fragment_size);
+	parse(Fixtures::httpMessage(body_size), fragment_size, body_size);
+}
+
+void HttpParserBenchmark::chunked_data() {
+	QTest::addColumn<int>("body_size");
+	QTest::addColumn<int>("chunk_size");
+	QTest::addColumn<int>("fragment_size");
+	QTest::newRow("64 KiB chunks 1024 whole") << 65536 << 1024 << 0;
+	QTest::newRow("64 KiB chunks 1024 by 1460") << 65536 << 1024 << 1460;
+	QTest::newRow("64 KiB chunks 128 by 100") << 65536 << 128 << 100;
+	QTest::newRow("4 KiB chunks 16 by 1") << 4096 << 16 << 1;
+}
+
+void HttpParserBenchmark::chunked() {
+	QFETCH(int, body_size);
+	QFETCH(int, chunk_size);
+	QFETCH(int, fragment_size);
+	parse(Fixtures::httpMessage(body_size, chunk_size), fragment_size, body_size);
+}
+
+void HttpParserBenchmark::pipelined_data() {
+	QTest::addColumn<int>("fragment_size");
+	QTest::newRow("16 requests whole") << 0;
+	QTest::newRow("16 requests by 1460") << 1460;
+	QTest::newRow("16 requests by 100") << 100;
+}
+
+void HttpParserBenchmark::pipelined() {
+	QFETCH(int, fragment_size);
+	// Alternates the CONTENT-LENGTH and chunked bodies.
+	QByteArray messages;
+	for ( int m = 0; m < 16; m++ ) {
+		messages += Fixtures::httpMessage(4096, (m & 1) ? 512 : 0);
+	}
+	QList<QByteArray> fragments = Fixtures::fragments(messages, fragment_size);
+	setBenchmarkBytes(messages.size());
+
+	QBENCHMARK {
+		QtUPnP::CHTTPParser parser;
+		int count = 0;
+		for ( QByteArray const & fragment : fragments ) {
+			parser.addData(fragment);
+			while ( parser.isComplete() ) {
+				QCOMPARE(parser.body().size(), 4096);
+				count++;
+				parser.reset();
+				parser.parseMessage();
+			}
+		}
+		QCOMPARE(count, 16);
+	}
+}
+
+void HttpParserBenchmark::fuzz_data() {
+	QTest::addColumn<int>("chunk_size");
+	QTest::newRow("content-length") << 0;
+	QTest::newRow("chunked") << 256;
+}
+
+void HttpParserBenchmark::fuzz() {
+	QFETCH(int, chunk_size);
+	std::mt19937 random(31);
+	QByteArray message = Fixtures::httpMessage(4096, chunk_size);
+
+	// Two valid requests, so the damage of the first one can swallow or corrupt the second one.
+	QList<QList<QByteArray>> cases;
+	qint64 bytes = 0;
+	for ( int c = 0; c < fuzz_count; c++ ) {
+		QByteArray input = mutate(message, random) + message;
+		cases.append(randomFragments(input, random));
+		bytes += input.size();
+	}
+	setBenchmarkBytes(bytes);
+
+	QBENCHMARK {
+		int complete = 0;
+		for ( QList<QByteArray> const & fragments : cases ) {
+			QtUPnP::CHTTPParser parser;
+			for ( QByteArray const & fragment : fragments ) {
+				parser.addData(fragment);
+				QVERIFY(consistent(parser));
+				// Each round consumes at least the "\r\n\r\n" of a header, so it ends.
+				while ( parser.isComplete() ) {
+					complete++;
+					parser.reset();
+					parser.parseMessage();
+					QVERIFY(consistent(parser));
+				}
+			}
+		}
+		QVERIFY(complete > 0);
+	}
+}
+
+BENCHMARK_MAIN(HttpParserBenchmark)
+
+#include "bench_httpparser.moc"
@@ -0,0 +1,5 @@
+include(../benchmarks.pri)
+
+TARGET = bench_httpparser
+
+SOURCES += bench_httpparser.cpp
@@ -0,0 +1,65 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QtTest>
+
+#include "benchmain.hpp"
+#include "fixtures.hpp"
+
+#include "../../qtupnp/ssdpparser.hpp"
+
+/*
+ * CSSDPParser on bursts of SSDP messages, like a network with many devices answering an M-SEARCH
+ * and repeating their ssdp:alive. The uuid and the max-age are read like the discovery does.
+ */
+class SsdpBenchmark : public QObject
+{
+	Q_OBJECT
+private slots:
+	void burst_data();
+	void burst();
+};
+
+void SsdpBenchmark::burst_data() {
+	QTest::addColumn<int>("messages");
+	QTest::addColumn<int>("devices");
+	QTest::newRow("100 messages 10 devices") << 100 << 10;
+	QTest::newRow("1000 messages 50 devices") << 1000 << 50;
+	QTest::newRow("10000 messages 500 devices") << 10000 << 500;
+}
+
+void SsdpBenchmark::burst() {
+	QFETCH(int, messages);
+	QFETCH(int, devices);
+	QByteArray burst = Fixtures::ssdpBurst(messages, devices);
+	setBenchmarkBytes(burst.size());
+
+	QBENCHMARK {
+		QtUPnP::CSSDPParser parser;
+		char const * data = burst.constData();
+		int size = burst.size();
+		int parsed = 0;
+		int byebyes = 0;
+		qint64 max_age = 0;
+		for ( int length = parser.parse(data, size); length != 0; length = parser.parse(data, size) ) {
+			if ( parser.isByebye() ) {
+				byebyes++;
+			} else {
+				max_age += parser.maxAge();
+			}
+			parsed += parser.uuid().isEmpty() ? 0 : 1;
+			data += length;
+			size -= length;
+		}
+		QCOMPARE(parsed, messages);
+		QVERIFY(byebyes < messages && max_age > 0);
+	}
+}
+
+BENCHMARK_MAIN(SsdpBenchmark)
+
+#include "bench_ssdp.moc"
@@ -0,0 +1,5 @@
+include(../benchmarks.pri)
+
+TARGET = bench_ssdp
+
+SOURCES += bench_ssdp.cpp
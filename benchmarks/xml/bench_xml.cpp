@@ -0,0 +1,92 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QtTest>
+
+#include "benchmain.hpp"
+#include "fixtures.hpp"
+
+#include "../../qtupnp/xmlhdidllite.hpp"
+#include "../../qtupnp/device.hpp"
+#include "../../qtupnp/service.hpp"
+
+/*
+ * Parsing of the XML received from a box: the DIDL-Lite of Browse and Search, the device
+ * description and the service description (SCPD).
+ */
+class XmlBenchmark : public QObject
+{
+	Q_OBJECT
+private slots:
+	void didl_data();
+	void didl();
+	void device_data();
+	void device();
+	void service_data();
+	void service();
+};
+
+void XmlBenchmark::didl_data() {
+	QTest::addColumn<int>("items");
+	QTest::newRow("10 items") << 10;
+	QTest::newRow("100 items") << 100;
+	QTest::newRow("1000 items") << 1000;
+}
+
+void XmlBenchmark::didl() {
+	QFETCH(int, items);
+	QString didl = Fixtures::didl(items);
+	setBenchmarkBytes(didl.toUtf8().size());
+
+	QBENCHMARK {
+		QtUPnP::CXmlHDidlLite h;
+		h.parse(didl);
+		QCOMPARE(h.items().size(), items);
+	}
+}
+
+void XmlBenchmark::device_data() {
+	QTest::addColumn<int>("services");
+	QTest::newRow("2 services") << 2;
+	QTest::newRow("8 services") << 8;
+	QTest::newRow("32 services") << 32;
+}
+
+void XmlBenchmark::device() {
+	QFETCH(int, services);
+	QByteArray xml = Fixtures::deviceDescription(services);
+	setBenchmarkBytes(xml.size());
+
+	QBENCHMARK {
+		QtUPnP::CDevice device;
+		QVERIFY(device.parseXml(xml));
+		QCOMPARE(device.services().size(), services);
+	}
+}
+
+void XmlBenchmark::service_data() {
+	QTest::addColumn<int>("actions");
+	QTest::newRow("4 actions") << 4;
+	QTest::newRow("16 actions") << 16;
+	QTest::newRow("64 actions") << 64;
+}
+
+void XmlBenchmark::service() {
+	QFETCH(int, actions);
+	QByteArray xml = Fixtures::serviceDescription(actions);
+	setBenchmarkBytes(xml.size());
+
+	QBENCHMARK {
+		QtUPnP::CService service;
+		QVERIFY(service.parseXml(xml));
+		QCOMPARE(service.actions().size(), actions);
+	}
+}
+
+BENCHMARK_MAIN(XmlBenchmark)
+
+#include "bench_xml.moc"
@@ -0,0 +1,5 @@
+include(../benchmarks.pri)
+
+TARGET = bench_xml
+
+SOURCES += bench_xml.cpp
@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# Simulated Fetch STB for end-to-end tests of fetchtv
+#
+#-------------------------------------------------
+
+QT += core network xml
+
+TARGET = fetchsim
+TEMPLATE = app
+CONFIG += c++14
+
+SOURCES += main.cpp \
+		   simulator.cpp \
+		   syntheticstream.cpp
+
+HEADERS += simulator.hpp \
+		   syntheticstream.hpp
+
+unix {
+	LIBS += -L$$OUT_PWD/../qtupnp/ -lqtupnp
+	PRE_TARGETDEPS += $$OUT_PWD/../qtupnp/libqtupnp.a
+}
+
+win32 {
+	CONFIG(release, debug|release) {
+		LIBS += -L$$OUT_PWD/../qtupnp/release/ -lqtupnp
+		CONFIG += console
+	}
+	CONFIG(debug, debug|release) {
+		LIBS += -L$$OUT_PWD/../qtupnp/debug/ -lqtupnp
+	}
+}
@@ -0,0 +1,14 @@
+#include <QCoreApplication>
+
+#include "simulator.hpp"
+
+
+int main(int argc, char *argv[]) {
+	QCoreApplication a(argc, argv);
+
+	QCoreApplication::setApplicationName("fetchsim");
+	QCoreApplication::setApplicationVersion("20190125");
+	new Simulator(&a);
+
+	return a.exec();
+}
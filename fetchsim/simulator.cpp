@@ -0,0 +1,285 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QRegExp>
+#include <QDateTime>
+#include <iostream>
+
+#include "simulator.hpp"
+#include "syntheticstream.hpp"
+
+#include "../qtupnp/httpserver.hpp"
+#include "../qtupnp/upnpsocket.hpp"
+
+Simulator::Simulator(QCoreApplication * a, QObject * parent) : QObject(parent) {
+	this->app = a;
+
+	// CLI options
+	parser.setApplicationDescription("Simulated Fetch STB for fetchtv tests.");
+	parser.addHelpOption();
+	parser.addOptions({
+		{"port", "Port of the device description and the ContentDirectory. Default 49152.", "port", "49152"},
+		{"name", "Friendly and model name. fetchtv only uses the models starting with Fetch.", "name", "Fetch Simulator"},
+		{"series", "Number of series folders. Default 100.", "count", "100"},
+		{"episodes", "Number of recordings in each series folder. Default 30.", "count", "30"},
+		{"size", "Average size of the recordings in MiB. Default 256.", "MiB", "256"},
+		{"latency", "Delay in ms of every response. Default 0.", "ms", "0"},
+		{"bandwidth", "Bandwidth cap of each download in KiB/s. Default 0, no cap.", "KiB/s", "0"},
+		{"block", "Size of the writes to the socket in KiB. Default 256.", "KiB", "256"},
+		{"early-close", "Bytes not sent at the end of the downloads without Range, like the Fetch box. Default 29084.", "bytes", "29084"},
+	});
+	parser.process(*a);
+
+	this->latency = parser.value("latency").toInt();
+	this->bandwidth = parser.value("bandwidth").toLongLong() * 1024;
+	this->early_close = parser.value("early-close").toLongLong();
+	this->block_size = qMax<qint64>(1, parser.value("block").toLongLong()) * 1024;
+
+	connect(&stream_server, &QTcpServer::newConnection, this, &Simulator::newConnection);
+	if ( !stream_server.listen(QHostAddress::AnyIPv4) ) {
+		std::cout << "Can not listen: " << stream_server.errorString().toStdString() << std::endl;
+		QTimer::singleShot(0, a, [a]() { a->exit(1); });
+		return;
+	}
+
+	QString host = QtUPnP::CUpnpSocket::localHostAddress().toString();
+	media_server = new QtUPnP::CMediaServer(this);
+	media_server->setFriendlyName(parser.value("name"));
+	media_server->setModelName(parser.value("name"));
+	buildTree(host);
+
+	quint16 port = static_cast<quint16>(parser.value("port").toUInt());
+	if ( !media_server->start(QString(), port) ) {
+		std::cout << "Can not start the device on port " << port << std::endl;
+		QTimer::singleShot(0, a, [a]() { a->exit(1); });
+		return;
+	}
+	media_server->httpServer()->setResponseDelay(this->latency);
+
+	if ( this->bandwidth > 0 ) {
+		connect(&bandwidth_timer, &QTimer::timeout, this, &Simulator::refillBandwidth);
+		bandwidth_timer.start(bandwidth_tick);
+	}
+
+	std::cout << parser.value("name").toStdString() << " at http://" << host.toStdString() << ":"
+			  << media_server->httpServer()->serverPort() << "/description.xml" << std::endl;
+	std::cout << recording_sizes.size() << " recordings in " << parser.value("series").toInt() << " series, streamed from port "
+			  << stream_server.serverPort() << std::endl;
+}
+
+void Simulator::buildTree(QString const & host) {
+	int series_count = parser.value("series").toInt();
+	int episode_count = parser.value("episodes").toInt();
+	qint64 average_packets = parser.value("size").toLongLong() * 1024 * 1024 / SyntheticStream::packet_size;
+	QDateTime first_date(QDate(2019, 1, 1), QTime(20, 30));
+
+	// fetchtv browses the container numbered like the ContentDirectory service, so it must be 1.
+	QString recordings = media_server->addContainer("Recordings");
+	for (int s = 0; s < series_count; s++) {
+		QString series_title = QString("Series %1").arg(s + 1, 3, 10, QChar('0'));
+		QString series = media_server->addContainer(series_title, recordings);
+
+		for (int e = 0; e < episode_count; e++) {
+			int index = recording_sizes.size();
+			// Between half and one and a half of the average size, in whole packets.
+			qint64 size = average_packets * (50 + (index * 37) % 101) / 100 * SyntheticStream::packet_size;
+			recording_sizes.append(size);
+
+			// Half of the series repeat their name in the titles, like the Fetch box does for some channels.
+			QString title = QString("Episode %1").arg(e + 1);
+			if ( s % 2 ) {
+				title = series_title + " " + title;
+			}
+			QString id = media_server->addItem(series, title, QString("%1.tts").arg(index),
+											   first_date.addDays(7 * e).addSecs(1800 * s),
+											   QString("Synthetic recording %1").arg(index));
+			media_server->setItemResource(id, QString("http://%1:%2/recording/%3.tts").arg(host).arg(stream_server.serverPort()).arg(index), size);
+		}
+	}
+}
+
+void Simulator::newConnection() {
+	while ( stream_server.hasPendingConnections() ) {
+		QTcpSocket * socket = stream_server.nextPendingConnection();
+		requests.insert(socket, QByteArray());
+		connect(socket, &QTcpSocket::readyRead, this, &Simulator::readRequest);
+		connect(socket, &QTcpSocket::bytesWritten, this, &Simulator::sendData);
+		connect(socket, &QTcpSocket::disconnected, this, &Simulator::connectionClosed);
+	}
+}
+
+void Simulator::readRequest() {
+	QTcpSocket * socket = qobject_cast<QTcpSocket *>(sender());
+
+	// One request by connection, the responses close it.
+	if ( !requests.contains(socket) ) {
+		socket->readAll();
+		return;
+	}
+
+	QByteArray & request = requests[socket];
+	request += socket->readAll();
+	if ( request.indexOf("\r\n\r\n") == -1 ) {
+		if ( request.size() > 16 * 1024 ) {
+			requests.remove(socket);
+			sendError(socket, 400);
+		}
+		return;
+	}
+
+	QByteArray header = requests.take(socket);
+	if ( this->latency > 0 ) {
+		// The timer is cancelled if the socket is destroyed.
+		QTimer::singleShot(this->latency, socket, [this, socket, header]() { startTransfer(socket, header); });
+	} else {
+		startTransfer(socket, header);
+	}
+}
+
+void Simulator::startTransfer(QTcpSocket * socket, QByteArray const & request) {
+	static QRegExp path_check("/recording/(\\d+)\\.tts");
+	static QRegExp range_check("bytes=(\\d+)-(\\d*)");
+
+	QList<QByteArray> lines = request.split('\n');
+	QList<QByteArray> request_line = lines.value(0).trimmed().split(' ');
+	QByteArray method = request_line.value(0);
+
+	if ( method != "GET" && method != "HEAD" ) {
+		sendError(socket, 501);
+		return;
+	}
+	if ( !path_check.exactMatch(QString::fromLatin1(request_line.value(1))) || path_check.cap(1).toInt() >= recording_sizes.size() ) {
+		sendError(socket, 404);
+		return;
+	}
+
+	Transfer transfer;
+	transfer.recording = path_check.cap(1).toInt();
+	qint64 size = recording_sizes.at(transfer.recording);
+	transfer.end = size;
+
+	bool has_range = false;
+	for (QByteArray const & line : lines) {
+		if ( line.toLower().startsWith("range:") ) {
+			if ( !range_check.exactMatch(QString::fromLatin1(line.mid(6).trimmed())) ) {
+				continue;
+			}
+			qint64 first = range_check.cap(1).toLongLong();
+			qint64 last = range_check.cap(2).isEmpty() ? size - 1 : qMin(range_check.cap(2).toLongLong(), size - 1);
+			if ( first > last ) {
+				sendError(socket, 416);
+				return;
+			}
+			transfer.first = first;
+			transfer.position = first;
+			transfer.end = last + 1;
+			has_range = true;
+		}
+	}
+
+	// The box closes the connection before the end of a whole recording.
+	transfer.close_at = transfer.end;
+	if ( !has_range && this->early_close > 0 ) {
+		transfer.close_at = qMax<qint64>(0, size - this->early_close);
+	}
+
+	QByteArray header = has_range ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+	header += "Content-Type: video/mp2t\r\n";
+	header += "Content-Length: " + QByteArray::number(transfer.end - transfer.first) + "\r\n";
+	if ( has_range ) {
+		header += "Content-Range: bytes " + QByteArray::number(transfer.first) + "-" + QByteArray::number(transfer.end - 1)
+			+ "/" + QByteArray::number(size) + "\r\n";
+	}
+	header += "Accept-Ranges: bytes\r\n";
+	header += "Connection: close\r\n\r\n";
+	socket->write(header);
+
+	if ( method == "HEAD" ) {
+		socket->disconnectFromHost();
+		return;
+	}
+
+	transfer.allowance = this->bandwidth * bandwidth_tick / 1000;
+	transfer.timer.start();
+	transfers.insert(socket, transfer);
+	pump(socket);
+}
+
+void Simulator::pump(QTcpSocket * socket) {
+	QMap<QTcpSocket *, Transfer>::iterator it = transfers.find(socket);
+	if ( it == transfers.end() ) {
+		return;
+	}
+
+	Transfer & transfer = it.value();
+	while ( transfer.position < transfer.close_at && socket->bytesToWrite() < high_watermark ) {
+		qint64 size = qMin(block_size, transfer.close_at - transfer.position);
+		if ( this->bandwidth > 0 ) {
+			size = qMin(size, transfer.allowance);
+			if ( size <= 0 ) {
+				break;
+			}
+			transfer.allowance -= size;
+		}
+
+		QByteArray block(static_cast<int>(size), Qt::Uninitialized);
+		SyntheticStream::read(transfer.position, block.data(), size);
+		socket->write(block);
+		transfer.position += size;
+	}
+
+	// disconnectFromHost sends the pending data before closing.
+	if ( transfer.position >= transfer.close_at && socket->state() == QAbstractSocket::ConnectedState ) {
+		socket->disconnectFromHost();
+	}
+}
+
+void Simulator::sendData() {
+	pump(qobject_cast<QTcpSocket *>(sender()));
+}
+
+void Simulator::refillBandwidth() {
+	qint64 refill = this->bandwidth * bandwidth_tick / 1000;
+
+	// pump can close a connection, which removes its transfer.
+	const QList<QTcpSocket *> sockets = transfers.keys();
+	for (QTcpSocket * socket : sockets) {
+		if ( transfers.contains(socket) ) {
+			Transfer & transfer = transfers[socket];
+			transfer.allowance = qMin(transfer.allowance + refill, 2 * refill);
+			pump(socket);
+		}
+	}
+}
+
+void Simulator::connectionClosed() {
+	QTcpSocket * socket = qobject_cast<QTcpSocket *>(sender());
+	requests.remove(socket);
+
+	if ( transfers.contains(socket) ) {
+		Transfer transfer = transfers.take(socket);
+		qint64 sent = transfer.position - transfer.first;
+		qint64 elapsed = qMax<qint64>(1, transfer.timer.elapsed());
+		std::cout << "Recording " << transfer.recording << ": sent " << sent << " of " << transfer.end - transfer.first
+				  << " bytes from " << transfer.first << " in " << elapsed << " ms ("
+				  << sent / 1000 / elapsed << " MB/s)"
+				  << (transfer.close_at < transfer.end ? ", closed early" : "") << std::endl;
+	}
+	socket->deleteLater();
+}
+
+void Simulator::sendError(QTcpSocket * socket, int status) {
+	QByteArray reason;
+	switch ( status ) {
+		case 400: reason = "Bad Request"; break;
+		case 404: reason = "Not Found"; break;
+		case 416: reason = "Range Not Satisfiable"; break;
+		default: reason = "Not Implemented"; break;
+	}
+	socket->write("HTTP/1.1 " + QByteArray::number(status) + " " + reason + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+	socket->disconnectFromHost();
+}
@@ -0,0 +1,76 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#ifndef SIMULATOR_HPP
+#define SIMULATOR_HPP
+
+#include <QObject>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+#include <QMap>
+
+#include "../qtupnp/mediaserver.hpp"
+
+/*
+ * Simulated Fetch STB. The CMediaServer answers the discovery, the device description and the
+ * ContentDirectory Browse requests of a synthetic tree (Recordings / series / episodes). The
+ * recordings are generated by SyntheticStream and sent by a second server supporting Range,
+ * with a latency, a bandwidth cap by download and the early close of the box.
+ */
+class Simulator : public QObject
+{
+	Q_OBJECT
+public:
+	Simulator(QCoreApplication * a, QObject * parent = nullptr);
+
+public slots:
+	void newConnection();
+	void readRequest();
+	void sendData();
+	void refillBandwidth();
+	void connectionClosed();
+
+private:
+	struct Transfer {
+		int recording = -1;
+		qint64 first = 0;
+		qint64 position = 0;
+		qint64 end = 0;
+		qint64 close_at = 0;    // The box stops sending at this offset
+		qint64 allowance = 0;   // Bytes allowed by the bandwidth cap
+		QElapsedTimer timer;
+	};
+
+	void buildTree(QString const & host);
+	void startTransfer(QTcpSocket * socket, QByteArray const & request);
+	void pump(QTcpSocket * socket);
+	void sendError(QTcpSocket * socket, int status);
+
+	QCoreApplication * app = nullptr;
+	QCommandLineParser parser;
+	QtUPnP::CMediaServer * media_server = nullptr;
+	QTcpServer stream_server;
+	QTimer bandwidth_timer;
+
+	QMap<QTcpSocket *, QByteArray> requests;
+	QMap<QTcpSocket *, Transfer> transfers;
+	QVector<qint64> recording_sizes;
+
+	qint32 latency = 0;
+	qint64 bandwidth = 0;
+	qint64 early_close = 29084;
+	qint64 block_size = 256 * 1024;
+	qint64 high_watermark = 1024 * 1024;
+	qint32 bandwidth_tick = 50;
+};
+
+#endif // SIMULATOR_HPP
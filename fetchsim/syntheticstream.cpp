@@ -0,0 +1,151 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <cstring>
+
+#include "syntheticstream.hpp"
+
+// Packet layout, repeated every 500 packets: PAT, PMT, then audio every 10 packets and video.
+static const int table_period = 500;
+static const int audio_period = 10;
+static const int pcr_period = 100;
+static const int random_access_period = 2500;
+static const int pmt_pid = 0x1000;
+static const int video_pid = 0x100;
+static const int audio_pid = 0x101;
+// 27 MHz ticks of a packet at 8 Mbit/s.
+static const qint64 ticks_per_packet = 5076;
+
+static quint32 crc32(const quint8 * data, int size) {
+	quint32 crc = 0xffffffff;
+	for (int i = 0; i < size; i++) {
+		crc ^= static_cast<quint32>(data[i]) << 24;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+// Packet holding a whole section, the continuity counter is set by the caller.
+static void buildSection(quint8 * packet, int pid, const quint8 * section, int size) {
+	memset(packet, 0xff, SyntheticStream::packet_size);
+	packet[0] = 0x47;
+	packet[1] = 0x40 | (pid >> 8);
+	packet[2] = pid & 0xff;
+	packet[3] = 0x10;
+	packet[4] = 0x00;
+	memcpy(packet + 5, section, size);
+	quint32 crc = crc32(section, size);
+	packet[5 + size] = crc >> 24;
+	packet[6 + size] = (crc >> 16) & 0xff;
+	packet[7 + size] = (crc >> 8) & 0xff;
+	packet[8 + size] = crc & 0xff;
+}
+
+struct SyntheticTables {
+	quint8 pat[SyntheticStream::packet_size];
+	quint8 pmt[SyntheticStream::packet_size];
+
+	SyntheticTables() {
+		const quint8 pat_section[] = {
+			0x00, 0xb0, 13, 0x00, 0x01, 0xc1, 0x00, 0x00,
+			0x00, 0x01, 0xe0 | (pmt_pid >> 8), pmt_pid & 0xff
+		};
+		const quint8 pmt_section[] = {
+			0x02, 0xb0, 23, 0x00, 0x01, 0xc1, 0x00, 0x00,
+			0xe0 | (video_pid >> 8), video_pid & 0xff, 0xf0, 0x00,
+			0x1b, 0xe0 | (video_pid >> 8), video_pid & 0xff, 0xf0, 0x00,
+			0x03, 0xe0 | (audio_pid >> 8), audio_pid & 0xff, 0xf0, 0x00
+		};
+		buildSection(this->pat, 0, pat_section, sizeof(pat_section));
+		buildSection(this->pmt, pmt_pid, pmt_section, sizeof(pmt_section));
+	}
+};
+
+void SyntheticStream::packet(qint64 index, quint8 * data) {
+	static const SyntheticTables tables;
+	int position = static_cast<int>(index % table_period);
+
+	if ( position == 0 || position == 1 ) {
+		memcpy(data, position ? tables.pmt : tables.pat, packet_size);
+		data[3] |= (index / table_period) & 0xf;
+		return;
+	}
+
+	if ( index % audio_period == 5 ) {
+		data[0] = 0x47;
+		data[1] = audio_pid >> 8;
+		data[2] = audio_pid & 0xff;
+		data[3] = 0x10 | (((index + 4) / audio_period) & 0xf);
+		memset(data + 4, static_cast<int>(index & 0xff), packet_size - 4);
+		return;
+	}
+
+	// Packets of the other PIDs before this one.
+	qint64 video_count = index - (index + table_period - 1) / table_period - (index + table_period - 2) / table_period
+		- (index + audio_period - 6) / audio_period;
+	data[0] = 0x47;
+	data[1] = video_pid >> 8;
+	data[2] = video_pid & 0xff;
+
+	if ( index % pcr_period != 2 ) {
+		data[3] = 0x10 | (video_count & 0xf);
+		memset(data + 4, static_cast<int>(index & 0xff), packet_size - 4);
+		return;
+	}
+
+	bool random_access = index % random_access_period == 2;
+	qint64 pcr = index * ticks_per_packet;
+	qint64 base = pcr / 300;
+	int extension = pcr % 300;
+
+	data[1] |= random_access ? 0x40 : 0x00;
+	data[3] = 0x30 | (video_count & 0xf);
+	data[4] = 7;
+	data[5] = random_access ? 0x50 : 0x10;
+	data[6] = (base >> 25) & 0xff;
+	data[7] = (base >> 17) & 0xff;
+	data[8] = (base >> 9) & 0xff;
+	data[9] = (base >> 1) & 0xff;
+	data[10] = ((base & 0x1) << 7) | 0x7e | (extension >> 8);
+	data[11] = extension & 0xff;
+	memset(data + 12, static_cast<int>(index & 0xff), packet_size - 12);
+
+	if ( random_access ) {
+		// PES header with a PTS 500 ms after the PCR.
+		qint64 pts = base + 45000;
+		quint8 * pes = data + 12;
+		pes[0] = 0x00; pes[1] = 0x00; pes[2] = 0x01; pes[3] = 0xe0;
+		pes[4] = 0x00; pes[5] = 0x00;
+		pes[6] = 0x80; pes[7] = 0x80; pes[8] = 0x05;
+		pes[9] = 0x21 | ((pts >> 29) & 0x0e);
+		pes[10] = (pts >> 22) & 0xff;
+		pes[11] = ((pts >> 14) & 0xfe) | 0x01;
+		pes[12] = (pts >> 7) & 0xff;
+		pes[13] = ((pts << 1) & 0xfe) | 0x01;
+	}
+}
+
+void SyntheticStream::read(qint64 offset, char * data, qint64 size) {
+	quint8 buffer[packet_size];
+	qint64 end = offset + size;
+
+	while ( offset < end ) {
+		qint64 index = offset / packet_size;
+		int skip = static_cast<int>(offset % packet_size);
+		int length = static_cast<int>(qMin<qint64>(packet_size - skip, end - offset));
+		if ( skip == 0 && length == packet_size ) {
+			packet(index, reinterpret_cast<quint8 *>(data));
+		} else {
+			packet(index, buffer);
+			memcpy(data, buffer + skip, length);
+		}
+		data += length;
+		offset += length;
+	}
+}
@@ -0,0 +1,27 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#ifndef SYNTHETICSTREAM_HPP
+#define SYNTHETICSTREAM_HPP
+
+#include <QtGlobal>
+
+/*
+ * A valid 8 Mbit/s MPEG-TS of one program (H.264 video with its PCR, MPEG audio, PAT and PMT).
+ * Each packet only depends on its index, so any range of a recording is generated without state.
+ * The continuity counters, the PCR and the random access points (every 2500 packets) are consistent,
+ * so the downloads can be checked with fetchtv --verify, --filter and --index.
+ */
+class SyntheticStream {
+public:
+	static const int packet_size = 188;
+
+	static void read(qint64 offset, char * data, qint64 size);
+	static void packet(qint64 index, quint8 * data);
+};
+
+#endif // SYNTHETICSTREAM_HPP
@@ -2,5 +2,5 @@ TEMPLATE = subdirs
 
 CONFIG += ordered
 
-SUBDIRS += qtupnp fetchtv
+SUBDIRS += qtupnp fetchtv fetchsim benchmarks
 
@@ -11,9 +11,17 @@ TEMPLATE = app
 CONFIG += c++14
 
 SOURCES += main.cpp \
-		   task.cpp
+		   task.cpp \
+		   tsscanner.cpp \
+		   tsfilter.cpp \
+		   tsindex.cpp \
+		   progress.cpp
 
-HEADERS += task.hpp
+HEADERS += task.hpp \
+		   tsscanner.hpp \
+		   tsfilter.hpp \
+		   tsindex.hpp \
+		   progress.hpp
 
 win32 {
 	CONFIG(release, debug|release) {
@@ -0,0 +1,235 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QLocale>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+#else
+#include <unistd.h>
+#endif
+
+#include "progress.hpp"
+
+// The escape codes are only written to a terminal that understands them.
+static bool ansiTerminal() {
+#ifdef Q_OS_WIN
+	HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
+	DWORD console_mode = 0;
+	if ( !_isatty(_fileno(stdout)) || !GetConsoleMode(handle, &console_mode) ) {
+		return false;
+	}
+	return (console_mode & ENABLE_VIRTUAL_TERMINAL_PROCESSING)
+		|| SetConsoleMode(handle, console_mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#else
+	return isatty(fileno(stdout));
+#endif
+}
+
+Progress::Progress(QObject * parent) : QObject(parent) {
+	this->ansi = ansiTerminal();
+	this->timer.setInterval(250);
+	connect(&this->timer, &QTimer::timeout, this, &Progress::sample);
+}
+
+QSharedPointer<ProgressCounter> Progress::start(QString const & name, qint64 total, qint64 received) {
+	Transfer transfer;
+	transfer.name = name;
+	transfer.counter = QSharedPointer<ProgressCounter>::create();
+	transfer.counter->received.store(received);
+	transfer.counter->total.store(total);
+	transfer.start_bytes = received;
+	transfer.last_bytes = received;
+	transfer.elapsed.start();
+	this->transfers.append(transfer);
+
+	if ( this->mode != PM_NONE && !this->timer.isActive() ) {
+		this->timer.start();
+	}
+	return transfer.counter;
+}
+
+void Progress::finish(QSharedPointer<ProgressCounter> const & counter) {
+	for (int i = 0; i < this->transfers.size(); i++) {
+		if ( this->transfers.at(i).counter != counter ) {
+			continue;
+		}
+
+		Transfer & transfer = this->transfers[i];
+		update(transfer, transfer.elapsed.elapsed());
+		if ( this->mode == PM_JSON ) {
+			printJson(transfer, "done");
+		} else if ( this->mode == PM_TEXT && this->transfers.size() > 1 ) {
+			// The last line of a finished transfer stays above the others.
+			clearText();
+			std::cout << textLine(transfer.name, transfer.last_bytes, transfer.counter->total.load(), transfer.rate).toStdString() << std::endl;
+			this->transfers.removeAt(i);
+			printText();
+			return;
+		} else if ( this->mode == PM_TEXT ) {
+			printText();
+		}
+		this->transfers.removeAt(i);
+		break;
+	}
+
+	// The next messages start on a new line.
+	if ( this->transfers.isEmpty() ) {
+		this->timer.stop();
+		if ( this->mode == PM_TEXT ) {
+			std::cout << std::endl;
+			this->printed_lines = 0;
+			this->printed_length = 0;
+		}
+	}
+}
+
+void Progress::sample() {
+	for (Transfer & transfer : this->transfers) {
+		update(transfer, transfer.elapsed.elapsed());
+	}
+
+	if ( this->mode == PM_JSON ) {
+		for (Transfer const & transfer : this->transfers) {
+			printJson(transfer, "progress");
+		}
+	} else if ( this->mode == PM_TEXT ) {
+		printText();
+	}
+}
+
+void Progress::update(Transfer & transfer, qint64 now) {
+	qint64 bytes = transfer.counter->received.load();
+	qint64 delta = now - transfer.last_time;
+	if ( delta <= 0 ) {
+		return;
+	}
+
+	// The weight of the new sample depends on its duration, so late timer events are not over weighted.
+	double rate = (bytes - transfer.last_bytes) * 1000.0 / delta;
+	if ( transfer.has_rate ) {
+		transfer.rate += (1.0 - std::exp(-delta / this->time_constant)) * (rate - transfer.rate);
+	} else {
+		transfer.rate = rate;
+		transfer.has_rate = true;
+	}
+	transfer.last_bytes = bytes;
+	transfer.last_time = now;
+}
+
+// Moves back to the first line of the previous sample and erases the lines.
+// Without escape codes, the single line is overwritten with spaces.
+void Progress::clearText() {
+	if ( !this->ansi ) {
+		std::cout << '\r' << std::string(this->printed_length, ' ') << '\r';
+		this->printed_length = 0;
+		return;
+	}
+	if ( this->printed_lines > 0 ) {
+		std::cout << "\x1b[" << this->printed_lines << "A";
+	}
+	std::cout << "\r\x1b[J";
+	this->printed_lines = 0;
+}
+
+void Progress::printText() {
+	clearText();
+	if ( this->transfers.size() == 1 ) {
+		Transfer const & transfer = this->transfers.first();
+		printLine(textLine(QString(), transfer.last_bytes, transfer.counter->total.load(), transfer.rate));
+		return;
+	}
+
+	qint64 received = 0;
+	qint64 total = 0;
+	double rate = 0.0;
+	for (Transfer const & transfer : this->transfers) {
+		if ( this->ansi ) {
+			std::cout << textLine(transfer.name, transfer.last_bytes, transfer.counter->total.load(), transfer.rate).toStdString() << "\n";
+			this->printed_lines++;
+		}
+		received += transfer.last_bytes;
+		total += transfer.counter->total.load();
+		rate += transfer.rate;
+	}
+	QString name = this->ansi ? QString("Total") : QString("Total of %1 transfers").arg(this->transfers.size());
+	printLine(textLine(name, received, total, rate));
+}
+
+void Progress::printLine(QString const & line) {
+	std::cout << line.toStdString() << std::flush;
+	this->printed_length = line.length();
+}
+
+QString Progress::textLine(QString const & name, qint64 received, qint64 total, double rate) const {
+	qint64 left = INT64_MAX;
+	if ( rate >= 1.0 && total > received ) {
+		left = static_cast<qint64>((total - received) / rate);
+	}
+
+	QString line = QString("%1 of %2 at %3 per second. %4")
+			.arg(QLocale::system().formattedDataSize(received))
+			.arg(QLocale::system().formattedDataSize(total))
+			.arg(QLocale::system().formattedDataSize(static_cast<qint64>(rate)))
+			.arg(remainingTime(left));
+	return name.isEmpty() ? line : name + ": " + line;
+}
+
+void Progress::printJson(Transfer const & transfer, char const * event) {
+	qint64 total = transfer.counter->total.load();
+	qint64 elapsed = transfer.elapsed.elapsed();
+
+	QJsonObject line;
+	line["event"] = event;
+	line["name"] = transfer.name;
+	line["bytes"] = transfer.last_bytes;
+	line["total"] = total;
+	line["elapsed_ms"] = elapsed;
+	if ( QByteArray(event) == "done" ) {
+		line["rate"] = elapsed > 0 ? (transfer.last_bytes - transfer.start_bytes) * 1000.0 / elapsed : 0.0;
+	} else {
+		line["rate"] = transfer.rate;
+		line["eta_s"] = transfer.rate >= 1.0 && total > transfer.last_bytes ? (total - transfer.last_bytes) / transfer.rate : -1.0;
+	}
+	std::cout << QJsonDocument(line).toJson(QJsonDocument::Compact).constData() << std::endl;
+}
+
+QString Progress::remainingTime( qint64 s ) {
+	if ( s == INT64_MAX ) {
+		return  QString("Unknown Time remaining");
+	}
+
+	qint64 hours, minutes, seconds;
+	QString hour, minute, second;
+
+	hours = s / 3600;
+	minutes = s % 3600; // In seconds
+	seconds = minutes % 60;
+	minutes /= 60; // Convert to minutes
+
+	// Not happy with this method, but it cleanest that I could think of
+	hour = qAbs(hours) == 1 ? "hour" : "hours";
+	minute = qAbs(minutes) < 2 ? "minute" : "minutes";
+	second = qAbs(seconds) < 2 ? "second" : "seconds";
+
+	//We abs the second value so we don't have -1 hour and -13 minutes
+	if ( hours != 0 ) {
+		return QString("%1 %3 and %2 %4 remaining").arg(hours).arg(qAbs(minutes)).arg(hour).arg(minute);
+	} else if ( minutes != 0 ) {
+		return QString("%1 %3 and %2 %4 remaining").arg(minutes).arg(qAbs(seconds)).arg(minute).arg(second);
+	} else {
+		return QString("%1 %2 remaining").arg(seconds).arg(second);
+	}
+}
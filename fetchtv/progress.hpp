@@ -0,0 +1,92 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#ifndef PROGRESS_HPP
+#define PROGRESS_HPP
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+#include <QSharedPointer>
+
+enum ProgressMode {
+	PM_TEXT,
+	PM_JSON,
+	PM_NONE
+};
+
+/*
+ * Byte counters of a transfer. They are the only part touched while downloading,
+ * so they can be updated from any thread.
+ */
+class ProgressCounter {
+public:
+	void add(qint64 bytes) { this->received.fetchAndAddRelaxed(bytes); }
+	void setTotal(qint64 bytes) { this->total.store(bytes); }
+
+	QAtomicInteger<qint64> received;
+	QAtomicInteger<qint64> total;
+};
+
+/*
+ * Progress of the downloads. The counters are sampled by a timer (4 Hz by default), the rates
+ * are smoothed with an exponentially weighted moving average and give the remaining time.
+ * The text mode writes one line by transfer and a total line when several transfers run,
+ * redrawn with ANSI escape codes. When stdout is not a terminal, or a Windows console without
+ * VT processing, the text mode rewrites a single line with carriage returns.
+ * The json mode writes one JSON object by line and transfer.
+ */
+class Progress : public QObject
+{
+	Q_OBJECT
+public:
+	Progress(QObject * parent = nullptr);
+
+	void setMode(ProgressMode mode) { this->mode = mode; }
+	ProgressMode progressMode() const { return this->mode; }
+	void setInterval(int ms) { this->timer.setInterval(ms); }
+
+	QSharedPointer<ProgressCounter> start(QString const & name, qint64 total, qint64 received = 0);
+	void finish(QSharedPointer<ProgressCounter> const & counter);
+
+	static QString remainingTime(qint64 s);
+
+public slots:
+	void sample();
+
+private:
+	struct Transfer {
+		QString name;
+		QSharedPointer<ProgressCounter> counter;
+		QElapsedTimer elapsed;
+		qint64 start_bytes = 0;
+		qint64 last_bytes = 0;
+		qint64 last_time = 0;
+		double rate = 0.0;      // Bytes per second
+		bool has_rate = false;
+	};
+
+	void update(Transfer & transfer, qint64 now);
+	void printText();
+	void clearText();
+	void printLine(QString const & line);
+	void printJson(Transfer const & transfer, char const * event);
+	QString textLine(QString const & name, qint64 received, qint64 total, double rate) const;
+
+	QList<Transfer> transfers;
+	QTimer timer;
+	ProgressMode mode = PM_TEXT;
+	int printed_lines = 0;
+	int printed_length = 0;
+	bool ansi = false;
+	double time_constant = 2000.0;  // ms, the weight of a sample this old is 1/e
+};
+
+#endif // PROGRESS_HPP
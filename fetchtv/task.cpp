@@ -11,6 +11,13 @@ according to those terms.
 #include <QStandardPaths>
 #include <QFileInfo>
 #include <QDir>
+#include <QSettings>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
 
 #include "task.hpp"
 
@@ -18,6 +25,7 @@ according to those terms.
 #include "../qtupnp/browsereply.hpp"
 #include "../qtupnp/didlitem.hpp"
 #include "../qtupnp/action.hpp"
+#include "../qtupnp/metrics.hpp"
 
 inline ArgumentStringType GetArgumentStringType( const QString & str) {
 	static QRegExp datecheck("\\d{4}-\\d{2}-\\d{2}");
@@ -29,32 +37,37 @@ inline ArgumentStringType GetArgumentStringType( const QString & str) {
 	return AST_STRING;
 }
 
-QString GetRemainingTime( qint64 s ) {
-	if ( s == INT64_MAX ) {
-		return  QString("Unknown Time remaining");
-	}
-
-	qint64 hours, minutes, seconds;
-	QString hour, minute, second;
-
-	hours = s / 3600;
-	minutes = s % 3600; // In seconds
-	seconds = minutes % 60;
-	minutes /= 60; // Convert to minutes
+// Quoted string of a ContentDirectory search criteria.
+inline QString SearchString( const QString & str) {
+	QString escaped = str;
+	escaped.replace("\\", "\\\\").replace("\"", "\\\"");
+	return "\"" + escaped + "\"";
+}
 
-	// Not happy with this method, but it cleanest that I could think of
-	hour = qAbs(hours) == 1 ? "hour" : "hours";
-	minute = qAbs(minutes) < 2 ? "minute" : "minutes";
-	second = qAbs(seconds) < 2 ? "second" : "seconds";
+// User and system time of the process in microseconds.
+qint64 GetProcessCpuTime() {
+#ifdef Q_OS_UNIX
+	struct rusage usage;
+	if ( getrusage(RUSAGE_SELF, &usage) == 0 ) {
+		return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * Q_INT64_C(1000000) + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+	}
+#endif
+	return 0;
+}
 
-	//We abs the second value so we don't have -1 hour and -13 minutes
-	if ( hours != 0 ) {
-		return QString("%1 %3 and %2 %4 remaining").arg(hours).arg(qAbs(minutes)).arg(hour).arg(minute);
-	} else if ( minutes != 0 ) {
-		return QString("%1 %3 and %2 %4 remaining").arg(minutes).arg(qAbs(seconds)).arg(minute).arg(second);
-	} else {
-		return QString("%1 %2 remaining").arg(seconds).arg(second);
+// Peak resident memory of the process in kilobytes.
+qint64 GetPeakMemory() {
+#ifdef Q_OS_UNIX
+	struct rusage usage;
+	if ( getrusage(RUSAGE_SELF, &usage) == 0 ) {
+#ifdef Q_OS_MACOS
+		return usage.ru_maxrss / 1024;
+#else
+		return usage.ru_maxrss;
+#endif
 	}
+#endif
+	return 0;
 }
 
 BasicInfo Task::CDidlItem2BasicInfo( QString const& serverUUID, QtUPnP::CDidlItem const & didlItem ) {
@@ -98,22 +111,27 @@ BasicInfo Task::get( QString const& serverUUID, QString id ) {
 	return info;
 }
 
+// The Fetch box numbers its root container like the ContentDirectory service.
+QString Task::rootID(const QtUPnP::CDevice & device) {
+	QtUPnP::TMServices services = device.services();
+
+	QMap<QString, QtUPnP::CService>::const_iterator i = services.constBegin();
+	qint32 c = 0;
+	while (i != services.constEnd()) {
+		if ( i.key() == "urn:upnp-org:serviceId:ContentDirectory") {
+			return QString::number(c);
+		}
+		++i;
+		c++;
+	}
+	return QString();
+}
+
 QList<BasicInfo> Task::buildList(const QtUPnP::CDevice & device, QString id ) {
 	QList<BasicInfo> list;
 
 	if ( id.isEmpty() ) {
-		QtUPnP::TMServices services = device.services();
-
-		QMap<QString, QtUPnP::CService>::const_iterator i = services.constBegin();
-		qint32 c = 0;
-		while (i != services.constEnd()) {
-			QtUPnP::CService service = i.value();
-			if ( i.key() == "urn:upnp-org:serviceId:ContentDirectory") {
-				id = QString::number(c);
-			}
-			++i;
-			c++;
-		}
+		id = rootID(device);
 	}
 
 	QtUPnP::CContentDirectory cd(upnp_cp);
@@ -156,18 +174,58 @@ void Task::list(QString const& serverUUID, QString id, QString outputPrefix ) {
 }
 
 void Task::retrievedContentList(QtUPnP::CDevice device) {
-	QtUPnP::TMServices& services = device.services();
+	QString id = rootID(device);
+	if ( !id.isEmpty() ) {
+		this->list(device.uuid(), id);
+	}
+}
 
-	QMap<QString, QtUPnP::CService>::const_iterator i = services.constBegin();
-	qint32 c = 0;
-	while (i != services.constEnd()) {
-		QtUPnP::CService service = i.value();
-		if ( i.key() == "urn:upnp-org:serviceId:ContentDirectory") {
-			this->list(device.uuid(), QString::number(c));
+// Returns the recordings found by the Search action of the box. The folders are browsed.
+// Returns false when the box fails to search, the list is then empty.
+bool Task::searchList(const QtUPnP::CDevice & device, QString const & criteria, QList<BasicInfo> & list) {
+	list.clear();
+
+	// The results come by pages, several pages are requested at once.
+	QtUPnP::CContentDirectory cd(upnp_cp);
+	bool success = cd.searchPages(device.uuid(), rootID(device), criteria, [this, &device, &list](QtUPnP::CBrowseReply const & page) {
+		QList<QtUPnP::CDidlItem> const & didlItems = page.items();
+		for (QtUPnP::CDidlItem const & didlItem : didlItems) {
+			if ( didlItem.type() == QtUPnP::CDidlItem::StorageFolder) {
+				list.append(this->buildList(device, didlItem.id()));
+			} else if ( didlItem.type() == QtUPnP::CDidlItem::Movie || didlItem.type() == QtUPnP::CDidlItem::VideoItem) {
+				list.append(CDidlItem2BasicInfo(device.uuid(), didlItem));
+			}
+		}
+		return true;
+	});
+	if ( !success ) {
+		std::cout << "Search failed on " << device.friendlyName().toStdString() << ", listing all the recordings." << std::endl;
+		list.clear();
+	}
+	return success;
+}
+
+// True if the box can search all the properties.
+bool Task::canSearch(QStringList const & properties) const {
+	if ( this->search_caps.contains("*") ) {
+		return true;
+	}
+	for (QString const & property : properties) {
+		if ( !this->search_caps.contains(property) ) {
+			return false;
 		}
-		++i;
-		c++;
 	}
+	return true;
+}
+
+// Every recording of the box, only listed when a selector can not be searched.
+QList<BasicInfo> const & Task::cachedList(const QtUPnP::CDevice & device) {
+	if ( !this->has_cached_info ) {
+		std::cout << "Listing all recordings." << std::endl;
+		this->cached_info = this->buildList(device, "");
+		this->has_cached_info = true;
+	}
+	return this->cached_info;
 }
 
 void Task::newDevice( QString const & serverUUID) {
@@ -196,13 +254,22 @@ Task::Task(QCoreApplication * a, QObject * parent) : QObject(parent) {
 	this->action_method = &Task::actionHelp;
 
 	// CLI options
-	parser.addPositionalArgument("command", "download, list, help");
+	parser.addPositionalArgument("command", "download, list, serve, verify, index, help");
 	parser.addPositionalArgument("id/date/series", "ID, Date (YYYY-MM-DD) or Series Name (Wrap text in quote). Multiple option can be used.");
 	parser.addOptions({
 		{{"d", "directory"}, "Download into <directory>.", "directory"},
 		{"ip", "Fetch IP Address", "ip"},
+		{"port", "Port used by the serve command. Default 8080.", "port", "8080"},
 		//{"csv", "Output as CSV"},
 		{"resume", "[Untested] Resume downloads. May cause invalid videos"},
+		{"verify", "Check the MPEG-TS packets while downloading."},
+		{"filter", "Only keep the video, the first audio track and the program tables while downloading."},
+		{"retry-tail", "Request the missing end of a download again when the connection closes early."},
+		{"index", "Write a seek index (<file>.idx) while downloading."},
+		{"stats-json", "Append the speed, time to first byte, CPU time and peak memory of each download to <file>, one JSON object per line.", "file"},
+		{"progress", "Progress output: text, json (one JSON object by line) or none. Default text.", "mode", "text"},
+		{"metrics", "Write the UPnP and download metrics to <file> in the Prometheus text format. serve also answers GET /metrics.", "file"},
+		{"trace", "Write the timeline of the UPnP actions and the downloads to <file>, for chrome://tracing or ui.perfetto.dev.", "file"},
 	});
 
 	// Process the actual command line arguments given by the user
@@ -214,8 +281,47 @@ Task::Task(QCoreApplication * a, QObject * parent) : QObject(parent) {
 		return;
 	}
 
+	// Every command can collect metrics, they are written when the application exits.
+	if ( parser.isSet("metrics") ) {
+		this->metrics_file = parser.value("metrics");
+		QtUPnP::CMetrics::instance().setEnabled(true);
+	}
+	if ( parser.isSet("trace") ) {
+		this->trace_file = parser.value("trace");
+		QtUPnP::CMetrics::instance().setTracing(true);
+	}
+
+	// Serving the downloaded files does not need the Fetch box.
+	if ( parser.positionalArguments().value(0) == "serve" ) {
+		connect(this, &Task::taskCompleted, this, &Task::exitSuccessfully);
+		connect(this, &Task::taskFailed, this, &Task::exitNotSoSuccessfully);
+		QTimer::singleShot(0, this, &Task::actionServe);
+		return;
+	}
+
+	// Checking the downloaded files does not need the Fetch box either.
+	if ( parser.positionalArguments().value(0) == "verify" ) {
+		connect(this, &Task::taskCompleted, this, &Task::exitSuccessfully);
+		connect(this, &Task::taskFailed, this, &Task::exitNotSoSuccessfully);
+		QTimer::singleShot(0, this, &Task::actionVerify);
+		return;
+	}
+
+	// Indexing the downloaded files neither.
+	if ( parser.positionalArguments().value(0) == "index" ) {
+		connect(this, &Task::taskCompleted, this, &Task::exitSuccessfully);
+		connect(this, &Task::taskFailed, this, &Task::exitNotSoSuccessfully);
+		QTimer::singleShot(0, this, &Task::actionIndex);
+		return;
+	}
+
 	this->upnp_cp = new QtUPnP::CControlPoint(this);
 
+	// Only Fetch boxes are used, so don't download service descriptions for anything else.
+	// ContentDirectory is loaded when first browsed.
+	upnp_cp->setDeviceFilter([](QtUPnP::CDevice const & device) { return device.modelName().startsWith("Fetch"); });
+	upnp_cp->setLazyServiceLoading();
+
 	connect(this, &Task::taskCompleted, this, &Task::exitSuccessfully);
 	connect(this, &Task::taskFailed, this, &Task::exitNotSoSuccessfully);
 
@@ -239,6 +345,31 @@ Task::Task(QCoreApplication * a, QObject * parent) : QObject(parent) {
 		if ( parser.isSet("resume") ) {
 			this->resume_downloads = true;
 		}
+		if ( parser.isSet("verify") ) {
+			this->verify_downloads = true;
+		}
+		if ( parser.isSet("retry-tail") ) {
+			this->retry_tail = true;
+		}
+		if ( parser.isSet("index") ) {
+			this->index_downloads = true;
+		}
+		if ( parser.isSet("stats-json") ) {
+			this->stats_file = parser.value("stats-json");
+		}
+		if ( parser.value("progress") == "json" ) {
+			this->progress.setMode(PM_JSON);
+		} else if ( parser.value("progress") == "none" ) {
+			this->progress.setMode(PM_NONE);
+		}
+		if ( parser.isSet("filter") ) {
+			this->filter_downloads = true;
+			// The file offsets no longer match the recording.
+			if ( this->resume_downloads ) {
+				std::cout << "--resume can not be used with --filter, downloads will restart." << std::endl;
+				this->resume_downloads = false;
+			}
+		}
 
 		if (positionalArguments.isEmpty()) {
 			QTimer::singleShot(scan_time, this, &Task::actionList);
@@ -278,17 +409,219 @@ void Task::networkError(QString const & deviceUUID, QNetworkReply::NetworkError
 }
 
 void Task::exitSuccessfully() {
+	writeMetrics();
 	this->app->exit(0);
 }
 void Task::exitNotSoSuccessfully() {
+	writeMetrics();
 	this->app->exit(1);
 }
 
+void Task::writeMetrics() {
+	QtUPnP::CMetrics & metrics = QtUPnP::CMetrics::instance();
+	if ( !this->metrics_file.isEmpty() && !metrics.writePrometheus(this->metrics_file) ) {
+		std::cout << "Metrics file " << this->metrics_file.toStdString() << " can not be written." << std::endl;
+	}
+	if ( !this->trace_file.isEmpty() && !metrics.writeTrace(this->trace_file) ) {
+		std::cout << "Trace file " << this->trace_file.toStdString() << " can not be written." << std::endl;
+	}
+}
+
 void Task::actionHelp() {
 	std::cout << parser.helpText().toStdString() << std::endl;
 	emit taskCompleted();
 }
 
+void Task::actionServe() {
+	if ( parser.isSet("directory") ) {
+		media_directory.setPath(parser.value("directory"));
+	} else {
+		media_directory.setPath(QCoreApplication::applicationDirPath());
+	}
+
+	bool ok = false;
+	quint16 port = parser.value("port").toUShort(&ok);
+	if ( !ok ) {
+		std::cout << "Invalid port " << parser.value("port").toStdString() << std::endl;
+		emit taskFailed();
+		return;
+	}
+
+	media_server = new QtUPnP::CMediaServer(this);
+	media_server->setFriendlyName("fetchtv");
+
+	// Recordings are grouped by series using the sidecar written on download.
+	QMap<QString, QString> series_ids;
+	QStringList files = media_directory.entryList(QStringList() << "*.tts", QDir::Files, QDir::Name);
+	for (QString const & file : files) {
+		BasicInfo info = readSidecar(media_directory.filePath(file));
+		QString parent_id = "0";
+		if ( !info.series.isEmpty() ) {
+			parent_id = series_ids.value(info.series);
+			if ( parent_id.isEmpty() ) {
+				parent_id = media_server->addContainer(info.series);
+				series_ids.insert(info.series, parent_id);
+			}
+		}
+		media_server->addItem(parent_id, info.title, file, info.date);
+	}
+
+	if ( !media_server->start(media_directory.absolutePath(), port) ) {
+		std::cout << "Can not listen on port " << port << std::endl;
+		emit taskFailed();
+		return;
+	}
+
+	connect(media_server->httpServer(), &QtUPnP::CHTTPServer::mediaTransferEnded, this, &Task::mediaTransferEnded);
+
+	std::cout << "Serving " << files.size() << " recordings from " << media_directory.absolutePath().toStdString() << std::endl;
+	for (QString const & file : files) {
+		std::cout << media_server->httpServer()->mediaURI(file).toStdString() << std::endl;
+	}
+}
+
+void Task::actionVerify() {
+	if ( parser.isSet("directory") ) {
+		media_directory.setPath(parser.value("directory"));
+	} else {
+		media_directory.setPath(QCoreApplication::applicationDirPath());
+	}
+
+	// Files given on the command line, or every recording of the directory.
+	QStringList files = parser.positionalArguments().mid(1);
+	if ( files.isEmpty() ) {
+		files = media_directory.entryList(QStringList() << "*.tts", QDir::Files, QDir::Name);
+	}
+
+	int bad = 0;
+	for (QString const & file : files) {
+		TSReport report = TSScanner::scanFile(media_directory.filePath(file));
+		std::cout << file.toStdString() << ": " << report.toString().toStdString() << std::endl;
+		if ( !report.isValid() ) {
+			bad++;
+		}
+	}
+
+	std::cout << files.size() - bad << " of " << files.size() << " recordings are valid." << std::endl;
+	if ( bad ) {
+		emit taskFailed();
+	} else {
+		emit taskCompleted();
+	}
+}
+
+void Task::actionIndex() {
+	if ( parser.isSet("directory") ) {
+		media_directory.setPath(parser.value("directory"));
+	} else {
+		media_directory.setPath(QCoreApplication::applicationDirPath());
+	}
+
+	QStringList files = parser.positionalArguments().mid(1);
+	if ( files.isEmpty() ) {
+		files = media_directory.entryList(QStringList() << "*.tts", QDir::Files, QDir::Name);
+	}
+
+	int failed = 0;
+	for (QString const & file : files) {
+		QTime index_timer;
+		index_timer.start();
+		qint64 entries = TSIndexFile::build(media_directory.filePath(file));
+		if ( entries < 0 ) {
+			std::cout << file.toStdString() << ": can not be indexed." << std::endl;
+			failed++;
+		} else {
+			std::cout << file.toStdString() << ": " << entries << " seek points in " << index_timer.elapsed() << " ms" << std::endl;
+		}
+	}
+
+	if ( failed ) {
+		emit taskFailed();
+	} else {
+		emit taskCompleted();
+	}
+}
+
+void Task::writeSidecar(BasicInfo const & info, QString const & filename) {
+	QSettings sidecar(filename + ".ini", QSettings::IniFormat);
+	sidecar.setValue("id", info.id);
+	sidecar.setValue("title", info.title);
+	sidecar.setValue("series", info.series);
+	sidecar.setValue("date", info.date.toString(Qt::ISODate));
+	sidecar.setValue("uri", info.uri);
+	sidecar.setValue("filesize", static_cast<qlonglong>(info.filesize));
+}
+
+void Task::writeSidecarStatus(QString const & filename, bool complete, qint64 received, qint64 expected, qint64 trimmed) {
+	QSettings sidecar(filename + ".ini", QSettings::IniFormat);
+	sidecar.setValue("complete", complete);
+	sidecar.setValue("received", static_cast<qlonglong>(received));
+	sidecar.setValue("expected", static_cast<qlonglong>(expected));
+	sidecar.setValue("trimmed", static_cast<qlonglong>(trimmed));
+}
+
+void Task::writeStats(QString const & filename, bool complete) {
+	qint64 elapsed = qMax(1, this->timer.elapsed());
+	qint64 cpu_time = GetProcessCpuTime() - this->cpu_start_time;
+	double megabytes = this->downloaded / 1000000.0;
+	double speed = megabytes * 1000.0 / elapsed;
+
+	std::cout << "Stats: " << QString::number(speed, 'f', 1).toStdString() << " MB/s, first byte after " << this->first_byte_time
+			  << " ms, CPU " << QString::number(cpu_time / 10.0 / elapsed, 'f', 1).toStdString() << "%, peak memory "
+			  << QLocale::system().formattedDataSize(GetPeakMemory() * 1024).toStdString() << std::endl;
+
+	if ( this->stats_file.isEmpty() ) {
+		return;
+	}
+
+	QJsonObject stats;
+	stats["file"] = filename;
+	stats["complete"] = complete;
+	stats["bytes"] = this->downloaded;
+	stats["elapsed_ms"] = elapsed;
+	stats["mb_per_s"] = speed;
+	stats["ttfb_ms"] = this->first_byte_time;
+	stats["cpu_ms"] = cpu_time / 1000.0;
+	stats["cpu_percent"] = cpu_time / 10.0 / elapsed;
+	stats["cpu_ms_per_mb"] = megabytes > 0 ? cpu_time / 1000.0 / megabytes : 0.0;
+	stats["peak_rss_kb"] = GetPeakMemory();
+	stats["tail_retries"] = this->tail_retries;
+
+	// JSON Lines, so concurrent downloads can append to the same file.
+	QFile output(this->stats_file);
+	if ( output.open(QIODevice::WriteOnly | QIODevice::Append) ) {
+		output.write(QJsonDocument(stats).toJson(QJsonDocument::Compact) + "\n");
+	} else {
+		std::cout << "Stats file " << this->stats_file.toStdString() << " can not be open." << std::endl;
+	}
+}
+
+BasicInfo Task::readSidecar(QString const & filename) {
+	BasicInfo info;
+	QFileInfo file(filename);
+	info.filename = file.fileName();
+	info.title = file.completeBaseName();
+	if ( QFileInfo::exists(filename + ".ini") ) {
+		QSettings sidecar(filename + ".ini", QSettings::IniFormat);
+		info.id = sidecar.value("id").toString();
+		info.title = sidecar.value("title", info.title).toString();
+		info.series = sidecar.value("series").toString();
+		info.date = QDateTime::fromString(sidecar.value("date").toString(), Qt::ISODate);
+		info.uri = sidecar.value("uri").toString();
+		info.filesize = sidecar.value("filesize").toLongLong();
+	}
+	return info;
+}
+
+void Task::mediaTransferEnded(QtUPnP::CHTTPServer::SMediaStatistics const & statistics) {
+	std::cout << statistics.m_peerAddress.toString().toStdString() << " "
+			  << QFileInfo(statistics.m_fileName).fileName().toStdString() << " "
+			  << QLocale::system().formattedDataSize(statistics.m_sent).toStdString() << " of "
+			  << QLocale::system().formattedDataSize(statistics.m_size).toStdString() << " at "
+			  << QLocale::system().formattedDataSize(static_cast<qint64>(statistics.throughput())).toStdString()
+			  << " per second." << std::endl;
+}
+
 void Task::nextDownload() {
 	if ( download_actions.count() ) {
 		this->actionDownload();
@@ -299,8 +632,11 @@ void Task::nextDownload() {
 
 void Task::actionPreDownload() {
 	if ( founded_devices.size() ) {
+		// Dates and series are searched by the box when it can, instead of listing all recordings.
 		QList<QtUPnP::CDevice>::const_iterator d = founded_devices.constBegin();
-		this->cached_info = this->buildList( *d, "" );
+		QtUPnP::CContentDirectory cd(upnp_cp);
+		this->search_caps = cd.getSearchCaps(d->uuid());
+		this->has_cached_info = false;
 		this->nextDownload();
 	} else {
 		emit taskFailed();
@@ -315,25 +651,39 @@ void Task::actionDownload() {
 		QtUPnP::CDevice device = *i;
 
 		switch (GetArgumentStringType(download)) {
-			case AST_DATE:
+			case AST_DATE: {
 				this->since_date = QDateTime::fromString(download, Qt::ISODate);
-				for (int var = 0; var < this->cached_info.size(); ++var) {
-					BasicInfo q = this->cached_info.at(var);
+				QList<BasicInfo> found;
+				if ( !canSearch({"upnp:class", "dc:date"})
+					|| !searchList(device, "upnp:class derivedfrom \"object.item.videoItem\" and dc:date >= " + SearchString(download), found) ) {
+					found = cachedList(device);
+				}
+				// The box compares the dates as strings, they are checked again.
+				for (int var = 0; var < found.size(); ++var) {
+					BasicInfo q = found.at(var);
 					if ( q.date > this->since_date ) {
 						download_actions.push_back(q.id);
 					}
 				}
 				this->nextDownload();
+			}
 			break;
 
-			case AST_STRING:
-				for (int var = 0; var < this->cached_info.size(); ++var) {
-					BasicInfo q = this->cached_info.at(var);
+			case AST_STRING: {
+				QList<BasicInfo> found;
+				// The series are the folders of the recordings, their titles are checked again.
+				if ( !canSearch({"upnp:class", "dc:title"})
+					|| !searchList(device, "upnp:class derivedfrom \"object.container\" and dc:title contains " + SearchString(download), found) ) {
+					found = cachedList(device);
+				}
+				for (int var = 0; var < found.size(); ++var) {
+					BasicInfo q = found.at(var);
 					if ( q.series.compare(download, Qt::CaseInsensitive) == 0 ) {
 						download_actions.push_back(q.id);
 					}
 				}
 				this->nextDownload();
+			}
 			break;
 
 			case AST_NUMBER:
@@ -379,34 +729,42 @@ void Task::downloadStart(QtUPnP::CDevice device, quint32 id) {
 		}
 		if ( current_file.isOpen() ) {
 			std::cout << "Url: " << info.uri.toStdString() << std::endl;
+			writeSidecar(info, current_file.fileName());
 
 			this->downloaded = 0;
+			this->download_offset = 0;
+			this->expected_size = info.filesize;
+			this->tail_retries = 0;
+			this->download_uri = info.uri;
 			this->continuing = false;
+			this->download_scanner.reset();
+			this->download_filter.reset();
 
-			QNetworkRequest request(info.uri);
 			//Fetch STB have a problem with the last 28kb for a reason - 29084
 			//Might be able to enable resume, by forgetting the first 188 packet
 			if ( this->resume_downloads && path.size() ) {
 				std::cout << "Resuming from " << QLocale::system().formattedDataSize(path.size() ).toStdString() << std::endl;
-				QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(path.size() - 188) + "-";
-				request.setRawHeader("Range", rangeHeaderValue);
+				this->download_offset = path.size() - 188;
 				this->continuing = true;
 			}
 
-			this->timer.start();
-			reply = manager.get(request);
-
-			if ( reply ) {
-				connect(this, &Task::fetchHasClosedConnection, this, &Task::downloadCompleted);
-				connect(reply, &QNetworkReply::downloadProgress, this, &Task::downloadProgress);
-				connect(reply, SIGNAL(error(QNetworkReply::NetworkError)),
-								this, SLOT(downloadError(QNetworkReply::NetworkError)));
-				connect(reply, &QNetworkReply::finished, this, &Task::downloadCompleted);
-				connect(reply, &QNetworkReply::readyRead, this, &Task::downloadWrite);
-			} else {
-				std::cout << "Invalid QNetworkReply" << std::endl;
+			// The offsets of a resumed file are unknown, the index command can build it afterward.
+			if ( this->index_downloads && !this->continuing ) {
+				this->download_indexer.reset();
+				if ( !this->download_index.open(TSIndexFile::indexName(current_file.fileName()), 1000) ) {
+					std::cout << "Index " << TSIndexFile::indexName(current_file.fileName()).toStdString() << " can not be open." << std::endl;
+				}
 			}
 
+			this->first_byte_time = -1;
+			this->last_write_time = 0;
+			this->cpu_start_time = GetProcessCpuTime();
+			this->download_start_us = QtUPnP::CMetrics::instance().now();
+			this->timer.start();
+			this->progress_counter = this->progress.start(info.filename, this->expected_size, this->download_offset);
+			connect(this, &Task::fetchHasClosedConnection, this, &Task::downloadCompleted, Qt::UniqueConnection);
+			downloadRequest(this->download_offset);
+
 		} else {
 			std::cout << "File " << info.filename.toStdString() << " can not be open."<< std::endl;
 			nextDownload();
@@ -416,56 +774,202 @@ void Task::downloadStart(QtUPnP::CDevice device, quint32 id) {
 	}
 }
 
+void Task::downloadRequest(qint64 offset) {
+	this->request_offset = offset;
+	QNetworkRequest request(this->download_uri);
+	if ( offset > 0 ) {
+		QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(offset) + "-";
+		request.setRawHeader("Range", rangeHeaderValue);
+	}
+
+	reply = manager.get(request);
+
+	if ( reply ) {
+		connect(reply, &QNetworkReply::downloadProgress, this, &Task::downloadProgress);
+		connect(reply, SIGNAL(error(QNetworkReply::NetworkError)),
+						this, SLOT(downloadError(QNetworkReply::NetworkError)));
+		connect(reply, &QNetworkReply::finished, this, &Task::downloadCompleted);
+		connect(reply, &QNetworkReply::readyRead, this, &Task::downloadWrite);
+	} else {
+		std::cout << "Invalid QNetworkReply" << std::endl;
+	}
+}
+
 void Task::downloadWrite() {
+	// A server ignoring Range would send the recording again from the start.
+	if ( this->tail_retries > 0 && this->reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 206 ) {
+		std::cout << "The server does not support Range requests." << std::endl;
+		this->tail_retries = this->max_tail_retries;
+		QObject::disconnect(this->reply, &QNetworkReply::readyRead, this, nullptr);
+		this->reply->abort();
+		return;
+	}
+
 	QByteArray data = this->reply->readAll();
+	qint64 received = data.size();
+	qint64 now = this->timer.elapsed();
+	if ( this->first_byte_time < 0 && received ) {
+		this->first_byte_time = now;
+	}
+
+	// A long gap between two reads is a stall of the box or of the network.
+	QtUPnP::CMetrics & metrics = QtUPnP::CMetrics::instance();
+	if ( this->first_byte_time >= 0 && this->last_write_time > 0 && now - this->last_write_time > this->stall_time ) {
+		qint64 stall = now - this->last_write_time;
+		metrics.add("fetchtv_download_stalls_total", {});
+		metrics.add("fetchtv_download_stall_ms_total", {}, stall);
+		metrics.span("stall", "download", metrics.now() - stall * 1000, stall * 1000);
+	}
+	if ( received ) {
+		this->last_write_time = now;
+		metrics.add("fetchtv_download_bytes_total", {}, received);
+	}
+	this->progress_counter->add(received);
 
-	//Write the current buffer to file
 	if ( this->resume_downloads && this->downloaded <= 188) {
 		//Strip MPEG Transport Stream when resuming (Maybe?)
-		this->current_file.write(data.right(data.size()-188));
-	} else {
-		this->current_file.write(data);
+		data = data.right(data.size()-188);
+	}
+	if ( this->filter_downloads ) {
+		data = this->download_filter.filter(data);
+	}
+
+	downloadSave(data);
+	downloaded += received;
+}
+
+// Writes the current buffer to file, the check and the index see what is written.
+void Task::downloadSave(QByteArray const & data) {
+	this->current_file.write(data);
+	if ( this->verify_downloads ) {
+		this->download_scanner.addData(data);
+	}
+	if ( this->download_index.isOpen() ) {
+		this->download_indexer.addData(data);
+		this->download_index.write(this->download_indexer.takeEntries());
 	}
-	downloaded += data.size();
 }
 
 void Task::downloadCompleted() {
-	std::cout << "Saved to " << this->current_file.fileName().toStdString() << std::endl;
+	if ( this->reply->bytesAvailable() ) {
+		downloadWrite();
+	}
 
-	// Remove the read event
-	QObject::disconnect(this->reply, &QNetworkReply::readyRead, nullptr,nullptr);
+	// Remove the reply events, a retry uses a new reply.
+	QObject::disconnect(this->reply, nullptr, this, nullptr);
+	this->reply->deleteLater();
 
-	//Close Temporary File, rename file to original filename
-	this->current_file.close();
+	if ( downloadRetryTail() ) {
+		return;
+	}
 
-	this->reply->deleteLater();
+	downloadFinalise();
 	if ( download_actions.count() ) {
 		// More Downloads
 		QTimer::singleShot(scan_time, this, &Task::actionDownload);
 	} else {
 		emit taskCompleted();
 	}
+}
 
+// Compares the received size with the DIDL size and the Content-Length of the first reply,
+// then requests the missing end with a Range request.
+bool Task::downloadRetryTail() {
+	if ( this->tail_retries == 0 ) {
+		bool ok = false;
+		qint64 content_length = this->reply->header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
+		if ( ok && content_length > 0 ) {
+			qint64 total = this->download_offset + content_length;
+			if ( this->expected_size > 0 && total != this->expected_size ) {
+				std::cout << "Content-Length " << total << " differs from the listed size " << this->expected_size << std::endl;
+			}
+			this->expected_size = qMax(this->expected_size, total);
+		}
+	}
+
+	qint64 position = this->download_offset + this->downloaded;
+	if ( !this->retry_tail || position >= this->expected_size || this->tail_retries >= this->max_tail_retries ) {
+		return false;
+	}
+
+	this->tail_retries++;
+	std::cout << std::endl << "Missing " << QLocale::system().formattedDataSize(this->expected_size - position).toStdString()
+			  << ", requesting from byte " << position << " (" << this->tail_retries << "/" << this->max_tail_retries << ")" << std::endl;
+	downloadRequest(position);
+	return true;
+}
+
+void Task::downloadFinalise() {
+	this->progress.finish(this->progress_counter);
+	std::cout << "Saved to " << this->current_file.fileName().toStdString() << std::endl;
+	if ( this->filter_downloads ) {
+		// A short stream without a PMT is still held by the filter.
+		downloadSave(this->download_filter.finish());
+		if ( this->download_filter.isPassthrough() ) {
+			std::cout << "Filter: no program found, the recording was saved unchanged." << std::endl;
+		} else {
+			std::cout << "Filter: kept " << QLocale::system().formattedDataSize(this->download_filter.outputBytes()).toStdString()
+					  << " of " << QLocale::system().formattedDataSize(this->download_filter.inputBytes()).toStdString() << std::endl;
+		}
+	}
+	// Players expect whole packets, a partial one at the end is removed before the status is recorded.
+	this->current_file.flush();
+	qint64 trimmed = this->current_file.size() % 188;
+	if ( trimmed ) {
+		this->current_file.resize(this->current_file.size() - trimmed);
+	}
+
+	qint64 position = this->download_offset + this->downloaded;
+	bool complete = this->expected_size <= 0 || position >= this->expected_size;
+	if ( !complete ) {
+		std::cout << "Incomplete: " << QLocale::system().formattedDataSize(this->expected_size - position).toStdString()
+				  << " missing at the end";
+		if ( trimmed ) {
+			std::cout << ", " << trimmed << " bytes of a partial packet removed";
+		}
+		std::cout << "." << std::endl;
+	} else if ( trimmed ) {
+		std::cout << "Trimmed: " << trimmed << " bytes of a partial packet removed, the download is complete." << std::endl;
+	}
+
+	if ( this->verify_downloads ) {
+		// A resumed download only checks the new part.
+		this->download_scanner.finish();
+		TSReport report = this->download_scanner.report();
+		if ( complete ) {
+			// The whole stream was received, the partial packet is gone from the file.
+			report.trim();
+		}
+		std::cout << "Check: " << report.toString().toStdString() << std::endl;
+	}
+
+	writeSidecarStatus(this->current_file.fileName(), complete, position, this->expected_size, trimmed);
+	this->download_index.close();
+	writeStats(this->current_file.fileName(), complete);
+
+	QtUPnP::CMetrics & metrics = QtUPnP::CMetrics::instance();
+	qint64 elapsed = qMax(1, this->timer.elapsed());
+	QtUPnP::CMetrics::TLabels labels { { "complete", complete ? "true" : "false" } };
+	metrics.add("fetchtv_downloads_total", labels);
+	if ( this->first_byte_time >= 0 ) {
+		metrics.observe("fetchtv_download_ttfb_ms", {}, this->first_byte_time);
+	}
+	metrics.observe("fetchtv_download_duration_ms", {}, elapsed);
+	metrics.set("fetchtv_download_throughput_bytes_per_second", {}, this->downloaded * 1000.0 / elapsed);
+	metrics.span("download", "download", this->download_start_us, metrics.now() - this->download_start_us,
+				 { { "file", QFileInfo(this->current_file.fileName()).fileName() }, { "bytes", QString::number(this->downloaded) } });
+	writeMetrics();
+
+	//Close Temporary File, rename file to original filename
+	this->current_file.close();
 }
 
+// Only the counters are updated, the progress is printed by its timer.
 void Task::downloadProgress(qint64 bytesReceived, qint64 bytesTotal) {
-	qint64 q = 0;
-	qint64 bytes_left = bytesTotal - bytesReceived;
-	qint64 left = INT64_MAX;
-
-	if ( this->timer.elapsed() >= 1000) {
-		q = bytesReceived / (this->timer.elapsed()/1000);
-		left = bytes_left / (q ? q :1);
-	}
-
-	std::cout << ""
-			  << QLocale::system().formattedDataSize(bytesReceived).toStdString()
-			  << " of "
-			  << QLocale::system().formattedDataSize(bytesTotal).toStdString()
-			  << " at " << QLocale::system().formattedDataSize(q).toStdString()
-			  << " per second. "
-			  << GetRemainingTime(left).toStdString()
-			  << "\t\t\t\r" << std::flush;
+	Q_UNUSED(bytesReceived);
+	if ( bytesTotal > 0 ) {
+		this->progress_counter->setTotal(qMax(this->expected_size, this->request_offset + bytesTotal));
+	}
 }
 
 void Task::downloadError(QNetworkReply::NetworkError code) {
@@ -13,10 +13,18 @@ according to those terms.
 #include <QNetworkReply>
 #include <QCommandLineParser>
 #include <QFile>
+#include <QDir>
 #include <QRegExp>
 
 #include "../qtupnp/controlpoint.hpp"
 #include "../qtupnp/device.hpp"
+#include "../qtupnp/httpserver.hpp"
+#include "../qtupnp/mediaserver.hpp"
+
+#include "tsscanner.hpp"
+#include "tsfilter.hpp"
+#include "tsindex.hpp"
+#include "progress.hpp"
 
 enum ArgumentStringType {
 	AST_NUMBER,
@@ -67,6 +75,9 @@ public slots:
 	void actionList();
 	void actionDownload();
 	void actionPreDownload();
+	void actionServe();
+	void actionVerify();
+	void actionIndex();
 
 	void exitSuccessfully();
 	void exitNotSoSuccessfully();
@@ -79,6 +90,7 @@ public slots:
 	void upnpError(int errorCode, QString const & errorString);
 	void newDevice( QString const & msg);
 	void networkError(QString const & deviceUUID, QNetworkReply::NetworkError errorCode, QString const & errorDesc);
+	void mediaTransferEnded(QtUPnP::CHTTPServer::SMediaStatistics const & statistics);
 
 	private slots:
 
@@ -87,34 +99,75 @@ public slots:
 	BasicInfo CDidlItem2BasicInfo(QString const& serverUUID, const QtUPnP::CDidlItem & didlItem);
 	BasicInfo get(QString const& serverUUID, QString id );
 	QList<BasicInfo> buildList(const QtUPnP::CDevice & device, QString id);
+	bool searchList(const QtUPnP::CDevice & device, QString const & criteria, QList<BasicInfo> & list);
+	QList<BasicInfo> const & cachedList(const QtUPnP::CDevice & device);
+	bool canSearch(QStringList const & properties) const;
+	QString rootID(const QtUPnP::CDevice & device);
 	void list(QString const& serverUUID, QString id , QString outputPrefix = "");
 	void retrievedContentList(QtUPnP::CDevice device);
 	void downloadStart(QtUPnP::CDevice, quint32 id);
+	void downloadRequest(qint64 offset);
+	bool downloadRetryTail();
+	void downloadFinalise();
+	void downloadSave(QByteArray const & data);
 	void nextDownload();
+	void writeSidecar(BasicInfo const & info, QString const & filename);
+	void writeSidecarStatus(QString const & filename, bool complete, qint64 received, qint64 expected, qint64 trimmed);
+	void writeStats(QString const & filename, bool complete);
+	void writeMetrics();
+	BasicInfo readSidecar(QString const & filename);
 
 	QNetworkAccessManager manager;
 	QCoreApplication * app = nullptr;
 	QCommandLineParser parser;
 	QtUPnP::CControlPoint * upnp_cp = nullptr;
+	QtUPnP::CMediaServer * media_server = nullptr;
 
 	QList<QString> download_actions;
 	QList<QtUPnP::CDevice> founded_devices;
 	QList<BasicInfo> cached_info;
+	QStringList search_caps;
 	QString requested_device = "";
 
 	QNetworkReply * reply;
 	QTime timer;
 	QDateTime since_date;
+	QDir media_directory;
 
 	QFile current_file;
+	TSScanner download_scanner;
+	TSFilter download_filter;
+	TSIndexer download_indexer;
+	TSIndexFile download_index;
 	qint32 scan_time = 2000;
 	qint64 downloaded = 0;
+	qint64 download_offset = 0;
+	qint64 request_offset = 0;
+	qint64 expected_size = 0;
+	qint32 tail_retries = 0;
+	qint32 max_tail_retries = 3;
+	QString download_uri;
+	qint64 first_byte_time = -1;
+	qint64 cpu_start_time = 0;
+	QString stats_file;
+	QString metrics_file;
+	QString trace_file;
+	qint64 last_write_time = 0;
+	qint64 download_start_us = 0;
+	qint32 stall_time = 500;
+	Progress progress;
+	QSharedPointer<ProgressCounter> progress_counter;
 
 	bool has_failed = false;
 	bool has_device_ip = false;
+	bool has_cached_info = false;
 	bool output_as_csv = false;
 	bool resume_downloads = false;
 	bool continuing = false;
+	bool verify_downloads = false;
+	bool filter_downloads = false;
+	bool index_downloads = false;
+	bool retry_tail = false;
 	void (Task::*action_method)();
 
 
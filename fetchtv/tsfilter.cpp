@@ -0,0 +1,412 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <cstring>
+
+#include "tsfilter.hpp"
+
+static const int ts_packet_size = 188;
+static const quint8 ts_sync_byte = 0x47;
+
+// Without a PMT after this number of packets, the stream is written unchanged.
+static const qint64 max_packets_without_pmt = 50000;
+
+// MPEG-2 CRC32 (polynomial 0x04c11db7, not reflected). It is 0 over a section including its CRC.
+static quint32 crc32(const char * data, int size) {
+	static quint32 table[256];
+	static bool initialised = false;
+	if ( !initialised ) {
+		for (quint32 i = 0; i < 256; i++) {
+			quint32 crc = i << 24;
+			for (int bit = 0; bit < 8; bit++) {
+				crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+			}
+			table[i] = crc;
+		}
+		initialised = true;
+	}
+
+	quint32 crc = 0xffffffff;
+	for (int i = 0; i < size; i++) {
+		crc = (crc << 8) ^ table[((crc >> 24) ^ static_cast<quint8>(data[i])) & 0xff];
+	}
+	return crc;
+}
+
+static void appendCRC(QByteArray & section) {
+	quint32 crc = crc32(section.constData(), section.size());
+	section.append(static_cast<char>(crc >> 24));
+	section.append(static_cast<char>(crc >> 16));
+	section.append(static_cast<char>(crc >> 8));
+	section.append(static_cast<char>(crc));
+}
+
+enum StreamKind {
+	STREAM_OTHER,
+	STREAM_VIDEO,
+	STREAM_AUDIO
+};
+
+static StreamKind streamKind(int stream_type, const quint8 * descriptors, int length) {
+	switch (stream_type) {
+		case 0x01: // MPEG-1 video
+		case 0x02: // MPEG-2 video
+		case 0x10: // MPEG-4 video
+		case 0x1b: // H.264
+		case 0x24: // H.265
+			return STREAM_VIDEO;
+		case 0x03: // MPEG-1 audio
+		case 0x04: // MPEG-2 audio
+		case 0x0f: // AAC
+		case 0x11: // AAC LATM
+		case 0x81: // AC-3 (ATSC)
+		case 0x87: // E-AC-3 (ATSC)
+			return STREAM_AUDIO;
+		case 0x06: // DVB private data, the descriptors tell if it is audio
+			for (int i = 0; i + 2 <= length; i += 2 + descriptors[i + 1]) {
+				int tag = descriptors[i];
+				if ( tag == 0x6a || tag == 0x7a || tag == 0x7b || tag == 0x7c ) {
+					return STREAM_AUDIO;
+				}
+			}
+			return STREAM_OTHER;
+		default:
+			return STREAM_OTHER;
+	}
+}
+
+TSFilter::TSFilter() {
+	reset();
+}
+
+void TSFilter::reset() {
+	this->pid_actions.fill(PID_DROP, 8192);
+	this->pid_actions[0] = PID_SECTION;
+	this->sections.clear();
+	this->pending.clear();
+	this->held_input.clear();
+	this->held_output.clear();
+	this->current_program = -1;
+	this->pmt_pid = -1;
+	this->pat_counter = 0;
+	this->pmt_counter = 0;
+	this->packets = 0;
+	this->input_bytes = 0;
+	this->output_bytes = 0;
+	this->has_pmt = false;
+	this->passthrough = false;
+	this->in_sync = true;
+}
+
+// Writes a section in as many packets as needed, with the filter continuity counter.
+void TSFilter::writeSection(quint16 pid, quint8 & counter, QByteArray section, QByteArray & output) {
+	section.prepend('\0'); // pointer_field
+	for (int pos = 0; pos < section.size(); pos += ts_packet_size - 4) {
+		char packet[ts_packet_size];
+		memset(packet, 0xff, ts_packet_size);
+		packet[0] = static_cast<char>(ts_sync_byte);
+		packet[1] = static_cast<char>((pos == 0 ? 0x40 : 0x00) | (pid >> 8));
+		packet[2] = static_cast<char>(pid & 0xff);
+		packet[3] = static_cast<char>(0x10 | (counter & 0x0f));
+		memcpy(packet + 4, section.constData() + pos, qMin(section.size() - pos, ts_packet_size - 4));
+		output.append(packet, ts_packet_size);
+		counter = (counter + 1) & 0x0f;
+	}
+}
+
+void TSFilter::processPAT(QByteArray const & section, QByteArray & output) {
+	const quint8 * s = reinterpret_cast<const quint8 *>(section.constData());
+	if ( s[0] != 0x00 ) {
+		return;
+	}
+
+	int program = -1;
+	int pid = -1;
+	for (int i = 8; i + 4 <= section.size() - 4; i += 4) {
+		int number = (s[i] << 8) | s[i + 1];
+		if ( number != 0 && (this->selected_program == 0 || number == this->selected_program) ) {
+			program = number;
+			pid = ((s[i + 2] & 0x1f) << 8) | s[i + 3];
+			break;
+		}
+	}
+	if ( program < 0 ) {
+		return;
+	}
+
+	if ( pid != this->pmt_pid || program != this->current_program ) {
+		if ( this->pmt_pid >= 0 ) {
+			this->pid_actions[this->pmt_pid] = PID_DROP;
+		}
+		this->pmt_pid = pid;
+		this->current_program = program;
+		this->pid_actions[pid] = PID_SECTION;
+	}
+
+	QByteArray pat(section.constData(), 8);
+	pat[1] = static_cast<char>(0xb0);
+	pat[2] = 13;
+	pat[6] = 0;
+	pat[7] = 0;
+	pat.append(static_cast<char>(program >> 8));
+	pat.append(static_cast<char>(program & 0xff));
+	pat.append(static_cast<char>(0xe0 | (pid >> 8)));
+	pat.append(static_cast<char>(pid & 0xff));
+	appendCRC(pat);
+	writeSection(0, this->pat_counter, pat, output);
+}
+
+void TSFilter::processPMT(QByteArray const & section, QByteArray & output) {
+	const quint8 * s = reinterpret_cast<const quint8 *>(section.constData());
+	int end = section.size() - 4;
+	if ( s[0] != 0x02 || ((s[3] << 8) | s[4]) != this->current_program ) {
+		return;
+	}
+
+	int pcr_pid = ((s[8] & 0x1f) << 8) | s[9];
+	int program_info_length = ((s[10] & 0x0f) << 8) | s[11];
+	if ( 12 + program_info_length > end ) {
+		return;
+	}
+
+	QByteArray streams;
+	int video_pid = -1;
+	int audio_pid = -1;
+	for (int pos = 12 + program_info_length; pos + 5 <= end; ) {
+		int es_pid = ((s[pos + 1] & 0x1f) << 8) | s[pos + 2];
+		int es_info_length = ((s[pos + 3] & 0x0f) << 8) | s[pos + 4];
+		if ( pos + 5 + es_info_length > end ) {
+			break;
+		}
+		StreamKind kind = streamKind(s[pos], s + pos + 5, es_info_length);
+		if ( (kind == STREAM_VIDEO && video_pid < 0) || (kind == STREAM_AUDIO && audio_pid < 0) ) {
+			(kind == STREAM_VIDEO ? video_pid : audio_pid) = es_pid;
+			streams.append(section.constData() + pos, 5 + es_info_length);
+		}
+		pos += 5 + es_info_length;
+	}
+
+	for (int pid = 1; pid < this->pid_actions.size(); pid++) {
+		if ( this->pid_actions[pid] == PID_KEEP ) {
+			this->pid_actions[pid] = PID_DROP;
+		}
+	}
+	for (int pid : { pcr_pid, video_pid, audio_pid }) {
+		if ( pid > 0 && pid < 0x1fff && pid != this->pmt_pid ) {
+			this->pid_actions[pid] = PID_KEEP;
+		}
+	}
+	this->has_pmt = true;
+
+	QByteArray pmt(section.constData(), 12 + program_info_length);
+	pmt.append(streams);
+	int length = pmt.size() - 3 + 4;
+	pmt[1] = static_cast<char>((s[1] & 0xf0) | ((length >> 8) & 0x0f));
+	pmt[2] = static_cast<char>(length & 0xff);
+	pmt[6] = 0;
+	pmt[7] = 0;
+	appendCRC(pmt);
+	writeSection(static_cast<quint16>(this->pmt_pid), this->pmt_counter, pmt, output);
+}
+
+void TSFilter::completeSection(quint16 pid, QByteArray & section, QByteArray & output) {
+	if ( section.size() < 3 ) {
+		return;
+	}
+	if ( static_cast<quint8>(section.at(0)) == 0xff ) {
+		// Stuffing
+		section.clear();
+		return;
+	}
+
+	int length = 3 + (((section.at(1) & 0x0f) << 8) | static_cast<quint8>(section.at(2)));
+	if ( section.size() < length ) {
+		return;
+	}
+
+	QByteArray complete = section.left(length);
+	section.clear();
+	if ( length < 16 || crc32(complete.constData(), complete.size()) != 0 ) {
+		return;
+	}
+
+	if ( pid == 0 ) {
+		processPAT(complete, output);
+	} else if ( pid == this->pmt_pid ) {
+		processPMT(complete, output);
+	}
+}
+
+// Sections are assembled from the packets of their PID, the original packets are not written.
+void TSFilter::collectSection(const quint8 * packet, quint16 pid, QByteArray & output) {
+	int adaptation_control = (packet[3] >> 4) & 0x3;
+	if ( !(adaptation_control & 0x1) ) {
+		return;
+	}
+	int payload = 4 + ((adaptation_control & 0x2) ? 1 + packet[4] : 0);
+	if ( payload >= ts_packet_size ) {
+		return;
+	}
+
+	const char * bytes = reinterpret_cast<const char *>(packet);
+	QByteArray section = this->sections.take(pid);
+	if ( packet[1] & 0x40 ) {
+		int start = payload + 1 + packet[payload];
+		if ( start > ts_packet_size ) {
+			return;
+		}
+		if ( !section.isEmpty() ) {
+			section.append(bytes + payload + 1, start - payload - 1);
+			completeSection(pid, section, output);
+		}
+		section = QByteArray(bytes + start, ts_packet_size - start);
+	} else if ( !section.isEmpty() ) {
+		section.append(bytes + payload, ts_packet_size - payload);
+	}
+	completeSection(pid, section, output);
+	if ( !section.isEmpty() ) {
+		this->sections.insert(pid, section);
+	}
+}
+
+void TSFilter::filterPacket(const quint8 * packet, QByteArray & output) {
+	quint16 pid = static_cast<quint16>(((packet[1] & 0x1f) << 8) | packet[2]);
+	switch (this->pid_actions[pid]) {
+		case PID_KEEP:
+			output.append(reinterpret_cast<const char *>(packet), ts_packet_size);
+			break;
+		case PID_SECTION:
+			collectSection(packet, pid, output);
+			break;
+		default:
+			break;
+	}
+}
+
+QByteArray TSFilter::filter(QByteArray const & data) {
+	this->input_bytes += data.size();
+	if ( this->passthrough ) {
+		this->output_bytes += data.size();
+		return data;
+	}
+	if ( !this->has_pmt ) {
+		this->held_input.append(data);
+	}
+
+	QByteArray output;
+	output.reserve(data.size() + ts_packet_size);
+	QByteArray joined;
+	const char * bytes = data.constData();
+	qint64 size = data.size();
+	qint64 pos = 0;
+
+	if ( !this->pending.isEmpty() && this->in_sync ) {
+		// Completes the partial packet of the previous call.
+		pos = qMin(size, static_cast<qint64>(ts_packet_size - this->pending.size()));
+		this->pending.append(bytes, static_cast<int>(pos));
+		if ( this->pending.size() < ts_packet_size ) {
+			return output;
+		}
+		if ( static_cast<quint8>(this->pending.at(0)) == ts_sync_byte ) {
+			filterPacket(reinterpret_cast<const quint8 *>(this->pending.constData()), output);
+			this->packets++;
+		} else {
+			// Lost sync. The search goes on after the first byte of the pending packet.
+			this->in_sync = false;
+			joined = this->pending.mid(1) + data.mid(static_cast<int>(pos));
+		}
+		this->pending.clear();
+	} else if ( !this->pending.isEmpty() ) {
+		// A sync byte candidate waits for the sync byte that confirms it, the copy is limited to the resynchronisation.
+		joined = this->pending + data;
+		this->pending.clear();
+	}
+	if ( !joined.isNull() ) {
+		bytes = joined.constData();
+		size = joined.size();
+		pos = 0;
+	}
+
+	// Consecutive kept packets are copied at once.
+	qint64 run = -1;
+	while ( size - pos >= ts_packet_size ) {
+		const quint8 * packet = reinterpret_cast<const quint8 *>(bytes + pos);
+		if ( packet[0] == ts_sync_byte && !this->in_sync ) {
+			// After a lost sync, a sync byte is accepted only if the next packet starts with one too.
+			if ( size - pos == ts_packet_size ) {
+				break;
+			}
+			this->in_sync = static_cast<quint8>(bytes[pos + ts_packet_size]) == ts_sync_byte;
+		}
+		if ( packet[0] != ts_sync_byte || !this->in_sync ) {
+			if ( run >= 0 ) {
+				output.append(bytes + run, static_cast<int>(pos - run));
+				run = -1;
+			}
+			this->in_sync = false;
+			const void * next = memchr(bytes + pos + 1, ts_sync_byte, static_cast<size_t>(size - pos - 1));
+			pos = next ? static_cast<const char *>(next) - bytes : size;
+			continue;
+		}
+
+		this->packets++;
+		quint16 pid = static_cast<quint16>(((packet[1] & 0x1f) << 8) | packet[2]);
+		if ( this->pid_actions[pid] == PID_KEEP ) {
+			if ( run < 0 ) {
+				run = pos;
+			}
+		} else {
+			if ( run >= 0 ) {
+				output.append(bytes + run, static_cast<int>(pos - run));
+				run = -1;
+			}
+			filterPacket(packet, output);
+		}
+		pos += ts_packet_size;
+	}
+	if ( run >= 0 ) {
+		output.append(bytes + run, static_cast<int>(pos - run));
+	}
+	this->pending = QByteArray(bytes + pos, static_cast<int>(size - pos));
+
+	if ( !this->has_pmt ) {
+		if ( this->packets > max_packets_without_pmt ) {
+			// Not a stream the filter understands, everything received is written unchanged.
+			this->passthrough = true;
+			output = this->held_input;
+			this->held_input.clear();
+			this->held_output.clear();
+			this->pending.clear();
+		} else {
+			// The rewritten PAT waits for the PMT.
+			this->held_output.append(output);
+			output.clear();
+		}
+	} else if ( !this->held_input.isEmpty() ) {
+		output.prepend(this->held_output);
+		this->held_input.clear();
+		this->held_output.clear();
+	}
+
+	this->output_bytes += output.size();
+	return output;
+}
+
+// A partial packet at the end is dropped. Without a PMT, the held input is returned unchanged.
+QByteArray TSFilter::finish() {
+	QByteArray output;
+	if ( !this->has_pmt && !this->passthrough && !this->held_input.isEmpty() ) {
+		this->passthrough = true;
+		output = this->held_input;
+		this->output_bytes += output.size();
+	}
+	this->held_input.clear();
+	this->held_output.clear();
+	this->pending.clear();
+	this->sections.clear();
+	return output;
+}
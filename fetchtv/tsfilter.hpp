@@ -0,0 +1,68 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#ifndef TSFILTER_HPP
+#define TSFILTER_HPP
+
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+
+/*
+ * Streaming MPEG-TS filter keeping one program: its video, its first audio track, its PCR
+ * and the PAT/PMT. The PAT and PMT are rewritten to only list what is kept, with their own
+ * continuity counters. Other PIDs (extra audio, teletext, subtitles, EIT, SDT, null packets)
+ * are dropped. Kept packets are copied unchanged, so their continuity counters stay valid.
+ * Until a PMT is found the input is held back, so a stream the filter does not understand
+ * is written unchanged from its first byte.
+ */
+class TSFilter {
+public:
+	TSFilter();
+
+	void reset();
+	void setProgram(int program_number) { this->selected_program = program_number; }
+	QByteArray filter(QByteArray const & data);
+	QByteArray finish();
+
+	qint64 inputBytes() const { return this->input_bytes; }
+	qint64 outputBytes() const { return this->output_bytes; }
+	bool isPassthrough() const { return this->passthrough; }
+
+private:
+	enum PidAction {
+		PID_DROP,
+		PID_KEEP,
+		PID_SECTION
+	};
+
+	void filterPacket(const quint8 * packet, QByteArray & output);
+	void collectSection(const quint8 * packet, quint16 pid, QByteArray & output);
+	void completeSection(quint16 pid, QByteArray & section, QByteArray & output);
+	void processPAT(QByteArray const & section, QByteArray & output);
+	void processPMT(QByteArray const & section, QByteArray & output);
+	void writeSection(quint16 pid, quint8 & counter, QByteArray section, QByteArray & output);
+
+	QVector<quint8> pid_actions;
+	QHash<quint16, QByteArray> sections;
+	QByteArray pending;
+	QByteArray held_input;
+	QByteArray held_output;
+	int selected_program = 0;
+	int current_program = -1;
+	int pmt_pid = -1;
+	quint8 pat_counter = 0;
+	quint8 pmt_counter = 0;
+	qint64 packets = 0;
+	qint64 input_bytes = 0;
+	qint64 output_bytes = 0;
+	bool has_pmt = false;
+	bool passthrough = false;
+	bool in_sync = true; // False after a lost sync byte, until a sync byte is confirmed one packet later.
+};
+
+#endif // TSFILTER_HPP
@@ -0,0 +1,335 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QtEndian>
+#include <functional>
+#include <cstring>
+
+#include "tsindex.hpp"
+
+static const int ts_packet_size = 188;
+static const quint8 ts_sync_byte = 0x47;
+static const qint64 pcr_wrap = (Q_INT64_C(1) << 33) * 300;
+static const char index_magic[8] = { 'F', 'T', 'V', 'I', 'D', 'X', '1', '\0' };
+static const quint32 index_entry_size = 16;
+
+// The PIDs are read from the start of the recording before splitting it between threads.
+static const qint64 probe_size = 4 * 1024 * 1024;
+static const qint64 min_slice_size = 16 * 1024 * 1024;
+static const qint64 read_size = 1024 * 1024;
+
+TSIndexer::TSIndexer() {
+	reset();
+}
+
+void TSIndexer::reset(qint64 base_offset) {
+	this->entries.clear();
+	this->pending.clear();
+	this->offset = base_offset;
+	this->last_pcr = -1;
+	this->elapsed = 0;
+	this->last_entry_time = -1;
+	this->pmt_pid = -1;
+	this->video_pid = -1;
+	this->pcr_pid = -1;
+}
+
+QVector<TSIndexEntry> TSIndexer::takeEntries() {
+	QVector<TSIndexEntry> taken;
+	taken.swap(this->entries);
+	return taken;
+}
+
+// A random access point is kept one interval after the previous point, a PCR time two intervals after.
+bool TSIndexer::accept(TSIndexEntry const & entry, qint64 last_time, qint64 interval) {
+	if ( last_time < 0 ) {
+		return true;
+	}
+	qint64 gap = entry.time - last_time;
+	return entry.random_access ? gap >= interval : gap >= 2 * interval;
+}
+
+// PAT and PMT of the first program, when they start in the packet.
+void TSIndexer::parseSection(const quint8 * packet, int pid, int payload) {
+	if ( payload >= ts_packet_size ) {
+		return;
+	}
+	int start = payload + 1 + packet[payload];
+	if ( start + 12 > ts_packet_size ) {
+		return;
+	}
+	int table_id = packet[start];
+	int end = qMin(start + 3 + (((packet[start + 1] & 0x0f) << 8) | packet[start + 2]) - 4, ts_packet_size);
+
+	if ( pid == 0 && table_id == 0x00 ) {
+		for (int i = start + 8; i + 4 <= end; i += 4) {
+			if ( ((packet[i] << 8) | packet[i + 1]) != 0 ) {
+				this->pmt_pid = ((packet[i + 2] & 0x1f) << 8) | packet[i + 3];
+				break;
+			}
+		}
+	} else if ( pid == this->pmt_pid && table_id == 0x02 ) {
+		this->pcr_pid = ((packet[start + 8] & 0x1f) << 8) | packet[start + 9];
+		int pos = start + 12 + (((packet[start + 10] & 0x0f) << 8) | packet[start + 11]);
+		for (; pos + 5 <= end; pos += 5 + (((packet[pos + 3] & 0x0f) << 8) | packet[pos + 4])) {
+			int stream_type = packet[pos];
+			if ( stream_type == 0x01 || stream_type == 0x02 || stream_type == 0x10 || stream_type == 0x1b || stream_type == 0x24 ) {
+				this->video_pid = ((packet[pos + 1] & 0x1f) << 8) | packet[pos + 2];
+				break;
+			}
+		}
+	}
+}
+
+void TSIndexer::parsePacket(const quint8 * packet, qint64 packet_offset) {
+	int pid = ((packet[1] & 0x1f) << 8) | packet[2];
+	bool unit_start = packet[1] & 0x40;
+	int adaptation_control = (packet[3] >> 4) & 0x3;
+	int adaptation_length = (adaptation_control & 0x2) ? packet[4] : 0;
+	int flags = adaptation_length > 0 ? packet[5] : 0;
+
+	if ( unit_start && (adaptation_control & 0x1) && (pid == 0 || pid == this->pmt_pid) ) {
+		parseSection(packet, pid, 4 + ((adaptation_control & 0x2) ? 1 + adaptation_length : 0));
+		return;
+	}
+
+	bool has_pcr = pid == this->pcr_pid && adaptation_length >= 7 && (flags & 0x10);
+	if ( has_pcr ) {
+		qint64 base = (static_cast<qint64>(packet[6]) << 25) | (packet[7] << 17) | (packet[8] << 9)
+			| (packet[9] << 1) | (packet[10] >> 7);
+		qint64 pcr = base * 300 + (((packet[10] & 0x1) << 8) | packet[11]);
+		if ( this->last_pcr >= 0 && !(flags & 0x80) ) {
+			qint64 delta = (pcr - this->last_pcr + pcr_wrap) % pcr_wrap;
+			if ( delta < pcr_wrap / 2 ) {
+				this->elapsed += delta;
+			}
+		}
+		this->last_pcr = pcr;
+	}
+	if ( this->last_pcr < 0 && !this->keep_all ) {
+		return;
+	}
+
+	TSIndexEntry entry;
+	entry.random_access = pid == this->video_pid && unit_start && (flags & 0x40);
+	if ( !entry.random_access && !has_pcr ) {
+		return;
+	}
+	entry.offset = packet_offset;
+	entry.pcr = this->last_pcr;
+	entry.time = this->elapsed;
+	if ( this->keep_all || accept(entry, this->last_entry_time, this->interval) ) {
+		this->entries.append(entry);
+		this->last_entry_time = entry.time;
+	}
+}
+
+void TSIndexer::addData(const char * data, qint64 size) {
+	qint64 pos = 0;
+
+	// Completes the partial packet of the previous call.
+	if ( !this->pending.isEmpty() ) {
+		pos = qMin(size, static_cast<qint64>(ts_packet_size - this->pending.size()));
+		this->pending.append(data, static_cast<int>(pos));
+		if ( this->pending.size() < ts_packet_size ) {
+			return;
+		}
+		const quint8 * packet = reinterpret_cast<const quint8 *>(this->pending.constData());
+		if ( packet[0] == ts_sync_byte ) {
+			parsePacket(packet, this->offset);
+		}
+		this->offset += ts_packet_size;
+		this->pending.clear();
+	}
+
+	while ( size - pos >= ts_packet_size ) {
+		const quint8 * packet = reinterpret_cast<const quint8 *>(data + pos);
+		if ( packet[0] != ts_sync_byte ) {
+			const void * next = memchr(data + pos + 1, ts_sync_byte, static_cast<size_t>(size - pos - 1));
+			qint64 next_pos = next ? static_cast<const char *>(next) - data : size;
+			this->offset += next_pos - pos;
+			pos = next_pos;
+			continue;
+		}
+		parsePacket(packet, this->offset);
+		this->offset += ts_packet_size;
+		pos += ts_packet_size;
+	}
+	this->pending = QByteArray(data + pos, static_cast<int>(size - pos));
+}
+
+bool TSIndexFile::open(QString const & filename, qint64 interval_ms) {
+	close();
+	this->file.setFileName(filename);
+	if ( !this->file.open(QIODevice::WriteOnly | QIODevice::Truncate) ) {
+		return false;
+	}
+
+	char header[16];
+	memcpy(header, index_magic, 8);
+	qToLittleEndian<quint32>(index_entry_size, reinterpret_cast<uchar *>(header + 8));
+	qToLittleEndian<quint32>(static_cast<quint32>(interval_ms), reinterpret_cast<uchar *>(header + 12));
+	this->file.write(header, sizeof(header));
+	return true;
+}
+
+void TSIndexFile::write(QVector<TSIndexEntry> const & entries) {
+	if ( entries.isEmpty() || !this->file.isOpen() ) {
+		return;
+	}
+
+	QByteArray buffer(entries.size() * index_entry_size, Qt::Uninitialized);
+	uchar * out = reinterpret_cast<uchar *>(buffer.data());
+	for (TSIndexEntry const & entry : entries) {
+		qToLittleEndian<quint64>(static_cast<quint64>(entry.offset), out);
+		qToLittleEndian<quint32>(static_cast<quint32>(entry.time / 27000), out + 8);
+		qToLittleEndian<quint32>(entry.random_access ? 1 : 0, out + 12);
+		out += index_entry_size;
+	}
+	this->file.write(buffer);
+}
+
+void TSIndexFile::close() {
+	if ( this->file.isOpen() ) {
+		this->file.close();
+	}
+}
+
+class TSIndexTask : public QRunnable {
+public:
+	TSIndexTask(std::function<void()> const & work, QSemaphore * done) : work(work), done(done) {}
+	void run() override {
+		this->work();
+		this->done->release();
+	}
+
+private:
+	std::function<void()> work;
+	QSemaphore * done;
+};
+
+// First sync byte at or after from, confirmed by the next two packets.
+static qint64 syncAfter(const uchar * data, qint64 size, qint64 from) {
+	for (qint64 pos = from; pos < size; ++pos) {
+		const void * next = memchr(data + pos, ts_sync_byte, static_cast<size_t>(size - pos));
+		if ( !next ) {
+			break;
+		}
+		pos = static_cast<const uchar *>(next) - data;
+		if ( (pos + ts_packet_size >= size || data[pos + ts_packet_size] == ts_sync_byte)
+			&& (pos + 2 * ts_packet_size >= size || data[pos + 2 * ts_packet_size] == ts_sync_byte) ) {
+			return pos;
+		}
+	}
+	return size;
+}
+
+// Builds the index of an existing recording. The memory mapped file is split in slices scanned
+// by the global thread pool, then the slices are joined on the PCR values. The slices return all
+// the candidates and the points are only selected in the join, as a sequential scan does.
+// Returns the number of entries, or -1 on error.
+qint64 TSIndexFile::build(QString const & recording, qint64 interval_ms, int threads) {
+	QFile input(recording);
+	if ( !input.open(QIODevice::ReadOnly) ) {
+		return -1;
+	}
+
+	qint64 size = input.size();
+	const uchar * data = size > 0 ? input.map(0, size) : nullptr;
+	QVector<QVector<TSIndexEntry>> slices;
+
+	if ( data ) {
+		TSIndexer probe;
+		probe.addData(reinterpret_cast<const char *>(data), qMin(size, probe_size));
+
+		int count = threads > 0 ? threads : QThread::idealThreadCount();
+		count = static_cast<int>(qBound<qint64>(1, size / min_slice_size, qMax(1, count)));
+
+		QVector<qint64> starts(count + 1);
+		starts[0] = syncAfter(data, size, 0);
+		for (int k = 1; k < count; ++k) {
+			starts[k] = qMax(starts[k - 1], syncAfter(data, size, k * (size / count)));
+		}
+		starts[count] = size;
+
+		slices.resize(count);
+		std::function<void(int)> scanSlice = [&](int k) {
+			TSIndexer indexer;
+			indexer.reset(starts[k]);
+			indexer.setInterval(interval_ms);
+			indexer.setPids(probe.videoPid(), probe.pcrPid());
+			indexer.setKeepAll(true);
+			indexer.addData(reinterpret_cast<const char *>(data + starts[k]), starts[k + 1] - starts[k]);
+			slices[k] = indexer.takeEntries();
+		};
+
+		QSemaphore done;
+		int started = 0;
+		for (int k = 1; k < count; ++k) {
+			TSIndexTask * task = new TSIndexTask([&scanSlice, k]() { scanSlice(k); }, &done);
+			if ( QThreadPool::globalInstance()->tryStart(task) ) {
+				started++;
+			} else {
+				delete task;
+				scanSlice(k);
+			}
+		}
+		scanSlice(0);
+		done.acquire(started);
+		input.unmap(const_cast<uchar *>(data));
+	} else {
+		TSIndexer indexer;
+		indexer.setKeepAll(true);
+		QByteArray buffer(read_size, Qt::Uninitialized);
+		qint64 read;
+		while ( (read = input.read(buffer.data(), buffer.size())) > 0 ) {
+			indexer.addData(buffer.constData(), read);
+		}
+		slices.append(indexer.takeEntries());
+	}
+
+	// The time of each slice started at 0, it is computed again from the PCR values.
+	// The points before the first PCR of a slice take the last PCR of the previous slices.
+	QVector<TSIndexEntry> entries;
+	qint64 time = 0;
+	qint64 last_pcr = -1;
+	qint64 last_time = -1;
+	qint64 interval = interval_ms * 27000;
+	for (QVector<TSIndexEntry> const & slice : slices) {
+		for (TSIndexEntry entry : slice) {
+			if ( entry.pcr < 0 ) {
+				if ( last_pcr < 0 ) {
+					continue;
+				}
+				entry.pcr = last_pcr;
+			} else if ( last_pcr >= 0 ) {
+				qint64 delta = (entry.pcr - last_pcr + pcr_wrap) % pcr_wrap;
+				if ( delta < pcr_wrap / 2 ) {
+					time += delta;
+				}
+			}
+			last_pcr = entry.pcr;
+			entry.time = time;
+			if ( TSIndexer::accept(entry, last_time, interval) ) {
+				entries.append(entry);
+				last_time = time;
+			}
+		}
+	}
+
+	TSIndexFile index;
+	if ( !index.open(indexName(recording), interval_ms) ) {
+		return -1;
+	}
+	index.write(entries);
+	index.close();
+	return entries.size();
+}
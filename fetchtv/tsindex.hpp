@@ -0,0 +1,86 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#ifndef TSINDEX_HPP
+#define TSINDEX_HPP
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QFile>
+
+class TSIndexEntry {
+public:
+	qint64 offset = 0;          // Offset of the packet in the recording
+	qint64 pcr = -1;            // Last PCR seen before the packet (27 MHz)
+	qint64 time = 0;            // 27 MHz ticks since the first PCR
+	bool random_access = false; // Video packet with the random access indicator
+};
+
+/*
+ * Finds seek points in a 188 bytes packets transport stream: the video packets flagged
+ * as random access points, or a PCR time when no random access point came for two intervals.
+ * Points closer than the interval are skipped, so the memory use only depends on the duration.
+ * With setKeepAll, every candidate is kept, including the random access points before the first
+ * PCR (pcr is -1), for a caller that applies accept itself.
+ */
+class TSIndexer {
+public:
+	TSIndexer();
+
+	void reset(qint64 base_offset = 0);
+	void setInterval(qint64 milliseconds) { this->interval = milliseconds * 27000; }
+	void setPids(int video, int pcr) { this->video_pid = video; this->pcr_pid = pcr; }
+	void setKeepAll(bool keep) { this->keep_all = keep; }
+	int videoPid() const { return this->video_pid; }
+	int pcrPid() const { return this->pcr_pid; }
+
+	void addData(const char * data, qint64 size);
+	void addData(QByteArray const & data) { addData(data.constData(), data.size()); }
+	QVector<TSIndexEntry> takeEntries();
+
+	static bool accept(TSIndexEntry const & entry, qint64 last_time, qint64 interval);
+
+private:
+	void parsePacket(const quint8 * packet, qint64 packet_offset);
+	void parseSection(const quint8 * packet, int pid, int payload);
+
+	QVector<TSIndexEntry> entries;
+	QByteArray pending;
+	qint64 offset = 0;
+	qint64 interval = 27000000;
+	qint64 last_pcr = -1;
+	qint64 elapsed = 0;
+	qint64 last_entry_time = -1;
+	int pmt_pid = -1;
+	int video_pid = -1;
+	int pcr_pid = -1;
+	bool keep_all = false;
+};
+
+/*
+ * Index sidecar (<recording>.idx), made to be memory mapped. All values are little endian.
+ *   header: "FTVIDX1\0", quint32 entry size (16), quint32 interval in milliseconds
+ *   entries: quint64 byte offset, quint32 time in milliseconds, quint32 flags (1: random access point)
+ */
+class TSIndexFile {
+public:
+	~TSIndexFile() { close(); }
+
+	bool open(QString const & filename, qint64 interval_ms);
+	bool isOpen() const { return this->file.isOpen(); }
+	void write(QVector<TSIndexEntry> const & entries);
+	void close();
+
+	static QString indexName(QString const & recording) { return recording + ".idx"; }
+	static qint64 build(QString const & recording, qint64 interval_ms = 1000, int threads = 0);
+
+private:
+	QFile file;
+};
+
+#endif // TSINDEX_HPP
@@ -0,0 +1,376 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#include <QFile>
+#include <QTime>
+#include <QStringList>
+#include <cstring>
+
+#include "tsscanner.hpp"
+
+static const int ts_packet_size = 188;
+static const quint8 ts_sync_byte = 0x47;
+static const quint16 ts_null_pid = 0x1fff;
+static const int detect_packets = 5;
+static const qint64 detect_size = detect_packets * 192 + 192;
+static const qint64 pcr_wrap = (Q_INT64_C(1) << 33) * 300;
+static const qint64 read_size = 1024 * 1024;
+
+QString TSReport::toString() const {
+	if ( !this->error.isEmpty() ) {
+		return QString("BAD %1").arg(this->error);
+	}
+
+	QString text = QString("%1 %2 packets of %3 bytes, %4 PIDs, %5")
+		.arg(isValid() ? "OK" : "BAD")
+		.arg(this->packets)
+		.arg(this->packet_size)
+		.arg(this->pids)
+		.arg(QTime(0, 0).addSecs(static_cast<int>(duration())).toString("hh:mm:ss"));
+
+	QStringList problems;
+	if ( this->sync_errors ) {
+		problems << QString("%1 sync losses (%2 bytes skipped)").arg(this->sync_errors).arg(this->skipped_bytes);
+	}
+	if ( this->continuity_errors ) {
+		problems << QString("%1 continuity errors").arg(this->continuity_errors);
+	}
+	if ( this->transport_errors ) {
+		problems << QString("%1 transport errors").arg(this->transport_errors);
+	}
+	if ( this->pcr_errors ) {
+		problems << QString("%1 PCR errors").arg(this->pcr_errors);
+	}
+	if ( !this->has_pat ) {
+		problems << "no PAT";
+	}
+	if ( !this->has_pmt ) {
+		problems << "no PMT";
+	}
+	if ( this->trailing_bytes ) {
+		problems << QString("truncated, %1 trailing bytes").arg(this->trailing_bytes);
+	}
+	if ( this->trimmed_bytes ) {
+		problems << QString("%1 bytes of a partial packet trimmed").arg(this->trimmed_bytes);
+	}
+	if ( this->first_error_offset >= 0 ) {
+		problems << QString("first error at byte %1").arg(this->first_error_offset);
+	}
+
+	if ( !problems.isEmpty() ) {
+		text += ": " + problems.join(", ");
+	}
+	return text;
+}
+
+void TSReport::trim() {
+	if ( !this->trailing_bytes ) {
+		return;
+	}
+	this->trimmed_bytes = this->trailing_bytes;
+	this->trailing_bytes = 0;
+	// Without other errors, the first error was the partial packet.
+	if ( this->sync_errors == 0 && this->continuity_errors == 0 && this->transport_errors == 0 && this->pcr_errors == 0 ) {
+		this->first_error_offset = -1;
+	}
+}
+
+TSScanner::TSScanner() {
+	reset();
+}
+
+void TSScanner::reset() {
+	this->ts_report = TSReport();
+	this->pending.clear();
+	this->continuity.fill(-1, 8192);
+	this->last_pcr.clear();
+	this->pmt_pids.clear();
+	this->offset = 0;
+	this->packet_offset = 0;
+	this->pcr_pid = -1;
+	this->in_sync = true;
+}
+
+void TSScanner::markError() {
+	if ( this->ts_report.first_error_offset < 0 ) {
+		this->ts_report.first_error_offset = this->packet_offset;
+	}
+}
+
+// Returns the offset of the first packet, or -1 if the data doesn't look like a transport stream.
+qint64 TSScanner::detectPacketSize(const quint8 * data, qint64 size) {
+	static const int sizes[] = { 188, 192 };
+	for (qint64 s = 0; s < qMin<qint64>(size, 2 * 192); ++s) {
+		if ( data[s] != ts_sync_byte ) {
+			continue;
+		}
+		for (int packet_size : sizes) {
+			int prefix = packet_size - ts_packet_size;
+			if ( s < prefix ) {
+				continue;
+			}
+			int k = 0;
+			while ( k < detect_packets && s + k * packet_size < size && data[s + k * packet_size] == ts_sync_byte ) {
+				++k;
+			}
+			if ( k == detect_packets || (k > 0 && s + k * packet_size >= size) ) {
+				this->ts_report.packet_size = packet_size;
+				return s - prefix;
+			}
+		}
+	}
+	return -1;
+}
+
+// Checks the whole packets of data. Returns the number of bytes used, the rest must be given again.
+qint64 TSScanner::scan(const quint8 * data, qint64 size, bool at_end) {
+	const int packet_size = this->ts_report.packet_size;
+	const int prefix = packet_size - ts_packet_size;
+	const quint8 * end = data + size;
+	qint64 pos = 0;
+
+	while ( size - pos >= packet_size ) {
+		const quint8 * packet = data + pos + prefix;
+		this->packet_offset = this->offset + pos;
+		if ( packet[0] == ts_sync_byte ) {
+			this->in_sync = true;
+			parsePacket(packet);
+			pos += packet_size;
+			continue;
+		}
+
+		if ( this->in_sync ) {
+			this->in_sync = false;
+			this->ts_report.sync_errors++;
+			markError();
+		}
+
+		// Next sync byte confirmed by the sync byte of the following packet.
+		const quint8 * candidate = packet + 1;
+		qint64 next = -1;
+		while ( candidate < end ) {
+			candidate = static_cast<const quint8 *>(memchr(candidate, ts_sync_byte, end - candidate));
+			if ( !candidate ) {
+				break;
+			}
+			if ( candidate + packet_size < end ) {
+				if ( candidate[packet_size] == ts_sync_byte ) {
+					next = candidate - data - prefix;
+					break;
+				}
+			} else {
+				// Not enough data to confirm it.
+				next = candidate - data - prefix;
+				if ( !at_end ) {
+					this->ts_report.skipped_bytes += next - pos;
+					this->offset += next;
+					return next;
+				}
+				break;
+			}
+			++candidate;
+		}
+
+		if ( next < 0 ) {
+			next = qMax(pos, size - prefix);
+		}
+		this->ts_report.skipped_bytes += next - pos;
+		pos = next;
+	}
+
+	this->offset += pos;
+	return pos;
+}
+
+void TSScanner::parsePacket(const quint8 * packet) {
+	this->ts_report.packets++;
+
+	quint16 pid = static_cast<quint16>(((packet[1] & 0x1f) << 8) | packet[2]);
+	int adaptation_control = (packet[3] >> 4) & 0x3;
+	int counter = packet[3] & 0xf;
+
+	if ( packet[1] & 0x80 ) {
+		this->ts_report.transport_errors++;
+		markError();
+	}
+	if ( pid == ts_null_pid ) {
+		return;
+	}
+
+	bool has_adaptation = adaptation_control & 0x2;
+	bool has_payload = adaptation_control & 0x1;
+	int adaptation_length = has_adaptation ? packet[4] : 0;
+	bool discontinuity = has_adaptation && adaptation_length > 0 && (packet[5] & 0x80);
+
+	// The counter is incremented by packets with a payload. A packet can be sent twice.
+	qint8 & last = this->continuity[pid];
+	if ( last < 0 ) {
+		this->ts_report.pids++;
+	} else if ( !discontinuity ) {
+		int expected = has_payload ? (last + 1) & 0xf : last;
+		if ( counter != expected && !(has_payload && counter == last) ) {
+			this->ts_report.continuity_errors++;
+			markError();
+		}
+	}
+	last = static_cast<qint8>(counter);
+
+	if ( has_adaptation && adaptation_length >= 7 && (packet[5] & 0x10) ) {
+		qint64 base = (static_cast<qint64>(packet[6]) << 25) | (packet[7] << 17) | (packet[8] << 9)
+			| (packet[9] << 1) | (packet[10] >> 7);
+		qint64 pcr = base * 300 + (((packet[10] & 0x1) << 8) | packet[11]);
+
+		QHash<quint16, qint64>::iterator previous = this->last_pcr.find(pid);
+		if ( previous != this->last_pcr.end() && !discontinuity ) {
+			qint64 delta = (pcr - previous.value() + pcr_wrap) % pcr_wrap;
+			if ( delta > pcr_wrap / 2 ) {
+				this->ts_report.pcr_errors++;
+				markError();
+			} else if ( pid == this->pcr_pid ) {
+				this->ts_report.pcr_ticks += delta;
+			}
+		}
+		this->last_pcr.insert(pid, pcr);
+		if ( this->pcr_pid < 0 ) {
+			this->pcr_pid = pid;
+		}
+	}
+
+	if ( has_payload && (packet[1] & 0x40) && (pid == 0 || this->pmt_pids.contains(pid)) ) {
+		parseSection(packet, pid, 4 + (has_adaptation ? 1 + adaptation_length : 0));
+	}
+}
+
+// PAT and PMT. Only the sections starting in the packet are read, which is enough for their presence.
+void TSScanner::parseSection(const quint8 * packet, quint16 pid, int payload) {
+	if ( payload >= ts_packet_size ) {
+		return;
+	}
+	int start = payload + 1 + packet[payload];
+	if ( start + 8 > ts_packet_size ) {
+		return;
+	}
+
+	int table_id = packet[start];
+	int section_length = ((packet[start + 1] & 0x0f) << 8) | packet[start + 2];
+	if ( pid == 0 ) {
+		if ( table_id == 0x00 ) {
+			this->ts_report.has_pat = true;
+			int end = qMin(start + 3 + section_length - 4, ts_packet_size);
+			for (int i = start + 8; i + 4 <= end; i += 4) {
+				quint16 program = static_cast<quint16>((packet[i] << 8) | packet[i + 1]);
+				if ( program != 0 ) {
+					this->pmt_pids.insert(static_cast<quint16>(((packet[i + 2] & 0x1f) << 8) | packet[i + 3]));
+				}
+			}
+		}
+	} else if ( table_id == 0x02 ) {
+		this->ts_report.has_pmt = true;
+	}
+}
+
+void TSScanner::addData(const char * data, qint64 size) {
+	const quint8 * bytes = reinterpret_cast<const quint8 *>(data);
+	this->ts_report.bytes += size;
+
+	if ( this->ts_report.packet_size == 0 ) {
+		this->pending.append(data, static_cast<int>(size));
+		if ( this->pending.size() < detect_size ) {
+			return;
+		}
+		qint64 start = detectPacketSize(reinterpret_cast<const quint8 *>(this->pending.constData()), this->pending.size());
+		if ( start < 0 ) {
+			// Not a transport stream start, the scan will resynchronise.
+			this->ts_report.packet_size = ts_packet_size;
+			start = 0;
+		} else if ( start > 0 ) {
+			this->ts_report.sync_errors++;
+			this->ts_report.skipped_bytes += start;
+			markError();
+		}
+		this->offset = start;
+		this->pending.remove(0, static_cast<int>(start));
+		qint64 used = scan(reinterpret_cast<const quint8 *>(this->pending.constData()), this->pending.size(), false);
+		this->pending.remove(0, static_cast<int>(used));
+		return;
+	}
+
+	qint64 skip = 0;
+	if ( !this->pending.isEmpty() ) {
+		// Completes the pending packet with the start of data.
+		qint64 old_size = this->pending.size();
+		qint64 head = qMin(size, static_cast<qint64>(2 * this->ts_report.packet_size));
+		this->pending.append(data, static_cast<int>(head));
+		qint64 used = scan(reinterpret_cast<const quint8 *>(this->pending.constData()), this->pending.size(), false);
+		if ( used < old_size ) {
+			// Resynchronisation waiting for more data.
+			this->pending.remove(0, static_cast<int>(used));
+			this->pending.append(data + head, static_cast<int>(size - head));
+			used = scan(reinterpret_cast<const quint8 *>(this->pending.constData()), this->pending.size(), false);
+			this->pending.remove(0, static_cast<int>(used));
+			return;
+		}
+		this->pending.clear();
+		skip = used - old_size;
+	}
+
+	qint64 used = scan(bytes + skip, size - skip, false);
+	this->pending = QByteArray(data + skip + used, static_cast<int>(size - skip - used));
+}
+
+void TSScanner::finish() {
+	if ( this->ts_report.packet_size == 0 ) {
+		qint64 start = detectPacketSize(reinterpret_cast<const quint8 *>(this->pending.constData()), this->pending.size());
+		if ( start < 0 ) {
+			this->ts_report.error = "no MPEG-TS packet found";
+			this->pending.clear();
+			return;
+		}
+		if ( start > 0 ) {
+			this->ts_report.sync_errors++;
+			this->ts_report.skipped_bytes += start;
+			markError();
+		}
+		this->offset = start;
+		this->pending.remove(0, static_cast<int>(start));
+	}
+
+	qint64 used = scan(reinterpret_cast<const quint8 *>(this->pending.constData()), this->pending.size(), true);
+	if ( !this->in_sync ) {
+		this->ts_report.skipped_bytes += this->pending.size() - used;
+	} else {
+		this->ts_report.trailing_bytes = this->pending.size() - used;
+	}
+	if ( this->ts_report.trailing_bytes ) {
+		this->packet_offset = this->offset;
+		markError();
+	}
+	this->pending.clear();
+}
+
+TSReport TSScanner::scanFile(QString const & filename) {
+	TSScanner scanner;
+	QFile file(filename);
+	if ( !file.open(QIODevice::ReadOnly) ) {
+		TSReport report;
+		report.error = file.errorString();
+		return report;
+	}
+
+	QByteArray buffer(read_size, Qt::Uninitialized);
+	qint64 read;
+	while ( (read = file.read(buffer.data(), buffer.size())) > 0 ) {
+		scanner.addData(buffer.constData(), read);
+	}
+	scanner.finish();
+
+	TSReport report = scanner.report();
+	if ( read < 0 ) {
+		report.error = file.errorString();
+	}
+	return report;
+}
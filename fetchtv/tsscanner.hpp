@@ -0,0 +1,84 @@
+/*****************************************************************************
+Copyright © Luke Salisbury
+
+Licensed under the under the ZLIB or GNU General Public License Version 3, at
+your option. This file may not be copied, modified, or distributed except
+according to those terms.
+*****************************************************************************/
+#ifndef TSSCANNER_HPP
+#define TSSCANNER_HPP
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+
+class TSReport {
+public:
+	QString error;
+	int packet_size = 0;
+	qint64 bytes = 0;
+	qint64 packets = 0;
+	qint64 pids = 0;
+	qint64 sync_errors = 0;
+	qint64 skipped_bytes = 0;
+	qint64 continuity_errors = 0;
+	qint64 transport_errors = 0;
+	qint64 pcr_errors = 0;
+	qint64 trailing_bytes = 0;
+	qint64 trimmed_bytes = 0;
+	qint64 first_error_offset = -1;
+	qint64 pcr_ticks = 0;
+	bool has_pat = false;
+	bool has_pmt = false;
+
+	bool isValid() const {
+		return error.isEmpty() && packets > 0 && has_pat && has_pmt && sync_errors == 0 && continuity_errors == 0
+			&& transport_errors == 0 && pcr_errors == 0 && trailing_bytes == 0;
+	}
+	// The trailing bytes were removed from the file, they are no longer a truncation.
+	void trim();
+	double duration() const {
+		return pcr_ticks / 27000000.0;
+	}
+	QString toString() const;
+};
+
+/*
+ * Single pass MPEG-TS checker. Data can be given in chunks of any size.
+ * 188 (TS) and 192 (M2TS) bytes packets are detected from the first packets.
+ * Checks: 0x47 sync byte, continuity counters per PID, transport error indicator,
+ * PAT and PMT presence, PCR monotonicity per PID.
+ */
+class TSScanner {
+public:
+	TSScanner();
+
+	void reset();
+	void addData(const char * data, qint64 size);
+	void addData(QByteArray const & data) { addData(data.constData(), data.size()); }
+	void finish();
+	TSReport const & report() const { return this->ts_report; }
+
+	static TSReport scanFile(QString const & filename);
+
+private:
+	qint64 detectPacketSize(const quint8 * data, qint64 size);
+	qint64 scan(const quint8 * data, qint64 size, bool at_end);
+	void parsePacket(const quint8 * packet);
+	void parseSection(const quint8 * packet, quint16 pid, int payload);
+	void markError();
+
+	TSReport ts_report;
+	QByteArray pending;
+	QVector<qint8> continuity;
+	QHash<quint16, qint64> last_pcr;
+	QSet<quint16> pmt_pids;
+	qint64 offset = 0;
+	qint64 packet_offset = 0;
+	int pcr_pid = -1;
+	bool in_sync = true;
+};
+
+#endif // TSSCANNER_HPP
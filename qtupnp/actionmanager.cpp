@@ -2,6 +2,7 @@
 #include "actionmanager.hpp"
 #include "actioninfo.hpp"
 #include "dump.hpp"
+#include "metrics.hpp"
 
 USING_UPNP_NAMESPACE
 
@@ -45,6 +46,65 @@ void CActionManager::error (QNetworkReply::NetworkError err)
   emit networkError (m_device, err, errorString);
 }
 
+void CActionManager::batchFinished ()
+{
+  m_finishTimes.insert (sender (), CMetrics::instance ().now ());
+  if (--m_pending == 0)
+  {
+    exit (0);
+  }
+}
+
+QNetworkRequest CActionManager::request (QUrl const & url, CActionInfo const & info)
+{
+  QNetworkRequest req (url);
+
+  req.setPriority (QNetworkRequest::HighPriority);
+   // To fix a problem with DSM6 (Synology). If User-Agent exists DSM send only the full precision
+   // image not the thumbnails.
+  req.setHeader (QNetworkRequest::UserAgentHeader, " ");
+  req.setHeader (QNetworkRequest::ContentTypeHeader, QString ("text/xml; charset=\"utf-8\""));
+  req.setRawHeader ("Accept-Encoding", "*");
+  req.setRawHeader ("Accept-Language", "*");
+  req.setRawHeader ("Connection", "Close");
+  QString soapActionHdr = QString ("\"%1#%2\"").arg (info.serviceID ()).arg (info.actionName ());
+  req.setRawHeader ("SOAPAction", soapActionHdr.toUtf8 ());
+  return req;
+}
+
+void CActionManager::failed (QNetworkReply* reply, QUrl const & url, CActionInfo const & info)
+{
+  qint32 statusCode = reply->attribute (QNetworkRequest::HttpStatusCodeAttribute).toInt ();
+  m_lastError       = reply->attribute (QNetworkRequest::HttpReasonPhraseAttribute).toString ();
+  QString message   = QString ("Action failed. Response from the server: %1, %2").arg (statusCode).arg (m_lastError);
+  message          += '\n';
+  message          += url.toString () + '\n';
+  message          += info.message () + "\n\n";
+  qDebug () << "CActionManager::post:" << message;
+  m_lastError.prepend (QString ("(%1) ").arg (statusCode));
+  CDump::dump (message);
+}
+
+void CActionManager::record (QString const & device, CActionInfo const & info, int sent, qint64 start,
+                             qint64 duration, bool success)
+{
+  CMetrics& metrics = CMetrics::instance ();
+  if (metrics.isEnabled () || metrics.isTracing ())
+  {
+    CMetrics::TLabels deviceLabel { { "device", device } };
+    CMetrics::TLabels labels      { { "device", device }, { "service", info.serviceID () }, { "action", info.actionName () } };
+    metrics.observe ("upnp_action_duration_ms", labels, duration / 1000.0);
+    metrics.add ("upnp_device_bytes_sent_total", deviceLabel, sent);
+    metrics.add ("upnp_device_bytes_received_total", deviceLabel, info.response ().size ());
+    if (!success)
+    {
+      metrics.add ("upnp_action_errors_total", labels);
+    }
+
+    metrics.span (info.actionName ().toUtf8 ().constData (), "action", start, duration, labels);
+  }
+}
+
 bool CActionManager::post (QString const & device, QUrl const & url, CActionInfo& info, int timeout)
 {
   m_lastError.clear ();
@@ -52,26 +112,16 @@ bool CActionManager::post (QString const & device, QUrl const & url, CActionInfo
   bool success = false;
   if (!isRunning ())
   {
-    QNetworkRequest req (url);
-
-    req.setPriority (QNetworkRequest::HighPriority);
-     // To fix a problem with DSM6 (Synology). If User-Agent exists DSM send only the full precision
-     // image not the thumbnails.
-    req.setHeader (QNetworkRequest::UserAgentHeader, " ");
-    req.setHeader (QNetworkRequest::ContentTypeHeader, QString ("text/xml; charset=\"utf-8\""));
-    req.setRawHeader ("Accept-Encoding", "*");
-    req.setRawHeader ("Accept-Language", "*");
-    req.setRawHeader ("Connection", "Close");
-    QString const & actionName    = info.actionName ();
-    QString         soapActionHdr = QString ("\"%1#%2\"").arg (info.serviceID ()).arg (actionName);
-    req.setRawHeader ("SOAPAction", soapActionHdr.toUtf8 ());
+    QNetworkRequest req = request (url, info);
 
     QTime time;
     time.start ();
+    qint64 start = CMetrics::instance ().now ();
 
 	//qDebug() << "QNetworkRequest" << url << info.message ().toUtf8 ();
     m_naMgr->setNetworkAccessible (QNetworkAccessManager::Accessible);
-    QNetworkReply* reply = m_naMgr->post (req, info.message ().toUtf8 ());
+    QByteArray     message = info.message ().toUtf8 ();
+    QNetworkReply* reply   = m_naMgr->post (req, message);
     connect (reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(error(QNetworkReply::NetworkError)));
     connect (reply, SIGNAL(finished()), this, SLOT(finished()));
 
@@ -88,21 +138,76 @@ bool CActionManager::post (QString const & device, QUrl const & url, CActionInfo
     {
       if (m_error != QNetworkReply::NoError)
       {
-        qint32 statusCode = reply->attribute (QNetworkRequest::HttpStatusCodeAttribute).toInt ();
-        m_lastError       = reply->attribute (QNetworkRequest::HttpReasonPhraseAttribute).toString ();
-        QString message   = QString ("Action failed. Response from the server: %1, %2").arg (statusCode).arg (m_lastError);
-        message          += '\n';
-        message          += url.toString () + '\n';
-        message          += info.message () + "\n\n";
-        qDebug () << "CActionManager::post:" << message;
-        m_lastError.prepend (QString ("(%1) ").arg (statusCode));
-        CDump::dump (message);
+        failed (reply, url, info);
       }
     }
 
     reply->deleteLater ();
     m_elapsedTime = time.elapsed ();
+    record (device, info, message.size (), start, CMetrics::instance ().now () - start, success);
   }
 
   return success;
 }
+
+QVector<bool> CActionManager::post (QString const & device, QUrl const & url, QList<CActionInfo>& infos, int timeout)
+{
+  m_lastError.clear ();
+  m_device = device;
+  QVector<bool> successes (infos.size (), false);
+  if (!isRunning () && !infos.isEmpty ())
+  {
+    QTime time;
+    time.start ();
+    qint64 start = CMetrics::instance ().now ();
+
+    // QNetworkAccessManager sends up to 6 requests at once to the same host, the others are queued.
+    m_naMgr->setNetworkAccessible (QNetworkAccessManager::Accessible);
+    QVector<QNetworkReply*> replies;
+    QVector<int>            sizes;
+    replies.reserve (infos.size ());
+    sizes.reserve (infos.size ());
+    m_finishTimes.clear ();
+    m_pending = infos.size ();
+    for (CActionInfo const & info : infos)
+    {
+      QByteArray     message = info.message ().toUtf8 ();
+      QNetworkReply* reply   = m_naMgr->post (request (url, info), message);
+      connect (reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(error(QNetworkReply::NetworkError)));
+      connect (reply, SIGNAL(finished()), this, SLOT(batchFinished()));
+      replies.append (reply);
+      sizes.append (message.size ());
+    }
+
+    m_error     = QNetworkReply::NoError;
+    int idTimer = startTimer (timeout);
+    exec (QEventLoop::ExcludeUserInputEvents);
+    killTimer (idTimer);
+    for (int k = 0; k < replies.size (); ++k)
+    {
+      QNetworkReply* reply = replies[k];
+      disconnect (reply, nullptr, this, nullptr);
+      if (!reply->isFinished ())
+      { // Timeout.
+        reply->abort ();
+      }
+      else if (reply->error () == QNetworkReply::NoError)
+      {
+        infos[k].setResponse (reply->readAll ());
+        successes[k] = true;
+      }
+      else
+      {
+        failed (reply, url, infos[k]);
+      }
+
+      reply->deleteLater ();
+      qint64 end = m_finishTimes.value (reply, CMetrics::instance ().now ());
+      record (device, infos[k], sizes[k], start, end - start, successes[k]);
+    }
+
+    m_elapsedTime = time.elapsed ();
+  }
+
+  return successes;
+}
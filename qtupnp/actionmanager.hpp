@@ -5,6 +5,8 @@
 #include "upnp_global.hpp"
 #include <QtNetwork/QNetworkReply>
 #include <QEventLoop>
+#include <QVector>
+#include <QMap>
 
 START_DEFINE_UPNP_NAMESPACE
 
@@ -44,6 +46,16 @@ public :
   bool post (QString const & device, QUrl const & url, CActionInfo& info,
              int timeout = CActionManager::Timeout);
 
+  /*! Posts several upnp actions at once on the network and waits for all the responses.
+   * \param device: The device uuid.
+   * \param url: The destination url.
+   * \param infos: The formatted messages to sent and the responses.
+   * \param timeout: Maximum time for all the responses.
+   * \return The success of each action.
+   */
+  QVector<bool> post (QString const & device, QUrl const & url, QList<CActionInfo>& infos,
+                      int timeout = CActionManager::Timeout);
+
   /*! The time to execute the last action. */
   static int lastElapsedTime () { return m_elapsedTime; }
 
@@ -65,6 +77,20 @@ private slots:
    */
   void error (QNetworkReply::NetworkError err);
 
+  /*! Slot call when a response of several actions is finished. */
+  void batchFinished ();
+
+private :
+  /*! Returns the HTTP request of an action. */
+  static QNetworkRequest request (QUrl const & url, CActionInfo const & info);
+
+  /*! Reports a failed action. */
+  void failed (QNetworkReply* reply, QUrl const & url, CActionInfo const & info);
+
+  /*! Records the metrics of an action. */
+  static void record (QString const & device, CActionInfo const & info, int sent, qint64 start,
+                      qint64 duration, bool success);
+
 signals :
   /*! Network error. */
   void networkError (QString const &, QNetworkReply::NetworkError, QString const &);
@@ -74,6 +100,8 @@ private :
   QString m_device; //!< Device uuid.
   QNetworkReply::NetworkError m_error = QNetworkReply::NoError; //!< Network error.
   QNetworkAccessManager* m_naMgr = nullptr; //!< The current netword access manager. see CActionManager (QNetworkAccessManager* naMgr, QObject* parent).
+  int m_pending = 0; //!< The number of responses of several actions not finished.
+  QMap<QObject*, qint64> m_finishTimes; //!< The end time of the responses of several actions.
 
   static int m_elapsedTime; //!< The time to execute the last action.
   static QString m_lastError; //!< The error generated by the last action.
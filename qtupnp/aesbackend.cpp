@@ -0,0 +1,338 @@
+#include "aesbackend.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AESBACKEND_AESNI
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+/*
+ * Tables
+ * */
+
+namespace {
+
+inline quint8 rotl8(quint8 x, int shift) {
+    return (quint8) ((x << shift) | (x >> (8 - shift)));
+}
+
+inline quint8 gfMultiply(quint8 x, quint8 y) {
+    quint8 r = 0;
+    while (y) {
+        if (y & 1)
+            r ^= x;
+        x = (quint8) ((x << 1) ^ (((x >> 7) & 1) * 0x1b));
+        y >>= 1;
+    }
+    return r;
+}
+
+inline quint32 ror8(quint32 w) {
+    return (w >> 8) | (w << 24);
+}
+
+inline quint32 load32(const quint8* p) {
+    return ((quint32) p[0] << 24) | ((quint32) p[1] << 16) | ((quint32) p[2] << 8) | (quint32) p[3];
+}
+
+inline void store32(quint8* p, quint32 w) {
+    p[0] = (quint8) (w >> 24);
+    p[1] = (quint8) (w >> 16);
+    p[2] = (quint8) (w >> 8);
+    p[3] = (quint8) w;
+}
+
+// The tables are computed once from the S-box definition.
+struct STables {
+    quint8 sbox[256];
+    quint8 rsbox[256];
+    quint32 te[4][256];
+    quint32 td[4][256];
+
+    STables() {
+        // S-box: multiplicative inverse in GF(2^8) followed by the affine transformation.
+        quint8 p = 1, q = 1;
+        do {
+            p = (quint8) (p ^ (p << 1) ^ (p & 0x80 ? 0x1b : 0));
+            q ^= (quint8) (q << 1);
+            q ^= (quint8) (q << 2);
+            q ^= (quint8) (q << 4);
+            q ^= q & 0x80 ? 0x09 : 0;
+            quint8 x = q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4);
+            sbox[p] = x ^ 0x63;
+        } while (p != 1);
+        sbox[0] = 0x63;
+
+        for (int i = 0; i < 256; ++i)
+            rsbox[sbox[i]] = (quint8) i;
+
+        for (int i = 0; i < 256; ++i) {
+            quint8 s = sbox[i];
+            quint8 r = rsbox[i];
+            te[0][i] = ((quint32) gfMultiply(s, 2) << 24) | ((quint32) s << 16) | ((quint32) s << 8) | gfMultiply(s, 3);
+            td[0][i] = ((quint32) gfMultiply(r, 14) << 24) | ((quint32) gfMultiply(r, 9) << 16) |
+                       ((quint32) gfMultiply(r, 13) << 8) | gfMultiply(r, 11);
+            for (int t = 1; t < 4; ++t) {
+                te[t][i] = ror8(te[t - 1][i]);
+                td[t][i] = ror8(td[t - 1][i]);
+            }
+        }
+    }
+};
+
+const STables& tables() {
+    static const STables t;
+    return t;
+}
+
+} // namespace
+
+/*
+ * End Tables
+ * */
+
+CAESBackend::CAESBackend()
+    : m_type(TTable), m_rounds(0)
+{
+}
+
+bool CAESBackend::hasAESNI()
+{
+#ifdef AESBACKEND_AESNI
+    static const bool aesni = __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse2");
+    return aesni;
+#else
+    return false;
+#endif
+}
+
+bool CAESBackend::setKey(const quint8* expandedKey, int size, int rounds, CAESBackend::TYPE type)
+{
+    if (rounds < 10 || rounds > 14 || size < 16 * (rounds + 1))
+        return false;
+
+    const STables& t = tables();
+    m_rounds = rounds;
+    m_type = type == AESNI && hasAESNI() ? AESNI : TTable;
+
+    int words = 4 * (rounds + 1);
+    for (int i = 0; i < words; ++i)
+        m_encKey[i] = load32(expandedKey + 4 * i);
+
+    // Equivalent inverse cipher: reversed round keys, InvMixColumns applied to the inner rounds.
+    for (int j = 0; j < 4; ++j) {
+        m_decKey[j] = m_encKey[4 * rounds + j];
+        m_decKey[4 * rounds + j] = m_encKey[j];
+    }
+    for (int r = 1; r < rounds; ++r) {
+        for (int j = 0; j < 4; ++j) {
+            quint32 w = m_encKey[4 * (rounds - r) + j];
+            m_decKey[4 * r + j] = t.td[0][t.sbox[w >> 24]] ^ t.td[1][t.sbox[(w >> 16) & 0xff]] ^
+                                  t.td[2][t.sbox[(w >> 8) & 0xff]] ^ t.td[3][t.sbox[w & 0xff]];
+        }
+    }
+
+    for (int i = 0; i < words; ++i) {
+        store32(m_encKeyBytes + 4 * i, m_encKey[i]);
+        store32(m_decKeyBytes + 4 * i, m_decKey[i]);
+    }
+    return true;
+}
+
+void CAESBackend::encryptBlocks(quint8* data, int count, int stride) const
+{
+#ifdef AESBACKEND_AESNI
+    if (m_type == AESNI) {
+        encryptAESNI(data, count, stride);
+        return;
+    }
+#endif
+    for (int k = 0; k < count; ++k)
+        encryptTTable(data + k * stride);
+}
+
+void CAESBackend::decryptBlocks(quint8* data, int count, int stride) const
+{
+#ifdef AESBACKEND_AESNI
+    if (m_type == AESNI) {
+        decryptAESNI(data, count, stride);
+        return;
+    }
+#endif
+    for (int k = 0; k < count; ++k)
+        decryptTTable(data + k * stride);
+}
+
+void CAESBackend::encryptTTable(quint8* block) const
+{
+    const STables& t = tables();
+    const quint32* rk = m_encKey;
+    quint32 s0 = load32(block) ^ rk[0];
+    quint32 s1 = load32(block + 4) ^ rk[1];
+    quint32 s2 = load32(block + 8) ^ rk[2];
+    quint32 s3 = load32(block + 12) ^ rk[3];
+    quint32 t0, t1, t2, t3;
+
+    for (int round = 1; round < m_rounds; ++round) {
+        rk += 4;
+        t0 = t.te[0][s0 >> 24] ^ t.te[1][(s1 >> 16) & 0xff] ^ t.te[2][(s2 >> 8) & 0xff] ^ t.te[3][s3 & 0xff] ^ rk[0];
+        t1 = t.te[0][s1 >> 24] ^ t.te[1][(s2 >> 16) & 0xff] ^ t.te[2][(s3 >> 8) & 0xff] ^ t.te[3][s0 & 0xff] ^ rk[1];
+        t2 = t.te[0][s2 >> 24] ^ t.te[1][(s3 >> 16) & 0xff] ^ t.te[2][(s0 >> 8) & 0xff] ^ t.te[3][s1 & 0xff] ^ rk[2];
+        t3 = t.te[0][s3 >> 24] ^ t.te[1][(s0 >> 16) & 0xff] ^ t.te[2][(s1 >> 8) & 0xff] ^ t.te[3][s2 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    // The last round has no MixColumns.
+    rk += 4;
+    const quint8* sbox = t.sbox;
+    t0 = ((quint32) sbox[s0 >> 24] << 24) ^ ((quint32) sbox[(s1 >> 16) & 0xff] << 16) ^
+         ((quint32) sbox[(s2 >> 8) & 0xff] << 8) ^ sbox[s3 & 0xff] ^ rk[0];
+    t1 = ((quint32) sbox[s1 >> 24] << 24) ^ ((quint32) sbox[(s2 >> 16) & 0xff] << 16) ^
+         ((quint32) sbox[(s3 >> 8) & 0xff] << 8) ^ sbox[s0 & 0xff] ^ rk[1];
+    t2 = ((quint32) sbox[s2 >> 24] << 24) ^ ((quint32) sbox[(s3 >> 16) & 0xff] << 16) ^
+         ((quint32) sbox[(s0 >> 8) & 0xff] << 8) ^ sbox[s1 & 0xff] ^ rk[2];
+    t3 = ((quint32) sbox[s3 >> 24] << 24) ^ ((quint32) sbox[(s0 >> 16) & 0xff] << 16) ^
+         ((quint32) sbox[(s1 >> 8) & 0xff] << 8) ^ sbox[s2 & 0xff] ^ rk[3];
+    store32(block, t0);
+    store32(block + 4, t1);
+    store32(block + 8, t2);
+    store32(block + 12, t3);
+}
+
+void CAESBackend::decryptTTable(quint8* block) const
+{
+    const STables& t = tables();
+    const quint32* rk = m_decKey;
+    quint32 s0 = load32(block) ^ rk[0];
+    quint32 s1 = load32(block + 4) ^ rk[1];
+    quint32 s2 = load32(block + 8) ^ rk[2];
+    quint32 s3 = load32(block + 12) ^ rk[3];
+    quint32 t0, t1, t2, t3;
+
+    for (int round = 1; round < m_rounds; ++round) {
+        rk += 4;
+        t0 = t.td[0][s0 >> 24] ^ t.td[1][(s3 >> 16) & 0xff] ^ t.td[2][(s2 >> 8) & 0xff] ^ t.td[3][s1 & 0xff] ^ rk[0];
+        t1 = t.td[0][s1 >> 24] ^ t.td[1][(s0 >> 16) & 0xff] ^ t.td[2][(s3 >> 8) & 0xff] ^ t.td[3][s2 & 0xff] ^ rk[1];
+        t2 = t.td[0][s2 >> 24] ^ t.td[1][(s1 >> 16) & 0xff] ^ t.td[2][(s0 >> 8) & 0xff] ^ t.td[3][s3 & 0xff] ^ rk[2];
+        t3 = t.td[0][s3 >> 24] ^ t.td[1][(s2 >> 16) & 0xff] ^ t.td[2][(s1 >> 8) & 0xff] ^ t.td[3][s0 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    // The last round has no InvMixColumns.
+    rk += 4;
+    const quint8* rsbox = t.rsbox;
+    t0 = ((quint32) rsbox[s0 >> 24] << 24) ^ ((quint32) rsbox[(s3 >> 16) & 0xff] << 16) ^
+         ((quint32) rsbox[(s2 >> 8) & 0xff] << 8) ^ rsbox[s1 & 0xff] ^ rk[0];
+    t1 = ((quint32) rsbox[s1 >> 24] << 24) ^ ((quint32) rsbox[(s0 >> 16) & 0xff] << 16) ^
+         ((quint32) rsbox[(s3 >> 8) & 0xff] << 8) ^ rsbox[s2 & 0xff] ^ rk[1];
+    t2 = ((quint32) rsbox[s2 >> 24] << 24) ^ ((quint32) rsbox[(s1 >> 16) & 0xff] << 16) ^
+         ((quint32) rsbox[(s0 >> 8) & 0xff] << 8) ^ rsbox[s3 & 0xff] ^ rk[2];
+    t3 = ((quint32) rsbox[s3 >> 24] << 24) ^ ((quint32) rsbox[(s2 >> 16) & 0xff] << 16) ^
+         ((quint32) rsbox[(s1 >> 8) & 0xff] << 8) ^ rsbox[s0 & 0xff] ^ rk[3];
+    store32(block, t0);
+    store32(block + 4, t1);
+    store32(block + 8, t2);
+    store32(block + 12, t3);
+}
+
+#ifdef AESBACKEND_AESNI
+
+// 4 blocks are interleaved to hide the latency of the AES instructions.
+__attribute__((target("aes,sse2")))
+void CAESBackend::encryptAESNI(quint8* data, int count, int stride) const
+{
+    __m128i rk[15];
+    for (int r = 0; r <= m_rounds; ++r)
+        rk[r] = _mm_loadu_si128((const __m128i*) (m_encKeyBytes + 16 * r));
+
+    int k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128i* p0 = (__m128i*) (data + k * stride);
+        __m128i* p1 = (__m128i*) (data + (k + 1) * stride);
+        __m128i* p2 = (__m128i*) (data + (k + 2) * stride);
+        __m128i* p3 = (__m128i*) (data + (k + 3) * stride);
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128(p0), rk[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128(p1), rk[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128(p2), rk[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128(p3), rk[0]);
+        for (int r = 1; r < m_rounds; ++r) {
+            b0 = _mm_aesenc_si128(b0, rk[r]);
+            b1 = _mm_aesenc_si128(b1, rk[r]);
+            b2 = _mm_aesenc_si128(b2, rk[r]);
+            b3 = _mm_aesenc_si128(b3, rk[r]);
+        }
+        _mm_storeu_si128(p0, _mm_aesenclast_si128(b0, rk[m_rounds]));
+        _mm_storeu_si128(p1, _mm_aesenclast_si128(b1, rk[m_rounds]));
+        _mm_storeu_si128(p2, _mm_aesenclast_si128(b2, rk[m_rounds]));
+        _mm_storeu_si128(p3, _mm_aesenclast_si128(b3, rk[m_rounds]));
+    }
+
+    for (; k < count; ++k) {
+        __m128i* p = (__m128i*) (data + k * stride);
+        __m128i b = _mm_xor_si128(_mm_loadu_si128(p), rk[0]);
+        for (int r = 1; r < m_rounds; ++r)
+            b = _mm_aesenc_si128(b, rk[r]);
+        _mm_storeu_si128(p, _mm_aesenclast_si128(b, rk[m_rounds]));
+    }
+}
+
+__attribute__((target("aes,sse2")))
+void CAESBackend::decryptAESNI(quint8* data, int count, int stride) const
+{
+    __m128i rk[15];
+    for (int r = 0; r <= m_rounds; ++r)
+        rk[r] = _mm_loadu_si128((const __m128i*) (m_decKeyBytes + 16 * r));
+
+    int k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128i* p0 = (__m128i*) (data + k * stride);
+        __m128i* p1 = (__m128i*) (data + (k + 1) * stride);
+        __m128i* p2 = (__m128i*) (data + (k + 2) * stride);
+        __m128i* p3 = (__m128i*) (data + (k + 3) * stride);
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128(p0), rk[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128(p1), rk[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128(p2), rk[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128(p3), rk[0]);
+        for (int r = 1; r < m_rounds; ++r) {
+            b0 = _mm_aesdec_si128(b0, rk[r]);
+            b1 = _mm_aesdec_si128(b1, rk[r]);
+            b2 = _mm_aesdec_si128(b2, rk[r]);
+            b3 = _mm_aesdec_si128(b3, rk[r]);
+        }
+        _mm_storeu_si128(p0, _mm_aesdeclast_si128(b0, rk[m_rounds]));
+        _mm_storeu_si128(p1, _mm_aesdeclast_si128(b1, rk[m_rounds]));
+        _mm_storeu_si128(p2, _mm_aesdeclast_si128(b2, rk[m_rounds]));
+        _mm_storeu_si128(p3, _mm_aesdeclast_si128(b3, rk[m_rounds]));
+    }
+
+    for (; k < count; ++k) {
+        __m128i* p = (__m128i*) (data + k * stride);
+        __m128i b = _mm_xor_si128(_mm_loadu_si128(p), rk[0]);
+        for (int r = 1; r < m_rounds; ++r)
+            b = _mm_aesdec_si128(b, rk[r]);
+        _mm_storeu_si128(p, _mm_aesdeclast_si128(b, rk[m_rounds]));
+    }
+}
+
+#else
+
+void CAESBackend::encryptAESNI(quint8* data, int count, int stride) const
+{
+    for (int k = 0; k < count; ++k)
+        encryptTTable(data + k * stride);
+}
+
+void CAESBackend::decryptAESNI(quint8* data, int count, int stride) const
+{
+    for (int k = 0; k < count; ++k)
+        decryptTTable(data + k * stride);
+}
+
+#endif
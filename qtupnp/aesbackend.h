@@ -0,0 +1,66 @@
+#ifndef AESBACKEND_H
+#define AESBACKEND_H
+
+#include <QtGlobal>
+
+/*! \brief Fast AES block functions used by CAESEncryption.
+ *
+ * The blocks are processed in place in a contiguous buffer. The round keys come from
+ * CAESEncryption::expandKey, so the results are the same as CAESEncryption::cipher and
+ * CAESEncryption::invCipher. Two implementations exist:
+ * \li TTable: 32 bits table lookups. Portable.
+ * \li AESNI: AES-NI instructions. Used only if the processor supports them (runtime detection).
+ *
+ * Only the first 16 bytes of each block are transformed. The block stride is a parameter to keep
+ * the CAESEncryption block length of 32 bytes.
+ */
+class CAESBackend
+{
+public:
+    typedef enum {
+        TTable,
+        AESNI
+    } TYPE;
+
+    CAESBackend();
+
+    /*! Sets the key.
+     * \param expandedKey: The expanded key returned by CAESEncryption::expandKey.
+     * \param size: The expanded key size.
+     * \param rounds: The number of rounds (10, 12 or 14).
+     * \param type: The implementation. AESNI is replaced by TTable if not available.
+     * \return False if the expanded key is too short.
+     */
+    bool setKey(const quint8* expandedKey, int size, int rounds, CAESBackend::TYPE type);
+
+    /*! Returns the implementation used. */
+    CAESBackend::TYPE type() const { return m_type; }
+
+    /*! Encrypts the first 16 bytes of count blocks in place.
+     * \param data: The first block.
+     * \param count: The number of blocks.
+     * \param stride: The distance in bytes between 2 blocks.
+     */
+    void encryptBlocks(quint8* data, int count, int stride) const;
+
+    /*! Decrypts the first 16 bytes of count blocks in place. */
+    void decryptBlocks(quint8* data, int count, int stride) const;
+
+    /*! Returns true if AES-NI can be used. */
+    static bool hasAESNI();
+
+private:
+    void encryptTTable(quint8* block) const;
+    void decryptTTable(quint8* block) const;
+    void encryptAESNI(quint8* data, int count, int stride) const;
+    void decryptAESNI(quint8* data, int count, int stride) const;
+
+    TYPE m_type;
+    int m_rounds;
+    quint32 m_encKey[60]; // Encryption round keys as big endian words.
+    quint32 m_decKey[60]; // Equivalent inverse cipher round keys as big endian words.
+    quint8 m_encKeyBytes[240]; // Encryption round keys for AES-NI.
+    quint8 m_decKeyBytes[240]; // Equivalent inverse cipher round keys for AES-NI.
+};
+
+#endif // AESBACKEND_H
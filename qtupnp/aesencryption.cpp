@@ -1,4 +1,10 @@
 #include "aesencryption.h"
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <cstring>
 
 /*
  * Static Functions
@@ -43,7 +49,8 @@ inline int getPadding(int currSize, int alignment) {
 
 
 CAESEncryption::CAESEncryption(CAESEncryption::AES level, CAESEncryption::MODE mode)
-    : m_nb(4), m_blocklen(32), m_level(level), m_mode(mode)
+    : m_nb(4), m_blocklen(32), m_level(level), m_mode(mode), m_backend(AUTO), m_threadCount(0),
+      m_keystreamPos(16), m_streamEncryption(true), m_streamFast(false), m_streamReady(false), m_padding(PKCS7)
 {
     m_state = NULL;
 
@@ -345,11 +352,19 @@ QByteArray CAESEncryption::invCipher(const QByteArray expKey, const QByteArray i
 
 QByteArray CAESEncryption::encode(const QByteArray rawText, const QByteArray key, const QByteArray iv)
 {
-    if (m_mode >= CBC && (iv.isNull() || iv.size() != m_blocklen))
+    if (m_mode >= CBC && (iv.isNull() || iv.size() != ivLength()))
        return QByteArray();
 
-    QByteArray ret;
+    if (m_mode == CTR) {
+        init(key, iv, true, ZERO);
+        return update(rawText);
+    }
+
     QByteArray expandedKey = expandKey(key);
+    if (initBackend(expandedKey))
+        return fastEncode(rawText, iv);
+
+    QByteArray ret;
     QByteArray alignedText(rawText);
     QByteArray ivTemp(iv);
 
@@ -388,11 +403,19 @@ QByteArray CAESEncryption::encode(const QByteArray rawText, const QByteArray key
 
 QByteArray CAESEncryption::decode(const QByteArray rawText, const QByteArray key, const QByteArray iv)
 {
-    if (m_mode >= CBC && (iv.isNull() || iv.size() != m_blocklen))
+    if (m_mode >= CBC && (iv.isNull() || iv.size() != ivLength()))
        return QByteArray();
 
-    QByteArray ret;
+    if (m_mode == CTR) {
+        init(key, iv, false, ZERO);
+        return update(rawText);
+    }
+
     QByteArray expandedKey = expandKey(key);
+    if (rawText.size() % m_blocklen == 0 && initBackend(expandedKey))
+        return fastDecode(rawText, iv);
+
+    QByteArray ret;
     QByteArray ivTemp(iv);
 
     //Preparation for CFB
@@ -423,3 +446,408 @@ QByteArray CAESEncryption::decode(const QByteArray rawText, const QByteArray key
     }
     return ret;
 }
+
+/*
+ * Fast backend
+ * */
+
+// Cache sized unit of work of the parallel processing.
+static const int slabSize = 64 * 1024;
+
+// Under this number of slabs, the text is processed by the calling thread.
+static const int minParallelSlabs = 4;
+
+class CAESSlabTask : public QRunnable
+{
+public:
+    CAESSlabTask(const std::function<void ()>& work, QSemaphore* done)
+        : m_work(work), m_done(done) {}
+
+    void run() override {
+        m_work();
+        m_done->release();
+    }
+
+private:
+    std::function<void ()> m_work;
+    QSemaphore* m_done;
+};
+
+// Adds n to a 128 bits big endian counter.
+inline void addCounter(quint8* counter, quint64 n) {
+    for (int i = 15; i >= 0 && n != 0; --i) {
+        quint64 sum = counter[i] + (n & 0xff);
+        counter[i] = (quint8) sum;
+        n = (n >> 8) + (sum >> 8);
+    }
+}
+
+// 8 bytes at a time, the compiler vectorizes the loop.
+inline void blockXor(quint8* out, const quint8* in, int len) {
+    int i = 0;
+    for (; i + 8 <= len; i += 8) {
+        quint64 a, b;
+        memcpy(&a, out + i, 8);
+        memcpy(&b, in + i, 8);
+        a ^= b;
+        memcpy(out + i, &a, 8);
+    }
+    for (; i < len; ++i)
+        out[i] ^= in[i];
+}
+
+bool CAESEncryption::initBackend(const QByteArray& expandedKey)
+{
+    if (m_backend == REFERENCE)
+        return false;
+
+    CAESBackend::TYPE type = m_backend == TTABLE ? CAESBackend::TTable : CAESBackend::AESNI;
+    return m_fast.setKey(reinterpret_cast<const quint8*>(expandedKey.constData()), expandedKey.size(), m_nr, type);
+}
+
+// Calls function(first, count) for each slab of grain items. The calling thread takes part in the
+// work, so it progresses even if the pool has no free thread.
+void CAESEncryption::parallelFor(int total, int grain, const std::function<void (int, int)>& function)
+{
+    int slabs = (total + grain - 1) / grain;
+    int threads = qMin(slabs, m_threadCount > 0 ? m_threadCount : QThread::idealThreadCount());
+    if (threads <= 1 || slabs < minParallelSlabs) {
+        if (total > 0)
+            function(0, total);
+        return;
+    }
+
+    QAtomicInt next(0);
+    std::function<void ()> worker = [&]() {
+        for (int slab = next.fetchAndAddRelaxed(1); slab < slabs; slab = next.fetchAndAddRelaxed(1)) {
+            int first = slab * grain;
+            function(first, qMin(grain, total - first));
+        }
+    };
+
+    QSemaphore done;
+    int started = 0;
+    QThreadPool* pool = QThreadPool::globalInstance();
+    for (int i = 1; i < threads; ++i) {
+        CAESSlabTask* task = new CAESSlabTask(worker, &done);
+        if (pool->tryStart(task))
+            ++started;
+        else {
+            delete task;
+            break;
+        }
+    }
+
+    worker();
+    done.acquire(started);
+}
+
+QByteArray CAESEncryption::fastEncode(const QByteArray& rawText, const QByteArray& iv)
+{
+    //Zero padding as the reference implementation
+    QByteArray ret(rawText.size() + getPadding(rawText.size(), m_blocklen), 0);
+    if (!rawText.isEmpty())
+        memcpy(ret.data(), rawText.constData(), rawText.size());
+
+    quint8* data = reinterpret_cast<quint8*>(ret.data());
+    int count = ret.size() / m_blocklen;
+    switch(m_mode)
+    {
+    case ECB:
+        parallelFor(count, slabSize / m_blocklen, [&](int first, int n) {
+            m_fast.encryptBlocks(data + first * m_blocklen, n, m_blocklen);
+        });
+        break;
+    case CBC: {
+        const quint8* previous = reinterpret_cast<const quint8*>(iv.constData());
+        for (int k = 0; k < count; ++k) {
+            quint8* block = data + k * m_blocklen;
+            blockXor(block, previous, m_blocklen);
+            m_fast.encryptBlocks(block, 1, m_blocklen);
+            previous = block;
+        }
+        }
+        break;
+    case CFB: {
+        quint8 feedback[32];
+        memcpy(feedback, iv.constData(), m_blocklen);
+        for (int k = 0; k < count; ++k) {
+            quint8* block = data + k * m_blocklen;
+            m_fast.encryptBlocks(feedback, 1, m_blocklen);
+            blockXor(block, feedback, m_blocklen);
+            memcpy(feedback, block, m_blocklen);
+        }
+        }
+        break;
+    default:
+        //do nothing
+        break;
+    }
+    return ret;
+}
+
+QByteArray CAESEncryption::fastDecode(const QByteArray& rawText, const QByteArray& iv)
+{
+    if (rawText.isEmpty())
+        return QByteArray();
+
+    QByteArray ret;
+    const quint8* cipherText = reinterpret_cast<const quint8*>(rawText.constData());
+    int count = rawText.size() / m_blocklen;
+    switch(m_mode)
+    {
+    case ECB: {
+        ret = QByteArray(rawText.constData(), rawText.size());
+        quint8* data = reinterpret_cast<quint8*>(ret.data());
+        parallelFor(count, slabSize / m_blocklen, [&](int first, int n) {
+            m_fast.decryptBlocks(data + first * m_blocklen, n, m_blocklen);
+        });
+        }
+        break;
+    case CBC: {
+        //The blocks are independent: decrypt, then xor with the previous cipher block
+        ret = QByteArray(rawText.constData(), rawText.size());
+        quint8* data = reinterpret_cast<quint8*>(ret.data());
+        const quint8* ivData = reinterpret_cast<const quint8*>(iv.constData());
+        parallelFor(count, slabSize / m_blocklen, [&](int first, int n) {
+            quint8* slab = data + first * m_blocklen;
+            m_fast.decryptBlocks(slab, n, m_blocklen);
+            if (first == 0) {
+                blockXor(slab, ivData, m_blocklen);
+                blockXor(slab + m_blocklen, cipherText, (n - 1) * m_blocklen);
+            } else
+                blockXor(slab, cipherText + (first - 1) * m_blocklen, n * m_blocklen);
+        });
+        }
+        break;
+    case CFB: {
+        //The keystream is the encryption of the iv followed by the cipher blocks
+        ret = iv;
+        ret.append(rawText.constData(), rawText.size() - m_blocklen);
+        quint8* data = reinterpret_cast<quint8*>(ret.data());
+        parallelFor(count, slabSize / m_blocklen, [&](int first, int n) {
+            quint8* slab = data + first * m_blocklen;
+            m_fast.encryptBlocks(slab, n, m_blocklen);
+            blockXor(slab, cipherText + first * m_blocklen, n * m_blocklen);
+        });
+        }
+        break;
+    default:
+        //do nothing
+        break;
+    }
+    return ret;
+}
+
+/*
+ * Streaming
+ * */
+
+// The streaming API uses the standard AES block in every mode, not the 32 bytes m_blocklen of
+// encode and decode where only the first 16 bytes of each block are ciphered.
+static const int streamBlockLen = 16;
+
+void CAESEncryption::cryptBlocks(quint8* data, int count, int stride, bool inverse)
+{
+    if (m_streamFast) {
+        if (inverse)
+            m_fast.decryptBlocks(data, count, stride);
+        else
+            m_fast.encryptBlocks(data, count, stride);
+        return;
+    }
+
+    for (int k = 0; k < count; ++k) {
+        quint8* block = data + k * stride;
+        QByteArray in(reinterpret_cast<const char*>(block), 16);
+        QByteArray out = inverse ? invCipher(m_streamKey, in) : cipher(m_streamKey, in);
+        memcpy(block, out.constData(), 16);
+    }
+}
+
+bool CAESEncryption::init(const QByteArray key, const QByteArray iv, bool encryption, CAESEncryption::PADDING padding)
+{
+    m_streamReady = false;
+    m_pending.clear();
+    m_keystreamPos = 16;
+    if (key.size() < m_keyLen || (m_mode >= CBC && (iv.isNull() || iv.size() != streamBlockLen)))
+        return false;
+
+    m_streamKey = expandKey(key);
+    m_streamFast = initBackend(m_streamKey);
+    m_streamIv = iv;
+    m_streamEncryption = encryption;
+    m_padding = padding;
+    m_streamReady = true;
+    return true;
+}
+
+// Processes full blocks in place and updates the chaining value.
+void CAESEncryption::processBlocks(quint8* data, int count)
+{
+    quint8* chain = reinterpret_cast<quint8*>(m_streamIv.data());
+    switch(m_mode)
+    {
+    case ECB:
+        cryptBlocks(data, count, streamBlockLen, !m_streamEncryption);
+        break;
+    case CBC:
+        if (m_streamEncryption) {
+            for (int k = 0; k < count; ++k) {
+                quint8* block = data + k * streamBlockLen;
+                blockXor(block, chain, streamBlockLen);
+                cryptBlocks(block, 1, streamBlockLen, false);
+                memcpy(chain, block, streamBlockLen);
+            }
+        } else if (count > 0) {
+            //Backward to keep the previous cipher block
+            quint8 last[streamBlockLen];
+            memcpy(last, data + (count - 1) * streamBlockLen, streamBlockLen);
+            for (int k = count - 1; k >= 0; --k) {
+                quint8* block = data + k * streamBlockLen;
+                cryptBlocks(block, 1, streamBlockLen, true);
+                blockXor(block, k > 0 ? block - streamBlockLen : chain, streamBlockLen);
+            }
+            memcpy(chain, last, streamBlockLen);
+        }
+        break;
+    case CFB:
+        for (int k = 0; k < count; ++k) {
+            quint8* block = data + k * streamBlockLen;
+            quint8 keystream[streamBlockLen];
+            memcpy(keystream, chain, streamBlockLen);
+            cryptBlocks(keystream, 1, streamBlockLen, false);
+            if (!m_streamEncryption)
+                memcpy(chain, block, streamBlockLen);
+            blockXor(block, keystream, streamBlockLen);
+            if (m_streamEncryption)
+                memcpy(chain, block, streamBlockLen);
+        }
+        break;
+    default:
+        //do nothing
+        break;
+    }
+}
+
+QByteArray CAESEncryption::ctrUpdate(const QByteArray& chunk)
+{
+    quint8* counter = reinterpret_cast<quint8*>(m_streamIv.data());
+    QByteArray ret(chunk.constData(), chunk.size());
+    quint8* data = reinterpret_cast<quint8*>(ret.data());
+    int size = ret.size();
+    int pos = 0;
+
+    //End of the previous keystream block
+    while (pos < size && m_keystreamPos < 16)
+        data[pos++] ^= m_keystream[m_keystreamPos++];
+
+    //Full blocks. Each slab starts at its own counter value.
+    int blocks = (size - pos) / 16;
+    quint8* text = data + pos;
+    auto work = [this, text, counter](int first, int count) {
+        const int batch = 256;
+        quint8 keystream[batch * 16];
+        quint8 value[16];
+        memcpy(value, counter, 16);
+        addCounter(value, first);
+        for (int done = 0; done < count; ) {
+            int n = qMin(count - done, batch);
+            for (int k = 0; k < n; ++k) {
+                memcpy(keystream + k * 16, value, 16);
+                addCounter(value, 1);
+            }
+            cryptBlocks(keystream, n, 16, false);
+            blockXor(text + (first + done) * 16, keystream, n * 16);
+            done += n;
+        }
+    };
+
+    //The reference backend is not reentrant
+    if (m_streamFast)
+        parallelFor(blocks, slabSize / 16, work);
+    else if (blocks > 0)
+        work(0, blocks);
+
+    addCounter(counter, blocks);
+    pos += blocks * 16;
+
+    //Start of a new keystream block
+    if (pos < size) {
+        memcpy(m_keystream, counter, 16);
+        addCounter(counter, 1);
+        cryptBlocks(m_keystream, 1, 16, false);
+        m_keystreamPos = 0;
+        while (pos < size)
+            data[pos++] ^= m_keystream[m_keystreamPos++];
+    }
+    return ret;
+}
+
+QByteArray CAESEncryption::update(const QByteArray chunk)
+{
+    if (!m_streamReady || chunk.isEmpty())
+        return QByteArray();
+
+    if (m_mode == CTR)
+        return ctrUpdate(chunk);
+
+    int size = m_pending.size() + chunk.size();
+    int count = size / streamBlockLen;
+    //The last block is kept to check the padding in finalize
+    if (!m_streamEncryption && m_padding == PKCS7 && count > 0 && size % streamBlockLen == 0)
+        --count;
+
+    if (count == 0) {
+        m_pending.append(chunk);
+        return QByteArray();
+    }
+
+    QByteArray ret(m_pending);
+    int used = count * streamBlockLen - m_pending.size();
+    ret.append(chunk.constData(), used);
+    m_pending = QByteArray(chunk.constData() + used, chunk.size() - used);
+    processBlocks(reinterpret_cast<quint8*>(ret.data()), count);
+    return ret;
+}
+
+QByteArray CAESEncryption::finalize(bool* ok)
+{
+    bool valid = m_streamReady;
+    QByteArray ret;
+    if (valid && m_mode != CTR) {
+        if (m_streamEncryption) {
+            int padding = getPadding(m_pending.size(), streamBlockLen);
+            if (m_padding == PKCS7 && padding == 0)
+                padding = streamBlockLen;
+
+            ret = m_pending;
+            ret.append(QByteArray(padding, m_padding == PKCS7 ? char(padding) : char(0)));
+            processBlocks(reinterpret_cast<quint8*>(ret.data()), ret.size() / streamBlockLen);
+        } else if (m_padding == ZERO) {
+            valid = m_pending.isEmpty();
+        } else if (m_pending.size() != streamBlockLen) {
+            valid = false;
+        } else {
+            ret = m_pending;
+            processBlocks(reinterpret_cast<quint8*>(ret.data()), 1);
+            int padding = (quint8) ret.at(streamBlockLen - 1);
+            valid = padding >= 1 && padding <= streamBlockLen;
+            for (int i = streamBlockLen - padding; valid && i < streamBlockLen; ++i)
+                valid = (quint8) ret.at(i) == padding;
+
+            if (valid)
+                ret.truncate(streamBlockLen - padding);
+            else
+                ret.clear();
+        }
+    }
+
+    if (ok)
+        *ok = valid;
+
+    m_streamReady = false;
+    m_pending.clear();
+    m_streamIv.fill(0);
+    return ret;
+}
@@ -3,6 +3,8 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <functional>
+#include "aesbackend.h"
 
 /*! \brief AES encryption class.
  *
@@ -10,6 +12,20 @@
  * For more information see https://github.com/bricke/Qt-AES.
  * I just make very little changes. I rename QAESEncryption in CAESEncryption for homogeneity
  * and initialize m_blocklen in the constructor to 32 in place of 16 (16 creates a crash).
+ *
+ * encode and decode use CAESBackend (T-tables or AES-NI) on a contiguous copy of the text.
+ * The results are the same as the reference implementation (cipher, invCipher) which is still
+ * used with the REFERENCE backend.
+ *
+ * For large payloads, init, update and finalize process the text chunk by chunk. The context keeps
+ * only the chaining value and the last partial block, so the memory use does not depend on the
+ * text size. Unlike encode and decode, which keep the 32 bytes blocks of Qt-AES where only the first
+ * 16 bytes are ciphered, they use the standard 16 bytes AES block and a 16 bytes iv in every mode:
+ * ECB, CBC, CFB-128 and CTR (big endian increment of the counter block). The PKCS#7 padding is on
+ * 16 bytes, so the results interoperate with the other AES implementations.
+ *
+ * Large texts are split in 64 KiB slabs processed by the global QThreadPool when the blocks are
+ * independent: ECB, CBC and CFB decryption, CTR. The output is the same as with one thread.
  */
 
 class CAESEncryption : public QObject
@@ -25,9 +41,22 @@ public:
     typedef enum {
         ECB,
         CBC,
-        CFB
+        CFB,
+        CTR
     } MODE;
 
+    typedef enum {
+        ZERO,
+        PKCS7
+    } PADDING;
+
+    typedef enum {
+        AUTO,
+        REFERENCE,
+        TTABLE,
+        AESNI
+    } BACKEND;
+
     static QByteArray Crypt(CAESEncryption::AES level, CAESEncryption::MODE mode, const QByteArray rawText, const QByteArray key, const QByteArray iv = NULL);
     static QByteArray Decrypt(CAESEncryption::AES level, CAESEncryption::MODE mode, const QByteArray rawText, const QByteArray key, const QByteArray iv = NULL);
     static QByteArray ExpandKey(CAESEncryption::AES level, CAESEncryption::MODE mode, const QByteArray key);
@@ -38,6 +67,18 @@ public:
     QByteArray decode (const QByteArray rawText, const QByteArray key, const QByteArray iv = NULL);
     QByteArray expandKey (const QByteArray key);
 
+    void setBackend (CAESEncryption::BACKEND backend) { m_backend = backend; }
+    CAESEncryption::BACKEND backend() const { return m_backend; }
+
+    // 0 for QThread::idealThreadCount, 1 to disable the parallel processing.
+    void setThreadCount (int count) { m_threadCount = count; }
+    int threadCount() const { return m_threadCount; }
+
+    // Streaming with 16 bytes blocks. The padding is ignored by CTR.
+    bool init (const QByteArray key, const QByteArray iv = NULL, bool encryption = true, CAESEncryption::PADDING padding = PKCS7);
+    QByteArray update (const QByteArray chunk);
+    QByteArray finalize (bool* ok = NULL);
+
 private:
     int m_nb;
     int m_blocklen;
@@ -48,6 +89,19 @@ private:
     int m_nr;
     int m_expandedKey;
     QByteArray* m_state;
+    BACKEND m_backend;
+    CAESBackend m_fast;
+    int m_threadCount;
+
+    QByteArray m_streamKey;
+    QByteArray m_streamIv;
+    QByteArray m_pending;
+    quint8 m_keystream[16];
+    int m_keystreamPos;
+    bool m_streamEncryption;
+    bool m_streamFast;
+    bool m_streamReady;
+    PADDING m_padding;
 
     typedef struct{
         int nk = 8;
@@ -83,6 +137,14 @@ private:
     QByteArray cipher(const QByteArray expKey, const QByteArray plainText);
     QByteArray invCipher(const QByteArray expKey, const QByteArray plainText);
     QByteArray byteXor(const QByteArray in, const QByteArray iv);
+    bool initBackend(const QByteArray& expandedKey);
+    QByteArray fastEncode(const QByteArray& rawText, const QByteArray& iv);
+    QByteArray fastDecode(const QByteArray& rawText, const QByteArray& iv);
+    int ivLength() const { return m_mode == CTR ? 16 : m_blocklen; }
+    void cryptBlocks(quint8* data, int count, int stride, bool inverse);
+    void processBlocks(quint8* data, int count);
+    QByteArray ctrUpdate(const QByteArray& chunk);
+    void parallelFor(int total, int grain, const std::function<void (int, int)>& function);
 
     const quint8 sbox[256] =   {
       //0     1    2      3     4    5     6     7      8    9     A      B    C     D     E     F
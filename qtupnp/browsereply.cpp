@@ -1,6 +1,12 @@
 #include "browsereply.hpp"
 #include "helper.hpp"
+#include "searchindex.hpp"
 #include <QDebug>
+#include <QCollator>
+#include <QDateTime>
+#include <QSharedPointer>
+#include <QMutexLocker>
+#include <numeric>
 
 START_DEFINE_UPNP_NAMESPACE
 
@@ -14,6 +20,8 @@ struct SBrowseReplyData : public QSharedData
   unsigned m_totalMatches = 0;
   unsigned m_updateID = 0;
   QList<CDidlItem> m_items;
+  mutable QSharedPointer<CSearchIndex> m_index; //!< Built by the first search, removed when the items change.
+  mutable QMutex m_indexMutex; //!< Protects m_index, the data can be shared by replies used in several threads.
 };
 
 SBrowseReplyData::SBrowseReplyData (SBrowseReplyData const & other) : QSharedData (other),
@@ -23,6 +31,42 @@ SBrowseReplyData::SBrowseReplyData (SBrowseReplyData const & other) : QSharedDat
 {
 }
 
+/*! \brief The sort keys of a criterion, extracted once for all the items. */
+struct SSortKeys
+{
+  enum EType { String, Numerical, Time, Date };
+
+  /*! Returns the value of the criterion. */
+  QString value (CDidlItem const & item) const
+  {
+    CDidlElem const & elem = item.value (m_elemName);
+    return m_propName.isEmpty () ? elem.value () : elem.props ().value (m_propName);
+  }
+
+  /*! Compares the keys of two items. Returns <0, 0 or >0. */
+  int compare (int i1, int i2) const
+  {
+    int result;
+    if (m_type == String)
+    {
+      result = m_strings[i1].compare (m_strings[i2]);
+    }
+    else
+    {
+      result = m_numbers[i1] < m_numbers[i2] ? -1 : (m_numbers[i1] > m_numbers[i2] ? 1 : 0);
+    }
+
+    return m_descending ? -result : result;
+  }
+
+  QString m_elemName; //!< The CDidlElem name.
+  QString m_propName; //!< The property name or empty.
+  bool m_descending = false; //!< The order.
+  EType m_type = String; //!< The type of the values.
+  QVector<qint64> m_numbers; //!< The keys of the numbers, durations in ms and dates in ms since epoch.
+  std::vector<QCollatorSortKey> m_strings; //!< The keys of the strings.
+};
+
 }//Namespace
 
 USING_UPNP_NAMESPACE
@@ -67,6 +111,7 @@ void CBrowseReply::setUpdateID (unsigned updateID)
 void CBrowseReply::setItems (QList<CDidlItem> const & items)
 {
   m_d->m_items = items;
+  m_d->m_index.reset ();
 }
 
 unsigned CBrowseReply::numberReturned () const
@@ -91,6 +136,7 @@ QList<CDidlItem> const & CBrowseReply::items () const
 
 QList<CDidlItem>& CBrowseReply::items ()
 {
+  m_d->m_index.reset (); // The items can be changed.
   return m_d->m_items;
 }
 
@@ -100,99 +146,31 @@ CBrowseReply& CBrowseReply::operator += (CBrowseReply const & other)
   m_d->m_totalMatches   += other.m_d->m_totalMatches;
   m_d->m_updateID        = other.m_d->m_updateID;
   m_d->m_items          += other.m_d->m_items;
+  m_d->m_index.reset ();
   return *this;
 }
 
 QList<CDidlItem> CBrowseReply::search (QList<CDidlItem> const & items, QString text, int returned,
                                        int commonPrefixLength)
 {
-  typedef QPair<float, int> TDistance;
-  QList<CDidlItem> results;
-  if (!text.isEmpty ())
-  {
-    QRegExp re ("[\\s\\-,&°()':\\.\"]"); // Separators.
-    text = removeDiacritics (text.toUpper ());
-
-    // Update returned.
-    int cItems  = items.size ();
-    if (returned <= 0 || returned > items.size ())
-    {
-      returned = cItems;
-    }
-
-    float       distanceMax = 100000.0f;
-    QStringList texts       = text.split (re, QString::SkipEmptyParts);
-
-    QVector<TDistance> distances (cItems);
-    int                cMatches = 0;
-    QStringList        titleComponents;
-    titleComponents.reserve (20);
-
-    QVector<QString> titles (cItems); // To speed up pass 2.
-
-    // Pass 1. Search exact matches. For each item title, the distance is defined by the position
-    // in the title words and the index of the title words. This defined the bigger distance
-    // by the position in the word and the position int the list of words.
-    // Part 1 is to find a word every where in the title.
-    for (int iItem = 0; iItem < cItems; ++iItem)
-    {
-      float biggerDistance = 0.0f;
-      titles[iItem]        = removeDiacritics (items[iItem].title ().toUpper ());
-      titleComponents      = titles[iItem].split (re, QString::SkipEmptyParts);
-      for (int k = 0, cTitleComponents = titleComponents.size (); k < cTitleComponents; ++k)
-      {
-        for (QString const & text : texts)
-        {
-          int index = titleComponents[k].indexOf (text);
-          if (index != -1)
-          {
-            float distance = distanceMax - static_cast<float>((index + 1) * (k + 1));
-            if (distance > biggerDistance)
-            {
-              biggerDistance = distance;
-            }
-          }
-        }
-      }
-
-      if (biggerDistance != 0.0f)
-      {
-        distances[iItem] = TDistance (biggerDistance, iItem);
-        ++cMatches;
-      }
-    }
+  return CSearchIndex::scan (items, text, returned, commonPrefixLength);
+}
 
-    // Pass 2. Compute the Jaro-Winkler distance.
-    if (cMatches < returned)
+QList<CDidlItem> CBrowseReply::search (QString text, int returned, int commonPrefixLength) const
+{
+  QSharedPointer<CSearchIndex> index;
+  {
+    // The other replies sharing the data can search at the same time, the index is built once.
+    QMutexLocker locker (&m_d->m_indexMutex);
+    if (m_d->m_index.isNull ())
     {
-      for (int iItem = 0; iItem < cItems; ++iItem)
-      {
-        if (distances[iItem].first == 0.0f)
-        {
-          float distance   = jaroWinklerDistance (text, titles[iItem], commonPrefixLength);
-          distances[iItem] = TDistance (distance, iItem);
-        }
-      }
+      m_d->m_index = QSharedPointer<CSearchIndex>::create (m_d->m_items);
     }
 
-    std::sort (distances.begin (), distances.end (),
-               [] (TDistance const & d1, TDistance const & d2) { return d1.first > d2.first; });
-
-    // Reorganized items.
-    results.reserve (returned);
-    for (int iItem = 0; iItem < returned; ++iItem)
-    {
-      int index = distances[iItem].second;
-      results.push_back (items[index]);
-    }
+    index = m_d->m_index;
   }
 
-  return results;
-}
-
-QList<CDidlItem> CBrowseReply::search (QString text, int returned, int commonPrefixLength) const
-{
-  return search (m_d->m_items, text, returned, commonPrefixLength);
+  return index->search (text, returned, commonPrefixLength);
 }
 
 QStringList CBrowseReply::sortCapabilities (bool sameContent) const
@@ -237,76 +215,124 @@ QStringList CBrowseReply::sortCapabilities (CBrowseReply const & reply, bool sam
 
 void CBrowseReply::sort (CBrowseReply& reply, QString const & criteria, ESortDir dir)
 {
-  enum EComparType { String, Numerical, Time };
-
-  QString elemName, propName;
-  int     index = criteria.indexOf ('@');
-  if (index != -1)
-  {
-    elemName = criteria.left (index);
-    propName = criteria.right (criteria.length () - index - 1);
-  }
-  else
+  reply.m_d->m_index.reset ();
+  QList<CDidlItem>&  items  = reply.m_d->m_items;
+  int                cItems = items.size ();
+  QCollator          collator;
+  QVector<SSortKeys> keys;
+  for (QString criterion : criteria.split (',', QString::SkipEmptyParts))
   {
-    elemName = criteria;
-  }
+    SSortKeys sortKeys;
+    criterion             = criterion.trimmed ();
+    sortKeys.m_descending = dir == Descending;
+    if (criterion.startsWith ('+') || criterion.startsWith ('-'))
+    {
+      sortKeys.m_descending = criterion[0] == '-';
+      criterion.remove (0, 1);
+    }
 
-  EComparType       type = String;
-  QString           value;
-  QList<CDidlItem>& items = reply.m_d->m_items;
-  for (int iItem = 0, end = items.size (); iItem < end; ++iItem)
-  {
-    CDidlElem const & elem = items[iItem].value (elemName);
-    value                  = index != -1 ? elem.props ().value (propName) : elem.value ();
-    if (!value.isEmpty ())
+    int index = criterion.indexOf ('@');
+    if (index != -1)
     {
-      bool ok;
-      value.toLongLong (&ok);
-      type = !ok && ::isDuration (value) ? Time : Numerical;
-      break;
+      sortKeys.m_elemName = criterion.left (index);
+      sortKeys.m_propName = criterion.mid (index + 1);
+    }
+    else
+    {
+      sortKeys.m_elemName = criterion;
     }
-  }
 
-  if (!value.isEmpty ())
-  {
-    int const kmax = 15;
+    // The type is detected from the first value.
     QString value;
-    if (type != String)
+    for (int iItem = 0; iItem < cItems && value.isEmpty (); ++iItem)
     {
-      value.resize (kmax);
+      value = sortKeys.value (items[iItem]);
     }
 
-    typedef QPair<QString, CDidlItem> TSortItem;
-    QVector<TSortItem> itemArray (items.size ());
-    for (int iItem = 0, end = items.size (); iItem < end; ++iItem)
+    if (value.isEmpty ())
+    { // Not in the items.
+      continue;
+    }
+
+    bool ok;
+    value.toLongLong (&ok);
+    if (ok)
     {
-      CDidlElem const & elem = items[iItem].value (elemName);
-      value                  = index != -1 ? elem.props ().value (propName) : elem.value ();
-      if (type != String)
+      sortKeys.m_type = SSortKeys::Numerical;
+    }
+    else if (::isDuration (value))
+    {
+      sortKeys.m_type = SSortKeys::Time;
+    }
+    else if (QDateTime::fromString (value, Qt::ISODate).isValid ())
+    {
+      sortKeys.m_type = SSortKeys::Date;
+    }
+
+    if (sortKeys.m_type == SSortKeys::String)
+    {
+      sortKeys.m_strings.reserve (cItems);
+    }
+    else
+    {
+      sortKeys.m_numbers.resize (cItems);
+    }
+
+    for (int iItem = 0; iItem < cItems; ++iItem)
+    {
+      value = sortKeys.value (items[iItem]);
+      switch (sortKeys.m_type)
       {
-        int k = kmax - 1;
-        for  (int i = value.length () - 1; i >= 0; --i, --k)
+        case SSortKeys::Numerical :
+          sortKeys.m_numbers[iItem] = value.toLongLong ();
+          break;
+
+        case SSortKeys::Time :
+          sortKeys.m_numbers[iItem] = ::timeToMS (value);
+          break;
+
+        case SSortKeys::Date :
         {
-          value[k] = value[i];
+          QDateTime date            = QDateTime::fromString (value, Qt::ISODate);
+          sortKeys.m_numbers[iItem] = date.isValid () ? date.toMSecsSinceEpoch () : 0;
+          break;
         }
 
-        for (; k >= 0; --k)
+        default :
+          sortKeys.m_strings.push_back (collator.sortKey (value));
+          break;
+      }
+    }
+
+    keys.append (std::move (sortKeys));
+  }
+
+  if (!keys.isEmpty ())
+  { // Sorts the item indexes, the equal items keep their order.
+    QVector<int> indexes (cItems);
+    std::iota (indexes.begin (), indexes.end (), 0);
+    std::stable_sort (indexes.begin (), indexes.end (), [&keys] (int i1, int i2) -> bool
+    {
+      for (SSortKeys const & sortKeys : keys)
+      {
+        int result = sortKeys.compare (i1, i2);
+        if (result != 0)
         {
-          value[k] = '0';
+          return result < 0;
         }
       }
 
-      itemArray[iItem] = TSortItem (value, items[iItem]);
-    }
+      return false;
+    });
 
-    auto lt = [] (TSortItem const & s1, TSortItem const & s2) -> bool { return s1.first < s2.first; };
-    auto gt = [] (TSortItem const & s1, TSortItem const & s2) -> bool { return s1.first > s2.first; };
-    std::sort (itemArray.begin (), itemArray.end (), dir ? gt : lt);
-
-    for (int iItem = 0, end = items.size (); iItem < end; ++iItem)
+    QList<CDidlItem> sorted;
+    sorted.reserve (cItems);
+    for (int index : indexes)
     {
-      items[iItem] = itemArray[iItem].second;
+      sorted.append (items[index]);
     }
+
+    items.swap (sorted);
   }
 }
 
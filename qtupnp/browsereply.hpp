@@ -73,6 +73,8 @@ public :
    * \param criteria: The criteria is the CDidlElem name or property.
    * To sort by CDidlElem name, the criteria must be the complet name (e.g. to sort by title, the criteria is "dc:title").
    * To sort by property, the criteria must have the form "name@property".
+   * Several criteria are separated by commas. A criterion starting by + or - is sorted in ascending or descending order
+   * whatever dir (e.g. "+upnp:class,-dc:date").
    * \param dir: ascending or descending see ESortDir.
    * E.g. To sort by duration, the criteria is "res@duration".
    */
@@ -98,6 +100,9 @@ public :
    * To sort by property, the criteria must have the form "name@property".
    * E.g. To sort by duration, the criteria is "res@duration".
    * \param dir: Ascending or Descending see ESortDir.
+   *
+   * The values are compared as numbers, durations, ISO dates or strings (locale collation),
+   * following the first value of each criterion. The keys are computed once and the equal items keep their order.
    */
   static void sort (CBrowseReply& reply, QString const & criteria, ESortDir dir = Ascending);
 
@@ -108,6 +113,8 @@ public :
    * \param commonPrefixLength; Winkler common prefix see jaroWinklerDistance in helper.hpp.
    * \param returned: Max number of CDidlItem return. If returned <= 0 or > items size, returnd whill be items size.
    * \return The list of sorted CDidlItem.
+   * \remark The first search builds a CSearchIndex of the items, kept for the next searches until the items change.
+   * The index is built under a lock, copies of the reply can be searched from several threads.
    */
   QList<CDidlItem> search (QString text, int returned = -1, int commonPrefixLength = -1) const;
 
@@ -119,6 +126,8 @@ public :
    * \param commonPrefixLength; Winkler common prefix see jaroWinklerDistance in helper.hpp.
    * \param returned: Max number of CDidlItem return. If returned <= 0 or > items size, returnd whill be items size.
    * \return The list of sorted CDidlItem.
+   * \remark The function compares the title words of each item, see CSearchIndex::scan. To search several times
+   * the same items, use CSearchIndex.
    */
   static QList<CDidlItem> search (QList<CDidlItem> const & items, QString text, int returned = -1,
                                   int commonPrefixLength = -1);
@@ -1,9 +1,25 @@
 #include "contentdirectory.hpp"
 #include "actioninfo.hpp"
 #include "xmlhdidllite.hpp"
+#include "metrics.hpp"
 
 USING_UPNP_NAMESPACE
 
+/*! Returns the items of the DIDL-Lite result of Browse or Search. */
+static QList<CDidlItem> parseDidl (QString const & didl, char const * action)
+{
+  CMetrics&     metrics = CMetrics::instance ();
+  qint64        start   = metrics.now ();
+  CXmlHDidlLite h;
+  h.parse (didl);
+  if (metrics.isEnabled ())
+  {
+    metrics.observe ("upnp_didl_parse_ms", CMetrics::TLabels { { "action", action } }, (metrics.now () - start) / 1000.0);
+  }
+
+  return h.items ();
+}
+
 CBrowseReply CContentDirectory::browse (QString const & serverUUID,
             QString const & objectID, EBrowseType type, QString const & filter,
             int startingIndex, int requestedCount, QString const & sortCriteria)
@@ -25,9 +41,7 @@ CBrowseReply CContentDirectory::browse (QString const & serverUUID,
       cReturned = tempReply.numberReturned ();
       if (cReturned != 0)
       {
-        CXmlHDidlLite h;
-        h.parse (args[6].second);
-        tempReply.setItems (h.items ());
+        tempReply.setItems (parseDidl (args[6].second, "Browse"));
 
         reply          += tempReply;
         index          += cReturned;
@@ -59,7 +73,7 @@ CBrowseReply CContentDirectory::search (QString const & serverUUID, QString cons
   {
     CBrowseReply                    tempReply;
     QList<CControlPoint::TArgValue> args = searchArguments (containerID, searchCriteria,
-                  filter, startingIndex, requestedCount, sortCriteria);
+                  filter, index, requestedCount, sortCriteria);
     CActionInfo actionInfo = m_cp->invokeAction (serverUUID, "Search", args, m_browseTimeout);
     if (actionInfo.succeeded ())
     {
@@ -69,9 +83,7 @@ CBrowseReply CContentDirectory::search (QString const & serverUUID, QString cons
       cReturned = tempReply.numberReturned ();
       if (cReturned != 0)
       {
-        CXmlHDidlLite h;
-        h.parse (args[6].second);
-        tempReply.setItems (h.items ());
+        tempReply.setItems (parseDidl (args[6].second, "Search"));
 
         reply          += tempReply;
         index          += cReturned;
@@ -92,6 +104,94 @@ CBrowseReply CContentDirectory::search (QString const & serverUUID, QString cons
   return reply;
 }
 
+bool CContentDirectory::searchPages (QString const & serverUUID, QString const & containerID,
+             QString const & searchCriteria, TPageHandler const & handler, QString const & filter,
+             int pageSize, int window, QString const & sortCriteria)
+{
+  Q_ASSERT (m_cp != nullptr);
+  bool                    success = true, more = true;
+  int                     index   = 0, totalMatches = 0;
+  QMap<int, CBrowseReply> fetched; // Pages received ahead of index, by starting index.
+  pageSize                        = std::max (pageSize, 1);
+  while (success && more)
+  { // The first page gives the total matches. Without it, the pages are requested one by one.
+    // Only the ranges not already received are requested. When the server returns less items
+    // than requested, the pages received after the short one are kept and the gap is filled.
+    int                                    cPages = totalMatches != 0 ? std::max (window, 1) : 1;
+    QList<int>                             starts, counts;
+    QList<QList<CControlPoint::TArgValue>> argsList;
+    QMap<int, CBrowseReply>::const_iterator next = fetched.constBegin ();
+    for (int start = index; starts.size () < cPages && (starts.isEmpty () || start < totalMatches); )
+    {
+      int count = pageSize;
+      if (next != fetched.constEnd ())
+      {
+        if (start >= next.key ())
+        {
+          break;
+        }
+
+        count = std::min (count, next.key () - start);
+      }
+
+      starts << start;
+      counts << count;
+      argsList << searchArguments (containerID, searchCriteria, filter, start, count, sortCriteria);
+      start += count;
+    }
+
+    QList<CActionInfo> actionInfos = m_cp->invokeActions (serverUUID, "Search", argsList, m_browseTimeout);
+    success                        = actionInfos.size () == argsList.size ();
+    for (int k = 0; k < actionInfos.size () && success; ++k)
+    {
+      success = actionInfos[k].succeeded ();
+      if (success)
+      {
+        CBrowseReply                            page;
+        QList<CControlPoint::TArgValue> const & args = argsList[k];
+        page.setNumberReturned (args[7].second.toUInt ());
+        page.setTotalMatches (args[8].second.toUInt ());
+        page.setUpdateID (args[9].second.toUInt ());
+        totalMatches = page.totalMatches ();
+        if (page.numberReturned () != 0)
+        {
+          page.setItems (parseDidl (args[6].second, "Search"));
+          if (page.numberReturned () < counts[k])
+          { // The server returns less items than requested. The next requests use its count.
+            pageSize = page.numberReturned ();
+          }
+        }
+
+        fetched.insert (starts[k], page);
+      }
+    }
+
+    // Give the in-order prefix of what is received.
+    while (success && more && fetched.contains (index))
+    {
+      CBrowseReply page      = fetched.take (index);
+      int          cReturned = page.numberReturned ();
+      if (cReturned != 0)
+      {
+        index += cReturned;
+        more   = handler (page) && (totalMatches == 0 || index < totalMatches);
+      }
+      else
+      {
+        more = false;
+      }
+    }
+
+    // A page can not start before index, except with a server returning more than requested.
+    while (!fetched.isEmpty () && fetched.firstKey () < index)
+    {
+      fetched.remove (fetched.firstKey ());
+    }
+  }
+
+  return success;
+}
+
 QStringList CContentDirectory::getSearchCaps (QString const & serverUUID)
 {
   Q_ASSERT (m_cp != nullptr);
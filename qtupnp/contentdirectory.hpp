@@ -4,6 +4,7 @@
 #include "control.hpp"
 #include "controlpoint.hpp"
 #include "browsereply.hpp"
+#include <functional>
 
 START_DEFINE_UPNP_NAMESPACE
 
@@ -19,6 +20,9 @@ public:
                      BrowseDirectChildren, //!< Return the children.
                    };
 
+  /*! The function called with each page of searchPages. It returns false to stop the search. */
+  typedef std::function<bool (CBrowseReply const & page)> TPageHandler;
+
   /*! The defaut constructor. */
   CContentDirectory () {}
 
@@ -70,6 +74,26 @@ public:
                        int startingIndex = 0, int requestedCount = 0,
                        QString const & sortCriteria = QString::null);
 
+  /*! Searchs from a container identifier and gives the results page by page.
+   * The first page gives the total matches, then up to window pages are requested concurrently.
+   * The delivery is per window: the pages are given in order to handler once a window is received,
+   * and handler can stop the search early. When the server returns less items than requested, the pages
+   * received after the short one are kept, only the missing range is requested again.
+   * \param serverUUID: Server uuid.
+   * \param containerID: Server uuid.
+   * \param searchCriteria: Search criteria of the request. See search.
+   * \param handler: The function called with each page. It returns false to stop the search.
+   * \param filter: Filter of the request. See search.
+   * \param pageSize: The number of items requested by page. It is reduced if the server returns less.
+   * \param window: The number of pages requested at once.
+   * \param sortCriteria: The sort criteria. See search.
+   * \return False if an action failed.
+   */
+  bool searchPages (QString const & serverUUID, QString const & containerID,
+                    QString const & searchCriteria, TPageHandler const & handler,
+                    QString const & filter = "*", int pageSize = 100, int window = 4,
+                    QString const & sortCriteria = QString::null);
+
   /*! Returns search capabilities.
    * \param serverUUID: Server uuid.
    * \return The search capabilities.
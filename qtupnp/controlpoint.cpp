@@ -1,11 +1,10 @@
 #include "controlpoint.hpp"
-#include "initialdiscovery.hpp"
 #include "xmlhaction.hpp"
 #include "actioninfo.hpp"
-#include "multicastsocket.hpp"
-#include "unicastsocket.hpp"
+#include "discoveryworker.hpp"
 #include "plugin.hpp"
 #include "dump.hpp"
+#include "metrics.hpp"
 #include <QDir>
 #include <QLibrary>
 #include <QCoreApplication>
@@ -40,63 +39,40 @@ CControlPoint::~CControlPoint ()
   {
     close ();
   }
-}
 
-CMulticastSocket* CControlPoint::initializeMulticast (QHostAddress const & host, QHostAddress const & group, char const * name)
-{
-  CMulticastSocket* socket = new CMulticastSocket (this);
-  if (socket->initialize (host, group))
-  {
-    socket->setName (name);
-    connect (socket, SIGNAL(readyRead()), this, SLOT(readDatagrams()));
-  }
-  else
-  {
-    delete socket;
-    socket = nullptr;
-  }
-
-  return socket;
+  // The worker and its sockets are deleted in the discovery thread when it finishes.
+  m_discoveryThread.quit ();
+  m_discoveryThread.wait ();
+  m_discoveryWorker = nullptr;
 }
 
-CUnicastSocket* CControlPoint::initializeUnicast (QHostAddress const & host, char const * name)
+bool CControlPoint::initialize ()
 {
-  CUnicastSocket* socket = new CUnicastSocket (this);
-  if (socket->bind (host))
-  {
-    socket->setName (name);
-    connect (socket, SIGNAL(readyRead()), this, SLOT(readDatagrams()));
-  }
-  else
-  {
-    delete socket;
-    socket = nullptr;
+  if (m_discoveryWorker != nullptr)
+  { // Already initialized by the constructor.
+    return m_done;
   }
 
-  return socket;
-}
-
-bool CControlPoint::initialize ()
-{
   new CDump (this);
   bool done         = false;
-  m_multicastSocket = initializeMulticast (QHostAddress::AnyIPv4, CMulticastSocket::upnpMulticastAddr, "MulticastSocket");
-  if (m_multicastSocket != nullptr)
+  m_discoveryWorker = new CDiscoveryWorker;
+  m_discoveryWorker->moveToThread (&m_discoveryThread);
+  connect (&m_discoveryThread, &QThread::finished, m_discoveryWorker, &QObject::deleteLater);
+  connect (m_discoveryWorker, SIGNAL(devicesReady()), &m_newDevicesDetectedTimer, SLOT(start()));
+  m_discoveryThread.setObjectName ("Discovery");
+  m_discoveryThread.start ();
+
+  // The sockets must be created in the discovery thread.
+  QMetaObject::invokeMethod (m_discoveryWorker, "initialize", Qt::BlockingQueuedConnection, Q_RETURN_ARG (bool, done));
+  if (done)
   {
-    m_multicastSocket6 = initializeMulticast (QHostAddress::AnyIPv6, CMulticastSocket::upnpMulticastAddr6, "MulticastSocket6");
-    m_unicastSocket    = initializeUnicast (CUpnpSocket::localHostAddress (), "UnicastSocket");
-    if (m_unicastSocket != nullptr)
-    {
-      m_unicastSocketLocal = initializeUnicast (QHostAddress ("127.0.0.1"), "UnicastSocketLocal");
-      CHTTPServer* server = m_devices.httpServer ();
-      connect (server, &CHTTPServer::eventReady, this, &CControlPoint::updateEventVars);
-      connect (server, &CHTTPServer::mediaRequest, this, &CControlPoint::mediaRequest);
-      connect (server, &CHTTPServer::serverComStarted, this, &CControlPoint::serverComStarted);
-      connect (server, &CHTTPServer::serverComEnded, this, &CControlPoint::serverComEnded);
-      connect (server, &CHTTPServer::rendererComStarted, this, &CControlPoint::rendererComStarted);
-      connect (server, &CHTTPServer::rendererComEnded, this, &CControlPoint::rendererComEnded);
-      done = true;
-    }
+    CHTTPServer* server = m_devices.httpServer ();
+    connect (server, &CHTTPServer::eventReady, this, &CControlPoint::updateEventVars);
+    connect (server, &CHTTPServer::mediaRequest, this, &CControlPoint::mediaRequest);
+    connect (server, &CHTTPServer::serverComStarted, this, &CControlPoint::serverComStarted);
+    connect (server, &CHTTPServer::serverComEnded, this, &CControlPoint::serverComEnded);
+    connect (server, &CHTTPServer::rendererComStarted, this, &CControlPoint::rendererComStarted);
+    connect (server, &CHTTPServer::rendererComEnded, this, &CControlPoint::rendererComEnded);
   }
 
   return done;
@@ -120,34 +96,37 @@ bool CControlPoint::avDiscover ()
     }
 
     m_devices.setAVOnly ();
+    CMetrics&    metrics = CMetrics::instance ();
+    qint64       start   = metrics.now ();
     char const * urns[] = { "urn:schemas-upnp-org:device:MediaServer:1",
                             "urn:schemas-upnp-org:device:MediaRenderer:1",
                             "upnp:rootdevice",
                           };
 
-    int               cDeviceTypes = sizeof (urns) / sizeof (char const *);
-    int               cDiscoveries = cDeviceTypes * 4;
-    int               iDiscovery   = 0;
-    CInitialDiscovery initDiscovery (nullptr, CMulticastSocket::upnpMulticastAddr, CMulticastSocket::upnpMulticastPort);
+    int cDeviceTypes = sizeof (urns) / sizeof (char const *);
+    int cDiscoveries = cDeviceTypes * 4;
+    int iDiscovery   = 0;
     for (int iDeviceType = 0; iDeviceType < cDeviceTypes; ++iDeviceType)
     {
       int          index = iDeviceType % cDeviceTypes;
       char const * urn   = urns[index];
 
-      initDiscovery.setSocket (m_unicastSocket);
-      success |= initDiscovery.discover (false, urn);
+      success |= search (CDiscoveryWorker::Unicast, urn);
       emit searched (urn, ++iDiscovery, cDiscoveries);
-      success |= initDiscovery.discover (false, urn);
+      success |= search (CDiscoveryWorker::Unicast, urn);
       emit searched (urn, ++iDiscovery, cDiscoveries);
 
-      initDiscovery.setSocket (m_unicastSocketLocal);
-      success |= initDiscovery.discover (false, urn);
+      success |= search (CDiscoveryWorker::UnicastLocal, urn);
       emit searched (urn, ++iDiscovery, cDiscoveries);
-      success |= initDiscovery.discover (false, urn);
+      success |= search (CDiscoveryWorker::UnicastLocal, urn);
       emit searched (urn, ++iDiscovery, cDiscoveries);
 
       ++iDeviceType;
     }
+
+    qint64 duration = metrics.now () - start;
+    metrics.observe ("upnp_discovery_phase_ms", CMetrics::TLabels { { "phase", "search" } }, duration / 1000.0);
+    metrics.span ("search", "discovery", start, duration);
   }
 
   return success;
@@ -158,81 +137,70 @@ bool CControlPoint::discover (char const * nt)
   bool success = false;
   if (!m_closing)
   {
-    int               iDiscovery   = 0;
-    CInitialDiscovery initDiscovery (m_unicastSocket, CMulticastSocket::upnpMulticastAddr, CMulticastSocket::upnpMulticastPort);
-
-    success |= initDiscovery.discover (false, nt);
+    int iDiscovery = 0;
+    success |= search (CDiscoveryWorker::Unicast, nt);
     emit searched (nt, ++iDiscovery, 4);
 
-    success |= initDiscovery.discover (false, nt);
+    success |= search (CDiscoveryWorker::Unicast, nt);
     emit searched (nt, ++iDiscovery, 4);
 
-    initDiscovery.setSocket (m_unicastSocketLocal);
-    success |= initDiscovery.discover (false, nt);
+    success |= search (CDiscoveryWorker::UnicastLocal, nt);
     emit searched (nt, ++iDiscovery, 4);
 
-    success |= initDiscovery.discover (false, nt);
+    success |= search (CDiscoveryWorker::UnicastLocal, nt);
     emit searched (nt, ++iDiscovery, 4);
   }
 
   return success;
 }
 
-void CControlPoint::readDatagrams ()
+bool CControlPoint::search (int socket, char const * nt)
 {
-  CUpnpSocket*       socket    = static_cast<CUpnpSocket*>(sender ());
-  QByteArray const & datagrams = socket->readDatagrams ();
-  if (!datagrams.isEmpty () && datagrams.endsWith ("\r\n\r\n"))
-  {
-    socket->decodeDatagram ();
-    m_newDevicesDetectedTimer.start ();
-  }
+  bool success = false;
+  QMetaObject::invokeMethod (m_discoveryWorker, "search", Qt::BlockingQueuedConnection, Q_RETURN_ARG (bool, success),
+                             Q_ARG (int, socket), Q_ARG (QByteArray, QByteArray (nt)));
+  return success;
 }
 
 void CControlPoint::newDevicesDetected ()
 {
-#ifdef Q_OS_LINUX
-  CUpnpSocket* sockets[]           = { m_unicastSocket, m_unicastSocketLocal, m_multicastSocket, m_multicastSocket6 };
-  int          cRemainingDatagrams = 0;
-  for (CUpnpSocket* socket : sockets)
-  {
-    if (socket != nullptr)
-    {
-      cRemainingDatagrams += socket->datagram ().size ();
-    }
+  if (m_processingDevices)
+  { // Called by an event loop of extractDevicesFromNotify. The outer call takes the new devices.
+    return;
   }
 
-
-  if (cRemainingDatagrams != 0)
-  { // Delayed devices creation.
+#ifdef Q_OS_LINUX
+  if (m_discoveryWorker->hasIncompleteDatagrams () && m_newDevicesDeferrals < MaxNewDevicesDeferrals)
+  { // Delayed devices creation. Limited to not starve when datagrams keep arriving.
+    ++m_newDevicesDeferrals;
     m_newDevicesDetectedTimer.start ();
     return;
   }
+
+  m_newDevicesDeferrals = 0;
 #endif
 
-  ++m_level;
-  if (extractDevicesFromNotify () != 0) // Extracts devices from UDP socket cache.
+  m_processingDevices = true;
+  do
   {
-    if (m_level == 1)
+    extractDevicesFromNotify (); // Extracts devices from the discovery thread snapshot.
+    QStringList lostDevices = m_devices.lostDevices ();
+    QStringList newDevices  = m_devices.newDevices ();
+    m_devices.lostDevices ().clear ();
+    m_devices.newDevices ().clear ();
+    for (QString const & device : lostDevices)
     {
-      QStringList lostDevices = m_devices.lostDevices ();
-      for (QString const & device : lostDevices)
-      {
-        emit lostDevice (device);
-      }
-
-      QStringList newDevices = m_devices.newDevices ();
-      for (QString const & device : newDevices)
-      {
-        emit newDevice (device);
-      }
+      emit lostDevice (device);
+    }
 
-      m_devices.lostDevices ().clear ();
-      m_devices.newDevices ().clear ();
+    for (QString const & device : newDevices)
+    {
+      emit newDevice (device);
     }
   }
+  while (!m_closing && m_discoveryWorker->hasDevices ());
 
-  --m_level;
+  m_processingDevices = false;
 }
 
 void CControlPoint::renewalTimeout ()
@@ -288,165 +256,272 @@ void CControlPoint::networkAccessManager (QString const & deviceUUID, QNetworkRe
   emit networkError (deviceUUID, errorCode, errorDesc);
 }
 
-QList<CUpnpSocket::SNDevice> CControlPoint::ndevices () const
+int CControlPoint::extractDevicesFromNotify (int timeout)
 {
-  QList<CUpnpSocket::SNDevice> devices;
-  int                          cDevices = 0;
-  CUpnpSocket*                 sockets[] = { m_unicastSocket, m_unicastSocketLocal, m_multicastSocket, m_multicastSocket6 };
-  for (CUpnpSocket* socket : sockets)
+  int cDevices = 0;
+  if (!m_closing)
   {
-    if (socket != nullptr)
+    QList<CUpnpSocket::SNDevice> ndevs = m_discoveryWorker->takeDevices ();
+    cDevices                           = m_devices.extractDevicesFromNotify (ndevs, timeout);
+
+    // The repeated ssdp:alive of devices not created (e.g. the description fails) or lost
+    // must not be dropped by the discovery thread.
+    QStringList forgotten;
+    for (CUpnpSocket::SNDevice const & ndev : ndevs)
     {
-      cDevices += socket->devices ().size ();
+      if (!m_devices.contains (ndev.m_uuid) && !forgotten.contains (ndev.m_uuid))
+      {
+        forgotten.append (ndev.m_uuid);
+      }
     }
+
+    forgetDevices (forgotten);
   }
 
-  devices.reserve (cDevices);
-  for (CUpnpSocket* socket : sockets)
+  return cDevices;
+}
+
+void CControlPoint::forgetDevices (QStringList const & uuids)
+{
+  if (!uuids.isEmpty ())
   {
-    if (socket != nullptr)
+    QMetaObject::invokeMethod (m_discoveryWorker, "forgetDevices", Qt::QueuedConnection, Q_ARG (QStringList, uuids));
+  }
+}
+
+bool CControlPoint::prepareAction (CDevice& device, CService& service, QString const & actionName,
+                                   QList<TArgValue> const & args, CActionInfo& actionInfo, QUrl& url)
+{
+  bool              success = false;
+  TMActions const & actions = service.actions (); // Action list of service
+  if (actions.contains (actionName))
+  { // The service has the action
+    CAction const & action = actions.value (actionName);
+    url                    = device.url (); // Base url
+    url.setPath (service.controlURL ()); // complete service url
+    actionInfo.startMessage (device.uuid (), service.serviceType (), actionName); // Start the HTTP message with upnp format.
+
+    success                       = true;
+    TMArguments const & arguments = action.arguments (); // Argument list of action.
+    for (TArgValue const & arg : args)
     {
-      QList<CUpnpSocket::SNDevice> const & socketDevices = socket->devices ();
-      for (CUpnpSocket::SNDevice const & device : socketDevices)
+      if (arguments.contains (arg.first))
+      { // Known argument name.
+        CArgument const & argument = arguments.value (arg.first); // Get the argument.
+        if (argument.dir () == CArgument::In)
+        { // In argument
+          QString const &   relatedStateVariableName = argument.relatedStateVariable (); // Get related state variable name.
+          TMStateVariables& stateVariables           = service.stateVariables (); // Get related state variable.
+          if (stateVariables.contains (relatedStateVariableName))
+          { // Known state variable.
+            CStateVariable& stateVariable = stateVariables[relatedStateVariableName]; //Get the variable.
+            stateVariable.setValue (arg.second); // Change the variable value.
+            actionInfo.addArgument (arg.first, arg.second); // Add argument at the SOAP message
+          }
+          else
+          {
+            argStateVarRelationship (arg.first, relatedStateVariableName, actionName, device, service);
+          }
+        }
+      }
+      else
       {
-        devices.push_back (device);
+        unknownArg (arg.first, actionName, device, service);
+        success = false;
+        break;
       }
+    }
 
-      socket->resetDevices ();
+    if (success)
+    {
+      actionInfo.endMessage (); // End the HTTP message.
     }
   }
+  else
+  {
+    unknownAction (actionName, device, service);
+  }
 
-  return devices;
+  return success;
 }
 
-int CControlPoint::extractDevicesFromNotify (int timeout)
+void CControlPoint::parseActionResponse (CDevice& device, CService& service, QString const & actionName,
+                                         QList<TArgValue>& args, CActionInfo& actionInfo)
 {
-  int cDevices = 0;
-  if (!m_closing)
+  actionInfo.setSucceeded (true);
+
+  // Parse the action response.
+  QMap<QString, QString> vars; // Response of the action.
+  CXmlHAction            h (actionName, vars);
+  CMetrics&              metrics = CMetrics::instance ();
+  qint64                 start   = metrics.now ();
+  h.parse (actionInfo.response ());
+  if (metrics.isEnabled ())
   {
-    QList<CUpnpSocket::SNDevice> const & ndevs = ndevices ();
-    cDevices = m_devices.extractDevicesFromNotify (ndevs, timeout);
+    CMetrics::TLabels labels { { "service", service.serviceType () }, { "action", actionName } };
+    metrics.observe ("upnp_soap_parse_ms", labels, (metrics.now () - start) / 1000.0);
   }
 
-  return cDevices;
+  int errorCode = h.errorCode ();
+  if (errorCode != 0)
+  {
+    emit upnpError (errorCode, h.errorDesc ());
+  }
+  else
+  {
+    TMArguments const & arguments = service.actions ().value (actionName).arguments ();
+    // Update the out arguments value.
+    for (QList<TArgValue>::iterator it = args.begin (), end = args.end (); it != end; ++it)
+    {
+      TArgValue& arg = *it;
+      if (arguments.contains (arg.first))
+      { // Known argument.
+        CArgument const & argument                 = arguments.value (arg.first);
+        QString const &   relatedStateVariableName = argument.relatedStateVariable ();
+        TMStateVariables& stateVariables           = service.stateVariables ();
+        if (stateVariables.contains (relatedStateVariableName))
+        { // Known state variable.
+          CStateVariable& stateVariable = stateVariables[relatedStateVariableName];
+          if (argument.dir () == CArgument::Out)
+          { // Argument out direction.
+            QString value = vars.value (arg.first);
+            stateVariable.setValue (value); // Update the related state variable.
+            stateVariable.constraints ().clear (); // Constraints are used only from event response.
+            arg.second = value; // Update the argument value.
+          }
+        }
+        else
+        {
+          argStateVarRelationship (arg.first, relatedStateVariableName, actionName, device, service);
+        }
+      }
+      else
+      {
+        unknownArg (arg.first, actionName, device, service);
+      }
+    }
+  }
 }
 
 CActionInfo CControlPoint::invokeAction (CDevice& device, CService& service,
                                          QString const & actionName, QList<TArgValue>& args, int timeout)
 {
   m_lastActionError.clear ();
-  bool           success = false;
-  CActionInfo    actionInfo;
-  if (!m_closing)
+  CActionInfo actionInfo;
+  QString     uuid = device.uuid (); // Save device uuid because it can be deleted during event loop.
+  if (!service.componentsLoaded ())
+  {
+    device.extractServiceComponents (service, m_devices.networkAccessManager (), timeout);
+  }
+
+  QUrl url;
+  if (!m_closing && m_devices.contains (uuid) && prepareAction (device, service, actionName, args, actionInfo, url))
   {
-    QString        uuid       = device.uuid (); // Save device uuid because it can be deleted during event loop.
     CDevice::EType deviceType = device.type ();
     CActionManager actionManager (m_devices.networkAccessManager ());
     connect (&actionManager, SIGNAL(networkError(QString const &, QNetworkReply::NetworkError, QString const &)),
              this, SLOT(networkAccessManager(QString const &, QNetworkReply::NetworkError, QString const &)));
 
-    TMActions const & actions = service.actions (); // Action list of service
-    if (actions.contains (actionName))
-    { // The service has the action
-      CAction const & action  = actions.value (actionName);
-      QUrl            url     = device.url (); // Base url
-      url.setPath (service.controlURL ()); // complete service url
-      actionInfo.startMessage (device.uuid (), service.serviceType (), actionName); // Start the HTTP message with upnp format.
-
-      success                       = true;
-      TMArguments const & arguments = action.arguments (); // Argument list of action.
-      for (TArgValue const & arg : args)
+    startNetworkCom (deviceType);
+    bool success = actionManager.post (uuid, url, actionInfo, timeout); // Invoke the action.
+    endNetworkCom (deviceType);
+    if (success && m_devices.contains (uuid))
+    {
+      parseActionResponse (device, service, actionName, args, actionInfo);
+    }
+  }
+
+  return actionInfo;
+}
+
+QList<CActionInfo> CControlPoint::invokeActions (QString const & deviceUUID, QString const & actionName,
+                                                 QList<QList<TArgValue>>& argsList, int timeout)
+{
+  m_lastActionError.clear ();
+  QList<CActionInfo> actionInfos;
+  QString            serviceID;
+  if (!deviceUUID.isEmpty () && m_devices.contains (deviceUUID))
+  { // Search the service of the action.
+    // The loading of the components runs an event loop where the device can be removed.
+    // Hence the services are found again by their identifier rather than by iterators.
+    QStringList serviceIDs = m_devices[deviceUUID].services ().keys ();
+    for (QString const & id : serviceIDs)
+    {
+      if (!m_devices.contains (deviceUUID))
+      {
+        break; // Must be deleted during event loop.
+      }
+
+      CDevice&    device   = m_devices[deviceUUID];
+      TMServices& services = device.services ();
+      if (!services.contains (id))
       {
-        if (arguments.contains (arg.first))
-        { // Known argument name.
-          CArgument const & argument = arguments.value (arg.first); // Get the argument.
-          if (argument.dir () == CArgument::In)
-          { // In argument
-            QString const &   relatedStateVariableName = argument.relatedStateVariable (); // Get related state variable name.
-            TMStateVariables& stateVariables           = service.stateVariables (); // Get related state variable.
-            if (stateVariables.contains (relatedStateVariableName))
-            { // Known state variable.
-              CStateVariable& stateVariable = stateVariables[relatedStateVariableName]; //Get the variable.
-              stateVariable.setValue (arg.second); // Change the variable value.
-              actionInfo.addArgument (arg.first, arg.second); // Add argument at the SOAP message
-            }
-            else
-            {
-              argStateVarRelationship (arg.first, relatedStateVariableName, actionName, device, service);
-            }
-          }
-        }
-        else
-        {
-          unknownArg (arg.first, actionName, device, service);
-          success = false;
-          break;
-        }
+        continue;
       }
 
-      if (success)
+      if (!services[id].componentsLoaded ())
       {
-        actionInfo.endMessage (); // End the HTTP message.
-        startNetworkCom (deviceType);
-        success = actionManager.post (uuid, url, actionInfo, timeout); // Invoke the action.
-        endNetworkCom (deviceType);
-        if (success && m_devices.contains (uuid))
+        device.extractServiceComponents (services[id], m_devices.networkAccessManager (), timeout);
+        if (!m_devices.contains (deviceUUID) || !m_devices[deviceUUID].services ().contains (id))
         {
-          actionInfo.setSucceeded (success);
-
-          // Parse the action response.
-          QMap<QString, QString> vars; // Response of the action.
-          CXmlHAction            h (actionName, vars);
-          h.parse (actionInfo.response ());
-          int errorCode = h.errorCode ();
-          if (errorCode != 0)
-          {
-            emit upnpError (errorCode, h.errorDesc ());
-          }
-          else
-          {
-            TMArguments const & arguments = action.arguments ();
-            // Update the out arguments value.
-            for (QList<TArgValue>::iterator it = args.begin (), end = args.end (); it != end; ++it)
-            {
-              TArgValue& arg = *it;
-              if (arguments.contains (arg.first))
-              { // Known argument.
-                CArgument const & argument                 = arguments.value (arg.first);
-                QString const &   relatedStateVariableName = argument.relatedStateVariable ();
-                TMStateVariables& stateVariables           = service.stateVariables ();
-                if (stateVariables.contains (relatedStateVariableName))
-                { // Known state variable.
-                  CStateVariable& stateVariable = stateVariables[relatedStateVariableName];
-                  if (argument.dir () == CArgument::Out)
-                  { // Argument out direction.
-                    QString value = vars.value (arg.first);
-                    stateVariable.setValue (value); // Update the related state variable.
-                    stateVariable.constraints ().clear (); // Constraints are used only from event response.
-                    arg.second = value; // Update the argument value.
-                  }
-                }
-                else
-                {
-                  argStateVarRelationship (arg.first, relatedStateVariableName, actionName, device, service);
-                }
-              }
-              else
-              {
-                unknownArg (arg.first, actionName, device, service);
-              }
-            }
-          }
+          continue;
         }
       }
+
+      if (m_devices[deviceUUID].services ()[id].actions ().contains (actionName))
+      {
+        serviceID = id;
+        break;
+      }
     }
-    else
+  }
+  else
+  {
+    m_lastActionError.setString (ErrorDeviceUUID, deviceUUID);
+  }
+
+  if (!serviceID.isEmpty () && !m_closing && m_devices.contains (deviceUUID))
+  {
+    CDevice&  device  = m_devices[deviceUUID];
+    CService& service = device.services ()[serviceID];
+    QUrl      url;
+    bool      success = true;
+    for (QList<TArgValue> const & args : argsList)
     {
-      unknownAction (actionName, device, service);
+      CActionInfo actionInfo;
+      success = success && prepareAction (device, service, actionName, args, actionInfo, url);
+      actionInfos.append (actionInfo);
+    }
+
+    if (success)
+    {
+      CDevice::EType deviceType = device.type ();
+      CActionManager actionManager (m_devices.networkAccessManager ());
+      connect (&actionManager, SIGNAL(networkError(QString const &, QNetworkReply::NetworkError, QString const &)),
+               this, SLOT(networkAccessManager(QString const &, QNetworkReply::NetworkError, QString const &)));
+
+      startNetworkCom (deviceType);
+      QVector<bool> successes = actionManager.post (deviceUUID, url, actionInfos, timeout); // Invoke the actions.
+      endNetworkCom (deviceType);
+      for (int k = 0; k < successes.size (); ++k)
+      {
+        // The post runs an event loop, the references taken before can be dangling.
+        if (!m_devices.contains (deviceUUID) || !m_devices[deviceUUID].services ().contains (serviceID))
+        {
+          break; // Must be deleted during event loop.
+        }
+
+        if (successes[k])
+        {
+          CDevice&  postDevice  = m_devices[deviceUUID];
+          CService& postService = postDevice.services ()[serviceID];
+          parseActionResponse (postDevice, postService, actionName, argsList[k], actionInfos[k]);
+        }
+      }
     }
   }
 
-  return actionInfo;
+  return actionInfos;
 }
 
 CActionInfo CControlPoint::invokeAction (QString const & deviceUUID, QString const & serviceID,
@@ -505,18 +580,46 @@ CActionInfo CControlPoint::invokeAction (QString const & deviceUUID,
   return actionInfo;
 }
 
-CStateVariable CControlPoint::stateVariable (QString const & deviceUUID, QString const & serviceID, QString const & name) const
+CStateVariable CControlPoint::stateVariable (QString const & deviceUUID, QString const & serviceID, QString const & name)
 {
   CStateVariable var;
   if (!deviceUUID.isEmpty ())
   {
-    CDevice const & device = this->device (deviceUUID);
-    var                    = device.stateVariable (name, serviceID);
+    // The components must be loaded in the device of the map, not in a copy.
+    loadServiceComponents (deviceUUID, serviceID);
+    if (m_devices.contains (deviceUUID))
+    { // The device can be removed during the loading.
+      var = m_devices[deviceUUID].stateVariable (name, serviceID);
+    }
   }
 
   return var;
 }
 
+bool CControlPoint::loadServiceComponents (QString const & deviceUUID, QString const & serviceID, int timeout)
+{
+  bool success = false;
+  if (!deviceUUID.isEmpty () && m_devices.contains (deviceUUID))
+  {
+    CDevice&               device = m_devices[deviceUUID];
+    QNetworkAccessManager* naMgr  = m_devices.networkAccessManager ();
+    if (serviceID.isEmpty ())
+    {
+      success = device.extractServiceComponents (naMgr, timeout);
+    }
+    else
+    {
+      TMServices& services = device.services ();
+      if (services.contains (serviceID))
+      {
+        success = device.extractServiceComponents (services[serviceID], naMgr, timeout);
+      }
+    }
+  }
+
+  return success;
+}
+
 bool CControlPoint::subscribe (QString const & deviceUUID, int renewalDelay, int requestTimeout)
 {
   bool success = false;
@@ -737,6 +840,7 @@ QList<QString> CControlPoint::subscribedDevices () const
 void CControlPoint::removeDevice (QString const & uuid)
 {
   m_devices.removeDevice (uuid);
+  forgetDevices (QStringList (uuid));
 }
 
 void CControlPoint::initActionError (QString const & action, CDevice const & device, CService const & service)
@@ -819,18 +923,22 @@ QByteArray CControlPoint::callData (QString const & uri, int timeout)
 
 QString CControlPoint::deviceUUID (QString const & uri, CDevice::EType type) const
 {
-  QString     deviceUUID;
-  QString     ip    = QUrl (uri).host ();
-  QStringList uuids = devices (type);
-  for (QString const & uuid : uuids)
-  {
-    CDevice const & device = this->device (uuid);
-    QUrl const &    url    = device.url ();
-    QString         host   = url.host ();
-    if (host == ip)
+  QString ip         = QUrl (uri).host ();
+  QString deviceUUID = m_devices.uuid (ip);
+  if (!deviceUUID.isEmpty () && m_devices.value (deviceUUID).type () != type)
+  { // The host is shared by several devices (e.g. embedded devices).
+    deviceUUID.clear ();
+    QStringList uuids = devices (type);
+    for (QString const & uuid : uuids)
     {
-      deviceUUID = uuid;
-      break;
+      CDevice const & device = this->device (uuid);
+      QUrl const &    url    = device.url ();
+      QString         host   = url.host ();
+      if (host == ip)
+      {
+        deviceUUID = uuid;
+        break;
+      }
     }
   }
 
@@ -5,11 +5,11 @@
 #include "actionmanager.hpp"
 #include "httpserver.hpp"
 #include "helper.hpp"
+#include <QThread>
 
 START_DEFINE_UPNP_NAMESPACE
 
-class CUnicastSocket;
-class CMulticastSocket;
+class CDiscoveryWorker;
 class CPlugin;
 
 /*! \brief The CControlPoint class implements the base functionalities of an UPnP ControlPoint.
@@ -18,6 +18,8 @@ class CPlugin;
  * Probably, You will only need one control point for the application.
  * All root devices are searched.
  * The control insists particularly on UNpN/AV servers and renderers.
+ * The SSDP datagrams are received and decoded in a dedicated thread (see CDiscoveryWorker). The devices
+ * are created and the signals are emitted in the thread of the control point.
  * Because the discovery device and the UPnP events are asynchronous, it is not recommended
  * to use certain class directly for a long time.
  * In fact, a reference on a class (e.g. CDevice, CService, CAction, CArgument...) may be valid
@@ -207,6 +209,18 @@ public :
                             QList<TArgValue>& args = noArgs,
                             int timeout = CActionManager::Timeout);
 
+  /*! Invokes the same action several times at once, e.g. to get several pages of a Search action.
+   * The requests are sent concurrently and the function returns when all responses are received.
+   * \param deviceUUID: The device uuid.
+   * \param actionName; The name of the action.
+   * \param argsList: The action parameters of each invocation.
+   * \param timeout: The time out to wait all responds in ms.
+   * \return The action information of each invocation, empty if the action is not found.
+   */
+  QList<CActionInfo> invokeActions (QString const & deviceUUID, QString const & actionName,
+                                    QList<QList<TArgValue>>& argsList,
+                                    int timeout = CActionManager::Timeout);
+
   /*! Returns the http server for UPnP events.
    * \return The server. It is a not fully implemented HTTP server.
    */
@@ -240,8 +254,10 @@ public :
    * \param serviceID: The service identifier.
    * \param name: The variable name.
    * \return The variable.
+   *
+   * \remark The service components are loaded if needed, see loadServiceComponents.
    */
-  CStateVariable stateVariable (QString const & deviceUUID, QString const & serviceID, QString const & name) const;
+  CStateVariable stateVariable (QString const & deviceUUID, QString const & serviceID, QString const & name);
 
   /*! Returns the playlist URI.
    * \param name: The name of the playlist.
@@ -344,6 +360,32 @@ public :
    */
   void setExpandEmbeddedDevices () { m_devices.setExpandEmbeddedDevices (); }
 
+  /*! Sets the device filter. The devices rejected by the filter are dropped before any SCPD request
+   * and the signal newDevice is not emitted for them.
+   * e.g. to keep only the servers of a particular model.
+   * \code
+   * cp->setDeviceFilter ([] (CDevice const & device) { return device.modelName ().startsWith ("Fetch"); });
+   * \endcode
+   * Must be called before the discovery.
+   */
+  void setDeviceFilter (CDeviceMap::TDeviceFilter const & filter) { m_devices.setDeviceFilter (filter); }
+
+  /*! Sets the lazy service loading. The service list comes from the device description, but
+   * actions, arguments and state variables of a service are loaded at the first use of the service by
+   * invokeAction, stateVariable or subscribe.
+   * Must be called before the discovery.
+   */
+  void setLazyServiceLoading (bool lazy = true) { m_devices.setLazyServiceLoading (lazy); }
+
+  /*! Loads the actions and state variables of a service if not already done.
+   * \param deviceUUID: The device uuid.
+   * \param serviceID: The service identifier. If empty, all services of the device are loaded.
+   * \param timeout: The timeout of the SCPD request.
+   * \return True in case of success.
+   */
+  bool loadServiceComponents (QString const & deviceUUID, QString const & serviceID = QString (),
+                              int timeout = CDataCaller::Timeout);
+
   /*! Returns the plugin list. */
   QStringList plugins () const;
 
@@ -386,9 +428,6 @@ public :
   static QList<CControlPoint::TArgValue> noArgs;
 
 protected slots :
-  /*! Receipts unicast & multicast datagrams. */
-  void readDatagrams ();
-
   /*! Renewal subscribe timeout is emitted. */
   void renewalTimeout ();
 
@@ -421,7 +460,7 @@ protected slots :
    */
   void networkAccessManager (QString const & deviceUUID, QNetworkReply::NetworkError errorCode, QString const & errorDesc);
 
-  /*! New devices are detected. */
+  /*! New devices are detected by the discovery thread. */
   void newDevicesDetected ();
 
 signals :
@@ -461,11 +500,18 @@ signals :
   void networkComEnded (QtUPnP::CDevice::EType type);
 
 private :
-  CMulticastSocket* initializeMulticast (QHostAddress const & host, QHostAddress const & group, char const * name);
-  CUnicastSocket* initializeUnicast (QHostAddress const & host, char const * name);
+  /*! Max number of consecutive delays of newDevicesDetected while datagrams are incomplete. */
+  enum { MaxNewDevicesDeferrals = 10 };
 
-  /*! Returns the list of device recently discovered. */
-  QList<CUpnpSocket::SNDevice> ndevices () const;
+  /*! Sends an M-SEARCH datagram from the discovery thread.
+   * \param socket: CDiscoveryWorker::Unicast or CDiscoveryWorker::UnicastLocal.
+   * \param nt: The search target.
+   * \return True in case of success.
+   */
+  bool search (int socket, char const * nt);
+
+  /*! Removes devices from the repeated NOTIFY cache of the discovery thread. */
+  void forgetDevices (QStringList const & uuids);
 
   /*! Invoke an action of a device and a service.
    *
@@ -513,6 +559,17 @@ private :
     QVector<QString> m_strings; //!< The strings of the error.
   };
 
+  /*! Builds the SOAP message of an action.
+   * \param url: The control url of the service.
+   * \return False if the action or an argument is unknown.
+   */
+  bool prepareAction (CDevice& device, CService& service, QString const & actionName,
+                      QList<TArgValue> const & args, CActionInfo& actionInfo, QUrl& url);
+
+  /*! Parses the response of an action and updates the out arguments and the state variables. */
+  void parseActionResponse (CDevice& device, CService& service, QString const & actionName,
+                            QList<TArgValue>& args, CActionInfo& actionInfo);
+
   /*! Initializes action error. */
   void initActionError (QString const & action, CDevice const & device, CService const & service);
 
@@ -555,15 +612,14 @@ private :
   bool m_done = false; //!< The status of the creation.
   bool m_closing = false; //!< The control point  is being closed.
   bool m_networkCom = false; //!< Do not emit signals for network communications.
-  CUnicastSocket* m_unicastSocket = nullptr; //!< Unicast sockets.
-  CUnicastSocket* m_unicastSocketLocal = nullptr; //!< Unicast sockets local (bind on 127.0.0.1).
-  CMulticastSocket* m_multicastSocket = nullptr;  //!< Multicast sockets ipv4.
-  CMulticastSocket* m_multicastSocket6 = nullptr;  //!< Multicast sockets ipv6.
+  CDiscoveryWorker* m_discoveryWorker = nullptr; //!< Owns the unicast and multicast sockets.
+  QThread m_discoveryThread; //!< The thread of the discovery worker.
   CDeviceMap m_devices; //!< Map of discovered devices.
   QMap<QString, TSubscriptionTimer> m_subcriptionTimers; //!< Map of subscription timers.
   int m_renewalGard = 120; //!< Gard for renewing in seconds (2 mn).
   SLastActionError m_lastActionError; //!< Last error generate by the last action.
-  int m_level = 0; //!< To emit signal only once.
+  bool m_processingDevices = false; //!< New devices are being processed. To emit signal only once.
+  int m_newDevicesDeferrals = 0; //!< Number of consecutive delayed devices creations.
   QTimer m_newDevicesDetectedTimer; //!<< Timer to delayed device creation (similar at idle).
   QMap<QString, CPlugin*> m_plugins;
 
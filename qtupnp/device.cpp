@@ -1,6 +1,7 @@
 #include "device.hpp"
 #include "xmlhdevice.hpp"
 #include "datacaller.hpp"
+#include "metrics.hpp"
 
 START_DEFINE_UPNP_NAMESPACE
 
@@ -499,15 +500,34 @@ bool CDevice::extractServiceComponents (QNetworkAccessManager* naMgr, int timeou
   bool success = false;
   for (TMServices::iterator its = m_d->m_services.begin (), end = m_d->m_services.end (); its != end; ++its)
   {
-    CService& service = its.value ();
-    QString   scpdURL = service.scpdURL ();
-    success           = true;
+    success = extractServiceComponents (its.value (), naMgr, timeout);
+  }
+
+  return success;
+}
+
+bool CDevice::extractServiceComponents (CService& service, QNetworkAccessManager* naMgr, int timeout)
+{
+  bool success = true;
+  if (!service.componentsLoaded ())
+  {
+    QString scpdURL = service.scpdURL ();
     if (!scpdURL.isEmpty ())
     {
       QUrl url = m_d->m_url;
       url.setPath (scpdURL);
+      CMetrics&   metrics = CMetrics::instance ();
+      qint64      start   = metrics.now ();
       CDataCaller dc (naMgr);
       QByteArray  data = dc.callData (url.toString (), timeout);
+      if (metrics.isEnabled () || metrics.isTracing ())
+      {
+        qint64 duration = metrics.now () - start;
+        metrics.observe ("upnp_discovery_phase_ms", CMetrics::TLabels { { "phase", "scpd" } }, duration / 1000.0);
+        metrics.add ("upnp_device_bytes_received_total", CMetrics::TLabels { { "device", m_d->m_uuid } }, data.size ());
+        metrics.span ("scpd", "discovery", start, duration, CMetrics::TLabels { { "device", m_d->m_uuid }, { "service", service.serviceType () } });
+      }
+
       if (!data.isEmpty ())
       {
         success = service.parseXml (data);
@@ -523,9 +543,15 @@ bool CDevice::extractServiceComponents (QNetworkAccessManager* naMgr, int timeou
               break;
             }
           }
+
+          service.setComponentsLoaded (true);
         }
       }
     }
+    else
+    {
+      service.setComponentsLoaded (true);
+    }
   }
 
   return success;
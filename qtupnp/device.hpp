@@ -321,6 +321,15 @@ public:
   /*! Extracts the services components. */
   bool extractServiceComponents (QNetworkAccessManager* naMgr, int timeout = CDataCaller::Timeout);
 
+  /*! Extracts the components of one service of this device.
+   * The SCPD is retrieved and parsed only if it is not already done.
+   * \param service: The service. It must be a service of this device.
+   * \param naMgr: A QNetworkAccessManager.
+   * \param timeout: The timeout of the request.
+   * \return True in case of success.
+   */
+  bool extractServiceComponents (CService& service, QNetworkAccessManager* naMgr, int timeout = CDataCaller::Timeout);
+
   /*! Sets disabled the subscribtion for a list of services.
    * Assume a renderer have two no standard services named:
    * - urn:schemas-company-com:serviceId:X_ServiceManager
@@ -3,6 +3,7 @@
 #include "datacaller.hpp"
 #include "eventingmanager.hpp"
 #include "httpserver.hpp"
+#include "metrics.hpp"
 #include <QNetworkAccessManager>
 
 USING_UPNP_NAMESPACE
@@ -25,6 +26,11 @@ bool CDeviceMap::subscribe (CDevice& device, int renewDelay, int requestTimeout)
 {
   bool        success;
   int         cServices = 0, cEventings = 0;
+  if (m_lazyServiceLoading)
+  { // The evented status is known only when the service components are loaded.
+    device.extractServiceComponents (m_naMgr, requestTimeout);
+  }
+
   TMServices& services  = device.services ();
   for (TMServices::iterator it = services.begin (), end = services.end (); it != end; ++it)
   {
@@ -39,6 +45,7 @@ bool CDeviceMap::subscribe (CDevice& device, int renewDelay, int requestTimeout)
       if (success)
       {
         service.setSubscribeSID (em.sid ());
+        indexSID (em.sid (), device.uuid (), it.key ());
         ++cServices;
       }
     }
@@ -63,6 +70,7 @@ void CDeviceMap::renewSubscribe (CDevice& device, int requestTimeout)
         CEventingManager em (m_naMgr);
         if (!em.renewSubscribe (url, service.eventSubURL (), sid, requestTimeout))
         {
+          m_sidIndex.remove (sid);
           service.clearSID ();
         }
       }
@@ -82,6 +90,7 @@ void CDeviceMap::unsubscribe (CDevice& device, int requestTimeout)
     {
       CEventingManager em (m_naMgr);
       em.unsubscribe (url, service.eventSubURL (), sid, requestTimeout);
+      m_sidIndex.remove (sid);
       service.clearSID ();
     }
   }
@@ -96,7 +105,7 @@ CDeviceMap::iterator CDeviceMap::insertDevice (QString const & uuid)
 
 void CDeviceMap::insertDevice (CDevice& device)
 {
-  insert (device.uuid (), device); // Insert in the map.
+  insert (device.uuid (), device); // Insert in the map and the indexes.
   QList<CDevice>& subDevices = device.subDevices ();
   for (QList<CDevice>::iterator it = subDevices.begin (), end = subDevices.end (); it != end; ++it)
   {
@@ -109,9 +118,147 @@ void CDeviceMap::removeDevice (QString const & uuid)
   remove (uuid);
 }
 
+CDeviceMap::iterator CDeviceMap::insert (QString const & uuid, CDevice const & device)
+{
+  iterator it = find (uuid);
+  if (it != end ())
+  { // Replaced in place, device can be the value itself. The entries of the old device are removed first.
+    CDevice old = it.value ();
+    it.value () = device;
+    unindexDevice (old);
+  }
+  else
+  {
+    it = TMDevices::insert (uuid, device);
+  }
+
+  indexDevice (it.value ());
+  return it;
+}
+
+int CDeviceMap::remove (QString const & uuid)
+{
+  int      count = 0;
+  iterator it    = find (uuid);
+  if (it != end ())
+  {
+    CDevice device = it.value ();
+    TMDevices::erase (it);
+    unindexDevice (device);
+    count = 1;
+  }
+
+  return count;
+}
+
+CDevice CDeviceMap::take (QString const & uuid)
+{
+  CDevice  device;
+  iterator it = find (uuid);
+  if (it != end ())
+  {
+    device = it.value ();
+    TMDevices::erase (it);
+    unindexDevice (device);
+  }
+
+  return device;
+}
+
+void CDeviceMap::clear ()
+{
+  TMDevices::clear ();
+  m_hostIndex.clear ();
+  m_sidIndex.clear ();
+}
+
+void CDeviceMap::reindex (QString const & uuid)
+{
+  for (QHash<QString, QString>::iterator it = m_hostIndex.begin (); it != m_hostIndex.end ();)
+  {
+    it = it.value () == uuid ? m_hostIndex.erase (it) : it + 1;
+  }
+
+  for (QHash<QString, QPair<QString, QString>>::iterator it = m_sidIndex.begin (); it != m_sidIndex.end ();)
+  {
+    it = it.value ().first == uuid ? m_sidIndex.erase (it) : it + 1;
+  }
+
+  const_iterator it = constFind (uuid);
+  if (it != cend ())
+  {
+    indexDevice (it.value ());
+  }
+}
+
+void CDeviceMap::indexDevice (CDevice const & device)
+{
+  indexHost (device);
+  TMServices const & services = device.services ();
+  for (TMServices::const_iterator it = services.cbegin (), end = services.cend (); it != end; ++it)
+  {
+    QString const & sid = it.value ().subscribeSID ();
+    if (!sid.isEmpty ())
+    {
+      indexSID (sid, device.uuid (), it.key ());
+    }
+  }
+}
+
+void CDeviceMap::unindexDevice (CDevice const & device)
+{
+  QString const &    uuid     = device.uuid ();
+  TMServices const & services = device.services ();
+  for (TMServices::const_iterator its = services.cbegin (), end = services.cend (); its != end; ++its)
+  {
+    QString const & sid = its.value ().subscribeSID ();
+    if (!sid.isEmpty () && m_sidIndex.value (sid).first == uuid)
+    {
+      m_sidIndex.remove (sid);
+    }
+  }
+
+  QString host = device.url ().host ();
+  if (!host.isEmpty () && m_hostIndex.value (host) == uuid)
+  { // Another device of the host, e.g. an embedded device, takes the entry. Removals are rare.
+    rescanHost (host);
+  }
+}
+
+void CDeviceMap::rescanHost (QString const & host) const
+{
+  m_hostIndex.remove (host);
+  for (const_iterator it = cbegin (), end = cend (); it != end; ++it)
+  {
+    if (it.value ().url ().host () == host)
+    {
+      m_hostIndex.insert (host, it.key ());
+      break;
+    }
+  }
+}
+
+void CDeviceMap::indexHost (CDevice const & device)
+{
+  QString host = device.url ().host ();
+  if (!host.isEmpty ())
+  {
+    QString const &                   uuid = device.uuid ();
+    QHash<QString, QString>::iterator it   = m_hostIndex.find (host);
+    if (it == m_hostIndex.end ())
+    {
+      m_hostIndex.insert (host, uuid);
+    }
+    else if (uuid < it.value () || !contains (it.value ()))
+    {
+      it.value () = uuid;
+    }
+  }
+}
+
 bool CDeviceMap::extractServiceComponents (CDevice& device, int timeout)
 {
-  bool success = device.extractServiceComponents (m_naMgr, timeout);
+  bool success = m_lazyServiceLoading || device.extractServiceComponents (m_naMgr, timeout);
   if (success && m_expandEmbeddedDevices)
   {
     QString         parentUUID = device.uuid ();
@@ -165,8 +312,18 @@ int CDeviceMap::extractDevicesFromNotify (QList<CUpnpSocket::SNDevice> const & n
       {
         bool        success      = false;
         char const * failMessage = nullptr;
+        CMetrics&   metrics      = CMetrics::instance ();
+        qint64      start        = metrics.now ();
         CDevice&    device       = *insertDevice (nDevice.m_uuid); // Insert in the map.
         QByteArray  data         = CDataCaller (m_naMgr).callData (nDevice.m_url, timeout); // Get services, name, from device url.
+        if (metrics.isEnabled () || metrics.isTracing ())
+        {
+          qint64            duration = metrics.now () - start;
+          CMetrics::TLabels labels { { "phase", "description" } };
+          metrics.observe ("upnp_discovery_phase_ms", labels, duration / 1000.0);
+          metrics.add ("upnp_device_bytes_received_total", CMetrics::TLabels { { "device", nDevice.m_uuid } }, data.size ());
+          metrics.span ("description", "discovery", start, duration, CMetrics::TLabels { { "device", nDevice.m_uuid } });
+        }
         if (!data.isEmpty ())
         {
           QUrl url (nDevice.m_url.toString (QUrl::RemoveQuery));
@@ -176,7 +333,8 @@ int CDeviceMap::extractDevicesFromNotify (QList<CUpnpSocket::SNDevice> const & n
           {
             device.setType ();
             CDevice::EType type = device.type ();
-            if (!m_avOnly || type == CDevice::MediaServer || type == CDevice::MediaRenderer)
+            if ((!m_avOnly || type == CDevice::MediaServer || type == CDevice::MediaRenderer) &&
+                (!m_deviceFilter || m_deviceFilter (device)))
             {
               success = extractServiceComponents (device, timeout); // Extract state variables and actions
               if (!success)
@@ -214,6 +372,10 @@ int CDeviceMap::extractDevicesFromNotify (QList<CUpnpSocket::SNDevice> const & n
           qDebug () << failMessage << nDevice.m_uuid;
           removeDevice (nDevice.m_uuid);
         }
+        else
+        { // The filtered devices stay in the map and are indexed too.
+          indexHost (device);
+        }
       }
     }
   }
@@ -221,40 +383,45 @@ int CDeviceMap::extractDevicesFromNotify (QList<CUpnpSocket::SNDevice> const & n
   return size ();
 }
 
+void CDeviceMap::indexSID (QString const & sid, QString const & uuid, QString const & serviceID)
+{
+  m_sidIndex.insert (sid, QPair<QString, QString> (uuid, serviceID));
+}
+
 QString CDeviceMap::uuid (QString const & host) const
 {
-  QString uuid;
-  for (TMDevices::const_iterator it = cbegin (), end = cend (); it != end; ++it)
+  // The index is maintained by insert, remove, take, clear, reindex and extractDevicesFromNotify.
+  // An unknown host is not searched.
+  QHash<QString, QString>::const_iterator it = m_hostIndex.constFind (host);
+  if (it == m_hostIndex.cend ())
   {
-    CDevice const & device = it.value ();
-    QUrl const &    url    = device.url ();
-    if (url.host () == host)
-    {
-      uuid = device.uuid ();
-      break;
-    }
+    return QString ();
+  }
+
+  const_iterator itd = constFind (it.value ());
+  if (itd == cend () || itd.value ().url ().host () != host)
+  { // The device changed through a reference without reindex.
+    rescanHost (host);
+    return m_hostIndex.value (host);
   }
 
-  return uuid;
+  return it.value ();
 }
 
 QPair<QString, QString> CDeviceMap::eventSender (QString const & sid) const
 {
-  QPair<QString, QString> ds;
-  for (TMDevices::const_iterator itd = cbegin (), end = cend (); itd != end && ds.second.isEmpty (); ++itd)
+  // The index is maintained by subscribe, renewSubscribe, unsubscribe and the functions of uuid.
+  // An unknown or stale sid is not searched, the sids are unique.
+  QPair<QString, QString> sender = m_sidIndex.value (sid);
+  if (!sender.first.isEmpty ())
   {
-    CDevice const &    device   = *itd;
-    TMServices const & services = device.services ();
-    for (TMServices::const_iterator its = services.cbegin (), end = services.cend (); its != end && ds.second.isEmpty (); ++its)
+    const_iterator it = constFind (sender.first);
+    if (it == cend () || it.value ().services ().value (sender.second).subscribeSID () != sid)
     {
-      CService const & service = its.value ();
-      if (service.subscribeSID () == sid)
-      {
-        ds.first  = device.uuid ();
-        ds.second = its.key ();
-      }
+      m_sidIndex.remove (sid);
+      sender = QPair<QString, QString> ();
     }
   }
 
-  return ds;
+  return sender;
 }
@@ -5,6 +5,8 @@
 #include "eventingmanager.hpp"
 #include "upnpsocket.hpp"
 #include <QTimer>
+#include <QHash>
+#include <functional>
 
 class QNetworkAccessManager;
 
@@ -15,10 +17,18 @@ typedef QMap<QString, CDevice> TMDevices;
 
 class CHTTPServer;
 
-/*! \brief It is the container of devices. */
+/*! \brief It is the container of devices.
+ *
+ * The map keeps a host index and an event sid index. insert, remove, take and clear keep them in
+ * sync and must be used instead of the functions of TMDevices. A device changed through a
+ * reference (e.g. a new URL) must be passed to reindex.
+ */
 class UPNP_API CDeviceMap : public TMDevices
 {
 public :
+  /*! Device filter. Returns false to drop the device before its services are loaded. */
+  typedef std::function<bool (CDevice const &)> TDeviceFilter;
+
   /*! Default constructor. */
   CDeviceMap ();
 
@@ -43,13 +53,41 @@ public :
   /*! Renews subscribe eventing services. */
   void renewSubscribe (CDevice& device, int requestTimeout = CEventingManager::RequestTimeout);
 
+  /*! Inserts or replaces a device and indexes its host and its subscription sids.
+   * \param uuid: The device uuid.
+   * \param device: The device.
+   * \return An iterator of the device.
+   */
+  iterator insert (QString const & uuid, CDevice const & device);
+
+  /*! Removes a device and its index entries.
+   * \param uuid: The device uuid.
+   * \return The number of devices removed (0 or 1).
+   */
+  int remove (QString const & uuid);
+
+  /*! Removes a device and its index entries, and returns it. */
+  CDevice take (QString const & uuid);
+
+  /*! Removes all devices and clears the indexes. */
+  void clear ();
+
+  /*! Updates the index entries of a device changed through a reference.
+   * \param uuid: The device uuid.
+   */
+  void reindex (QString const & uuid);
+
   /*! Returns the uuid from id address.
+   * The host index is used. An unknown host returns an empty uuid without scanning the devices.
+   * A hit is checked against the device, the devices are scanned only if its host changed.
    * \param host: The ip address.
    * \return The uuid.
    */
   QString uuid (QString const & host) const;
 
   /*! Returns the device uuid and the service from event sid.
+   * The sid index is used. An unknown or stale sid returns empty strings without scanning the devices.
+   * A hit is checked against the subscription sid of the service.
    * \param sid: The event sid.
    * \return first=device uuid, second=service id.
    */
@@ -89,6 +127,19 @@ public :
    */
   void setExpandEmbeddedDevices () { m_expandEmbeddedDevices = true; }
 
+  /*! Sets the device filter. The filter is called after the device description is parsed
+   * and before any SCPD request. A filtered device is never inserted in the new device list.
+   */
+  void setDeviceFilter (TDeviceFilter const & filter) { m_deviceFilter = filter; }
+
+  /*! Sets the lazy service loading. When lazy, the SCPD of a service is retrieved and parsed
+   * only at the first use of the service (see CControlPoint::loadServiceComponents).
+   */
+  void setLazyServiceLoading (bool lazy = true) { m_lazyServiceLoading = lazy; }
+
+  /*! Returns true if the services are loaded at the first use. */
+  bool isLazyServiceLoading () const { return m_lazyServiceLoading; }
+
 protected :
   /*! Inserts a new device. */
   void insertDevice (CDevice& device);
@@ -102,7 +153,24 @@ protected :
  /*! Extracts the services components. */
   bool extractServiceComponents (CDevice& device, int timeout);
 
+  /*! Adds the host of the device in the host index.
+   * For a host shared by several devices (e.g. embedded devices), the first uuid in the map order is kept.
+   */
+  void indexHost (CDevice const & device);
+
+  /*! Adds the subscription sid of a service in the sid index. */
+  void indexSID (QString const & sid, QString const & uuid, QString const & serviceID);
+
 private :
+  /*! Adds the host and the subscription sids of a device in the indexes. */
+  void indexDevice (CDevice const & device);
+
+  /*! Removes the index entries of a device already removed from the map. */
+  void unindexDevice (CDevice const & device);
+
+  /*! Sets the host index entry of host at the first device of the map with this host. */
+  void rescanHost (QString const & host) const;
+
   CHTTPServer* m_httpServer = nullptr; //!< The http server for eventing.
   QNetworkAccessManager* m_naMgr = nullptr;  //!< The network access manager for dataCaller.
   QStringList m_newDevices; //!< List of new devices.
@@ -111,6 +179,10 @@ private :
   int m_deviceFails = 2; //!< Max number of fails to consider the device invalid.
   bool m_avOnly = false; //!< The discovery is launched from avDiscovery.
   bool m_expandEmbeddedDevices = false; //!< Embedded devices are also insert in the map.
+  bool m_lazyServiceLoading = false; //!< SCPDs are loaded at the first use of the service.
+  TDeviceFilter m_deviceFilter; //!< Filter called before loading the services.
+  mutable QHash<QString, QString> m_hostIndex; //!< Host to device uuid index. Repaired by the lookups.
+  mutable QHash<QString, QPair<QString, QString>> m_sidIndex; //!< Event sid to device uuid and service id index.
 };
 
 } // End namespace
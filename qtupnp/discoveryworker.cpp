@@ -0,0 +1,146 @@
+#include "discoveryworker.hpp"
+#include "initialdiscovery.hpp"
+#include "multicastsocket.hpp"
+#include "unicastsocket.hpp"
+#include <QMutexLocker>
+
+USING_UPNP_NAMESPACE
+
+CDiscoveryWorker::CDiscoveryWorker () : QObject (nullptr)
+{
+}
+
+CDiscoveryWorker::~CDiscoveryWorker ()
+{
+}
+
+CMulticastSocket* CDiscoveryWorker::initializeMulticast (QHostAddress const & host, QHostAddress const & group, char const * name)
+{
+  CMulticastSocket* socket = new CMulticastSocket (this);
+  if (socket->initialize (host, group))
+  {
+    socket->setName (name);
+    connect (socket, SIGNAL(readyRead()), this, SLOT(readDatagrams()));
+  }
+  else
+  {
+    delete socket;
+    socket = nullptr;
+  }
+
+  return socket;
+}
+
+CUnicastSocket* CDiscoveryWorker::initializeUnicast (QHostAddress const & host, char const * name)
+{
+  CUnicastSocket* socket = new CUnicastSocket (this);
+  if (socket->bind (host))
+  {
+    socket->setName (name);
+    connect (socket, SIGNAL(readyRead()), this, SLOT(readDatagrams()));
+  }
+  else
+  {
+    delete socket;
+    socket = nullptr;
+  }
+
+  return socket;
+}
+
+bool CDiscoveryWorker::initialize ()
+{
+  bool done = m_sockets[Multicast] != nullptr && m_sockets[Unicast] != nullptr;
+  if (!done)
+  {
+    m_sockets[Multicast] = initializeMulticast (QHostAddress::AnyIPv4, CMulticastSocket::upnpMulticastAddr, "MulticastSocket");
+    if (m_sockets[Multicast] != nullptr)
+    {
+      m_sockets[Multicast6] = initializeMulticast (QHostAddress::AnyIPv6, CMulticastSocket::upnpMulticastAddr6, "MulticastSocket6");
+      m_sockets[Unicast]    = initializeUnicast (CUpnpSocket::localHostAddress (), "UnicastSocket");
+      if (m_sockets[Unicast] != nullptr)
+      {
+        m_sockets[UnicastLocal] = initializeUnicast (QHostAddress ("127.0.0.1"), "UnicastSocketLocal");
+        done                    = true;
+      }
+    }
+  }
+
+  return done;
+}
+
+bool CDiscoveryWorker::search (int socket, QByteArray const & nt)
+{
+  bool success = false;
+  if (socket >= 0 && socket < LastSocket)
+  {
+    CInitialDiscovery initDiscovery (m_sockets[socket], CMulticastSocket::upnpMulticastAddr, CMulticastSocket::upnpMulticastPort);
+    success = initDiscovery.discover (false, nt.constData ());
+  }
+
+  return success;
+}
+
+void CDiscoveryWorker::forgetDevices (QStringList const & uuids)
+{
+  for (CUpnpSocket* socket : m_sockets)
+  {
+    if (socket != nullptr)
+    {
+      socket->forgetNotifies (uuids);
+    }
+  }
+}
+
+void CDiscoveryWorker::readDatagrams ()
+{
+  CUpnpSocket*       socket    = static_cast<CUpnpSocket*>(sender ());
+  QByteArray const & datagrams = socket->readDatagrams ();
+  if (!datagrams.isEmpty () && datagrams.endsWith ("\r\n\r\n"))
+  {
+    socket->decodeDatagram ();
+    QList<CUpnpSocket::SNDevice> const & devices = socket->devices ();
+    if (!devices.isEmpty ())
+    {
+      bool notify = false;
+      {
+        QMutexLocker locker (&m_mutex);
+        m_devices.append (devices);
+        notify     = !m_notified;
+        m_notified = true;
+      }
+
+      socket->resetDevices ();
+      if (notify)
+      {
+        emit devicesReady ();
+      }
+    }
+  }
+
+  int cIncompletes = 0;
+  for (CUpnpSocket* upnpSocket : m_sockets)
+  {
+    if (upnpSocket != nullptr && !upnpSocket->datagram ().isEmpty ())
+    {
+      ++cIncompletes;
+    }
+  }
+
+  m_incompleteDatagrams.store (cIncompletes);
+}
+
+QList<CUpnpSocket::SNDevice> CDiscoveryWorker::takeDevices ()
+{
+  QList<CUpnpSocket::SNDevice> devices;
+  QMutexLocker                 locker (&m_mutex);
+  devices.swap (m_devices);
+  m_notified = false;
+  return devices;
+}
+
+bool CDiscoveryWorker::hasDevices ()
+{
+  QMutexLocker locker (&m_mutex);
+  return !m_devices.isEmpty ();
+}
@@ -0,0 +1,99 @@
+#ifndef DISCOVERY_WORKER_HPP
+#define DISCOVERY_WORKER_HPP 1
+
+#include "upnpsocket.hpp"
+#include <QMutex>
+#include <QAtomicInt>
+
+START_DEFINE_UPNP_NAMESPACE
+
+class CUnicastSocket;
+class CMulticastSocket;
+
+/*! \brief The CDiscoveryWorker class receives and decodes the SSDP datagrams in a dedicated thread.
+ *
+ * The worker owns the unicast and multicast sockets. It must be moved in its thread before calling
+ * initialize, so the sockets are created in this thread. The control point uses it with queued
+ * connections.
+ *
+ * The decoded devices are stored in a back buffer protected by a mutex. The first device stored after
+ * a takeDevices call emits devicesReady. The control point takes the whole back buffer in the main
+ * thread and processes it without lock.
+ */
+class CDiscoveryWorker : public QObject
+{
+  Q_OBJECT
+
+public :
+  /*! The sockets. */
+  enum ESocket { Unicast, //!< Unicast socket.
+                 UnicastLocal, //!< Unicast socket local (bind on 127.0.0.1).
+                 Multicast, //!< Multicast socket ipv4.
+                 Multicast6, //!< Multicast socket ipv6.
+                 LastSocket, //!< Use just for set size.
+               };
+
+  /*! Default constructor. */
+  CDiscoveryWorker ();
+
+  /*! Destructor. */
+  virtual ~CDiscoveryWorker ();
+
+  /*! Returns the devices decoded since the last call and clears the back buffer.
+   * This function is thread safe.
+   */
+  QList<CUpnpSocket::SNDevice> takeDevices ();
+
+  /*! Returns true if devices wait to be taken.
+   * This function is thread safe.
+   */
+  bool hasDevices ();
+
+  /*! Returns true if a socket has an incomplete datagram.
+   * This function is thread safe.
+   */
+  bool hasIncompleteDatagrams () const { return m_incompleteDatagrams.load () != 0; }
+
+public slots :
+  /*! Creates the sockets. Must be called in the thread of the worker.
+   * \return True in case of well initialization.
+   */
+  bool initialize ();
+
+  /*! Sends an M-SEARCH datagram.
+   * \param socket: The unicast socket used to send the datagram (Unicast or UnicastLocal).
+   * \param nt: The search target.
+   * \return True in case of success.
+   */
+  bool search (int socket, QByteArray const & nt);
+
+  /*! Removes the devices from the repeated NOTIFY cache of the sockets.
+   * Used for the devices that are not in the device map, e.g. the description can not be read.
+   * Their next ssdp:alive are decoded again.
+   * \param uuids: The device uuids.
+   */
+  void forgetDevices (QStringList const & uuids);
+
+signals :
+  /*! Emitted when devices are available after a takeDevices call. */
+  void devicesReady ();
+
+protected slots :
+  /*! Receipts unicast & multicast datagrams. */
+  void readDatagrams ();
+
+private :
+  CMulticastSocket* initializeMulticast (QHostAddress const & host, QHostAddress const & group, char const * name);
+  CUnicastSocket* initializeUnicast (QHostAddress const & host, char const * name);
+
+private :
+  CUpnpSocket* m_sockets[LastSocket] = { nullptr, nullptr, nullptr, nullptr }; //!< The sockets.
+  QMutex m_mutex; //!< Protects m_devices and m_notified.
+  QList<CUpnpSocket::SNDevice> m_devices; //!< Back buffer of decoded devices.
+  bool m_notified = false; //!< devicesReady is emitted and the devices are not taken.
+  QAtomicInt m_incompleteDatagrams; //!< Number of sockets with an incomplete datagram.
+};
+
+} // Namespace
+
+#endif // DISCOVERY_WORKER_HPP
@@ -1,6 +1,7 @@
 #include "eventingmanager.hpp"
 #include "helper.hpp"
 #include "dump.hpp"
+#include "metrics.hpp"
 #include <QHostAddress>
 
 USING_UPNP_NAMESPACE
@@ -47,6 +48,8 @@ bool CEventingManager::sendRequest (QUrl url, char const * verb, QString const &
 
   QTime time;
   time.start ();
+  CMetrics& metrics = CMetrics::instance ();
+  qint64    start   = metrics.now ();
 
   QNetworkReply* reply = m_naMgr->sendCustomRequest (req, verb);
   connect (reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(error(QNetworkReply::NetworkError)));
@@ -75,6 +78,19 @@ bool CEventingManager::sendRequest (QUrl url, char const * verb, QString const &
 
   reply->deleteLater ();
   m_elapsedTime = time.elapsed ();
+  if (metrics.isEnabled () || metrics.isTracing ())
+  {
+    qint64            duration = metrics.now () - start;
+    CMetrics::TLabels labels { { "host", url.host () }, { "verb", verb } };
+    metrics.observe ("upnp_eventing_duration_ms", labels, duration / 1000.0);
+    if (!success)
+    {
+      metrics.add ("upnp_eventing_errors_total", labels);
+    }
+
+    metrics.span (verb, "eventing", start, duration, labels);
+  }
+
   return success;
 }
 
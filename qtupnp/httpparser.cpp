@@ -5,20 +5,66 @@ USING_UPNP_NAMESPACE
 
 char const * CHTTPParser::m_playlistSuffixes[] = { "m3u", "m3u8", "wpl", "xspl", "" };
 
-CHTTPParser::CHTTPParser (CHTTPParser const & other) : m_message (other.m_message), m_verb (other.m_verb),
-            m_headerElems (other.m_headerElems), m_queryType (other.m_queryType)
+CHTTPParser::CHTTPParser (CHTTPParser const & other) : m_message (other.m_message), m_body (other.m_body),
+            m_verb (other.m_verb), m_headerElems (other.m_headerElems), m_queryType (other.m_queryType),
+            m_headerLength (other.m_headerLength), m_contentLength (other.m_contentLength),
+            m_state (other.m_state), m_pos (other.m_pos), m_chunkRemaining (other.m_chunkRemaining)
 {
 }
 
 CHTTPParser& CHTTPParser::operator = (CHTTPParser const & other)
 {
-  m_message     = other.m_message;
-  m_verb        = other.m_verb;
-  m_headerElems = m_headerElems;
-  m_queryType   = other.m_queryType;
+  m_message        = other.m_message;
+  m_body           = other.m_body;
+  m_verb           = other.m_verb;
+  m_headerElems    = other.m_headerElems;
+  m_queryType      = other.m_queryType;
+  m_headerLength   = other.m_headerLength;
+  m_contentLength  = other.m_contentLength;
+  m_state          = other.m_state;
+  m_pos            = other.m_pos;
+  m_chunkRemaining = other.m_chunkRemaining;
   return *this;
 }
 
+void CHTTPParser::setMessage (QByteArray const & message)
+{
+  reset ();
+  m_message = message;
+}
+
+bool CHTTPParser::addData (QByteArray const & data)
+{
+  if (m_state != Error)
+  { // A malformed message is not kept growing.
+    m_message += data;
+  }
+
+  return parseMessage ();
+}
+
+void CHTTPParser::reset ()
+{
+  if (m_state == Done)
+  { // Keep the next pipelined message.
+    m_message = m_message.mid (m_pos);
+  }
+  else
+  {
+    m_message.clear ();
+  }
+
+  m_body.clear ();
+  m_verb.clear ();
+  m_headerElems.clear ();
+  m_queryType      = Unknown;
+  m_headerLength   = 0;
+  m_contentLength  = 0;
+  m_state          = Header;
+  m_pos            = 0;
+  m_chunkRemaining = 0;
+}
+
 int CHTTPParser::headerLengthReached () const
 {
   int length = m_message.indexOf ("\r\n\r\n");
@@ -42,130 +88,238 @@ int CHTTPParser::headerContentLength () const
   }
   else
   {
-    len = value.toInt ();
+    bool ok = false;
+    len     = value.toInt (&ok);
+    if (!ok || len < 0)
+    {
+      len = Invalid;
+    }
   }
 
   return len;
 }
 
-bool CHTTPParser::parseMessage ()
+void CHTTPParser::parseHeader ()
 {
-  bool atEnd = true;
-  if (!m_message.isEmpty ())
+  QByteArray        header = QByteArray::fromRawData (m_message.constData (), m_headerLength - 4);
+  QList<QByteArray> rows   = header.split ('\r');
+  QByteArray        name, value;
+  for (QByteArray const & row : rows)
   {
-    atEnd = false;
-    if (m_headerLength == 0)
+    int index = row.indexOf (':');
+    if (index == -1 && m_verb.isEmpty ())
     {
-      // Some routers (Netgear) start sometimes the message by '\0' and ' '. Remove it.
-      int k = 0, end = m_message.length ();
-      while (k < end && (m_message[k] == '\0' || m_message[k] == ' '))
-      {
-        ++k;
-      }
+      index = row.indexOf (' ');
+    }
 
-      if (k != 0)
+    if (index != -1)
+    {
+      name  = row.left (index).trimmed ().toUpper ();
+      value = row.mid (index + 1).trimmed ();
+      if (m_verb.isEmpty ())
       {
-        m_message = m_message.mid (k);
+        m_verb = name;
+        if (name == "GET" || name == "HEAD")
+        {
+          value.truncate (value.length () - 9);
+          m_queryType = queryType (value);
+        }
       }
 
-      m_headerLength = headerLengthReached ();
+      m_headerElems.insert (name, value);
     }
+  }
+}
 
-    if (m_headerLength > 0)
-    { // Header is well defined
-      QByteArray        header = m_message.left (m_headerLength - 4);
-      QList<QByteArray> rows;
-      rows.reserve (15);
-      rows = header.split ('\r');
-      QByteArray name, value;
-      for (QByteArray const row : rows)
+bool CHTTPParser::parseChunks ()
+{
+  bool more = false;
+  while (!more && m_state != Done && m_state != Error)
+  {
+    switch (m_state)
+    {
+      case ChunkSize :
       {
-        int index = row.indexOf (':');
-        if (index == -1 && m_verb.isEmpty ())
+        int index = m_message.indexOf ("\r\n", m_pos);
+        if (index == -1)
         {
-          index = row.indexOf (' ');
+          more = true;
         }
-
-        if (index != -1)
+        else
         {
-          name  = row.left (index).trimmed ().toUpper ();
-          value = row.mid (index + 1).trimmed ();
-          if (m_verb.isEmpty ())
+          // Chunk extensions after ';' are ignored.
+          int end = m_message.indexOf (';', m_pos);
+          if (end == -1 || end > index)
+          {
+            end = index;
+          }
+
+          bool ok          = false;
+          int  chunkLength = m_message.mid (m_pos, end - m_pos).trimmed ().toInt (&ok, 16);
+          if (ok && chunkLength >= 0)
           {
-            m_verb = name;
-            if (name == "GET" || name == "HEAD")
+            m_pos            = index + 2;
+            m_chunkRemaining = chunkLength;
+            if (chunkLength == 0)
             {
-              value.truncate (value.length () - 9);
-              m_queryType = queryType (value);
+              m_state = Trailer;
+            }
+            else
+            {
+              m_state = ChunkData;
             }
           }
-
-          m_headerElems.insert (name, value);
+          else
+          {
+            m_state = Error;
+          }
         }
+        break;
       }
 
-      m_contentLength = headerContentLength ();
-      if (m_contentLength == 0)
+      case ChunkData :
       {
-        atEnd = true;
+        int length = qMin (m_message.size () - m_pos, m_chunkRemaining);
+        m_body.append (m_message.constData () + m_pos, length);
+        m_pos            += length;
+        m_chunkRemaining -= length;
+        if (m_chunkRemaining == 0)
+        {
+          m_state = ChunkDataEnd;
+        }
+        else
+        {
+          more = true;
+        }
+        break;
       }
-      else if (m_contentLength >= 0)
-      { // CONTENT-LENGTH header is defined.
-        int messageLength = m_message.size ();
-        if (messageLength >= m_headerLength + m_contentLength)
+
+      case ChunkDataEnd :
+        if (m_message.size () - m_pos >= 2)
+        {
+          m_pos  += 2;
+          m_state = ChunkSize;
+        }
+        else
+        {
+          more = true;
+        }
+        break;
+
+      case Trailer :
+      {
+        // Some devices close the body after "0\r\n". The message is complete at the last chunk,
+        // the trailer rows and the final "\r\n" are consumed when they are already received.
+        int index = m_message.indexOf ("\r\n", m_pos);
+        while (index > m_pos)
+        {
+          m_pos = index + 2;
+          index = m_message.indexOf ("\r\n", m_pos);
+        }
+
+        if (index == m_pos)
         {
-          atEnd = true;
+          m_pos += 2;
         }
+
+        m_state = Done;
+        break;
       }
-      else if (m_contentLength == Chunked)
+
+      default :
+        more = true;
+        break;
+    }
+  }
+
+  return !more;
+}
+
+bool CHTTPParser::parseMessage ()
+{
+  bool parsing = true;
+  while (parsing)
+  {
+    switch (m_state)
+    {
+      case Header :
       {
-        // TRANSFER-ENCODING: chunked is defined; In this case messageData.second == Chunked and represent
-        // the current decoded length.
-        typedef QPair<int, int> TChunk;
-        QList<TChunk>           chunks;
-        int                     length = m_headerLength;
-        QByteArray              hexaChunkLength;
-        hexaChunkLength.reserve (16);
-        bool ok            = true;
-        int index          = m_message.indexOf ("\r\n", length), chunkLength;
-        while (index != -1 && ok)
+        if (m_pos == 0)
         {
-          int hexaChunkLengthSize = index - length + 2;
-          hexaChunkLength         = m_message.mid (length, hexaChunkLengthSize - 2);
-          chunkLength             = hexaChunkLength.toUInt (&ok, 16);
-          if (ok)
+          // Some routers (Netgear) start sometimes the message by '\0' and ' '. Remove it.
+          int k = 0, end = m_message.length ();
+          while (k < end && (m_message[k] == '\0' || m_message[k] == ' '))
           {
-            int removeBegin  = length;
-            int removeLength = hexaChunkLengthSize;
-            if (length != m_headerLength)
-            {
-              removeBegin  -= 2; // Remove previous \r\n.
-              removeLength += 2; // Add 2 at length to remove.
-            }
-
-            chunks.append (QPair<int, int> (removeBegin, removeLength));
-            length += hexaChunkLengthSize + chunkLength + 2;
-            if (chunkLength == 0)
-            {
-              m_message.truncate (length - 2);
-              atEnd = true;
-              break;
-            }
+            ++k;
+          }
 
-            index = m_message.indexOf ("\r\n", length);
+          if (k != 0)
+          {
+            m_message = m_message.mid (k);
           }
         }
 
-        for (QList<TChunk>::const_reverse_iterator it = chunks.crbegin (), end = chunks.crend (); it != end; ++it)
+        // The search restarts just before the end of the data already received.
+        int index = m_message.indexOf ("\r\n\r\n", m_pos);
+        if (index > 0)
         {
-          TChunk const & chunk = *it;
-          m_message.remove (chunk.first, chunk.second);
+          m_headerLength = index + 4;
+          m_pos          = m_headerLength;
+          parseHeader ();
+          m_contentLength = headerContentLength ();
+          if (m_contentLength == Invalid)
+          {
+            m_state = Error;
+          }
+          else if (m_contentLength == 0)
+          {
+            m_state = Done;
+          }
+          else if (m_contentLength > 0)
+          {
+            m_state = Body;
+          }
+          else
+          {
+            m_state = ChunkSize;
+          }
         }
+        else
+        {
+          m_pos   = qMax (0, m_message.size () - 3);
+          parsing = false;
+        }
+        break;
       }
+
+      case Body :
+        // Subtracted to not overflow with the CONTENT-LENGTH close to INT_MAX.
+        if (m_message.size () - m_headerLength >= m_contentLength)
+        {
+          m_body  = m_message.mid (m_headerLength, m_contentLength);
+          m_pos   = m_headerLength + m_contentLength;
+          m_state = Done;
+        }
+        else
+        {
+          parsing = false;
+        }
+        break;
+
+      case ChunkSize :
+      case ChunkData :
+      case ChunkDataEnd :
+      case Trailer :
+        parsing = parseChunks ();
+        break;
+
+      default :
+        parsing = false;
+        break;
     }
   }
 
-  return atEnd;
+  return m_state == Done;
 }
 
 bool CHTTPParser::transferChunked () const
@@ -190,6 +344,10 @@ CHTTPParser::EQueryType CHTTPParser::queryType (QByteArray const & query)
   {
     type = Plugin;
   }
+  else if (query.contains ("/media/"))
+  {
+    type = Media;
+  }
 
   return type;
 }
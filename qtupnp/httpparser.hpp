@@ -11,6 +11,11 @@ START_DEFINE_UPNP_NAMESPACE
 /*! \brief A very simple HTTP parser used by eventing.
  *
  * All member functions must are called after having called parseMessage function.
+ *
+ * The parser is resumable. The data can be appended to the message in several times, each call of
+ * parseMessage continues from the position reached by the previous call. The header is parsed once
+ * and the chunks of a chunked body are decoded in the body buffer without modifying the message.
+ * When the message is complete, reset keeps the bytes of the next pipelined message.
  */
 class UPNP_API CHTTPParser
 {
@@ -18,12 +23,25 @@ public :
   enum EQueryType { Unknown,
                     Playlist,
                     Plugin,
+                    Media,
                   };
 
-  enum EContentLength { Unreached = -2,
+  enum EContentLength { Invalid   = -3,
+                        Unreached = -2,
                         Chunked   = -1,
                       };
 
+  /*! The parser states. */
+  enum EState { Header, //!< Waiting the end of the header.
+                Body, //!< Waiting CONTENT-LENGTH bytes of body.
+                ChunkSize, //!< Waiting the chunk size line.
+                ChunkData, //!< Waiting the chunk data.
+                ChunkDataEnd, //!< Waiting the "\r\n" following the chunk data.
+                Trailer, //!< Waiting the end of the trailer.
+                Done, //!< The message is complete.
+                Error, //!< The message is malformed.
+              };
+
   /*! Constructor. */
   CHTTPParser () {}
 
@@ -36,13 +54,24 @@ public :
   /*! Equal operator. */
   CHTTPParser& operator = (CHTTPParser const & other);
 
-  /*! Sets the current message. */
-  void setMessage (QByteArray const & message) { m_message = message; }
+  /*! Sets the current message and restarts the parsing. */
+  void setMessage (QByteArray const & message);
+
+  /*! Appends data at the current message and continues the parsing.
+   * The data are ignored in the Error state.
+   * \return True if the message is complete.
+   */
+  bool addData (QByteArray const & data);
+
+  /*! Restarts the parsing for the next message.
+   * If the message is complete, the bytes following it are kept. Otherwize the message is cleared.
+   */
+  void reset ();
 
   /*! Returns the header length when it is complet otherwize return 0. */
   int headerLengthReached () const;
 
-  /*! Returns the content length. */
+  /*! Returns the content length, Chunked, or Invalid for a negative or not numeric CONTENT-LENGTH. */
   int headerContentLength () const;
 
   /*! Returns the header length including "\r\n\r\n" at the end. */
@@ -69,11 +98,17 @@ public :
   /*! Returns the number of header elements. */
   int headerElemsCount () const { return m_headerElems.size (); }
 
-  /*! Parse the response.
+  /*! Parse the response. The parsing continues from the position reached by the previous call.
    * \return True if the message is complete.
    */
   bool parseMessage ();
 
+  /*! Returns the parser state. */
+  EState state () const { return m_state; }
+
+  /*! Returns true if the message is complete. */
+  bool isComplete () const { return m_state == Done; }
+
   /*! Returns if the header contains TRANSFER-ENCODING: chunked or CONTENT-LENGTH. */
   bool transferChunked () const;
 
@@ -85,15 +120,31 @@ public :
   /*! Returns a reference on the current message. */
   QByteArray& message () { return m_message; }
 
+  /*! Returns the body. For a chunked message, it is the decoded body. */
+  QByteArray const & body () const { return m_body; }
+
   /*! Returns the query type from the query. */
   static EQueryType queryType (QByteArray const & query);
 
+private :
+  /*! Parses the header rows. */
+  void parseHeader ();
+
+  /*! Parses the chunked body from m_pos.
+   * \return False if more data are needed.
+   */
+  bool parseChunks ();
+
 private :
   QByteArray m_message; //!< The response.
+  QByteArray m_body; //!< The body (decoded for a chunked message).
   QByteArray m_verb; //!< The verb
   QMap<QByteArray, QByteArray> m_headerElems; //!< The headers map of rows.
   EQueryType m_queryType = Unknown; //!< Type of query.
   int m_headerLength = 0, m_contentLength = 0;
+  EState m_state = Header; //!< Parser state.
+  int m_pos = 0; //!< Current parsing position in the message.
+  int m_chunkRemaining = 0; //!< Remaining bytes of the current chunk.
 
   static char const * m_playlistSuffixes[]; //!< Play list suffixes (m3u, m3u8...)
 };
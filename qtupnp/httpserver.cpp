@@ -2,13 +2,23 @@
 #include "waitingloop.hpp"
 #include "xmlhevent.hpp"
 #include "helper.hpp"
+#include "upnpsocket.hpp"
+#include "metrics.hpp"
 #include <QTcpSocket>
 #include <QDate>
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QUrl>
+#include <QTimer>
 #include <cstring>
 #include <array>
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <cerrno>
+#endif
 
 USING_UPNP_NAMESPACE
 
@@ -36,16 +46,15 @@ static void dump (QByteArray data)
 
 CHTTPServer::CHTTPServer (QHostAddress const & address, quint16 port, QObject* parent) :
              QTcpServer (parent), m_done (false),
-             m_httpsBufferSize (4096),
-             m_httpsReadDataTimeout (1),
-             m_httpsReadDataWaitingRetry (20000)
+             m_httpsBufferSize (256 * 1024),
+             m_streamingHighWatermark (1024 * 1024),
+             m_streamingLowWatermark (256 * 1024)
 {
   bool success = listen (address, port);
   if (success)
   {
     m_httpsRequest.setSslConfiguration (QSslConfiguration::defaultConfiguration ());
     connect (this, &CHTTPServer::httpValidReadMessage, this, &CHTTPServer::sendResponse, Qt::QueuedConnection);
-    connect (this, &CHTTPServer::streamingReady, this, &CHTTPServer::streamBlock, Qt::QueuedConnection);
     m_done = true;
   }
 }
@@ -53,6 +62,10 @@ CHTTPServer::CHTTPServer (QHostAddress const & address, quint16 port, QObject* p
 CHTTPServer::~CHTTPServer ()
 {
   abortStreaming ();
+  for (SMediaTransfer& transfer : m_mediaTransfers)
+  {
+    delete transfer.m_file;
+  }
 }
 
 void CHTTPServer::incomingConnection (qintptr socketDescriptor)
@@ -104,7 +117,7 @@ bool CHTTPServer::httpSimpleResponse (QTcpSocket* socket, bool reject)
                  content_length;
 
   QByteArray utf8 = data.toUtf8 ();
-  m_writingSocketSizes.insert (socket, utf8.size ());
+  m_writingSocketSizes[socket] += utf8.size (); // Several pipelined responses can be waiting.
   return sendHttpResponse (socket, utf8);
 }
 
@@ -156,7 +169,7 @@ void CHTTPServer::sendResponse (CHTTPParser const * httpParser, QTcpSocket* sock
         m_vars.clear ();
         if (httpParser->contentLength () != 0)
         {
-          QByteArray data = httpParser->message ().mid (httpParser->headerLength ());
+          QByteArray data = httpParser->body ();
           CXmlHEvent h (m_vars);
           h.parse (data);
 
@@ -192,7 +205,7 @@ void CHTTPServer::sendResponse (CHTTPParser const * httpParser, QTcpSocket* sock
           case CHTTPParser::Playlist :
           {
             response = headerResponse (m_playlistContent.size (), "audio/x-mpegurl") + m_playlistContent;
-            m_writingSocketSizes.insert (socket, response.size ());
+            m_writingSocketSizes[socket] += response.size ();
             sendHttpResponse (socket, response);
             break;
           }
@@ -221,9 +234,49 @@ void CHTTPServer::sendResponse (CHTTPParser const * httpParser, QTcpSocket* sock
             break;
           }
 
+          case CHTTPParser::Media :
+            sendMedia (httpParser, socket);
+            break;
+
           default :
-            qDebug () << "Unhandled http response type";
+          {
+            QByteArray contentType, body;
+            int        status = 0;
+            QByteArray query = httpParser->value (verb);
+            query            = query.left (query.indexOf ('?'));
+            if (verb == "GET" && query == "/metrics" && CMetrics::instance ().isEnabled ())
+            { // Prometheus scrape.
+              contentType = "text/plain; version=0.0.4";
+              body        = CMetrics::instance ().prometheus ();
+              status      = 200;
+            }
+            else if (m_requestHandler)
+            {
+              status = m_requestHandler (*httpParser, contentType, body);
+            }
+
+            if (status != 0)
+            {
+              response = statusHeaderResponse (status, body.size (), contentType) + body;
+              m_writingSocketSizes[socket] += response.size ();
+              if (m_responseDelay > 0)
+              { // The timer is cancelled if the socket is destroyed.
+                QTimer::singleShot (m_responseDelay, socket, [this, socket, response] ()
+                {
+                  sendHttpResponse (socket, response);
+                });
+              }
+              else
+              {
+                sendHttpResponse (socket, response);
+              }
+            }
+            else
+            {
+              qDebug () << "Unhandled http response type";
+            }
             break;
+          }
         }
       }
     }
@@ -231,25 +284,63 @@ void CHTTPServer::sendResponse (CHTTPParser const * httpParser, QTcpSocket* sock
     {
       qDebug () << "Verb is empty, very strange";
     }
+
+    nextMessage (socket);
   }
 }
 
-void CHTTPServer::streamBlock ()
+void CHTTPServer::nextMessage (QTcpSocket* socket)
 {
-  // Wait 20s max by default. In fact this code is to initialyze an event loop. Generally cWaitings < 3.
-  int cWaitings = 0;
-  while (m_httpsReply != nullptr && cWaitings < m_httpsReadDataWaitingRetry && m_httpsReply->bytesAvailable () == 0)
-  {
-    ++cWaitings;
-    CWaitingLoop::wait (m_httpsReadDataTimeout, QEventLoop::AllEvents);
+  QMap<QTcpSocket*, CHTTPParser>::iterator it = m_eventMessages.find (socket);
+  if (it != m_eventMessages.end () && socket->state () == QAbstractSocket::ConnectedState &&
+      !m_mediaTransfers.contains (socket) && socket != m_streamingSocket)
+  { // The media and streaming responses close the connection, the next requests are not answered.
+    CHTTPParser& parser = it.value ();
+    parser.reset (); // Keeps the bytes of the next pipelined request.
+    if (parser.parseMessage ())
+    {
+      emit httpValidReadMessage (&parser, socket);
+    }
+    else if (parser.state () == CHTTPParser::Error)
+    {
+      dropMessage (socket);
+    }
   }
+}
+
+void CHTTPServer::dropMessage (QTcpSocket* socket)
+{
+  qDebug () << "CHTTPServer: Malformed request from" << socket->peerAddress ().toString ();
+  m_eventMessages.remove (socket); // The following data are not read.
+  m_writingSocketSizes.remove (socket);
+  socket->abort (); // Emits disconnected, the socket is deleted by socketDisconnected.
+}
 
-  if (m_httpsReply != nullptr && cWaitings < m_httpsReadDataWaitingRetry)
+void CHTTPServer::forwardStreamingData ()
+{
+  if (m_httpsReply != nullptr)
   {
-    emit serverComStarted ();
-    QByteArray data = m_httpsReply->read (m_httpsBufferSize);
-    emit serverComEnded ();
-    sendHttpResponse (m_streamingSocket, data);
+    if (m_streamingSocket != nullptr && m_streamingHeaderSent)
+    {
+      while (m_streamingSocket->bytesToWrite () < m_streamingHighWatermark && m_httpsReply->bytesAvailable () > 0)
+      {
+        emit serverComStarted ();
+        qint64 cBytes = m_httpsReply->read (m_streamingResponseBuffer.data (), m_streamingResponseBuffer.size ());
+        emit serverComEnded ();
+        if (cBytes <= 0)
+        {
+          break;
+        }
+
+        m_streamingSocket->write (m_streamingResponseBuffer.constData (), cBytes);
+      }
+    }
+
+    if (m_httpsFinished && (m_streamingSocket == nullptr || !m_streamingHeaderSent || m_httpsReply->bytesAvailable () == 0))
+    { // All data are forwarded.
+      m_httpsReply->deleteLater ();
+      m_httpsReply = nullptr;
+    }
   }
 }
 
@@ -258,16 +349,23 @@ void CHTTPServer::socketReadyRead ()
   QTcpSocket* socket = static_cast<QTcpSocket*>(sender ());
   if (m_eventMessages.contains (socket))
   {
-    CHTTPParser* parser       = &m_eventMessages[socket];
-    QByteArray&  eventMessage = parser->message ();
+    CHTTPParser* parser   = &m_eventMessages[socket];
+    bool         complete = parser->isComplete ();
     while (socket->bytesAvailable () != 0)
     {
-      eventMessage += socket->readAll ();
+      parser->message () += socket->readAll ();
     }
 
-    if (parser->parseMessage ())
-    {
-      emit httpValidReadMessage (parser, socket);
+    if (!complete)
+    { // Emitted once by message. The following bytes stay in the message until nextMessage.
+      if (parser->parseMessage ())
+      {
+        emit httpValidReadMessage (parser, socket);
+      }
+      else if (parser->state () == CHTTPParser::Error)
+      {
+        dropMessage (socket);
+      }
     }
   }
 }
@@ -358,20 +456,33 @@ void CHTTPServer::socketBytesWritten (qint64 bytes)
 #endif
 
   // Only for known sockets.
-  if (m_writingSocketSizes.contains (socket))
+  if (m_mediaTransfers.contains (socket))
+  { // Media socket. The sizes are not counted because sendfile bypasses the socket buffer.
+    if (socket->bytesToWrite () <= m_mediaLowWatermark)
+    {
+      forwardMediaData (socket);
+    }
+  }
+  else if (m_writingSocketSizes.contains (socket))
   {
-    int   sizeToWrite = m_writingSocketSizes.value (socket); // Remains to stream.
-    sizeToWrite      -= bytes;
-    if (sizeToWrite == 0)
+    qint64 sizeToWrite = m_writingSocketSizes.value (socket); // Remains to stream.
+    sizeToWrite       -= bytes;
+    QMap<QTcpSocket*, CHTTPParser>::const_iterator itm = m_eventMessages.constFind (socket);
+    bool pipelined = itm != m_eventMessages.cend () && !itm.value ().message ().isEmpty ();
+    if (sizeToWrite == 0 && !pipelined)
     { // Finished close the socket.
       socket->close ();
     }
+    else if (sizeToWrite == 0)
+    { // A pipelined request is received. Its response is added to the size.
+      m_writingSocketSizes[socket] = 0;
+    }
     else
     {
       m_writingSocketSizes[socket] = sizeToWrite; // Store the new rest.
-      if (socket == m_streamingSocket && socket->bytesToWrite () == 0)
-      { // For streaming socket, if the renderer has dowloaded all data, ask a new block.
-        emit streamingReady ();
+      if (socket == m_streamingSocket && socket->bytesToWrite () <= m_streamingLowWatermark)
+      { // For streaming socket, if the renderer has dowloaded enough data, forward a new block.
+        forwardStreamingData ();
       }
     }
   }
@@ -380,12 +491,14 @@ void CHTTPServer::socketBytesWritten (qint64 bytes)
 void CHTTPServer::socketDisconnected ()
 {
   QTcpSocket* socket = static_cast<QTcpSocket*>(sender ());
+  endMediaTransfer (socket);
   m_eventMessages.remove (socket);
   m_writingSocketSizes.remove (socket);
   socket->deleteLater ();
   if (socket == m_streamingSocket)
-  {
+  { // The renderer has closed the connection. Stop the https download.
     m_streamingSocket = nullptr;
+    abortStreaming ();
   }
 }
 
@@ -418,15 +531,16 @@ bool CHTTPServer::startStreaming (QNetworkRequest const & request, QString const
     else
     {
       m_httpsReply = m_naMgr->get (request);
-      m_httpsReply->setReadBufferSize (m_httpsBufferSize);
+      m_httpsReply->setReadBufferSize (m_httpsBufferSize); // Pauses the download when the renderer is slower.
     }
 
     connect (m_httpsReply, static_cast<TFctNetworkReplyError>(&QNetworkReply::error), this, &CHTTPServer::httpsError);
     connect (m_httpsReply, &QNetworkReply::finished, this, &CHTTPServer::httpsFinished);
     connect (m_httpsReply, &QNetworkReply::readyRead, this, &CHTTPServer::httpsReadyRead);
-    m_streamingResponseBuffer.clear ();
-    m_readyReadConnected = true; // The slot readyRead is connected. See httpsFinished slot.
-    success              = true;
+    m_streamingResponseBuffer.resize (m_httpsBufferSize);
+    m_streamingHeaderSent = false;
+    m_httpsFinished       = false;
+    success               = true;
   }
 
   return success;
@@ -442,24 +556,16 @@ void CHTTPServer::httpsError (QNetworkReply::NetworkError err)
 
 void CHTTPServer::httpsFinished ()
 {
-  if (m_readyReadConnected)
-  { // The https socket has emitted connect -> finished not connect -> readyRead -> finished
-    emit m_httpsReply->readyRead ();
-  }
-  else
-  { // Remaining data.
-    qint64 bytesAvailable = m_httpsReply->bytesAvailable ();
-    if (bytesAvailable != 0)
-    { // Pending data if exists.
-      emit serverComStarted ();
-      QByteArray data = m_httpsReply->readAll ();
-      emit serverComEnded ();
-      sendHttpResponse (m_streamingSocket, data);
+  if (sender () == m_httpsReply)
+  {
+    m_httpsFinished = true;
+    if (!m_streamingHeaderSent && m_httpsReply->error () != QNetworkReply::OperationCanceledError)
+    { // The https socket has emitted connect -> finished not connect -> readyRead -> finished
+      sendStreamingHeader ();
     }
-  }
 
-  m_httpsReply->deleteLater ();
-  m_httpsReply = nullptr;
+    forwardStreamingData (); // Remaining data. The reply is deleted when all data are forwarded.
+  }
 }
 
 QByteArray CHTTPServer::streamingHeaderResponse (QNetworkReply const * reply, QList<QPair<QByteArray, QByteArray>> const & headers) const
@@ -521,7 +627,20 @@ Connection: close\r\n";
 
 void CHTTPServer::httpsReadyRead ()
 {
-  QNetworkReply* reply = static_cast<QNetworkReply*>(sender ());
+  if (sender () == m_httpsReply)
+  {
+    if (!m_streamingHeaderSent)
+    {
+      sendStreamingHeader ();
+    }
+
+    forwardStreamingData ();
+  }
+}
+
+void CHTTPServer::sendStreamingHeader ()
+{
+  QNetworkReply* reply = m_httpsReply;
   if (reply->isOpen ()) // In fact the reply is always open.
   {
     qint64 totalContentLength = reply->rawHeader ("content-length").toLongLong ();
@@ -548,26 +667,20 @@ void CHTTPServer::httpsReadyRead ()
       }
     }
 
-    m_streamingResponseBuffer = streamingHeaderResponse (reply, headers); // Prepare the header for renderers.
-    int totalToWrite          = m_streamingResponseBuffer.size ();
-    if (m_httpsReply->operation () == QNetworkAccessManager::GetOperation)
-    { // For get operation, add the start of content data.
-      emit serverComStarted ();
-      m_streamingResponseBuffer += reply->read (m_httpsBufferSize);
-      totalToWrite              += totalContentLength;
-      emit serverComEnded ();
+    QByteArray header       = streamingHeaderResponse (reply, headers); // Prepare the header for renderers.
+    qint64     totalToWrite = header.size ();
+    if (reply->operation () == QNetworkAccessManager::GetOperation)
+    { // For get operation, the content data follow the header.
+      totalToWrite += totalContentLength;
     }
 
     // Initialize the size to stream.
     m_writingSocketSizes.insert (m_streamingSocket, totalToWrite);
-
-    // Disconnect the readyRead signal. It is the renderer who drive the https read.
-    disconnect (reply, &QNetworkReply::readyRead, this, &CHTTPServer::httpsReadyRead);
-    m_readyReadConnected = false;
+    m_streamingHeaderSent = true;
 #ifdef DUMP
-    dump (m_streamingResponseBuffer);
+    dump (header);
 #endif
-    sendHttpResponse (m_streamingSocket, m_streamingResponseBuffer);
+    sendHttpResponse (m_streamingSocket, header);
   }
 }
 
@@ -596,3 +709,333 @@ void CHTTPServer::abortStreaming ()
   clearStreaming ();
 }
 
+QString CHTTPServer::mediaURI (QString const & fileName) const
+{
+  QHostAddress host = serverAddress ();
+  if (host == QHostAddress::Any || host == QHostAddress::AnyIPv4 || host == QHostAddress::AnyIPv6)
+  {
+    host = CUpnpSocket::localHostAddress ();
+  }
+
+  return QString ("http://%1:%2/media/%3").arg (host.toString ())
+                                          .arg (serverPort ())
+                                          .arg (QString (QUrl::toPercentEncoding (fileName, "/")));
+}
+
+QString CHTTPServer::mediaFilePath (QByteArray const & query) const
+{
+  QString path;
+  int     index = query.indexOf ("/media/");
+  if (!m_mediaFolder.isEmpty () && index != -1)
+  {
+    QByteArray name = query.mid (index + 7);
+    int        end  = name.indexOf ('?');
+    if (end != -1)
+    {
+      name.truncate (end);
+    }
+
+    // The canonical paths resolve "..", symbolic links and check the existence.
+    QString   root = QFileInfo (m_mediaFolder).canonicalFilePath ();
+    QFileInfo fi (QDir (m_mediaFolder), QUrl::fromPercentEncoding (name));
+    QString   file = fi.canonicalFilePath ();
+    if (!root.isEmpty () && !file.isEmpty () && fi.isFile () && file.startsWith (root + '/'))
+    {
+      path = file;
+    }
+  }
+
+  return path;
+}
+
+int CHTTPServer::mediaRange (QByteArray const & range, qint64 size, qint64& first, qint64& last)
+{
+  int status = 200;
+  first      = 0;
+  last       = size - 1;
+
+  QByteArray value = range.trimmed ();
+  if (value.startsWith ("bytes=") && !value.contains (','))
+  {
+    value     = value.mid (6);
+    int index = value.indexOf ('-');
+    if (index != -1)
+    {
+      QByteArray start   = value.left (index).trimmed ();
+      QByteArray stop    = value.mid (index + 1).trimmed ();
+      bool       okStart = false, okStop = false;
+      qint64     a       = start.toLongLong (&okStart);
+      qint64     b       = stop.toLongLong (&okStop);
+      status             = 416;
+      if (start.isEmpty ())
+      { // bytes=-n: The last n bytes.
+        if (okStop && b > 0 && size > 0)
+        {
+          first  = qMax (Q_INT64_C(0), size - b);
+          status = 206;
+        }
+      }
+      else if (okStart && a >= 0 && a < size)
+      { // bytes=a- or bytes=a-b
+        if (stop.isEmpty ())
+        {
+          first  = a;
+          status = 206;
+        }
+        else if (okStop && b >= a)
+        {
+          first  = a;
+          last   = qMin (b, size - 1);
+          status = 206;
+        }
+      }
+    }
+  }
+
+  return status;
+}
+
+QByteArray CHTTPServer::mediaContentType (QString const & fileName)
+{
+  static char const * types[][2] = { { "tts", "video/mp2t" },
+                                     { "ts", "video/mp2t" },
+                                     { "m2ts", "video/mp2t" },
+                                     { "mts", "video/mp2t" },
+                                     { "mp4", "video/mp4" },
+                                     { "mkv", "video/x-matroska" },
+                                     { "mp3", "audio/mpeg" },
+                                     { "jpg", "image/jpeg" },
+                                     { "png", "image/png" },
+                                     { nullptr, "application/octet-stream" },
+                                   };
+
+  QString suffix = QFileInfo (fileName).suffix ().toLower ();
+  int     k      = 0;
+  for (; types[k][0] != nullptr && suffix != types[k][0]; ++k);
+  return types[k][1];
+}
+
+QByteArray CHTTPServer::statusHeaderResponse (int status, qint64 contentLength, QByteArray const & contentType,
+                                               QByteArray const & contentRange) const
+{
+  char const * reason;
+  switch (status)
+  {
+    case 200 :
+      reason = "OK";
+      break;
+
+    case 206 :
+      reason = "Partial Content";
+      break;
+
+    case 404 :
+      reason = "Not Found";
+      break;
+
+    case 416 :
+      reason = "Range Not Satisfiable";
+      break;
+
+    case 500 :
+      reason = "Internal Server Error";
+      break;
+
+    default :
+      reason = "Not Implemented";
+      break;
+  }
+
+  QByteArray const crlf = "\r\n";
+  QByteArray       header;
+  header.reserve (512);
+  header  = "HTTP/1.1 " + QByteArray::number (status) + ' ' + reason + crlf;
+  header += "Server: UPnP/1.0 QtUPnP/1.0.0" + crlf;
+  header += "Date: " + this->currentTime () + crlf;
+  if (!contentType.isEmpty ())
+  {
+    header += "Content-Type: " + contentType + crlf;
+  }
+
+  header += "Accept-Ranges: bytes" + crlf;
+  header += "Content-Length: " + QByteArray::number (contentLength) + crlf;
+  if (!contentRange.isEmpty ())
+  {
+    header += "Content-Range: " + contentRange + crlf;
+  }
+
+  header += "TransferMode.dlna.org: Streaming" + crlf;
+  header += "Connection: close" + crlf + crlf;
+  return header;
+}
+
+void CHTTPServer::sendMedia (CHTTPParser const * httpParser, QTcpSocket* socket)
+{
+  QByteArray const & verb     = httpParser->verb ();
+  QString            fileName = mediaFilePath (httpParser->value (verb));
+  QFile*             file     = nullptr;
+  int                status   = 404;
+  qint64             first = 0, last = -1, size = 0;
+  if (verb != "GET" && verb != "HEAD")
+  {
+    status = 501;
+  }
+  else if (!fileName.isEmpty ())
+  {
+    file = new QFile (fileName);
+    if (file->open (QIODevice::ReadOnly))
+    {
+      size   = file->size ();
+      status = mediaRange (httpParser->value ("RANGE"), size, first, last);
+    }
+  }
+
+  QByteArray contentType, contentRange;
+  qint64     contentLength = 0;
+  if (status == 200 || status == 206)
+  {
+    contentType   = mediaContentType (fileName);
+    contentLength = last - first + 1;
+    if (status == 206)
+    {
+      contentRange = "bytes " + QByteArray::number (first) + '-' + QByteArray::number (last) + '/' + QByteArray::number (size);
+    }
+  }
+  else if (status == 416)
+  {
+    contentRange = "bytes */" + QByteArray::number (size);
+  }
+
+  QByteArray header  = statusHeaderResponse (status, contentLength, contentType, contentRange);
+  bool       success = sendHttpResponse (socket, header);
+  if (success && verb == "GET" && (status == 200 || status == 206) && last >= first)
+  {
+    SMediaTransfer& transfer            = m_mediaTransfers[socket];
+    transfer.m_file                     = file;
+    transfer.m_pos                      = first;
+    transfer.m_end                      = last + 1;
+    transfer.m_statistics.m_fileName    = fileName;
+    transfer.m_statistics.m_peerAddress = socket->peerAddress ();
+    transfer.m_statistics.m_size        = last - first + 1;
+    transfer.m_timer.start ();
+    forwardMediaData (socket);
+  }
+  else
+  {
+    delete file;
+    if (success)
+    {
+      socket->disconnectFromHost (); // Closed when the header is written.
+    }
+  }
+}
+
+void CHTTPServer::forwardMediaData (QTcpSocket* socket)
+{
+  QMap<QTcpSocket*, SMediaTransfer>::iterator it = m_mediaTransfers.find (socket);
+  if (it != m_mediaTransfers.end () && socket->state () == QAbstractSocket::ConnectedState)
+  {
+    SMediaTransfer& transfer = it.value ();
+    qint64          burst    = 0;
+    while (transfer.m_pos < transfer.m_end && socket->bytesToWrite () < m_mediaHighWatermark && burst < m_mediaMaxBurst)
+    {
+      qint64 length = qMin (m_mediaBlockSize, transfer.m_end - transfer.m_pos);
+      qint64 sent   = -1;
+#ifdef Q_OS_LINUX
+      if (transfer.m_sendfile && socket->bytesToWrite () != 0)
+      { // The header or a previous block is still in the socket buffer. Copying the block behind it would
+        // lose sendfile, the socket emits bytesWritten when it is written and the transfer continues there.
+        break;
+      }
+
+      if (transfer.m_sendfile)
+      { // Nothing is waiting in the socket buffer, the kernel can send the file directly.
+        off_t   offset = static_cast<off_t>(transfer.m_pos);
+        ssize_t cBytes = ::sendfile (static_cast<int>(socket->socketDescriptor ()), transfer.m_file->handle (),
+                                     &offset, static_cast<size_t>(length));
+        if (cBytes > 0)
+        {
+          sent                                  = cBytes;
+          transfer.m_statistics.m_sendfileSent += cBytes;
+        }
+        else if (cBytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        { // E.g. the file system does not support sendfile.
+          transfer.m_sendfile = false;
+        }
+      }
+#endif
+
+      if (sent < 0)
+      { // The kernel buffer is full or sendfile is not available. The block is written in the socket buffer.
+        // The socket emits bytesWritten when it can send again, and sendfile restarts once the buffer is empty.
+        uchar* data = transfer.m_file->map (transfer.m_pos, length);
+        if (data != nullptr)
+        {
+          sent = socket->write (reinterpret_cast<char const *>(data), length);
+          transfer.m_file->unmap (data);
+        }
+        else if (transfer.m_file->seek (transfer.m_pos))
+        {
+          sent = socket->write (transfer.m_file->read (length));
+        }
+      }
+
+      if (sent <= 0)
+      {
+        qDebug () << "CHTTPServer::forwardMediaData: Write error" << transfer.m_statistics.m_fileName;
+        socket->abort ();
+        endMediaTransfer (socket);
+        return;
+      }
+
+      transfer.m_pos               += sent;
+      transfer.m_statistics.m_sent += sent;
+      m_mediaBytesSent             += sent;
+      burst                        += sent;
+    }
+
+    if (transfer.m_pos >= transfer.m_end)
+    { // The socket is closed when the buffer is written.
+      socket->disconnectFromHost ();
+    }
+    else if (socket->bytesToWrite () == 0)
+    { // The burst is reached and bytesWritten will not be emitted. Let the other connections work.
+      QMetaObject::invokeMethod (this, [this, socket] () { forwardMediaData (socket); }, Qt::QueuedConnection);
+    }
+  }
+}
+
+void CHTTPServer::endMediaTransfer (QTcpSocket* socket)
+{
+  QMap<QTcpSocket*, SMediaTransfer>::iterator it = m_mediaTransfers.find (socket);
+  if (it != m_mediaTransfers.end ())
+  {
+    SMediaStatistics statistics = it.value ().m_statistics;
+    statistics.m_elapsed        = it.value ().m_timer.elapsed ();
+    CMetrics& metrics = CMetrics::instance ();
+    if (metrics.isEnabled () || metrics.isTracing ())
+    {
+      CMetrics::TLabels labels { { "peer", statistics.m_peerAddress.toString () } };
+      metrics.add ("upnp_media_bytes_sent_total", labels, statistics.m_sent);
+      metrics.add ("upnp_media_transfers_total", labels);
+      metrics.span ("media", "media", metrics.now () - statistics.m_elapsed * 1000, statistics.m_elapsed * 1000, labels);
+    }
+
+    delete it.value ().m_file;
+    m_mediaTransfers.erase (it);
+    emit mediaTransferEnded (statistics);
+  }
+}
+
+QList<CHTTPServer::SMediaStatistics> CHTTPServer::mediaStatistics () const
+{
+  QList<SMediaStatistics> statistics;
+  statistics.reserve (m_mediaTransfers.size ());
+  for (SMediaTransfer const & transfer : m_mediaTransfers)
+  {
+    statistics.append (transfer.m_statistics);
+    statistics.last ().m_elapsed = transfer.m_timer.elapsed ();
+  }
+
+  return statistics;
+}
@@ -5,8 +5,11 @@
 #include "didlitem.hpp"
 #include <QTcpServer>
 #include <QNetworkReply>
+#include <QElapsedTimer>
+#include <functional>
 
 class QNetworkAccessManager;
+class QFile;
 
 START_DEFINE_UPNP_NAMESPACE
 
@@ -39,6 +42,14 @@ typedef void (QNetworkReply::*TFctNetworkReplyError) (QNetworkReply::NetworkErro
 /*! Defines type for QTcpSocket::connect function. */
 typedef void (QAbstractSocket::*TFctSocketError) (QAbstractSocket::SocketError);
 
+/*! Defines the type of the handler of the requests not managed by the server.
+ * \param CHTTPParser: The request.
+ * \param QByteArray: The content type of the response.
+ * \param QByteArray: The body of the response.
+ * \return The HTTP status of the response or 0 if the request is not handled.
+ */
+typedef std::function<int (CHTTPParser const &, QByteArray&, QByteArray&)> TRequestHandler;
+
 /*! \brief A partial HTTP server used by UPnP events, playlist manager and streaming server.
  *
  * This class manages only HTTP header verb "NOTIFY" of UPnP events and "HEAD" and "GET".
@@ -53,7 +64,18 @@ typedef void (QAbstractSocket::*TFctSocketError) (QAbstractSocket::SocketError);
  * \li Streaming server
  * The streaming server replace the https server. Once the renderer asks a data (audio, video, image)
  * a https request is sent to the https server. The https reply is converted in a http reply and sent
- * to the renderer.
+ * to the renderer. The streaming request comes from a CPlugin (see CControlPoint::mediaRequest). plugin.cpp
+ * and oauth2.cpp are not in qtupnp.pro, so no plugin is loaded and this path is not used by this build.
+ *
+ * \li Media server
+ * The files of the media folder are served with the query /media/file name. GET and HEAD verbs and a
+ * single range (Range: bytes=first-last) are supported. Each connection has its own transfer. The file
+ * is sent by blocks while the socket has less than m_mediaHighWatermark bytes to write. On Linux, when
+ * the socket write buffer is empty, the blocks are sent by sendfile without copy in user space.
+ *
+ * \li Other requests
+ * The requests not managed (e.g. device description or SOAP control of a local device) are given to
+ * the request handler. See setRequestHandler.
  */
 class UPNP_API CHTTPServer : public QTcpServer
 {
@@ -65,6 +87,20 @@ public :
   /*! Defines type for QTcpSocket::byWritten function. */
   typedef QPair<qint64, qint64> TMWritingLength;
 
+  /*! \brief The counters of a media transfer. */
+  struct SMediaStatistics
+  {
+    /*! Returns the throughput in bytes per second. */
+    double throughput () const { return m_elapsed > 0 ? m_sent * 1000.0 / m_elapsed : 0.0; }
+
+    QString m_fileName; //!< The file served.
+    QHostAddress m_peerAddress; //!< The client address.
+    qint64 m_size = 0; //!< The number of bytes to send (range length).
+    qint64 m_sent = 0; //!< The number of bytes sent.
+    qint64 m_sendfileSent = 0; //!< The number of bytes sent by sendfile.
+    qint64 m_elapsed = 0; //!< The duration in ms.
+  };
+
   /*! Constructs a server.
    * The server listens for incoming connections on address address and port port.
    */
@@ -108,6 +144,40 @@ public :
   void abortStreaming (); // Version 1.1
   void clearStreaming (); // Version 1.1
 
+  /*! Sets the folder of the files served by the /media/ query.
+   * \param folder: The folder. If it is empty, the media queries are rejected.
+   */
+  void setMediaFolder (QString const & folder) { m_mediaFolder = folder; }
+
+  /*! Returns the media folder. */
+  QString const & mediaFolder () const { return m_mediaFolder; }
+
+  /*! Builds an uri from a file name of the media folder.
+   * \param fileName: The file name relative to the media folder.
+   * \return The uri.
+   */
+  QString mediaURI (QString const & fileName) const;
+
+  /*! Sets the handler of the requests not managed by the server. */
+  void setRequestHandler (TRequestHandler handler) { m_requestHandler = handler; }
+
+  /*! Sets the delay of the responses of the request handler, e.g. to simulate a slow device.
+   * \param ms: The delay in ms. 0 to answer immediately.
+   */
+  void setResponseDelay (int ms) { m_responseDelay = ms; }
+
+  /*! Returns the delay of the responses of the request handler. */
+  int responseDelay () const { return m_responseDelay; }
+
+  /*! Returns the counters of the transfers in progress. */
+  QList<SMediaStatistics> mediaStatistics () const;
+
+  /*! Returns the number of bytes sent by all media transfers. */
+  qint64 mediaBytesSent () const { return m_mediaBytesSent; }
+
+  /*! Returns the content type from the file suffix. */
+  static QByteArray mediaContentType (QString const & fileName);
+
   /*! Returns the an uuid in form uuid:xxxx by uuid_xxx. */
   static QString formatUUID (QString const & uuid);
 
@@ -135,7 +205,27 @@ protected slots :
    * \param socket: The socket for the response.
    */
   void sendResponse (CHTTPParser const * httpParser, QTcpSocket* socket);
-  void streamBlock ();
+
+  /*! Parses the next pipelined request of the socket once the response of the current one is sent.
+   * The requests following a media or streaming response are not answered, these responses close the connection.
+   */
+  void nextMessage (QTcpSocket* socket);
+
+  /*! Drops a malformed request. The received data are discarded and the connection is closed. */
+  void dropMessage (QTcpSocket* socket);
+
+  /*! Forwards the https data to the renderer.
+   * The data are forwarded while the renderer socket has less than m_streamingHighWatermark bytes to write.
+   * When the renderer is slower than the https server, the data stay in the https reply. Its read buffer
+   * is limited to m_httpsBufferSize, so the https download is paused. The forwarding restarts when the
+   * renderer socket has less than m_streamingLowWatermark bytes to write.
+   */
+  void forwardStreamingData ();
+
+  /*! Sends the next blocks of the media file to the socket.
+   * \param socket: The socket of the transfer.
+   */
+  void forwardMediaData (QTcpSocket* socket);
 
   void httpsError (QNetworkReply::NetworkError err); // Version 1.1
   void httpsFinished (); // Version 1.1
@@ -152,12 +242,12 @@ signals:
   /*! Emitted when http parser in socketReadyRead slot has detected a full message. */
   void httpValidReadMessage (CHTTPParser const *, QTcpSocket*);
 
-  /*! Ready to stream a bock of data. */
-  void streamingReady (); // Version 1.1
-
   /*! Emitted when the didlitem contains an url managed by a plugin. */
   void mediaRequest (QString request); // Version 1.1
 
+  /*! Emitted when a media transfer ends (completed or aborted by the client). */
+  void mediaTransferEnded (CHTTPServer::SMediaStatistics const & statistics);
+
   void serverComStarted ();
   void serverComEnded ();
   void rendererComStarted ();
@@ -219,6 +309,9 @@ private :
    */
   QByteArray streamingHeaderResponse (QNetworkReply const * reply, QList<QPair<QByteArray, QByteArray>> const & headers) const;
 
+  /*! Sends the header of the https reply to the renderer and initializes the size to stream. */
+  void sendStreamingHeader ();
+
   /*! Starts the streaming. A head or get request is sent to the http server.
    * \param request: The request to send.
    * \param method: Head or get method.
@@ -227,6 +320,40 @@ private :
    */
   bool startStreaming (QNetworkRequest const & request, QString const & method, QTcpSocket* socket); // Version 1.1
 
+  /*! Answers a /media/ query. The header is sent and the transfer is started for GET verb.
+   * \param httpParser: The current http parser.
+   * \param socket: The socket for the response.
+   */
+  void sendMedia (CHTTPParser const * httpParser, QTcpSocket* socket);
+
+  /*! Ends a media transfer. The file is closed and mediaTransferEnded is emitted. */
+  void endMediaTransfer (QTcpSocket* socket);
+
+  /*! Returns the canonical path of the file of a media query.
+   * The path is empty if the file does not exist or if it is outside the media folder.
+   */
+  QString mediaFilePath (QByteArray const & query) const;
+
+  /*! Returns the header of a response with a status.
+   * \param status: The HTTP status (200, 206, 404, 416, 500 or 501).
+   * \param contentLength: The length of the content.
+   * \param contentType: The content type. Not sent if it is empty.
+   * \param contentRange: The Content-Range value. Not sent if it is empty.
+   * \return The http header.
+   */
+  QByteArray statusHeaderResponse (int status, qint64 contentLength, QByteArray const & contentType,
+                                   QByteArray const & contentRange = QByteArray ()) const;
+
+  /*! Decodes the Range header.
+   * \param range: The Range header value. It can be empty.
+   * \param size: The file size.
+   * \param first: The first byte of the range.
+   * \param last: The last byte of the range.
+   * \return 206 for a single satisfiable range, 416 for an unsatisfiable range and 200 otherwize.
+   * Multiple ranges are not supported, the whole file is sent.
+   */
+  static int mediaRange (QByteArray const & range, qint64 size, qint64& first, qint64& last);
+
   /*! Formats the HTTP date and time for the header.
    * \param dt: The date and time to convert.
    * \returns The HTTP formated time.
@@ -253,10 +380,32 @@ private :
   QNetworkReply* m_httpsReply = nullptr; //!< The reply of the https server.
   QNetworkRequest m_httpsRequest; //!< The request to send to the https server.
   int m_httpsBufferSize; //!< The https buffer size to limit the amount of data in memory.
-  int m_httpsReadDataTimeout; //!< Wait to have https data to stream a new block. Very smal delay.
-  int m_httpsReadDataWaitingRetry; //!< Number of waits. Total waiting time id approximativly m_httpsReadDataTimeout x m_httpsReadDataWaitingRetry.
-  bool m_readyReadConnected = false; //!< In case of very small amount of data, the slot readyRead is not emitted just finished.
+  qint64 m_streamingHighWatermark; //!< Pause the forwarding when the renderer socket has more bytes to write.
+  qint64 m_streamingLowWatermark; //!< Restart the forwarding when the renderer socket has less bytes to write.
+  bool m_streamingHeaderSent = false; //!< The header of the https reply is sent to the renderer.
+  bool m_httpsFinished = false; //!< The https reply is finished. Remaining data can be in the reply.
   QByteArray m_streamingResponseBuffer; //!< Intermediat buffer between https read and straming to renderer.
+
+  /*! \brief A media transfer in progress. */
+  struct SMediaTransfer
+  {
+    QFile* m_file = nullptr; //!< The file sent.
+    qint64 m_pos = 0; //!< The next byte to send.
+    qint64 m_end = 0; //!< The byte following the range.
+    bool m_sendfile = true; //!< sendfile can be used.
+    QElapsedTimer m_timer; //!< Transfer duration.
+    SMediaStatistics m_statistics; //!< The counters.
+  };
+
+  QString m_mediaFolder; //!< The folder of media files.
+  QMap<QTcpSocket*, SMediaTransfer> m_mediaTransfers; //!< The media transfers in progress.
+  qint64 m_mediaBlockSize = 256 * 1024; //!< The size of the blocks mapped and sent.
+  qint64 m_mediaHighWatermark = 1024 * 1024; //!< Pause the sending when the socket has more bytes to write.
+  qint64 m_mediaLowWatermark = 256 * 1024; //!< Restart the sending when the socket has less bytes to write.
+  qint64 m_mediaMaxBurst = 8 * 1024 * 1024; //!< Maximum bytes sent by a call of forwardMediaData.
+  qint64 m_mediaBytesSent = 0; //!< Bytes sent by all media transfers.
+  TRequestHandler m_requestHandler; //!< The handler of the requests not managed.
+  int m_responseDelay = 0; //!< The delay in ms of the responses of the request handler.
 };
 
 } // End namespace
@@ -0,0 +1,672 @@
+#include "mediaserver.hpp"
+#include "httpserver.hpp"
+#include "multicastsocket.hpp"
+#include "ssdpparser.hpp"
+#include "didlitem.hpp"
+#include "helper.hpp"
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QFileInfo>
+#include <QDir>
+#include <QUuid>
+#include <QLocale>
+
+USING_UPNP_NAMESPACE
+
+static char const * deviceType            = "urn:schemas-upnp-org:device:MediaServer:1";
+static char const * contentDirectoryType  = "urn:schemas-upnp-org:service:ContentDirectory:1";
+static char const * connectionManagerType = "urn:schemas-upnp-org:service:ConnectionManager:1";
+static char const * xmlContentType        = "text/xml; charset=\"utf-8\"";
+static char const * protocolInfos         = "http-get:*:video/mp2t:*,http-get:*:video/mp4:*,http-get:*:audio/mpeg:*";
+static char const * encodedDidlHeader     = "&lt;DIDL-Lite xmlns=&quot;urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/&quot; "
+                                            "xmlns:dc=&quot;http://purl.org/dc/elements/1.1/&quot; "
+                                            "xmlns:upnp=&quot;urn:schemas-upnp-org:metadata-1-0/upnp/&quot;&gt;";
+static char const * encodedDidlFooter     = "&lt;/DIDL-Lite&gt;";
+
+static char const * contentDirectorySCPD = "<?xml version=\"1.0\"?>\
+<scpd xmlns=\"urn:schemas-upnp-org:service-1-0\">\
+<specVersion><major>1</major><minor>0</minor></specVersion>\
+<actionList>\
+<action><name>Browse</name><argumentList>\
+<argument><name>ObjectID</name><direction>in</direction><relatedStateVariable>A_ARG_TYPE_ObjectID</relatedStateVariable></argument>\
+<argument><name>BrowseFlag</name><direction>in</direction><relatedStateVariable>A_ARG_TYPE_BrowseFlag</relatedStateVariable></argument>\
+<argument><name>Filter</name><direction>in</direction><relatedStateVariable>A_ARG_TYPE_Filter</relatedStateVariable></argument>\
+<argument><name>StartingIndex</name><direction>in</direction><relatedStateVariable>A_ARG_TYPE_Index</relatedStateVariable></argument>\
+<argument><name>RequestedCount</name><direction>in</direction><relatedStateVariable>A_ARG_TYPE_Count</relatedStateVariable></argument>\
+<argument><name>SortCriteria</name><direction>in</direction><relatedStateVariable>A_ARG_TYPE_SortCriteria</relatedStateVariable></argument>\
+<argument><name>Result</name><direction>out</direction><relatedStateVariable>A_ARG_TYPE_Result</relatedStateVariable></argument>\
+<argument><name>NumberReturned</name><direction>out</direction><relatedStateVariable>A_ARG_TYPE_Count</relatedStateVariable></argument>\
+<argument><name>TotalMatches</name><direction>out</direction><relatedStateVariable>A_ARG_TYPE_Count</relatedStateVariable></argument>\
+<argument><name>UpdateID</name><direction>out</direction><relatedStateVariable>A_ARG_TYPE_UpdateID</relatedStateVariable></argument>\
+</argumentList></action>\
+<action><name>GetSearchCapabilities</name><argumentList>\
+<argument><name>SearchCaps</name><direction>out</direction><relatedStateVariable>SearchCapabilities</relatedStateVariable></argument>\
+</argumentList></action>\
+<action><name>GetSortCapabilities</name><argumentList>\
+<argument><name>SortCaps</name><direction>out</direction><relatedStateVariable>SortCapabilities</relatedStateVariable></argument>\
+</argumentList></action>\
+<action><name>GetSystemUpdateID</name><argumentList>\
+<argument><name>Id</name><direction>out</direction><relatedStateVariable>SystemUpdateID</relatedStateVariable></argument>\
+</argumentList></action>\
+</actionList>\
+<serviceStateTable>\
+<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_ObjectID</name><dataType>string</dataType></stateVariable>\
+<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_BrowseFlag</name><dataType>string</dataType>\
+<allowedValueList><allowedValue>BrowseMetadata</allowedValue><allowedValue>BrowseDirectChildren</allowedValue></allowedValueList>\
+</stateVariable>\
+<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_Filter</name><dataType>string</dataType></stateVariable>\
+<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_Index</name><dataType>ui4</dataType></stateVariable>\
+<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_Count</name><dataType>ui4</dataType></stateVariable>\
+<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_SortCriteria</name><dataType>string</dataType></stateVariable>\
+<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_Result</name><dataType>string</dataType></stateVariable>\
+<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_UpdateID</name><dataType>ui4</dataType></stateVariable>\
+<stateVariable sendEvents=\"no\"><name>SearchCapabilities</name><dataType>string</dataType></stateVariable>\
+<stateVariable sendEvents=\"no\"><name>SortCapabilities</name><dataType>string</dataType></stateVariable>\
+<stateVariable sendEvents=\"yes\"><name>SystemUpdateID</name><dataType>ui4</dataType></stateVariable>\
+</serviceStateTable>\
+</scpd>";
+
+static char const * connectionManagerSCPD = "<?xml version=\"1.0\"?>\
+<scpd xmlns=\"urn:schemas-upnp-org:service-1-0\">\
+<specVersion><major>1</major><minor>0</minor></specVersion>\
+<actionList>\
+<action><name>GetProtocolInfo</name><argumentList>\
+<argument><name>Source</name><direction>out</direction><relatedStateVariable>SourceProtocolInfo</relatedStateVariable></argument>\
+<argument><name>Sink</name><direction>out</direction><relatedStateVariable>SinkProtocolInfo</relatedStateVariable></argument>\
+</argumentList></action>\
+<action><name>GetCurrentConnectionIDs</name><argumentList>\
+<argument><name>ConnectionIDs</name><direction>out</direction><relatedStateVariable>CurrentConnectionIDs</relatedStateVariable></argument>\
+</argumentList></action>\
+</actionList>\
+<serviceStateTable>\
+<stateVariable sendEvents=\"yes\"><name>SourceProtocolInfo</name><dataType>string</dataType></stateVariable>\
+<stateVariable sendEvents=\"yes\"><name>SinkProtocolInfo</name><dataType>string</dataType></stateVariable>\
+<stateVariable sendEvents=\"yes\"><name>CurrentConnectionIDs</name><dataType>string</dataType></stateVariable>\
+</serviceStateTable>\
+</scpd>";
+
+CMediaServer::CMediaServer (QObject* parent) : QObject (parent)
+{
+  m_uuid = "uuid:" + QUuid::createUuid ().toString ().mid (1, 36);
+
+  SObject root;
+  root.m_parentID  = "-1";
+  root.m_title     = "root";
+  root.m_upnpClass = "object.container.storageFolder";
+  m_objects.append (root);
+
+  connect (&m_aliveTimer, SIGNAL(timeout()), this, SLOT(sendAlive()));
+}
+
+CMediaServer::~CMediaServer ()
+{
+  stop ();
+}
+
+bool CMediaServer::start (QString const & folder, quint16 port)
+{
+  bool success = m_httpServer != nullptr;
+  if (!success)
+  {
+    m_hostAddress = CUpnpSocket::localHostAddress ();
+    m_httpServer  = new CHTTPServer (QHostAddress::AnyIPv4, port, this);
+    success       = m_httpServer->isDone ();
+    if (success)
+    {
+      m_httpServer->setMediaFolder (folder);
+      m_httpServer->setRequestHandler ([this] (CHTTPParser const & request, QByteArray& contentType, QByteArray& body) -> int
+      {
+        return handleRequest (request, contentType, body);
+      });
+
+      // The res urls depend on the server address.
+      for (SObject const & object : m_objects)
+      {
+        object.m_didl.clear ();
+      }
+
+      m_socket = new CMulticastSocket (this);
+      if (m_socket->initialize (QHostAddress::AnyIPv4, CMulticastSocket::upnpMulticastAddr))
+      {
+        connect (m_socket, SIGNAL(readyRead()), this, SLOT(readDatagrams()));
+      }
+      else
+      { // The server stays reachable from its description url.
+        qDebug () << "CMediaServer::start: Discovery unavailable";
+        delete m_socket;
+        m_socket = nullptr;
+      }
+
+      sendAlive ();
+      m_aliveTimer.start (m_maxAge * 500);
+    }
+    else
+    {
+      qDebug () << "CMediaServer::start: Listen error" << m_httpServer->errorString ();
+      delete m_httpServer;
+      m_httpServer = nullptr;
+    }
+  }
+
+  return success;
+}
+
+void CMediaServer::stop ()
+{
+  if (m_httpServer != nullptr)
+  {
+    m_aliveTimer.stop ();
+    sendNotify ("ssdp:byebye");
+    delete m_socket;
+    m_socket = nullptr;
+    delete m_httpServer;
+    m_httpServer = nullptr;
+  }
+}
+
+void CMediaServer::clear ()
+{
+  m_objects.resize (1);
+  m_objects[0].m_children.clear ();
+  m_objects[0].m_didl.clear ();
+  ++m_systemUpdateID;
+}
+
+int CMediaServer::objectIndex (QString const & id) const
+{
+  bool ok    = false;
+  int  index = id.toInt (&ok);
+  return ok && index >= 0 && index < m_objects.size () ? index : -1;
+}
+
+QString CMediaServer::addContainer (QString const & title, QString const & parentID)
+{
+  QString id;
+  int     parent = objectIndex (parentID);
+  if (parent != -1 && m_objects[parent].m_fileName.isEmpty ())
+  {
+    int     index = m_objects.size ();
+    SObject object;
+    object.m_parentID  = parentID;
+    object.m_title     = title;
+    object.m_upnpClass = "object.container.storageFolder";
+    m_objects.append (object);
+    m_objects[parent].m_children.append (index);
+    m_objects[parent].m_didl.clear (); // childCount has changed.
+    id = QString::number (index);
+    ++m_systemUpdateID;
+  }
+
+  return id;
+}
+
+QString CMediaServer::addItem (QString const & parentID, QString const & title, QString const & fileName,
+                               QDateTime const & date, QString const & description, QString const & upnpClass)
+{
+  QString id;
+  int     parent = objectIndex (parentID);
+  if (parent != -1 && m_objects[parent].m_fileName.isEmpty () && !fileName.isEmpty ())
+  {
+    int     index = m_objects.size ();
+    SObject object;
+    object.m_parentID    = parentID;
+    object.m_title       = title;
+    object.m_upnpClass   = upnpClass;
+    object.m_fileName    = fileName;
+    object.m_description = description;
+    object.m_date        = date;
+    m_objects.append (object);
+    m_objects[parent].m_children.append (index);
+    m_objects[parent].m_didl.clear (); // childCount has changed.
+    id = QString::number (index);
+    ++m_systemUpdateID;
+  }
+
+  return id;
+}
+
+bool CMediaServer::setItemResource (QString const & id, QString const & uri, qint64 size)
+{
+  int index = objectIndex (id);
+  if (index == -1 || m_objects[index].m_fileName.isEmpty ())
+  {
+    return false;
+  }
+
+  SObject& object = m_objects[index];
+  object.m_uri    = uri;
+  object.m_size   = size;
+  object.m_didl.clear ();
+  ++m_systemUpdateID;
+  return true;
+}
+
+QByteArray const & CMediaServer::didl (int index) const
+{
+  SObject const & object = m_objects[index];
+  if (object.m_didl.isEmpty ())
+  {
+    QByteArray xml;
+    if (object.m_fileName.isEmpty ())
+    { // Container.
+      QXmlStreamWriter stream (&xml);
+      stream.writeStartElement ("container");
+      stream.writeAttribute ("id", QString::number (index));
+      stream.writeAttribute ("parentID", object.m_parentID);
+      stream.writeAttribute ("restricted", "1");
+      stream.writeAttribute ("searchable", "0");
+      stream.writeAttribute ("childCount", QString::number (object.m_children.size ()));
+      stream.writeTextElement ("dc:title", object.m_title);
+      stream.writeTextElement ("upnp:class", object.m_upnpClass);
+      stream.writeEndElement ();
+    }
+    else
+    { // Item. Built by CDidlItem, the DIDL-Lite element is removed.
+      CDidlItem item;
+      CDidlElem elem;
+      elem.addProp ("id", QString::number (index));
+      elem.addProp ("parentID", object.m_parentID);
+      elem.addProp ("restricted", "1");
+      item.insert ("item", elem);
+      item.insert ("dc:title", CDidlElem (object.m_title));
+      item.insert ("upnp:class", CDidlElem (object.m_upnpClass));
+      if (object.m_date.isValid ())
+      {
+        item.insert ("dc:date", CDidlElem (object.m_date.toString (Qt::ISODate)));
+      }
+
+      if (!object.m_description.isEmpty ())
+      {
+        item.insert ("dc:description", CDidlElem (object.m_description));
+      }
+
+      if (!object.m_uri.isEmpty ())
+      {
+        CDidlElem res (object.m_uri);
+        res.addProp ("protocolInfo", "http-get:*:" + CHTTPServer::mediaContentType (object.m_fileName) + ":*");
+        res.addProp ("size", QString::number (object.m_size));
+        item.insert ("res", res);
+      }
+      else if (m_httpServer != nullptr)
+      {
+        QFileInfo fi (QDir (m_httpServer->mediaFolder ()), object.m_fileName);
+        CDidlElem res (m_httpServer->mediaURI (object.m_fileName));
+        res.addProp ("protocolInfo", "http-get:*:" + CHTTPServer::mediaContentType (object.m_fileName) + ":*");
+        res.addProp ("size", QString::number (fi.size ()));
+        item.insert ("res", res);
+      }
+
+      QString text  = item.didl (false);
+      int     begin = text.indexOf ("<item");
+      int     end   = text.lastIndexOf ("</DIDL-Lite>");
+      xml           = begin != -1 && end > begin ? text.mid (begin, end - begin).toUtf8 () : QByteArray ();
+    }
+
+    // Escaped as text, then encoded once. The bytes of xml are UTF-8, not Latin-1.
+    object.m_didl = QString::fromUtf8 (xml).toHtmlEscaped ().toUtf8 ();
+  }
+
+  return object.m_didl;
+}
+
+QByteArray CMediaServer::browse (QString const & objectID, bool metadata, int startingIndex, int requestedCount,
+                                 int& numberReturned, int& totalMatches) const
+{
+  QByteArray result;
+  numberReturned = 0;
+  totalMatches   = 0;
+  int index      = objectIndex (objectID);
+  if (index != -1)
+  {
+    if (metadata)
+    {
+      QByteArray const & fragment = didl (index);
+      result.reserve (fragment.size () + 512);
+      result         = encodedDidlHeader;
+      result        += fragment;
+      numberReturned = 1;
+      totalMatches   = 1;
+    }
+    else
+    {
+      QVector<int> const & children = m_objects[index].m_children;
+      totalMatches                  = children.size ();
+      int first                     = qBound (0, startingIndex, totalMatches);
+      int last                      = requestedCount > 0 && requestedCount < totalMatches - first ? first + requestedCount : totalMatches;
+      numberReturned                = last - first;
+
+      int size = 512;
+      for (int k = first; k < last; ++k)
+      {
+        size += didl (children[k]).size ();
+      }
+
+      result.reserve (size);
+      result = encodedDidlHeader;
+      for (int k = first; k < last; ++k)
+      {
+        result += didl (children[k]);
+      }
+    }
+
+    result += encodedDidlFooter;
+  }
+
+  return result;
+}
+
+QList<QByteArray> CMediaServer::notificationTypes () const
+{
+  return QList<QByteArray> () << "upnp:rootdevice" << m_uuid.toUtf8 () << deviceType
+                              << contentDirectoryType << connectionManagerType;
+}
+
+QByteArray CMediaServer::location () const
+{
+  return "http://" + m_hostAddress.toString ().toUtf8 () + ':' +
+         QByteArray::number (m_httpServer->serverPort ()) + "/description.xml";
+}
+
+static QByteArray usn (QByteArray const & uuid, QByteArray const & nt)
+{
+  return nt == uuid ? uuid : uuid + "::" + nt;
+}
+
+static QByteArray serverHeader ()
+{
+  return buildSystemHeader ().toUtf8 () + " UPnP/1.0 " + libraryName () + '/' + libraryVersion ();
+}
+
+void CMediaServer::sendNotify (char const * nts)
+{
+  if (m_socket != nullptr && m_httpServer != nullptr)
+  {
+    QByteArray const  uuid  = m_uuid.toUtf8 ();
+    QList<QByteArray> types = notificationTypes ();
+    for (QByteArray const & nt : types)
+    {
+      QByteArray datagram;
+      datagram.reserve (512);
+      datagram  = "NOTIFY * HTTP/1.1\r\n";
+      datagram += "HOST: 239.255.255.250:1900\r\n";
+      datagram += "CACHE-CONTROL: max-age=" + QByteArray::number (m_maxAge) + "\r\n";
+      datagram += "LOCATION: " + location () + "\r\n";
+      datagram += "NT: " + nt + "\r\n";
+      datagram += QByteArray ("NTS: ") + nts + "\r\n";
+      datagram += "SERVER: " + serverHeader () + "\r\n";
+      datagram += "USN: " + usn (uuid, nt) + "\r\n\r\n";
+      m_socket->writeDatagram (datagram, CMulticastSocket::upnpMulticastAddr, CMulticastSocket::upnpMulticastPort);
+    }
+  }
+}
+
+void CMediaServer::sendAlive ()
+{
+  sendNotify ("ssdp:alive");
+}
+
+void CMediaServer::readDatagrams ()
+{
+  QByteArray const  uuid = m_uuid.toUtf8 ();
+  QList<QByteArray> nts  = notificationTypes ();
+  CSSDPParser       parser;
+  QByteArray        datagram;
+  QHostAddress      sender;
+  quint16           port = 0;
+  while (m_socket->hasPendingDatagrams ())
+  {
+    datagram.resize (static_cast<int>(m_socket->pendingDatagramSize ()));
+    qint64 cBytes = m_socket->readDatagram (datagram.data (), datagram.size (), &sender, &port);
+    if (cBytes <= 0)
+    {
+      continue;
+    }
+
+    char const * data = datagram.constData ();
+    int          size = static_cast<int>(cBytes);
+    for (int len = parser.parse (data, size); len != 0; len = parser.parse (data, size))
+    {
+      if (parser.type () == CSSDPParser::Search)
+      {
+        QByteArray        st = parser.value (CSSDPParser::St).copy ();
+        QList<QByteArray> targets;
+        if (st == "ssdp:all")
+        {
+          targets = nts;
+        }
+        else if (nts.contains (st))
+        {
+          targets.append (st);
+        }
+
+        for (QByteArray const & target : targets)
+        {
+          QByteArray response;
+          response.reserve (512);
+          response  = "HTTP/1.1 200 OK\r\n";
+          response += "CACHE-CONTROL: max-age=" + QByteArray::number (m_maxAge) + "\r\n";
+          response += "DATE: " + QLocale (QLocale::English, QLocale::UnitedStates)
+                      .toString (QDateTime::currentDateTimeUtc (), "ddd, dd MMM yyyy HH:mm:ss").toUtf8 () + " GMT\r\n";
+          response += "EXT:\r\n";
+          response += "LOCATION: " + location () + "\r\n";
+          response += "SERVER: " + serverHeader () + "\r\n";
+          response += "ST: " + target + "\r\n";
+          response += "USN: " + usn (uuid, target) + "\r\n\r\n";
+          m_socket->writeDatagram (response, sender, port);
+        }
+      }
+
+      data += len;
+      size -= len;
+    }
+  }
+}
+
+QByteArray CMediaServer::deviceDescription () const
+{
+  QString const description = "<?xml version=\"1.0\"?>\
+<root xmlns=\"urn:schemas-upnp-org:device-1-0\">\
+<specVersion><major>1</major><minor>0</minor></specVersion>\
+<device>\
+<deviceType>%1</deviceType>\
+<friendlyName>%2</friendlyName>\
+<manufacturer>QtUPnP</manufacturer>\
+<modelName>%6</modelName>\
+<UDN>%3</UDN>\
+<serviceList>\
+<service><serviceType>%4</serviceType><serviceId>urn:upnp-org:serviceId:ContentDirectory</serviceId>\
+<SCPDURL>/ContentDirectory.xml</SCPDURL><controlURL>/control/ContentDirectory</controlURL>\
+<eventSubURL>/event/ContentDirectory</eventSubURL></service>\
+<service><serviceType>%5</serviceType><serviceId>urn:upnp-org:serviceId:ConnectionManager</serviceId>\
+<SCPDURL>/ConnectionManager.xml</SCPDURL><controlURL>/control/ConnectionManager</controlURL>\
+<eventSubURL>/event/ConnectionManager</eventSubURL></service>\
+</serviceList>\
+</device>\
+</root>";
+
+  return description.arg (deviceType)
+                    .arg (m_friendlyName.toHtmlEscaped ())
+                    .arg (m_uuid)
+                    .arg (contentDirectoryType)
+                    .arg (connectionManagerType)
+                    .arg (m_modelName.toHtmlEscaped ()).toUtf8 ();
+}
+
+int CMediaServer::handleRequest (CHTTPParser const & request, QByteArray& contentType, QByteArray& body)
+{
+  int                status = 0;
+  QByteArray const & verb   = request.verb ();
+  QByteArray         query  = request.value (verb);
+  int                index  = query.indexOf (' ');
+  if (index != -1)
+  { // Remove HTTP/1.1 for the verbs other than GET and HEAD.
+    query.truncate (index);
+  }
+
+  if (verb == "GET")
+  {
+    status = 200;
+    if (query == "/description.xml")
+    {
+      body = deviceDescription ();
+    }
+    else if (query == "/ContentDirectory.xml")
+    {
+      body = contentDirectorySCPD;
+    }
+    else if (query == "/ConnectionManager.xml")
+    {
+      body = connectionManagerSCPD;
+    }
+    else
+    {
+      status = 404;
+    }
+  }
+  else if (verb == "POST" && query.startsWith ("/control/"))
+  {
+    status = handleControl (request, body);
+  }
+  else
+  { // Eventing is not supported.
+    status = 501;
+  }
+
+  if (!body.isEmpty ())
+  {
+    contentType = xmlContentType;
+  }
+
+  return status;
+}
+
+QByteArray CMediaServer::soapResponse (char const * service, QByteArray const & action,
+                                       QList<QPair<QByteArray, QByteArray>> const & args)
+{
+  QByteArray response;
+  response  = "<?xml version=\"1.0\" encoding=\"utf-8\"?>";
+  response += "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" ";
+  response += "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body>";
+  response += "<u:" + action + "Response xmlns:u=\"" + service + "\">";
+  for (QPair<QByteArray, QByteArray> const & arg : args)
+  {
+    response += '<' + arg.first + '>' + arg.second + "</" + arg.first + '>';
+  }
+
+  response += "</u:" + action + "Response></s:Body></s:Envelope>";
+  return response;
+}
+
+QByteArray CMediaServer::soapFault (int errorCode, char const * errorDescription)
+{
+  QByteArray fault;
+  fault  = "<?xml version=\"1.0\" encoding=\"utf-8\"?>";
+  fault += "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" ";
+  fault += "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body><s:Fault>";
+  fault += "<faultcode>s:Client</faultcode><faultstring>UPnPError</faultstring><detail>";
+  fault += "<UPnPError xmlns=\"urn:schemas-upnp-org:control-1-0\">";
+  fault += "<errorCode>" + QByteArray::number (errorCode) + "</errorCode>";
+  fault += QByteArray ("<errorDescription>") + errorDescription + "</errorDescription>";
+  fault += "</UPnPError></detail></s:Fault></s:Body></s:Envelope>";
+  return fault;
+}
+
+int CMediaServer::handleControl (CHTTPParser const & request, QByteArray& body)
+{
+  // SOAPACTION: "urn:schemas-upnp-org:service:ContentDirectory:1#Browse"
+  QByteArray soapAction = request.value ("SOAPACTION").trimmed ();
+  soapAction.replace ('"', QByteArray ());
+  int        index   = soapAction.indexOf ('#');
+  QByteArray service = soapAction.left (index);
+  QByteArray action  = index != -1 ? soapAction.mid (index + 1) : QByteArray ();
+
+  // Input arguments are the children of the action element.
+  QString const          actionName = QString::fromUtf8 (action);
+  QMap<QString, QString> args;
+  QXmlStreamReader       reader (request.body ());
+  while (!reader.atEnd ())
+  {
+    if (reader.readNext () == QXmlStreamReader::StartElement && reader.name () == actionName)
+    {
+      while (reader.readNextStartElement ())
+      {
+        QString name = reader.name ().toString ();
+        args.insert (name, reader.readElementText ());
+      }
+
+      break;
+    }
+  }
+
+  int                                  status = 200;
+  QList<QPair<QByteArray, QByteArray>> outArgs;
+  if (service == contentDirectoryType)
+  {
+    if (action == "Browse")
+    {
+      int        numberReturned, totalMatches;
+      bool       metadata = args.value ("BrowseFlag") == "BrowseMetadata";
+      QByteArray result   = browse (args.value ("ObjectID"), metadata, args.value ("StartingIndex").toInt (),
+                                    args.value ("RequestedCount").toInt (), numberReturned, totalMatches);
+      if (!result.isEmpty ())
+      {
+        outArgs << qMakePair (QByteArray ("Result"), result)
+                << qMakePair (QByteArray ("NumberReturned"), QByteArray::number (numberReturned))
+                << qMakePair (QByteArray ("TotalMatches"), QByteArray::number (totalMatches))
+                << qMakePair (QByteArray ("UpdateID"), QByteArray::number (m_systemUpdateID));
+      }
+      else
+      {
+        body   = soapFault (701, "No such object");
+        status = 500;
+      }
+    }
+    else if (action == "GetSearchCapabilities")
+    {
+      outArgs << qMakePair (QByteArray ("SearchCaps"), QByteArray ());
+    }
+    else if (action == "GetSortCapabilities")
+    {
+      outArgs << qMakePair (QByteArray ("SortCaps"), QByteArray ());
+    }
+    else if (action == "GetSystemUpdateID")
+    {
+      outArgs << qMakePair (QByteArray ("Id"), QByteArray::number (m_systemUpdateID));
+    }
+    else
+    {
+      status = 500;
+    }
+  }
+  else if (service == connectionManagerType)
+  {
+    if (action == "GetProtocolInfo")
+    {
+      outArgs << qMakePair (QByteArray ("Source"), QByteArray (protocolInfos))
+              << qMakePair (QByteArray ("Sink"), QByteArray ());
+    }
+    else if (action == "GetCurrentConnectionIDs")
+    {
+      outArgs << qMakePair (QByteArray ("ConnectionIDs"), QByteArray ("0"));
+    }
+    else
+    {
+      status = 500;
+    }
+  }
+  else
+  {
+    status = 500;
+  }
+
+  if (status == 200)
+  {
+    body = soapResponse (service == connectionManagerType ? connectionManagerType : contentDirectoryType, action, outArgs);
+  }
+  else if (body.isEmpty ())
+  {
+    body = soapFault (401, "Invalid Action");
+  }
+
+  return status;
+}
@@ -0,0 +1,210 @@
+#ifndef MEDIA_SERVER_HPP
+#define MEDIA_SERVER_HPP 1
+
+#include "using_upnp_namespace.hpp"
+#include "upnp_global.hpp"
+#include <QObject>
+#include <QVector>
+#include <QMap>
+#include <QDateTime>
+#include <QTimer>
+#include <QHostAddress>
+
+START_DEFINE_UPNP_NAMESPACE
+
+class CHTTPServer;
+class CHTTPParser;
+class CMulticastSocket;
+
+/*! \brief A lightweight UPnP MediaServer publishing the files of a folder.
+ *
+ * The server publishes a device urn:schemas-upnp-org:device:MediaServer:1 with the services
+ * ContentDirectory:1 and ConnectionManager:1.
+ *
+ * \li Discovery
+ * The server sends ssdp:alive NOTIFY messages at start and every m_maxAge / 2 seconds, and ssdp:byebye
+ * messages at stop. It answers M-SEARCH requests.
+ *
+ * \li ContentDirectory
+ * The objects are stored in an in-memory index. The identifier of an object is its index in the
+ * vector of objects. The root container has the identifier "0". The DIDL-Lite fragment of each object
+ * is built once, already xml encoded for the SOAP response. A Browse request concatenates the
+ * fragments of the requested page, so its cost depends only on the page size.
+ *
+ * \li Media
+ * The files are served by CHTTPServer with the query /media/ (Range, HEAD, sendfile).
+ *
+ * \code
+ * CMediaServer server;
+ * QString series = server.addContainer ("News");
+ * server.addItem (series, "News at 6", "News at 6.tts", QDateTime::currentDateTime ());
+ * server.start ("/home/user/recordings", 8080);
+ * \endcode
+ */
+class UPNP_API CMediaServer : public QObject
+{
+  Q_OBJECT
+
+public :
+  /*! \brief An object of the ContentDirectory (container or item). */
+  struct SObject
+  {
+    QString m_parentID; //!< The parent identifier.
+    QString m_title; //!< The title.
+    QString m_upnpClass; //!< The upnp:class.
+    QString m_fileName; //!< The file name relative to the media folder. Empty for a container.
+    QString m_uri; //!< The res url of an item served elsewhere. Empty for a file of the media folder.
+    QString m_description; //!< The description.
+    QDateTime m_date; //!< The date.
+    qint64 m_size = 0; //!< The file size.
+    QVector<int> m_children; //!< The children of a container.
+    mutable QByteArray m_didl; //!< The xml encoded DIDL-Lite fragment. Empty when it must be rebuilt.
+  };
+
+  /*! Default constructor. */
+  CMediaServer (QObject* parent = nullptr);
+
+  /*! Destructor. Sends ssdp:byebye. */
+  virtual ~CMediaServer ();
+
+  /*! Starts the http server and the discovery.
+   * \param folder: The media folder.
+   * \param port: The http port. 0 to use a free port.
+   * \return True in case of success.
+   */
+  bool start (QString const & folder, quint16 port = 0);
+
+  /*! Sends ssdp:byebye and stops the discovery and the http server. */
+  void stop ();
+
+  /*! Returns true if the server is started. */
+  bool isStarted () const { return m_httpServer != nullptr; }
+
+  /*! Sets the friendly name. Must be called before start. */
+  void setFriendlyName (QString const & name) { m_friendlyName = name; }
+
+  /*! Returns the friendly name. */
+  QString const & friendlyName () const { return m_friendlyName; }
+
+  /*! Sets the model name of the device description. Must be called before start. */
+  void setModelName (QString const & name) { m_modelName = name; }
+
+  /*! Returns the model name. */
+  QString const & modelName () const { return m_modelName; }
+
+  /*! Returns the device uuid (uuid:xxx). */
+  QString const & uuid () const { return m_uuid; }
+
+  /*! Returns the http server. It is null if the server is not started. */
+  CHTTPServer* httpServer () { return m_httpServer; }
+
+  /*! Removes all objects except the root container. */
+  void clear ();
+
+  /*! Adds a container (object.container.storageFolder).
+   * \param title: The title.
+   * \param parentID: The parent container.
+   * \return The identifier or an empty string if the parent is not a container.
+   */
+  QString addContainer (QString const & title, QString const & parentID = QString ("0"));
+
+  /*! Adds an item.
+   * \param parentID: The parent container.
+   * \param title: The title.
+   * \param fileName: The file name relative to the media folder.
+   * \param date: The date.
+   * \param description: The description.
+   * \param upnpClass: The upnp:class.
+   * \return The identifier or an empty string if the parent is not a container.
+   */
+  QString addItem (QString const & parentID, QString const & title, QString const & fileName,
+                   QDateTime const & date = QDateTime (), QString const & description = QString (),
+                   QString const & upnpClass = QString ("object.item.videoItem"));
+
+  /*! Sets the resource of an item not served from the media folder.
+   * \param id: The item identifier.
+   * \param uri: The res url.
+   * \param size: The size in bytes.
+   * \return False if the object is not an item.
+   */
+  bool setItemResource (QString const & id, QString const & uri, qint64 size);
+
+  /*! Returns the number of objects including the root container. */
+  int objectCount () const { return m_objects.size (); }
+
+  /*! Returns the xml encoded DIDL-Lite of a Browse request.
+   * \param objectID: The object identifier.
+   * \param metadata: True for BrowseMetadata, false for BrowseDirectChildren.
+   * \param startingIndex: The index of the first child.
+   * \param requestedCount: The maximum number of children. 0 for all.
+   * \param numberReturned: The number of objects returned.
+   * \param totalMatches: The number of children.
+   * \return The encoded DIDL-Lite. Empty if the object does not exist.
+   */
+  QByteArray browse (QString const & objectID, bool metadata, int startingIndex, int requestedCount,
+                     int& numberReturned, int& totalMatches) const;
+
+  /*! Returns the system update identifier. It is incremented at each modification. */
+  quint32 systemUpdateID () const { return m_systemUpdateID; }
+
+protected slots :
+  /*! Answers the M-SEARCH requests. */
+  void readDatagrams ();
+
+  /*! Sends the ssdp:alive messages. */
+  void sendAlive ();
+
+private :
+  /*! Answers the http requests not managed by CHTTPServer. */
+  int handleRequest (CHTTPParser const & request, QByteArray& contentType, QByteArray& body);
+
+  /*! Answers a SOAP request. */
+  int handleControl (CHTTPParser const & request, QByteArray& body);
+
+  /*! Returns the device description. */
+  QByteArray deviceDescription () const;
+
+  /*! Returns the location of the device description. */
+  QByteArray location () const;
+
+  /*! Returns the notification types of the device. */
+  QList<QByteArray> notificationTypes () const;
+
+  /*! Sends NOTIFY messages.
+   * \param nts: ssdp:alive or ssdp:byebye.
+   */
+  void sendNotify (char const * nts);
+
+  /*! Returns the identifier index or -1 if it does not exist. */
+  int objectIndex (QString const & id) const;
+
+  /*! Returns the DIDL-Lite fragment of an object. It is built if it is empty. */
+  QByteArray const & didl (int index) const;
+
+  /*! Returns a SOAP response.
+   * \param service: The service type.
+   * \param action: The action name.
+   * \param args: The output arguments (name and xml encoded value).
+   */
+  static QByteArray soapResponse (char const * service, QByteArray const & action,
+                                  QList<QPair<QByteArray, QByteArray>> const & args);
+
+  /*! Returns a SOAP fault. */
+  static QByteArray soapFault (int errorCode, char const * errorDescription);
+
+private :
+  CHTTPServer* m_httpServer = nullptr; //!< The http server.
+  CMulticastSocket* m_socket = nullptr; //!< The multicast socket.
+  QTimer m_aliveTimer; //!< Repeats the ssdp:alive messages.
+  QString m_friendlyName = "QtUPnP Media Server"; //!< The friendly name.
+  QString m_modelName = "QtUPnP Media Server"; //!< The model name.
+  QString m_uuid; //!< The device uuid.
+  QHostAddress m_hostAddress; //!< The local address for LOCATION.
+  QVector<SObject> m_objects; //!< The objects. The index is the identifier.
+  quint32 m_systemUpdateID = 0; //!< The system update identifier.
+  int m_maxAge = 1800; //!< The CACHE-CONTROL max-age in seconds.
+};
+
+} // Namespace
+
+#endif // MEDIA_SERVER_HPP
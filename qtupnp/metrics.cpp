@@ -0,0 +1,225 @@
+#include "metrics.hpp"
+#include <QFile>
+#include <QThread>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <algorithm>
+
+USING_UPNP_NAMESPACE
+
+CMetrics::CMetrics ()
+{
+  m_clock.start ();
+}
+
+CMetrics& CMetrics::instance ()
+{
+  static CMetrics metrics;
+  return metrics;
+}
+
+QVector<double> const & CMetrics::bucketBounds ()
+{
+  static QVector<double> const bounds { 1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000 };
+  return bounds;
+}
+
+QByteArray CMetrics::formatLabels (TLabels const & labels)
+{
+  QByteArray text;
+  for (QPair<QByteArray, QString> const & label : labels)
+  {
+    QByteArray value = label.second.toUtf8 ();
+    value.replace ('\\', "\\\\").replace ('"', "\\\"").replace ('\n', "\\n");
+    if (!text.isEmpty ())
+    {
+      text += ',';
+    }
+
+    text += label.first + "=\"" + value + '"';
+  }
+
+  return text;
+}
+
+CMetrics::SSeries& CMetrics::series (char const * name, EType type, TLabels const & labels)
+{
+  SFamily& family = m_families[name];
+  family.m_type   = type;
+  SSeries& series = family.m_series[formatLabels (labels)];
+  if (type == Histogram && series.m_buckets.isEmpty ())
+  {
+    series.m_buckets.fill (0, bucketBounds ().size () + 1);
+  }
+
+  return series;
+}
+
+void CMetrics::add (char const * name, TLabels const & labels, double value)
+{
+  if (isEnabled ())
+  {
+    QMutexLocker locker (&m_mutex);
+    series (name, Counter, labels).m_value += value;
+  }
+}
+
+void CMetrics::set (char const * name, TLabels const & labels, double value)
+{
+  if (isEnabled ())
+  {
+    QMutexLocker locker (&m_mutex);
+    series (name, Gauge, labels).m_value = value;
+  }
+}
+
+void CMetrics::observe (char const * name, TLabels const & labels, double ms)
+{
+  if (isEnabled ())
+  {
+    QVector<double> const & bounds = bucketBounds ();
+    int                     bucket = std::lower_bound (bounds.cbegin (), bounds.cend (), ms) - bounds.cbegin ();
+
+    QMutexLocker locker (&m_mutex);
+    SSeries&     values = series (name, Histogram, labels);
+    ++values.m_buckets[bucket];
+    ++values.m_count;
+    values.m_sum += ms;
+  }
+}
+
+void CMetrics::span (char const * name, char const * category, qint64 start, qint64 duration, TLabels const & args)
+{
+  if (isTracing ())
+  {
+    QMutexLocker locker (&m_mutex);
+    if (m_spans.size () < m_maxSpans)
+    {
+      SSpan span;
+      span.m_name     = name;
+      span.m_category = category;
+      span.m_start    = start;
+      span.m_duration = duration;
+      span.m_thread   = reinterpret_cast<quintptr>(QThread::currentThreadId ());
+      span.m_args     = args;
+      m_spans.append (span);
+    }
+    else
+    {
+      ++m_droppedSpans;
+    }
+  }
+}
+
+QByteArray CMetrics::prometheus () const
+{
+  static char const * types[] = { "counter", "gauge", "histogram" };
+
+  QVector<double> const & bounds = bucketBounds ();
+  QByteArray              text;
+  QMutexLocker            locker (&m_mutex);
+  for (QMap<QByteArray, SFamily>::const_iterator itf = m_families.cbegin (), endf = m_families.cend (); itf != endf; ++itf)
+  {
+    QByteArray const & name   = itf.key ();
+    SFamily const &    family = itf.value ();
+    text += "# TYPE " + name + ' ' + types[family.m_type] + '\n';
+    for (QMap<QByteArray, SSeries>::const_iterator its = family.m_series.cbegin (), ends = family.m_series.cend (); its != ends; ++its)
+    {
+      QByteArray const & labels = its.key ();
+      SSeries const &    values = its.value ();
+      if (family.m_type != Histogram)
+      {
+        text += name;
+        if (!labels.isEmpty ())
+        {
+          text += '{' + labels + '}';
+        }
+
+        text += ' ' + QByteArray::number (values.m_value, 'g', 15) + '\n';
+      }
+      else
+      { // The Prometheus buckets are cumulated.
+        QByteArray prefix     = labels.isEmpty () ? QByteArray () : labels + ',';
+        quint64    cumulative = 0;
+        for (int k = 0; k < values.m_buckets.size (); ++k)
+        {
+          cumulative   += values.m_buckets[k];
+          QByteArray le = k < bounds.size () ? QByteArray::number (bounds[k]) : QByteArray ("+Inf");
+          text += name + "_bucket{" + prefix + "le=\"" + le + "\"} " + QByteArray::number (cumulative) + '\n';
+        }
+
+        QByteArray suffix = labels.isEmpty () ? QByteArray () : '{' + labels + '}';
+        text += name + "_sum" + suffix + ' ' + QByteArray::number (values.m_sum, 'g', 15) + '\n';
+        text += name + "_count" + suffix + ' ' + QByteArray::number (values.m_count) + '\n';
+      }
+    }
+  }
+
+  return text;
+}
+
+QByteArray CMetrics::trace () const
+{
+  QJsonArray   events;
+  QMutexLocker locker (&m_mutex);
+  for (SSpan const & span : m_spans)
+  {
+    QJsonObject args;
+    for (QPair<QByteArray, QString> const & arg : span.m_args)
+    {
+      args.insert (QString::fromUtf8 (arg.first), arg.second);
+    }
+
+    QJsonObject event;
+    event.insert ("name", QString::fromUtf8 (span.m_name));
+    event.insert ("cat", QString::fromUtf8 (span.m_category));
+    event.insert ("ph", "X");
+    event.insert ("ts", static_cast<double>(span.m_start));
+    event.insert ("dur", static_cast<double>(span.m_duration));
+    event.insert ("pid", 1);
+    event.insert ("tid", static_cast<double>(span.m_thread % 1000000));
+    event.insert ("args", args);
+    events.append (event);
+  }
+
+  QJsonObject root;
+  root.insert ("traceEvents", events);
+  root.insert ("displayTimeUnit", "ms");
+  if (m_droppedSpans != 0)
+  {
+    root.insert ("droppedSpans", static_cast<double>(m_droppedSpans));
+  }
+
+  return QJsonDocument (root).toJson (QJsonDocument::Compact);
+}
+
+static bool writeFile (QString const & fileName, QByteArray const & data)
+{
+  QFile file (fileName);
+  bool  success = file.open (QIODevice::WriteOnly | QIODevice::Truncate);
+  if (success)
+  {
+    success = file.write (data) == data.size ();
+  }
+
+  return success;
+}
+
+bool CMetrics::writePrometheus (QString const & fileName) const
+{
+  return writeFile (fileName, prometheus ());
+}
+
+bool CMetrics::writeTrace (QString const & fileName) const
+{
+  return writeFile (fileName, trace ());
+}
+
+void CMetrics::clear ()
+{
+  QMutexLocker locker (&m_mutex);
+  m_families.clear ();
+  m_spans.clear ();
+  m_droppedSpans = 0;
+}
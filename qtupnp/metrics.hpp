@@ -0,0 +1,151 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP 1
+
+#include "using_upnp_namespace.hpp"
+#include "upnp_global.hpp"
+#include <QMap>
+#include <QVector>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+START_DEFINE_UPNP_NAMESPACE
+
+/*! \brief The CMetrics class collects counters, gauges, latency histograms and trace spans.
+ *
+ * The collection is disabled by default and each function returns immediately. When it is enabled,
+ * the values are stored by name and labels (e.g. device, service, action) and exported in the
+ * Prometheus text format, to a file or by the /metrics query of CHTTPServer.
+ *
+ * When the tracing is enabled, the spans are kept and exported in the Chrome trace format
+ * (chrome://tracing or https://ui.perfetto.dev). It is intended for single runs.
+ *
+ * The functions are thread safe.
+ * \code
+ * CMetrics& metrics = CMetrics::instance ();
+ * metrics.setEnabled (true);
+ * qint64 start = metrics.now ();
+ * ...
+ * metrics.observe ("upnp_action_duration_ms", labels, (metrics.now () - start) / 1000.0);
+ * metrics.span ("Browse", "action", start, metrics.now () - start, labels);
+ * metrics.writePrometheus ("metrics.prom");
+ * \endcode
+ */
+class UPNP_API CMetrics
+{
+public :
+  /*! The labels of a series (name and value). */
+  typedef QList<QPair<QByteArray, QString>> TLabels;
+
+  /*! The type of a metric. */
+  enum EType { Counter, Gauge, Histogram };
+
+  /*! Returns the unique object. */
+  static CMetrics& instance ();
+
+  /*! Enables or disables the collection of the metrics. */
+  void setEnabled (bool enabled) { m_enabled.store (enabled ? 1 : 0); }
+
+  /*! Returns true if the metrics are collected. */
+  bool isEnabled () const { return m_enabled.load () != 0; }
+
+  /*! Enables or disables the collection of the trace spans. */
+  void setTracing (bool tracing) { m_tracing.store (tracing ? 1 : 0); }
+
+  /*! Returns true if the trace spans are collected. */
+  bool isTracing () const { return m_tracing.load () != 0; }
+
+  /*! Returns the time in micro seconds since the creation of the object. */
+  qint64 now () const { return m_clock.nsecsElapsed () / 1000; }
+
+  /*! Adds a value to a counter.
+   * \param name: The metric name.
+   * \param labels: The labels of the series.
+   * \param value: The value to add.
+   */
+  void add (char const * name, TLabels const & labels, double value = 1.0);
+
+  /*! Sets the value of a gauge. */
+  void set (char const * name, TLabels const & labels, double value);
+
+  /*! Adds a duration in ms to a latency histogram. */
+  void observe (char const * name, TLabels const & labels, double ms);
+
+  /*! Adds a span to the trace.
+   * \param name: The span name.
+   * \param category: The category (e.g. action, discovery, download).
+   * \param start: The start time from now () in micro seconds.
+   * \param duration: The duration in micro seconds.
+   * \param args: The arguments shown with the span.
+   */
+  void span (char const * name, char const * category, qint64 start, qint64 duration, TLabels const & args = TLabels ());
+
+  /*! Returns the metrics in the Prometheus text format. */
+  QByteArray prometheus () const;
+
+  /*! Writes the metrics in the Prometheus text format. The file is replaced. */
+  bool writePrometheus (QString const & fileName) const;
+
+  /*! Returns the spans in the Chrome trace format. */
+  QByteArray trace () const;
+
+  /*! Writes the spans in the Chrome trace format. The file is replaced. */
+  bool writeTrace (QString const & fileName) const;
+
+  /*! Removes all metrics and spans. */
+  void clear ();
+
+  /*! Returns the upper bounds in ms of the histogram buckets. The last bucket is +Inf. */
+  static QVector<double> const & bucketBounds ();
+
+private :
+  /*! \brief The values of a series. */
+  struct SSeries
+  {
+    double m_value = 0.0; //!< The counter or gauge value.
+    QVector<quint64> m_buckets; //!< The histogram bucket counts, not cumulated.
+    quint64 m_count = 0; //!< The number of histogram observations.
+    double m_sum = 0.0; //!< The sum of histogram observations.
+  };
+
+  /*! \brief The series of a metric by formatted labels. */
+  struct SFamily
+  {
+    EType m_type = Counter; //!< The type.
+    QMap<QByteArray, SSeries> m_series; //!< The series.
+  };
+
+  /*! \brief A complete span. */
+  struct SSpan
+  {
+    QByteArray m_name; //!< The name.
+    QByteArray m_category; //!< The category.
+    qint64 m_start = 0; //!< Start in micro seconds.
+    qint64 m_duration = 0; //!< Duration in micro seconds.
+    quint64 m_thread = 0; //!< The thread.
+    TLabels m_args; //!< The arguments.
+  };
+
+  /*! Constructor. */
+  CMetrics ();
+
+  /*! Returns the series of a metric, created if it does not exist. The mutex must be locked. */
+  SSeries& series (char const * name, EType type, TLabels const & labels);
+
+  /*! Returns the labels formatted for Prometheus (name="value",...). */
+  static QByteArray formatLabels (TLabels const & labels);
+
+private :
+  QAtomicInt m_enabled; //!< The metrics are collected. Read by the discovery thread.
+  QAtomicInt m_tracing; //!< The spans are collected. Read by the discovery thread.
+  QElapsedTimer m_clock; //!< The time base.
+  mutable QMutex m_mutex; //!< Protects the metrics and the spans.
+  QMap<QByteArray, SFamily> m_families; //!< The metrics by name.
+  QVector<SSpan> m_spans; //!< The spans.
+  int m_maxSpans = 1000000; //!< The spans following are dropped.
+  quint64 m_droppedSpans = 0; //!< The number of spans dropped.
+};
+
+} // Namespace
+
+#endif // METRICS_HPP
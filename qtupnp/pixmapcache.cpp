@@ -1,7 +1,8 @@
-
 #include "pixmapcache.hpp"
-#include <QCryptographicHash>
 #include <QPainter>
+#include <QDir>
+#include <QFile>
+#include <QImageReader>
 
 USING_UPNP_NAMESPACE
 
@@ -9,98 +10,213 @@ CPixmapCache::CPixmapCache ()
 {
 }
 
-void CPixmapCache::setMaxEntries (int cEntries)
+CPixmapCache::~CPixmapCache ()
+{
+  clear ();
+}
+
+void CPixmapCache::setMaxBytes (qint64 cBytes)
 {
-  m_cMaxEntry = cEntries;
-  if (cEntries < m_cEntryToRemove * 4 / 5)
+  m_cMaxBytes = cBytes;
+  while (m_cMaxBytes != -1 && m_cBytes > m_cMaxBytes && m_last != nullptr)
   {
-    m_cEntryToRemove = m_cMaxEntry / 5; // 20%
+    remove (m_last);
   }
 }
 
-void CPixmapCache::setEntriesToRemove (int cEntries)
+void CPixmapCache::setDiskCache (QString const & directory)
 {
-  m_cEntryToRemove = cEntries;
-  if (m_cEntryToRemove > m_cMaxEntry / 2)
+  m_diskCache = directory;
+  if (!m_diskCache.isEmpty ())
   {
-    m_cEntryToRemove = m_cMaxEntry / 2;
+    QDir ().mkpath (m_diskCache);
   }
 }
 
 void CPixmapCache::clear ()
 {
-  m_changed = !m_pixmaps.isEmpty () || !m_md5s.isEmpty ();
-  if (m_changed)
+  m_changed = !m_entries.isEmpty ();
+  qDeleteAll (m_entries);
+  m_entries.clear ();
+  m_pixmaps.clear ();
+  m_first  = nullptr;
+  m_last   = nullptr;
+  m_cBytes = 0;
+}
+
+void CPixmapCache::pushFront (SEntry* entry)
+{
+  entry->m_prev = nullptr;
+  entry->m_next = m_first;
+  if (m_first != nullptr)
+  {
+    m_first->m_prev = entry;
+  }
+  else
+  {
+    m_last = entry;
+  }
+
+  m_first = entry;
+}
+
+void CPixmapCache::unlink (SEntry* entry)
+{
+  if (entry->m_prev != nullptr)
+  {
+    entry->m_prev->m_next = entry->m_next;
+  }
+  else
+  {
+    m_first = entry->m_next;
+  }
+
+  if (entry->m_next != nullptr)
+  {
+    entry->m_next->m_prev = entry->m_prev;
+  }
+  else
   {
-    m_pixmaps.clear ();
-    m_md5s.clear ();
-    m_dates.clear ();
+    m_last = entry->m_prev;
   }
 }
 
+void CPixmapCache::remove (SEntry* entry)
+{
+  unlink (entry);
+  QHash<quint64, SPixmap>::iterator it = m_pixmaps.find (entry->m_hash);
+  if (it != m_pixmaps.end () && --it.value ().m_cRefs == 0)
+  {
+    m_cBytes -= it.value ().m_cBytes;
+    m_pixmaps.erase (it);
+  }
+
+  m_entries.remove (entry->m_uri);
+  delete entry;
+}
+
+void CPixmapCache::insert (QString const & uri, quint64 hash, QPixmap const & pxm)
+{
+  SEntry* entry = m_entries.value (uri);
+  if (entry != nullptr)
+  { // The image of the uri has changed.
+    remove (entry);
+  }
+
+  SPixmap& pixmap = m_pixmaps[hash];
+  if (pixmap.m_cRefs == 0)
+  {
+    pixmap.m_pixmap = pxm;
+    pixmap.m_cBytes = static_cast<qint64>(pxm.width ()) * pxm.height () * pxm.depth () / 8;
+    m_cBytes       += pixmap.m_cBytes;
+  }
+
+  ++pixmap.m_cRefs;
+  entry         = new SEntry;
+  entry->m_uri  = uri;
+  entry->m_hash = hash;
+  m_entries.insert (uri, entry);
+  pushFront (entry);
+
+  // The new entry is kept even if it exceeds the budget alone.
+  while (m_cMaxBytes != -1 && m_cBytes > m_cMaxBytes && m_last != entry)
+  {
+    remove (m_last);
+  }
+}
+
+quint64 CPixmapCache::hash (char const * data, int size, quint64 hash)
+{
+  for (int i = 0; i < size; ++i)
+  {
+    hash ^= static_cast<quint8>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+QString CPixmapCache::diskFileName (QString const & uri) const
+{
+  QByteArray bytes = uri.toUtf8 ();
+  return m_diskCache + '/' + QString::number (hash (bytes.constData (), bytes.size ()), 16) + ".png";
+}
+
+// The text key of the hash in the PNG files.
+static char const * hashKey = "QtUPnPHash";
+
+quint64 CPixmapCache::storedHash (QImageReader& reader)
+{
+  bool    ok;
+  quint64 hash = reader.text (hashKey).toULongLong (&ok, 16);
+  return ok ? hash : 0;
+}
+
+void CPixmapCache::save (QString const & uri, quint64 hash, QPixmap const & pxm) const
+{
+  QString fileName = diskFileName (uri);
+  if (QFile::exists (fileName))
+  { // Only the header is read to get the text chunk.
+    QImageReader reader (fileName, "PNG");
+    if (storedHash (reader) == hash)
+    {
+      return;
+    }
+  }
+
+  QImage image = pxm.toImage ();
+  image.setText (hashKey, QString::number (hash, 16));
+  image.save (fileName, "PNG");
+}
+
+QPixmap CPixmapCache::scaled (QPixmap const & pxm, QSize const & iconSize)
+{
+  QPixmap scaledPxm = pxm.scaled (iconSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+  if (scaledPxm.width () != scaledPxm.height ())
+  { // Center the pixmap.
+    QPixmap resizedPxm (iconSize);
+    resizedPxm.fill (QColor (0, 0, 0, 0));
+    QPainter painter (&resizedPxm);
+    int x = (iconSize.width () - scaledPxm.width ()) / 2;
+    int y = (iconSize.height () - scaledPxm.height ()) / 2;
+    painter.drawPixmap (x, y, scaledPxm);
+    painter.end ();
+    scaledPxm = resizedPxm;
+  }
+
+  return scaledPxm;
+}
+
 QPixmap CPixmapCache::add (QString const & albumArtURI, QByteArray const & pxmBytes,
                            QSize const & iconSize)
 {
-  typedef QPair<qint64, QString> TDate;
-
   QPixmap pxm;
   if (!pxmBytes.isEmpty ())
-  {
-    QCryptographicHash md5Engine (QCryptographicHash::Md5);
-    md5Engine.addData (pxmBytes);
-    QString md5 = md5Engine.result ().toHex ();
-    if (m_md5s.contains (md5))
+  { // The same image scaled at another size is another pixmap.
+    int     size[]  = { iconSize.width (), iconSize.height () };
+    quint64 pxmHash = hash (pxmBytes.constData (), pxmBytes.size ());
+    pxmHash         = hash (reinterpret_cast<char const *>(size), sizeof (size), pxmHash);
+
+    QHash<quint64, SPixmap>::const_iterator it = m_pixmaps.constFind (pxmHash);
+    if (it != m_pixmaps.cend ())
     {
-      pxm                  = m_pixmaps.value (md5);
-      m_dates[albumArtURI] = QDateTime::currentMSecsSinceEpoch ();
+      pxm = it.value ().m_pixmap;
     }
     else
     {
-      if (m_cMaxEntry != -1 && m_md5s.size () >= m_cMaxEntry)
+      pxm.loadFromData (pxmBytes);
+      if (!pxm.isNull () && !iconSize.isNull ())
       {
-        QVector<TDate> dates;
-        dates.reserve (m_dates.size ());
-        for (QHash<QString, qint64>::const_iterator it = m_dates.begin (), end =  m_dates.end (); it != end; ++it)
-        {
-          QString const & uri  = it.key ();
-          qint64          date = it.value ();
-          dates.push_back (TDate (date, uri));
-        }
-
-        std::sort (dates.begin (), dates.end ());
-        int cEntriesToRemove = std::min (m_cEntryToRemove, dates.size ());
-        for (int iEntry = 0; iEntry < cEntriesToRemove; ++iEntry)
-        {
-          QString const & uri = dates[iEntry].second;
-          QString const & md5 = m_md5s.value (uri);
-          m_md5s.remove (uri);
-          m_dates.remove (uri);
-          m_pixmaps.remove (md5);
-        }
+        pxm = scaled (pxm, iconSize);
       }
+    }
 
-      m_md5s.insert (albumArtURI, md5);
-      m_dates.insert (albumArtURI, QDateTime::currentMSecsSinceEpoch ());
-      pxm.loadFromData (pxmBytes);
-      if (!pxm.isNull ())
+    if (!pxm.isNull ())
+    {
+      insert (albumArtURI, pxmHash, pxm);
+      if (!m_diskCache.isEmpty ())
       {
-        if (!iconSize.isNull ())
-        {
-          pxm = pxm.scaled (iconSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-          if (pxm.width () != pxm.height ())
-          { // Center the pixmap.
-            QPixmap resizedPxm (iconSize);
-            resizedPxm.fill (QColor (0, 0, 0, 0));
-            QPainter painter (&resizedPxm);
-            int x = (iconSize.width () - pxm.width ()) / 2;
-            int y = (iconSize.height () - pxm.height ()) / 2;
-            painter.drawPixmap (x, y, pxm);
-            painter.end ();
-            pxm = resizedPxm;
-          }
-        }
-
-        m_pixmaps.insert (md5, pxm);
+        save (albumArtURI, pxmHash, pxm);
       }
     }
 
@@ -112,16 +228,46 @@ QPixmap CPixmapCache::add (QString const & albumArtURI, QByteArray const & pxmBy
 
 QPixmap CPixmapCache::search (QString const & albumArtURI)
 {
-  QPixmap                                 pxm;
-  QHash<QString, QString>::const_iterator it = m_md5s.find (albumArtURI);
-  if (it != m_md5s.end ())
+  QPixmap pxm;
+  SEntry* entry = m_entries.value (albumArtURI);
+  if (entry != nullptr)
   {
-    QString key          = it.value ();
-    pxm                  = m_pixmaps.value (key);
-    m_dates[albumArtURI] = QDateTime::currentMSecsSinceEpoch ();
-    m_changed            = true;
+    pxm = m_pixmaps.value (entry->m_hash).m_pixmap;
+    if (entry != m_first)
+    {
+      unlink (entry);
+      pushFront (entry);
+    }
+  }
+  else if (!m_diskCache.isEmpty ())
+  { // The file holds the pixmap as added, with the hash of add for the deduplication.
+    QString fileName = diskFileName (albumArtURI);
+    if (QFile::exists (fileName))
+    {
+      QImageReader reader (fileName, "PNG");
+      quint64      pxmHash = storedHash (reader);
+      QHash<quint64, SPixmap>::const_iterator it = m_pixmaps.constFind (pxmHash);
+      if (pxmHash != 0 && it != m_pixmaps.cend ())
+      { // Already decoded for another URI.
+        pxm = it.value ().m_pixmap;
+      }
+      else
+      {
+        pxm = QPixmap::fromImage (reader.read ());
+      }
+
+      if (!pxm.isNull ())
+      {
+        if (pxmHash == 0)
+        { // A file without the hash is only shared by its URI.
+          QByteArray bytes = fileName.toUtf8 ();
+          pxmHash          = hash (bytes.constData (), bytes.size ());
+        }
+
+        insert (albumArtURI, pxmHash, pxm);
+      }
+    }
   }
 
   return pxm;
 }
-
@@ -5,7 +5,8 @@
 #include "upnp_global.hpp"
 #include <QHash>
 #include <QPixmap>
-#include <QDateTime>
+
+class QImageReader;
 
 START_DEFINE_UPNP_NAMESPACE
 
@@ -15,31 +16,31 @@ START_DEFINE_UPNP_NAMESPACE
  * For each track, to show the thumbnail, the control point asks the data of the thumbnail using
  * the albumArtURI CDidlElem. This take time. The pixmap cache store in memory the pixmap data, and
  * retreive it quickly from its URI.
- * A mechanism is set up to store only pixmaps that are different. For this, CPixmapCache use the md5
- * of the pixmap data.
+ * A mechanism is set up to store only pixmaps that are different. For this, CPixmapCache use a 64 bits
+ * hash of the image bytes and of the icon size.
  *
- * setMaxEntries and setEntriesToRemove must be called once after the creation of this object.
- * According to the values entered, the entries to remove must be ajusted.
+ * The URIs are kept in a least recently used list. When the decoded pixmaps exceed the byte budget
+ * (setMaxBytes), the least recently used URIs are removed, and their pixmaps when no other URI uses them.
+ * A search moves the URI at the front of the list.
  * By default, the cache as an unlimited size.
  *
  * An example with 10472 music tracks:
- * \li m_md5s size is 10472.
- * \li m_dates size is 10472.
- * \li m_pixmaps size is 471.
+ * \li 10472 URIs.
+ * \li 471 pixmaps.
  *
- * The functions pixmaps, md5s, dates and setPixmaps, setMd5s, setDates can be used to save on disk and load
- * from the disk the cache.
- * Simple iterator can be used to enumerate the elements of the hash table. For example:
+ * When a directory is set by setDiskCache, the decoded and scaled pixmaps are also saved as PNG files
+ * named from the URI. A file is only written when it is missing or holds another image. It keeps the
+ * hash of add in a text chunk, so a search that is not in memory loads the file, shares a pixmap
+ * already in memory, and the next runs don't fetch and scale the images again.
  * \code
  * CPixmapCache cache;
- * QHash<QString, QPixmap> const & pxms = cache.pixmaps ();
- * for (QHash<QString, QPixmap>::const_iterator it = pxms.begin (), end = pxms.end (); it != end; ++it)
+ * cache.setMaxBytes (64 * 1024 * 1024);
+ * cache.setDiskCache (QStandardPaths::writableLocation (QStandardPaths::CacheLocation) + "/thumbnails");
+ * QPixmap pxm = cache.search (uri);
+ * if (pxm.isNull ())
  * {
- *   QString const & md5   = it.key;
- *   QString const & bytes = it.value ();
- *   ******** Write md5 and bytes *************
+ *   pxm = cache.add (uri, bytes, QSize (64, 64));
  * }
- * ******* Make same thing for dates and md5s.
  * \endcode
  */
 class CPixmapCache
@@ -48,48 +49,39 @@ public :
   /*! Default constructor. */
   CPixmapCache ();
 
-  /*! Sets the maximum of entries in the cache. */
-  void setMaxEntries (int cEntries);
+  /*! Destructor. */
+  ~CPixmapCache ();
+
+  /*! Sets the maximum size in bytes of the decoded pixmaps. -1 is unlimited. */
+  void setMaxBytes (qint64 cBytes);
+
+  /*! Returns the maximum size in bytes of the decoded pixmaps. */
+  qint64 maxBytes () const { return m_cMaxBytes; }
+
+  /*! Returns the size in bytes of the decoded pixmaps. */
+  qint64 bytes () const { return m_cBytes; }
 
-  /*! Sets the number of entries to remove if the cache is full. */
-  void setEntriesToRemove (int cEntries);
+  /*! Returns the number of URIs. */
+  int entries () const { return m_entries.size (); }
 
-  /*! Returns the maximum of entries in the cache. */
-  int maxEntries () const { return m_cMaxEntry; }
+  /*! Returns the number of different pixmaps. */
+  int pixmaps () const { return m_pixmaps.size (); }
 
-  /*! Returns the number of entries to remove if the cache is full. */
-  int entriesToRemove () const { return m_cEntryToRemove; }
+  /*! Sets the directory of the pixmaps saved on disk. It is created if needed. An empty directory disables the disk cache. */
+  void setDiskCache (QString const & directory);
 
-  /*! Clear the cache. */
+  /*! Returns the directory of the pixmaps saved on disk. */
+  QString const & diskCache () const { return m_diskCache; }
+
+  /*! Clear the cache in memory. The files are kept. */
   void clear ();
 
   /*! Return true if the cache has changed. The cache changes:
    * \li clear function is called when the cache was not empty.
    * \li add function is called.
-   * \li search function is called.
-   *
-   * This flag can be used, for example, to avoid disk writing when the application close and not use the cache.
    */
   bool hasChanged () const { return m_changed; }
 
-  /*! Sets the pixmap hash table. */
-  void setPixmaps (QHash<QString, QPixmap> const & pixmaps) { m_pixmaps = pixmaps; }
-
-  /*! Sets the md5 hash table. */
-  void setMd5s (QHash<QString, QString> const & md5s) { m_md5s = md5s; }
-
-  /*! Sets the dates hash table. */
-  void setDates (QHash<QString, qint64> const & dates) { m_dates = dates; }
-
-  /*! Returns the pixmap hash table. */
-  QHash<QString, QPixmap> const & pixmaps () const { return m_pixmaps; }
-
-  /*! Returns the md5 hash table. */
-  QHash<QString, QString> const & md5s () const { return m_md5s; }
-
-  /*! Returns the dates hash table. */
-  QHash<QString, qint64> const & dates () const { return m_dates; }
-
   /*! Adds a album art URI in the cache.
    * \param albumArtURI: The URI defined by albumArtURI CDidlElem.
    * \param pxmBytes: The bytes that compose the image.
@@ -107,13 +99,62 @@ public :
    */
   QPixmap search (QString const & albumArtURI);
 
+private :
+  Q_DISABLE_COPY (CPixmapCache)
+
+  /*! \brief An URI in the least recently used list. */
+  struct SEntry
+  {
+    QString m_uri; //!< The URI.
+    quint64 m_hash = 0; //!< The hash of the pixmap.
+    SEntry* m_prev = nullptr; //!< The more recently used entry.
+    SEntry* m_next = nullptr; //!< The less recently used entry.
+  };
+
+  /*! \brief A pixmap shared by the URIs. */
+  struct SPixmap
+  {
+    QPixmap m_pixmap; //!< The pixmap.
+    qint64 m_cBytes = 0; //!< The decoded size.
+    int m_cRefs = 0; //!< The number of URIs.
+  };
+
+  /*! Inserts the entry at the front of the list. */
+  void pushFront (SEntry* entry);
+
+  /*! Removes the entry from the list. */
+  void unlink (SEntry* entry);
+
+  /*! Removes the entry and its pixmap if it is not used by other entries. */
+  void remove (SEntry* entry);
+
+  /*! Adds an URI with a pixmap, removes the least recently used entries if the budget is exceeded. */
+  void insert (QString const & uri, quint64 hash, QPixmap const & pxm);
+
+  /*! Returns the file name of an URI in the disk cache. */
+  QString diskFileName (QString const & uri) const;
+
+  /*! Saves the pixmap of an URI in the disk cache if the file is missing or holds another hash. */
+  void save (QString const & uri, quint64 hash, QPixmap const & pxm) const;
+
+  /*! Returns the hash stored in a file of the disk cache, 0 if there is none. */
+  static quint64 storedHash (QImageReader& reader);
+
+  /*! Returns the 64 bits FNV-1a hash of data, continued from hash. */
+  static quint64 hash (char const * data, int size, quint64 hash = 14695981039346656037ULL);
+
+  /*! Returns the pixmap scaled and centered in iconSize. */
+  static QPixmap scaled (QPixmap const & pxm, QSize const & iconSize);
+
 private :
   bool m_changed = false; //!< Indicate if the cache has changed
-  int m_cMaxEntry = -1; //!< The maximun of md5 stored in th cache.
-  int m_cEntryToRemove = 0; //!< The number of md5 remove to make room is the cache is full.
-  QHash<QString, QPixmap> m_pixmaps; //!< Hash table of uri and pixmap bytes.
-  QHash<QString, QString> m_md5s; //!< Hash table of uri and md5.
-  QHash<QString, qint64> m_dates; //!< Hash table of uri and date.
+  qint64 m_cMaxBytes = -1; //!< The maximum size of the decoded pixmaps.
+  qint64 m_cBytes = 0; //!< The size of the decoded pixmaps.
+  SEntry* m_first = nullptr; //!< The most recently used entry.
+  SEntry* m_last = nullptr; //!< The least recently used entry.
+  QHash<QString, SEntry*> m_entries; //!< Hash table of uri and entry.
+  QHash<quint64, SPixmap> m_pixmaps; //!< Hash table of hash and pixmap.
+  QString m_diskCache; //!< The directory of the pixmaps on disk.
 };
 
 } // Namespace
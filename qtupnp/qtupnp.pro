@@ -29,9 +29,11 @@ SOURCES += \
     devicemap.cpp \
     helper.cpp \
     initialdiscovery.cpp \
+    discoveryworker.cpp \
     multicastsocket.cpp \
     unicastsocket.cpp \
     upnpsocket.cpp \
+    ssdpparser.cpp \
     httpparser.cpp \
     waitingloop.cpp \
     didlitem.cpp \
@@ -64,8 +66,12 @@ SOURCES += \
     control.cpp \
     didlitem_playlist.cpp \
     httpserver.cpp \
+    mediaserver.cpp \
     dump.cpp \
-    aesencryption.cpp
+    aesencryption.cpp \
+    aesbackend.cpp \
+    metrics.cpp \
+    searchindex.cpp
 
 #    pixmapcache.cpp \
 #    plugin.cpp \
@@ -79,9 +85,11 @@ HEADERS +=\
     devicemap.hpp \
     helper.hpp \
     initialdiscovery.hpp \
+    discoveryworker.hpp \
     multicastsocket.hpp \
     unicastsocket.hpp \
     upnpsocket.hpp \
+    ssdpparser.hpp \
     using_upnp_namespace.hpp \
     httpparser.hpp \
     waitingloop.hpp \
@@ -115,9 +123,13 @@ HEADERS +=\
     actioninfo.hpp \
     xmlhaction.hpp \
     httpserver.hpp \
+    mediaserver.hpp \
     dump.hpp \
     aesencryption.h \
-    aes256.h
+    aesbackend.h \
+    aes256.h \
+    metrics.hpp \
+    searchindex.hpp
 
 #    pixmapcache.hpp \
 #    plugin.hpp \
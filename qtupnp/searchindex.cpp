@@ -0,0 +1,309 @@
+#include "searchindex.hpp"
+#include "helper.hpp"
+#include <algorithm>
+
+USING_UPNP_NAMESPACE
+
+static float const distanceMax = 100000.0f; // The distance of a match at the first position.
+
+CSearchIndex::CSearchIndex ()
+{
+}
+
+CSearchIndex::CSearchIndex (QList<CDidlItem> const & items)
+{
+  setItems (items);
+}
+
+void CSearchIndex::clear ()
+{
+  m_items.clear ();
+  m_titles.clear ();
+  m_words.clear ();
+  m_postings.clear ();
+  m_trigrams.clear ();
+}
+
+QString CSearchIndex::normalize (QString const & text)
+{
+  return removeDiacritics (text.toUpper ());
+}
+
+QStringList CSearchIndex::split (QString const & text)
+{
+  static QString const separators ("-,&°()':.\""); // The spaces are separators too.
+
+  QStringList words;
+  int         start = 0;
+  for (int i = 0, length = text.length (); i <= length; ++i)
+  {
+    if (i == length || text[i].isSpace () || separators.contains (text[i]))
+    {
+      if (i > start)
+      {
+        words.append (text.mid (start, i - start));
+      }
+
+      start = i + 1;
+    }
+  }
+
+  return words;
+}
+
+quint64 CSearchIndex::trigram (QString const & text, int index)
+{
+  return (static_cast<quint64>(text[index].unicode ()) << 32) |
+         (static_cast<quint64>(text[index + 1].unicode ()) << 16) | text[index + 2].unicode ();
+}
+
+void CSearchIndex::setItems (QList<CDidlItem> const & items)
+{
+  clear ();
+  m_items = items;
+
+  int                 cItems = m_items.size ();
+  QHash<QString, int> wordIds;
+  m_titles.resize (cItems);
+  for (int iItem = 0; iItem < cItems; ++iItem)
+  {
+    m_titles[iItem]   = normalize (m_items[iItem].title ());
+    QStringList words = split (m_titles[iItem]);
+    for (int k = 0, cWords = words.size (); k < cWords; ++k)
+    {
+      QString const &               word = words[k];
+      QHash<QString, int>::iterator it   = wordIds.find (word);
+      if (it == wordIds.end ())
+      {
+        int id = m_words.size ();
+        it     = wordIds.insert (word, id);
+        m_words.append (word);
+        m_postings.append (QVector<SPosting> ());
+
+        // A trigram appearing twice in the word is indexed once.
+        for (int i = 0, end = word.length () - 2; i < end; ++i)
+        {
+          QVector<int>& ids = m_trigrams[trigram (word, i)];
+          if (ids.isEmpty () || ids.last () != id)
+          {
+            ids.append (id);
+          }
+        }
+      }
+
+      m_postings[it.value ()].append (SPosting { iItem, k });
+    }
+  }
+}
+
+void CSearchIndex::findWords (QString const & text, QVector<int>& words) const
+{
+  if (text.length () < 3)
+  { // Too short for the trigrams. The distinct words are fewer than the titles.
+    for (int id = 0, cWords = m_words.size (); id < cWords; ++id)
+    {
+      if (m_words[id].contains (text))
+      {
+        words.append (id);
+      }
+    }
+  }
+  else
+  { // The words having text have all its trigrams. Check those having the rarest.
+    QVector<int> const * rarest = nullptr;
+    for (int i = 0, end = text.length () - 2; i < end; ++i)
+    {
+      QHash<quint64, QVector<int>>::const_iterator it = m_trigrams.constFind (trigram (text, i));
+      if (it == m_trigrams.cend ())
+      {
+        return;
+      }
+
+      if (rarest == nullptr || it.value ().size () < rarest->size ())
+      {
+        rarest = &it.value ();
+      }
+    }
+
+    for (int id : *rarest)
+    {
+      if (m_words[id].contains (text))
+      {
+        words.append (id);
+      }
+    }
+  }
+}
+
+QVector<int> CSearchIndex::searchIndexes (QString const & text, int returned, int commonPrefixLength) const
+{
+  QVector<int> results;
+  int          cItems = m_items.size ();
+  if (text.isEmpty () || cItems == 0)
+  {
+    return results;
+  }
+
+  // Pass 1. Search exact matches. For each item title, the distance is defined by the position
+  // in the title words and the index of the title words, see CBrowseReply::search.
+  QString const      normalized = normalize (text);
+  QStringList const  texts      = split (normalized);
+  QVector<float>     distances (cItems, 0.0f);
+  QVector<int>       matches;
+  QVector<int>       words;
+  for (QString const & part : texts)
+  {
+    words.clear ();
+    findWords (part, words);
+    for (int id : words)
+    {
+      float index = static_cast<float>(m_words[id].indexOf (part) + 1);
+      for (SPosting const & posting : m_postings[id])
+      {
+        float distance = distanceMax - index * static_cast<float>(posting.m_word + 1);
+        if (distances[posting.m_item] == 0.0f)
+        {
+          matches.append (posting.m_item);
+        }
+
+        distances[posting.m_item] = std::max (distances[posting.m_item], distance);
+      }
+    }
+  }
+
+  return select (distances, matches, normalized, m_titles, returned, commonPrefixLength);
+}
+
+QVector<int> CSearchIndex::scanIndexes (QList<CDidlItem> const & items, QString const & text, int returned,
+                                        int commonPrefixLength)
+{
+  QVector<int> results;
+  int          cItems = items.size ();
+  if (text.isEmpty () || cItems == 0)
+  {
+    return results;
+  }
+
+  // Pass 1 of searchIndexes, the title words are compared one by one.
+  QString const     normalized = normalize (text);
+  QStringList const texts      = split (normalized);
+  QVector<float>    distances (cItems, 0.0f);
+  QVector<int>      matches;
+  QVector<QString>  titles (cItems);
+  for (int iItem = 0; iItem < cItems; ++iItem)
+  {
+    titles[iItem]     = normalize (items[iItem].title ());
+    QStringList words = split (titles[iItem]);
+    for (int k = 0, cWords = words.size (); k < cWords; ++k)
+    {
+      for (QString const & part : texts)
+      {
+        int index = words[k].indexOf (part);
+        if (index != -1)
+        {
+          float distance   = distanceMax - static_cast<float>((index + 1) * (k + 1));
+          distances[iItem] = std::max (distances[iItem], distance);
+        }
+      }
+    }
+
+    if (distances[iItem] != 0.0f)
+    {
+      matches.append (iItem);
+    }
+  }
+
+  return select (distances, matches, normalized, titles, returned, commonPrefixLength);
+}
+
+QVector<int> CSearchIndex::select (QVector<float> const & distances, QVector<int> const & matches,
+                                   QString const & normalized, QVector<QString> const & titles,
+                                   int returned, int commonPrefixLength)
+{
+  typedef QPair<float, int> TDistance;
+
+  int cItems = distances.size ();
+  if (returned <= 0 || returned > cItems)
+  {
+    returned = cItems;
+  }
+
+  // The returned best distances are kept in a heap with the worst at the front.
+  // At equal distances, the first items are kept.
+  auto better = [] (TDistance const & d1, TDistance const & d2) -> bool
+  {
+    return d1.first > d2.first || (d1.first == d2.first && d1.second < d2.second);
+  };
+
+  QVector<TDistance> heap;
+  heap.reserve (returned);
+  auto push = [&heap, &better, returned] (TDistance const & distance)
+  {
+    if (heap.size () < returned)
+    {
+      heap.append (distance);
+      std::push_heap (heap.begin (), heap.end (), better);
+    }
+    else if (better (distance, heap.front ()))
+    {
+      std::pop_heap (heap.begin (), heap.end (), better);
+      heap.last () = distance;
+      std::push_heap (heap.begin (), heap.end (), better);
+    }
+  };
+
+  for (int iItem : matches)
+  {
+    push (TDistance (distances[iItem], iItem));
+  }
+
+  // Pass 2. Compute the Jaro-Winkler distance of the other items. This is a scan of all the titles,
+  // the trigrams only give exact matches and an approximate title may share none of them.
+  if (matches.size () < returned)
+  {
+    for (int iItem = 0; iItem < cItems; ++iItem)
+    {
+      if (distances[iItem] == 0.0f)
+      {
+        push (TDistance (jaroWinklerDistance (normalized, titles[iItem], commonPrefixLength), iItem));
+      }
+    }
+  }
+
+  std::sort_heap (heap.begin (), heap.end (), better);
+  QVector<int> results;
+  results.reserve (heap.size ());
+  for (TDistance const & distance : heap)
+  {
+    results.append (distance.second);
+  }
+
+  return results;
+}
+
+QList<CDidlItem> CSearchIndex::search (QString const & text, int returned, int commonPrefixLength) const
+{
+  QVector<int>     indexes = searchIndexes (text, returned, commonPrefixLength);
+  QList<CDidlItem> results;
+  results.reserve (indexes.size ());
+  for (int index : indexes)
+  {
+    results.append (m_items[index]);
+  }
+
+  return results;
+}
+
+QList<CDidlItem> CSearchIndex::scan (QList<CDidlItem> const & items, QString const & text, int returned,
+                                     int commonPrefixLength)
+{
+  QVector<int>     indexes = scanIndexes (items, text, returned, commonPrefixLength);
+  QList<CDidlItem> results;
+  results.reserve (indexes.size ());
+  for (int index : indexes)
+  {
+    results.append (items[index]);
+  }
+
+  return results;
+}
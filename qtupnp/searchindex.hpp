@@ -0,0 +1,111 @@
+#ifndef SEARCH_INDEX_HPP
+#define SEARCH_INDEX_HPP
+
+#include "using_upnp_namespace.hpp"
+#include "upnp_global.hpp"
+#include "didlitem.hpp"
+#include <QHash>
+#include <QVector>
+
+START_DEFINE_UPNP_NAMESPACE
+
+/*! \brief The CSearchIndex class searches CDidlItem titles like CBrowseReply::search with a prebuilt index.
+ *
+ * The titles are uppercased, without diacritics and split in words once, when the items are set.
+ * The distinct words are indexed by trigrams. A query word is searched in the words sharing its
+ * rarest trigram, or in all distinct words when it is shorter than 3 characters, instead of every title.
+ * The best results are selected with a bounded heap.
+ *
+ * The results are the results of CBrowseReply::search. The exact matches come first, then
+ * the other items ordered by the Jaro-Winkler distance when there are not enough exact matches.
+ * The Jaro-Winkler pass is not indexed: when there are fewer exact matches than returned, the distance
+ * of the query to every title without a match is computed, O(items x title length). It is kept over
+ * all the items to return the results of CBrowseReply::search; use a small returned value to avoid it.
+ *
+ * Building the index costs more than one search. For a single search, scan compares the title words
+ * directly, with the same results.
+ *
+ * \code
+ * CSearchIndex index (reply.items ());
+ * QList<CDidlItem> items = index.search ("jingle", 10);
+ * \endcode
+ */
+class UPNP_API CSearchIndex
+{
+public :
+  /*! Default constructor. */
+  CSearchIndex ();
+
+  /*! Constructs the index of items. */
+  CSearchIndex (QList<CDidlItem> const & items);
+
+  /*! Replaces the items and builds the index. */
+  void setItems (QList<CDidlItem> const & items);
+
+  /*! Returns the indexed items. */
+  QList<CDidlItem> const & items () const { return m_items; }
+
+  /*! Returns the number of indexed items. */
+  int size () const { return m_items.size (); }
+
+  /*! Removes the items and the index. */
+  void clear ();
+
+  /*! Returns the CDidlItem list that match exactly or approximately text.
+   * \param text: Text to search.
+   * \param returned: Max number of CDidlItem return. If returned <= 0 or > items size, returned will be items size.
+   * \param commonPrefixLength; Winkler common prefix see jaroWinklerDistance in helper.hpp.
+   * \return The list of sorted CDidlItem.
+   * \remark With fewer exact matches than returned, all the other titles are compared with Jaro-Winkler.
+   */
+  QList<CDidlItem> search (QString const & text, int returned = -1, int commonPrefixLength = -1) const;
+
+  /*! Same as search but returns the indexes of the items. */
+  QVector<int> searchIndexes (QString const & text, int returned = -1, int commonPrefixLength = -1) const;
+
+  /*! Same as search without index, for a single search in items. */
+  static QList<CDidlItem> scan (QList<CDidlItem> const & items, QString const & text, int returned = -1,
+                                int commonPrefixLength = -1);
+
+  /*! Same as scan but returns the indexes of the items. */
+  static QVector<int> scanIndexes (QList<CDidlItem> const & items, QString const & text, int returned = -1,
+                                   int commonPrefixLength = -1);
+
+  /*! Returns the text uppercased without diacritics. */
+  static QString normalize (QString const & text);
+
+  /*! Returns the words of a normalized text. */
+  static QStringList split (QString const & text);
+
+private :
+  /*! \brief The position of a word in a title. */
+  struct SPosting
+  {
+    int m_item; //!< The item index.
+    int m_word; //!< The word position in the title.
+  };
+
+  /*! Adds the word ids having text to words. */
+  void findWords (QString const & text, QVector<int>& words) const;
+
+  /*! Returns the key of the trigram at position index. */
+  static quint64 trigram (QString const & text, int index);
+
+  /*! Returns the indexes of the best items from the exact match distances, completed by the
+   * Jaro-Winkler distance of the titles if there are not enough matches.
+   */
+  static QVector<int> select (QVector<float> const & distances, QVector<int> const & matches,
+                              QString const & normalized, QVector<QString> const & titles,
+                              int returned, int commonPrefixLength);
+
+private :
+  QList<CDidlItem> m_items; //!< The items.
+  QVector<QString> m_titles; //!< The normalized titles.
+  QVector<QString> m_words; //!< The distinct words.
+  QVector<QVector<SPosting>> m_postings; //!< The positions of each distinct word.
+  QHash<quint64, QVector<int>> m_trigrams; //!< The distinct words by trigram.
+};
+
+} // Namespace
+
+#endif // SEARCH_INDEX_HPP
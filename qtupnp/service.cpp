@@ -20,6 +20,7 @@ struct SServiceData : public QSharedData
   unsigned short m_minorVersion = 0;
   unsigned short m_majorVersion = 1;
   bool m_evented = false;
+  bool m_componentsLoaded = false;
 };
 
 SServiceData::SServiceData (SServiceData const & other) :  QSharedData (other),
@@ -28,7 +29,7 @@ SServiceData::SServiceData (SServiceData const & other) :  QSharedData (other),
    m_stateVariables (other.m_stateVariables), m_actions (other.m_actions),
    m_instanceIDs (other.m_instanceIDs),
    m_minorVersion (other.m_minorVersion), m_majorVersion (other.m_majorVersion),
-   m_evented (other.m_evented)
+   m_evented (other.m_evented), m_componentsLoaded (other.m_componentsLoaded)
 {
 }
 
@@ -113,6 +114,11 @@ void CService::setEvented (bool evented)
   m_d->m_evented = evented;
 }
 
+void CService::setComponentsLoaded (bool loaded)
+{
+  m_d->m_componentsLoaded = loaded;
+}
+
 QString const & CService::serviceType () const
 {
   return m_d->m_serviceType;
@@ -191,6 +197,11 @@ bool CService::isEvented () const
   return m_d->m_evented;
 }
 
+bool CService::componentsLoaded () const
+{
+  return m_d->m_componentsLoaded;
+}
+
 void CService::clearSID ()
 {
   m_d->m_subscribeSID.clear ();
@@ -77,6 +77,9 @@ public:
   /*! Sets the evented. A service is evented if at least one state variable is evented. */
   void setEvented (bool evented);
 
+  /*! Sets the components loaded. The components are loaded when the SCPD has been parsed. */
+  void setComponentsLoaded (bool loaded);
+
   /*! Returns the service type. */
   QString const & serviceType () const;
 
@@ -119,6 +122,11 @@ public:
   /*! Returns the evented. A service is evented if at least one state variable is evented. */
   bool isEvented () const;
 
+  /*! Returns true if the actions and state variables have been extracted from the SCPD.
+   * With lazy service loading, the components are extracted only at the first use of the service.
+   */
+  bool componentsLoaded () const;
+
   /*! Clear the SID. */
   void clearSID ();
 
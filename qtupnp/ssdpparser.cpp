@@ -0,0 +1,162 @@
+#include "ssdpparser.hpp"
+#include <algorithm>
+
+USING_UPNP_NAMESPACE
+
+char const * CSSDPParser::m_headerNames[] = { "LOCATION", "USN", "NT", "NTS", "ST", "BOOTID.UPNP.ORG", "CACHE-CONTROL" };
+
+/*! Returns true if c is a space or a tab. */
+static inline bool isBlank (char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+int CSSDPParser::parse (char const * data, int size)
+{
+  m_type    = Unknown;
+  m_message = SView ();
+  for (SView& value : m_values)
+  {
+    value = SView ();
+  }
+
+  char const   separator[] = "\r\n\r\n";
+  char const * end         = data + size;
+  char const * eom         = std::search (data, end, separator, separator + 4);
+  if (eom == end)
+  {
+    return 0;
+  }
+
+  int length = static_cast<int>(eom - data) + 4;
+
+  // Some routers (Netgear) start sometimes the message by '\0' and ' '. Skip it.
+  char const * line = data;
+  while (line < eom && (*line == '\0' || *line == ' ' || *line == '\r' || *line == '\n'))
+  {
+    ++line;
+  }
+
+  m_message.m_data = line;
+  m_message.m_size = static_cast<int>(eom - line);
+
+  // Request or status line.
+  char const * eol = std::search (line, eom, separator, separator + 2);
+  int          len = static_cast<int>(eol - line);
+  if (len >= 7 && qstrncmp (line, "NOTIFY ", 7) == 0)
+  {
+    m_type = Notify;
+  }
+  else if (len >= 5 && qstrncmp (line, "HTTP/", 5) == 0)
+  {
+    m_type = Response;
+  }
+  else if (len >= 9 && qstrncmp (line, "M-SEARCH ", 9) == 0)
+  {
+    m_type = Search;
+  }
+
+  // Header lines.
+  while (eol < eom)
+  {
+    line               = eol + 2;
+    eol                = std::search (line, eom, separator, separator + 2);
+    char const * colon = std::find (line, eol, ':');
+    if (colon != eol)
+    {
+      char const * name    = line;
+      char const * nameEnd = colon;
+      while (name < nameEnd && isBlank (*name))
+      {
+        ++name;
+      }
+
+      while (nameEnd > name && isBlank (nameEnd[-1]))
+      {
+        --nameEnd;
+      }
+
+      char const * value    = colon + 1;
+      char const * valueEnd = eol;
+      while (value < valueEnd && isBlank (*value))
+      {
+        ++value;
+      }
+
+      while (valueEnd > value && isBlank (valueEnd[-1]))
+      {
+        --valueEnd;
+      }
+
+      uint nameLen = static_cast<uint>(nameEnd - name);
+      for (int k = 0; k < LastHeader; ++k)
+      {
+        if (qstrlen (m_headerNames[k]) == nameLen && qstrnicmp (name, m_headerNames[k], nameLen) == 0)
+        {
+          m_values[k].m_data = value;
+          m_values[k].m_size = static_cast<int>(valueEnd - value);
+          break;
+        }
+      }
+    }
+  }
+
+  return length;
+}
+
+CSSDPParser::SView CSSDPParser::uuid () const
+{
+  SView        uuid        = m_values[Usn];
+  char const   separator[] = "::";
+  char const * end         = uuid.m_data + uuid.m_size;
+  char const * pos         = std::search (uuid.m_data, end, separator, separator + 2);
+  uuid.m_size              = static_cast<int>(pos - uuid.m_data);
+  return uuid;
+}
+
+bool CSSDPParser::isByebye () const
+{
+  return containsNoCase (m_values[Nts], "ssdp:byebye");
+}
+
+int CSSDPParser::maxAge () const
+{
+  int           age   = -1;
+  SView const & value = m_values[CacheControl];
+  char const *  key   = "max-age";
+  uint          len   = qstrlen (key);
+  for (int k = 0, end = value.m_size - static_cast<int>(len); k <= end; ++k)
+  {
+    if (qstrnicmp (value.m_data + k, key, len) == 0)
+    {
+      int i = k + static_cast<int>(len);
+      while (i < value.m_size && (isBlank (value.m_data[i]) || value.m_data[i] == '='))
+      {
+        ++i;
+      }
+
+      age = 0;
+      while (i < value.m_size && value.m_data[i] >= '0' && value.m_data[i] <= '9')
+      {
+        age = age * 10 + (value.m_data[i] - '0');
+        ++i;
+      }
+
+      break;
+    }
+  }
+
+  return age;
+}
+
+bool CSSDPParser::containsNoCase (SView const & view, char const * str)
+{
+  bool found = false;
+  uint len   = qstrlen (str);
+  for (int k = 0, end = view.m_size - static_cast<int>(len); k <= end && !found; ++k)
+  {
+    found = qstrnicmp (view.m_data + k, str, len) == 0;
+  }
+
+  return found;
+}
@@ -0,0 +1,107 @@
+#ifndef SSDP_PARSER_HPP
+#define SSDP_PARSER_HPP
+
+#include "using_upnp_namespace.hpp"
+#include "upnp_global.hpp"
+#include <QByteArray>
+
+START_DEFINE_UPNP_NAMESPACE
+
+/*! \brief A dedicated SSDP parser used by the discovery.
+ *
+ * The parser works in place on the receive buffer. It does not copy the message and does not allocate.
+ * It extracts only the headers used by the discovery (LOCATION, USN, NT, NTS, ST, BOOTID.UPNP.ORG and
+ * CACHE-CONTROL). The values are views on the buffer and are valid only while the buffer is not modified.
+ *
+ * \code
+ * CSSDPParser parser;
+ * char const * data = buffer.constData ();
+ * int          size = buffer.size ();
+ * for (int len = parser.parse (data, size); len != 0; len = parser.parse (data, size))
+ * {
+ *   ... use parser.type (), parser.uuid ()...
+ *   data += len;
+ *   size -= len;
+ * }
+ * \endcode
+ */
+class UPNP_API CSSDPParser
+{
+public :
+  /*! The message type. */
+  enum EType { Unknown, //!< Unknown message.
+               Notify, //!< NOTIFY * HTTP/1.1
+               Search, //!< M-SEARCH * HTTP/1.1
+               Response, //!< HTTP/1.1 200 OK
+             };
+
+  /*! The headers extracted. */
+  enum EHeader { Location, //!< LOCATION
+                 Usn, //!< USN
+                 Nt, //!< NT
+                 Nts, //!< NTS
+                 St, //!< ST
+                 BootID, //!< BOOTID.UPNP.ORG
+                 CacheControl, //!< CACHE-CONTROL
+                 LastHeader, //!< Use just for set size.
+               };
+
+  /*! \brief A view on a part of the receive buffer. */
+  struct SView
+  {
+    /*! Returns true if the view is empty. */
+    bool isEmpty () const { return m_size == 0; }
+
+    /*! Returns the view as a QByteArray sharing the buffer. */
+    QByteArray toByteArray () const { return QByteArray::fromRawData (m_data, m_size); }
+
+    /*! Returns the view as a QByteArray with a deep copy. */
+    QByteArray copy () const { return QByteArray (m_data, m_size); }
+
+    char const * m_data = nullptr; //!< Start of the view.
+    int m_size = 0; //!< Size of the view.
+  };
+
+  /*! Default constructor. */
+  CSSDPParser () {}
+
+  /*! Parses the first message of the buffer.
+   * \param data: Start of the buffer.
+   * \param size: Size of the buffer.
+   * \return The number of bytes of the message including "\r\n\r\n" or 0 if no message is complete.
+   */
+  int parse (char const * data, int size);
+
+  /*! Returns the message type. */
+  EType type () const { return m_type; }
+
+  /*! Returns the view of a header. The view is empty if the header does not exist. */
+  SView const & value (EHeader header) const { return m_values[header]; }
+
+  /*! Returns the uuid. It is the USN part before "::". */
+  SView uuid () const;
+
+  /*! Returns true if the NTS header is ssdp:byebye. */
+  bool isByebye () const;
+
+  /*! Returns the max-age of CACHE-CONTROL in seconds or -1 if it does not exist. */
+  int maxAge () const;
+
+  /*! Returns the message start. */
+  SView const & message () const { return m_message; }
+
+private :
+  /*! Returns true if the view contains the string without regard to case. */
+  static bool containsNoCase (SView const & view, char const * str);
+
+private :
+  EType m_type = Unknown; //!< The message type.
+  SView m_message; //!< The message.
+  SView m_values[LastHeader]; //!< The values of the headers.
+
+  static char const * m_headerNames[LastHeader]; //!< The names of the headers.
+};
+
+} // Namespace
+
+#endif // SSDP_PARSER_HPP
@@ -1,6 +1,6 @@
 
 #include "upnpsocket.hpp"
-#include "httpparser.hpp"
+#include "ssdpparser.hpp"
 #include "waitingloop.hpp"
 #include "helper.hpp"
 #include <QNetworkInterface>
@@ -14,6 +14,9 @@ QHostAddress CUpnpSocket::m_localHostAddress;
 QHostAddress CUpnpSocket::m_localHostAddress6;
 QList<QByteArray> CUpnpSocket::m_skippedAddresses;
 QList<QByteArray> CUpnpSocket::m_skippedUUIDs;
+QVector<QByteArrayMatcher> CUpnpSocket::m_skippedUUIDMatchers;
+QSet<QByteArray> CUpnpSocket::m_skippedHosts;
+QReadWriteLock CUpnpSocket::m_skippedLock;
 
 CUpnpSocket::SNDevice::SNDevice (EType type) : m_type (type)
 {
@@ -43,6 +46,8 @@ CUpnpSocket::SNDevice& CUpnpSocket::SNDevice::operator = (SNDevice const & other
 
 CUpnpSocket::CUpnpSocket (QObject* parent) : QUdpSocket (parent)
 {
+  m_datagram.reserve (ReceiveBufferSize);
+  m_clock.start ();
 }
 
 CUpnpSocket::~CUpnpSocket ()
@@ -119,15 +124,19 @@ QHostAddress CUpnpSocket::localHostAddress (bool ipv6)
 
 QByteArray const & CUpnpSocket::readDatagrams ()
 {
-  QByteArray datagram;
   while (hasPendingDatagrams ())
   {
     qint64 size = pendingDatagramSize ();
-    if (size != 0)
+    if (size > 0)
     {
-      datagram.resize (size);
-      readDatagram (datagram.data (), size, &m_senderAddr, &m_senderPort);
-      m_datagram += datagram;
+      int offset = m_datagram.size ();
+      m_datagram.resize (offset + static_cast<int>(size));
+      qint64 read = readDatagram (m_datagram.data () + offset, size, &m_senderAddr, &m_senderPort);
+      m_datagram.resize (offset + static_cast<int>(qMax<qint64> (read, 0)));
+    }
+    else
+    {
+      readDatagram (nullptr, 0); // Discard the empty datagram.
     }
   }
 
@@ -136,101 +145,62 @@ QByteArray const & CUpnpSocket::readDatagrams ()
 
 void CUpnpSocket::decodeDatagram ()
 {
-  char const*  separator = "\r\n\r\n";
-  int          start     = 0;
-  int          pos       = m_datagram.indexOf (separator, start);
-  while (pos != -1)
+  CSSDPParser  parser;
+  char const * data = m_datagram.constData ();
+  int          size = m_datagram.size ();
+  for (int len = parser.parse (data, size); len != 0; len = parser.parse (data, size))
   {
-    pos                += 4;
-    QByteArray datagram = m_datagram.mid (start, pos - start);
-    SNDevice   device   = createDevice (datagram);
-    addDevice (device);
-    start = pos;
-    pos   = m_datagram.indexOf (separator, start);
+    if (!isRepeatedNotify (parser))
+    {
+      addDevice (createDevice (parser));
+    }
+
+    data += len;
+    size -= len;
   }
 
-  m_datagram.clear ();
+  m_datagram.resize (0); // Keep the capacity.
 }
 
-CUpnpSocket::SNDevice CUpnpSocket::createDevice (QByteArray datagram)
+CUpnpSocket::SNDevice CUpnpSocket::createDevice (CSSDPParser const & parser)
 {
-  CHTTPParser parser (datagram);
-  parser.parseMessage ();
-
   SNDevice::EType type = SNDevice::Unknown;
-  if (parser.verb ().startsWith ("NOTIFY"))
-  {
-    type = SNDevice::Notify;
-  }
-  else if (datagram.startsWith ("HTTP"))
-  {
-    type = SNDevice::Response;
-  }
-  else
-  {
-    if (!datagram.startsWith ("M-SEARCH "))
-    {
-      qDebug () << "CUpnpSocket::createDevice (Unkown datagram):\n" << datagram;
-    }
-
-    return SNDevice (type);
-  }
-
-  bool       nt = false;
-  QByteArray url, uuid;
-  QByteArray value = parser.value ("LOCATION");
-  if (!value.isEmpty ())
+  switch (parser.type ())
   {
-    url = value;
-  }
+    case CSSDPParser::Notify :
+      type = parser.isByebye () ? SNDevice::Byebye : SNDevice::Notify;
+      break;
 
-  value = parser.value ("USN");
-  if (!value.isEmpty ())
-  {
-    int index = value.indexOf ("::");
-    uuid      = index != -1 ? value.left (index) : value;
-  }
+    case CSSDPParser::Response :
+      type = SNDevice::Response;
+      break;
 
-  value = parser.value ("NT");
-  if (!value.isEmpty ())
-  {
-    nt = true;
-  }
+    case CSSDPParser::Search :
+      return SNDevice (type);
 
-  value = parser.value ("NTS");
-  if (!value.isEmpty ())
-  {
-    if (value.toLower ().indexOf ("ssdp:byebye") != -1)
-    {
-      type = SNDevice::Byebye;
-    }
+    default :
+      qDebug () << "CUpnpSocket::createDevice (Unkown datagram):\n" << parser.message ().toByteArray ();
+      return SNDevice (type);
   }
 
-  QUrl qUrl;
+  QByteArray url  = parser.value (CSSDPParser::Location).toByteArray ();
+  QByteArray uuid = parser.uuid ().toByteArray ();
+  QUrl       qUrl;
   if (type != SNDevice::Byebye)
   {
-    qUrl.setUrl (url);
-    if (!qUrl.isValid ())
+    qUrl.setUrl (QString::fromLatin1 (url));
+    if (!qUrl.isValid () || url.isEmpty ())
     {
       type = SNDevice::Unknown;
     }
-    else if (type == SNDevice::Notify && !nt)
+    else if (type == SNDevice::Notify && parser.value (CSSDPParser::Nt).isEmpty ())
     {
       type = SNDevice::Unknown;
     }
 
-    if (type != SNDevice::Unknown)
+    if (type != SNDevice::Unknown && isSkippedUUID (uuid, url))
     {
-      QString uuidTemp = uuid.toLower ();
-      QString urlTemp  = url.toLower ();
-      for (QList<QByteArray>::const_iterator it = m_skippedUUIDs.cbegin (), end = m_skippedUUIDs.cend (); it != end; ++it)
-      {
-        if (uuidTemp.contains (*it) || urlTemp.contains (*it))
-        {
-          type = SNDevice::Unknown;
-          break;
-        }
-      }
+      type = SNDevice::Unknown;
     }
   }
 
@@ -238,24 +208,87 @@ CUpnpSocket::SNDevice CUpnpSocket::createDevice (QByteArray datagram)
   {
     type = SNDevice::Unknown;
   }
-  else
+  else if (isSkippedAddress (url))
+  {
+    type = SNDevice::Unknown;
+  }
+
+  return SNDevice (type, qUrl, QString::fromLatin1 (uuid));
+}
+
+bool CUpnpSocket::isRepeatedNotify (CSSDPParser const & parser)
+{
+  bool repeated = false;
+  if (parser.type () == CSSDPParser::Notify)
   {
-    for (QList<QByteArray>::const_iterator it = m_skippedAddresses.cbegin (), end = m_skippedAddresses.cend (); it != end; ++it)
+    CSSDPParser::SView const & usnView = parser.value (CSSDPParser::Usn);
+    if (!usnView.isEmpty ())
     {
-      if (url.contains (*it))
+      QByteArray usn = usnView.toByteArray (); // Shares the receive buffer for the lookup.
+      if (parser.isByebye ())
       {
-        type = SNDevice::Unknown;
-        break;
+        m_notifies.remove (usn);
+      }
+      else
+      {
+        qint64                               now    = m_clock.elapsed ();
+        QByteArray                           bootID = parser.value (CSSDPParser::BootID).toByteArray ();
+        QHash<QByteArray, SNotify>::iterator it     = m_notifies.find (usn);
+        if (it != m_notifies.end ())
+        {
+          SNotify const & notify = it.value ();
+          repeated               = notify.m_expires > now && notify.m_bootID == bootID;
+        }
+
+        if (!repeated)
+        {
+          if (m_notifies.size () >= NotifyCacheSize)
+          { // Purge the expired entries.
+            for (QHash<QByteArray, SNotify>::iterator itn = m_notifies.begin (); itn != m_notifies.end ();)
+            {
+              if (itn.value ().m_expires <= now)
+              {
+                itn = m_notifies.erase (itn);
+              }
+              else
+              {
+                ++itn;
+              }
+            }
+          }
+
+          int     maxAge = parser.maxAge ();
+          SNotify notify;
+          notify.m_uuid    = parser.uuid ().copy ();
+          notify.m_bootID  = parser.value (CSSDPParser::BootID).copy ();
+          notify.m_expires = now + 1000LL * (maxAge >= 0 ? maxAge : DefaultMaxAge);
+          m_notifies.insert (parser.value (CSSDPParser::Usn).copy (), notify); // Deep copy, the buffer is reused.
+        }
       }
     }
   }
 
-  return SNDevice (type, qUrl, uuid);
+  return repeated;
+}
+
+void CUpnpSocket::forgetNotifies (QStringList const & uuids)
+{
+  for (QHash<QByteArray, SNotify>::iterator it = m_notifies.begin (); it != m_notifies.end ();)
+  {
+    if (uuids.contains (QString::fromLatin1 (it.value ().m_uuid)))
+    {
+      it = m_notifies.erase (it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
 }
 
 void CUpnpSocket::addDevice (SNDevice const & device)
 {
-  if (device.m_type != SNDevice::Unknown)
+  if (device.m_type != SNDevice::Unknown && !m_devices.contains (device))
   {
     m_devices.push_back (device);
   }
@@ -293,6 +326,46 @@ bool CUpnpSocket::discover (QHostAddress hostAddress, quint16 port, quint16 mx,
   return success;
 }
 
+bool CUpnpSocket::isSkippedUUID (QByteArray const & uuid, QByteArray const & url)
+{
+  bool        skipped = false;
+  QReadLocker locker (&m_skippedLock);
+  if (!m_skippedUUIDMatchers.isEmpty ())
+  {
+    QByteArray uuidTemp = uuid.toLower ();
+    QByteArray urlTemp  = url.toLower ();
+    for (QByteArrayMatcher const & matcher : m_skippedUUIDMatchers)
+    {
+      if (matcher.indexIn (uuidTemp) != -1 || matcher.indexIn (urlTemp) != -1)
+      {
+        skipped = true;
+        break;
+      }
+    }
+  }
+
+  return skipped;
+}
+
+bool CUpnpSocket::isSkippedAddress (QByteArray const & url)
+{
+  QReadLocker locker (&m_skippedLock);
+  return !m_skippedHosts.isEmpty () && m_skippedHosts.contains (host (url));
+}
+
+QByteArray CUpnpSocket::host (QByteArray const & url)
+{
+  int begin = url.indexOf ("//");
+  begin     = begin == -1 ? 0 : begin + 2;
+  int end   = begin;
+  while (end < url.size () && url[end] != ':' && url[end] != '/')
+  {
+    ++end;
+  }
+
+  return url.mid (begin, end - begin);
+}
+
 void CUpnpSocket::setSkippedAddresses (QList<QByteArray> const & addresses)
 {
   for (QByteArray const & address : addresses)
@@ -303,11 +376,50 @@ void CUpnpSocket::setSkippedAddresses (QList<QByteArray> const & addresses)
       addr.append (':');
     }
 
-    m_skippedAddresses << addr;
+    addSkippedAddresses (addr);
   }
 }
 
+QList<QByteArray> CUpnpSocket::skippedAddresses ()
+{
+  QReadLocker locker (&m_skippedLock);
+  return m_skippedAddresses;
+}
+
+void CUpnpSocket::addSkippedAddresses (QByteArray const & addr)
+{
+  QWriteLocker locker (&m_skippedLock);
+  m_skippedAddresses.append (addr);
+  m_skippedHosts.insert (host (addr));
+}
+
+void CUpnpSocket::clearSkippedAddresses ()
+{
+  QWriteLocker locker (&m_skippedLock);
+  m_skippedAddresses.clear ();
+  m_skippedHosts.clear ();
+}
+
+QList<QByteArray> CUpnpSocket::skippedUUIDs ()
+{
+  QReadLocker locker (&m_skippedLock);
+  return m_skippedUUIDs;
+}
+
 void CUpnpSocket::addSkippedUUID (QByteArray const & uuid)
 {
-  m_skippedUUIDs.append (uuid.toLower ());
+  QByteArray   lower = uuid.toLower ();
+  QWriteLocker locker (&m_skippedLock);
+  if (!m_skippedUUIDs.contains (lower))
+  {
+    m_skippedUUIDs.append (lower);
+    m_skippedUUIDMatchers.append (QByteArrayMatcher (lower));
+  }
+}
+
+void CUpnpSocket::clearSkippedUUID ()
+{
+  QWriteLocker locker (&m_skippedLock);
+  m_skippedUUIDs.clear ();
+  m_skippedUUIDMatchers.clear ();
 }
@@ -5,9 +5,18 @@
 #include "upnp_global.hpp"
 #include <QUdpSocket>
 #include <QUrl>
+#include <QByteArrayMatcher>
+#include <QVector>
+#include <QSet>
+#include <QHash>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QReadWriteLock>
 
 START_DEFINE_UPNP_NAMESPACE
 
+class CSSDPParser;
+
 /*! \brief The base class of CUnicastSocket and CMulticastSocket. */
 class UPNP_API CUpnpSocket : public QUdpSocket
 {
@@ -63,10 +72,15 @@ public :
   /*! Returns the current datagram. */
   QByteArray const & datagram () const { return m_datagram; }
 
-  /*! Returns the datagram. */
+  /*! Reads the pending datagrams directly at the end of the receive buffer.
+   * The receive buffer is reused. Its capacity is kept between the calls.
+   */
   QByteArray const & readDatagrams ();
 
-  /*! Decodes the datagram. */
+  /*! Decodes the datagram.
+   * The messages are parsed in place by CSSDPParser. NOTIFY ssdp:alive messages already received
+   * with the same USN and BOOTID.UPNP.ORG are ignored until the CACHE-CONTROL max-age expires.
+   */
   void decodeDatagram ();
 
   /*! Launchs the M-SEARCH udp datagram. */
@@ -78,6 +92,12 @@ public :
   /*! Returns the device list. */
   QList<SNDevice> const & devices () const { return m_devices; }
 
+  /*! Removes the NOTIFY messages of the devices from the repeated NOTIFY cache.
+   * The next ssdp:alive of these devices are decoded again.
+   * \param uuids: The device uuids.
+   */
+  void forgetNotifies (QStringList const & uuids);
+
   /*! Sets the user name.
    * \param name: The user name.
    */
@@ -100,16 +120,16 @@ public :
   static void setSkippedAddresses (QList<QByteArray> const & addresses);
 
   /*! Returns IPV4 addresses to ignore (see above). */
-  static QList<QByteArray> const & skippedAddresses () { return m_skippedAddresses; }
+  static QList<QByteArray> skippedAddresses ();
 
   /*! Adds IPV4 addresses to ignore (see above). */
-  static void addSkippedAddresses (QByteArray const & addr) { m_skippedAddresses.append (addr); }
+  static void addSkippedAddresses (QByteArray const & addr);
 
   /*! Clear the list of IP Addresses to ignored. */
-  static void clearSkippedAddresses () { m_skippedAddresses.clear (); }
+  static void clearSkippedAddresses ();
 
   /*! Returns the list of uuid to ignored. */
-  static QList<QByteArray> const & skippedUUIDs () { return m_skippedUUIDs; }
+  static QList<QByteArray> skippedUUIDs ();
 
   /*! Adds a device uuid to ignored.
    * \param uuid: uuid can be partial. E.g for a gateway device with an uuid=,
@@ -119,7 +139,7 @@ public :
   static void addSkippedUUID (QByteArray const & uuid);
 
   /*! Clear the list of device uuids to ignored. */
-  static void clearSkippedUUID () { m_skippedUUIDs.clear (); }
+  static void clearSkippedUUID ();
 
   /*! Returns the local host address.
    * This function returns the local host address of the first interface and different of 127.0.0.1.
@@ -133,23 +153,56 @@ private :
   /*! See CUpnpSocket::readDatagrams comment. */
   enum EWait { StartingWait = 30 };
 
+  /*! Receive buffer and notify cache sizes. */
+  enum ESizes { ReceiveBufferSize = 65536, //!< Initial capacity of the receive buffer.
+                DefaultMaxAge     = 1800, //!< Max-age in seconds if CACHE-CONTROL is missing.
+                NotifyCacheSize   = 1024, //!< Number of notify entries before purging expired entries.
+              };
+
+  /*! \brief The last NOTIFY ssdp:alive received for an USN. */
+  struct SNotify
+  {
+    QByteArray m_uuid; //!< The device uuid.
+    QByteArray m_bootID; //!< The BOOTID.UPNP.ORG value.
+    qint64 m_expires; //!< Expiration time in ms from m_clock.
+  };
+
   /*! Adds a device in the device list. */
   void addDevice (SNDevice const & device);
 
-  /*! Creates a device from a datagram. */
-  SNDevice createDevice (QByteArray datagram);
+  /*! Creates a device from a parsed message. */
+  SNDevice createDevice (CSSDPParser const & parser);
+
+  /*! Returns true if the NOTIFY message is an ssdp:alive already received and not expired.
+   * ssdp:byebye messages remove the USN of the cache.
+   */
+  bool isRepeatedNotify (CSSDPParser const & parser);
+
+  /*! Returns true if the uuid or the url contains a skipped uuid. */
+  static bool isSkippedUUID (QByteArray const & uuid, QByteArray const & url);
+
+  /*! Returns true if the host of the url is a skipped address. */
+  static bool isSkippedAddress (QByteArray const & url);
+
+  /*! Returns the host part of an address or an url. e.g. "http://192.168.0.10:80/desc.xml" returns "192.168.0.10". */
+  static QByteArray host (QByteArray const & url);
 
 private :
   static QHostAddress m_localHostAddress; //!< The local host address.
   static QHostAddress m_localHostAddress6; //!< The local host address.
   static QList<QByteArray> m_skippedUUIDs; //!< uuid to ignored.
   static QList<QByteArray> m_skippedAddresses; //!< IPV4 addresses to ignore.
+  static QVector<QByteArrayMatcher> m_skippedUUIDMatchers; //!< Precompiled matchers of m_skippedUUIDs.
+  static QSet<QByteArray> m_skippedHosts; //!< Hosts of m_skippedAddresses.
+  static QReadWriteLock m_skippedLock; //!< The skip lists are read by the discovery thread.
 
 private :
   QHostAddress m_senderAddr; //!< Host address of the device.
   quint16  m_senderPort; //!< The port used by the device.
   QByteArray m_datagram; //!< The current datagram.
   QList<SNDevice> m_devices; //!< The list of devices.
+  QHash<QByteArray, SNotify> m_notifies; //!< Last NOTIFY ssdp:alive by USN.
+  QElapsedTimer m_clock; //!< Clock for notify expirations.
   QString m_name; //!< Socket user name.
 };
 